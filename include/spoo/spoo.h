@@ -39,6 +39,9 @@ extern "C" {
  * Global definitions
  *************************************************************************/
 
+/* We need size_t for object and buffer sizes */
+#include <stddef.h>
+
 /* We need a NULL pointer from time to time */
 #ifndef NULL
  #ifdef __cplusplus
@@ -72,6 +75,62 @@ extern "C" {
 /* The official (but not only) invalid thread ID */
 #define SPOO_INVALID_THREAD       (-1)
 
+/* The invalid thread-local storage key */
+#define SPOO_INVALID_TLS_KEY      (-1)
+
+/* Maximum number of simultaneously existing thread-local storage keys */
+#define SPOO_MAX_TLS_KEYS         64
+
+/* spooCreateFileIO flags */
+#define SPOO_FILE_IO_THREADS      0x0001
+
+/* I/O readiness events */
+#define SPOO_IO_READ              0x0001
+#define SPOO_IO_WRITE             0x0002
+#define SPOO_IO_ERROR             0x0004
+
+/* Channel operation results */
+#define SPOO_CHANNEL_OK           0
+#define SPOO_CHANNEL_CLOSED       1
+#define SPOO_CHANNEL_TIMEOUT      2
+
+/* spooSelect case operations */
+#define SPOO_SELECT_SEND          1
+#define SPOO_SELECT_RECV          2
+
+/* Pipeline stage modes */
+#define SPOO_STAGE_PARALLEL       0
+#define SPOO_STAGE_SERIAL_IN_ORDER 1
+#define SPOO_STAGE_SERIAL_OUT_OF_ORDER 2
+
+/* spooParallelScan flags */
+#define SPOO_SCAN_INCLUSIVE       0x0000
+#define SPOO_SCAN_EXCLUSIVE       0x0001
+
+/* Number of hazard pointers each thread has per hazard domain */
+#define SPOO_HAZARD_SLOTS         4
+
+/* Sizes of the by-value mutex and condition variable storage */
+#define SPOO_MUTEX_STORAGE_SIZE   64
+#define SPOO_COND_STORAGE_SIZE    64
+
+/* Static initializers for by-value mutexes and condition variables */
+#define SPOO_MUTEX_STORAGE_INITIALIZER { 0 }
+#define SPOO_COND_STORAGE_INITIALIZER  { 0 }
+
+/* spooSetThreadStackCache flags */
+#define SPOO_STACK_PREFAULT       1
+#define SPOO_STACK_HUGE_PAGES     2
+
+/* spooCreateMutexKind kinds */
+#define SPOO_MUTEX_DEFAULT        0
+#define SPOO_MUTEX_TICKET         1
+#define SPOO_MUTEX_MCS            2
+
+/* spooCreateCounter kinds */
+#define SPOO_COUNTER_SUM          0
+#define SPOO_COUNTER_MAX          1
+
 
 /*************************************************************************
  * Typedefs
@@ -86,8 +145,172 @@ typedef void* SPOOmutex;
 /* Condition variable object */
 typedef void* SPOOcond;
 
+/* Thread-local storage key */
+typedef int SPOOtlskey;
+
+/* Fiber object */
+typedef void* SPOOfiber;
+
+/* Fiber-aware mutex object */
+typedef void* SPOOfibermutex;
+
+/* Fiber-aware condition variable object */
+typedef void* SPOOfibercond;
+
+/* Worker pool object */
+typedef void* SPOOpool;
+
+/* Channel object */
+typedef void* SPOOchannel;
+
+/* Concurrent hash map object */
+typedef void* SPOOhashmap;
+
+/* Hazard pointer domain object */
+typedef void* SPOOhazarddomain;
+
+/* Flat combining object */
+typedef void* SPOOcombiner;
+
+/* Sharded counter object */
+typedef void* SPOOcounter;
+
+/* Striped lock table object */
+typedef void* SPOOlocktable;
+
+/* Histogram object */
+typedef void* SPOOhistogram;
+
+/* Actor object */
+typedef void* SPOOactor;
+
+/* Pipeline object */
+typedef void* SPOOpipeline;
+
+/* Task graph object */
+typedef void* SPOOgraph;
+
+/* Task graph node */
+typedef void* SPOOgraphnode;
+
+/* I/O reactor object */
+typedef void* SPOOreactor;
+
+/* I/O reactor file descriptor watch */
+typedef void* SPOOwatch;
+
+/* Asynchronous file I/O service object */
+typedef void* SPOOfileio;
+
+/* Asynchronous file I/O request */
+typedef struct SPOOfilerequest SPOOfilerequest;
+
+/* Mutex contention statistics */
+typedef struct
+{
+  SPOOmutex     mutex;
+  const char*   name;
+  unsigned long acquisitions;
+  unsigned long contentions;
+  double        totalWaitTime;
+  double        maxWaitTime;
+  double        totalHoldTime;
+  double        maxHoldTime;
+} SPOOmutexstats;
+
+/* By-value mutex, to embed in other objects
+ * Zero-initialized storage is valid and is initialized on first use.  It
+ * must not be moved or copied once in use. */
+typedef struct
+{
+  volatile long    state;
+  union
+  {
+    void*          pointer;
+    long long      integer;
+    double         real;
+    char           data[SPOO_MUTEX_STORAGE_SIZE];
+  } storage;
+} SPOOmutexstorage;
+
+/* By-value condition variable, to embed in other objects
+ * Zero-initialized storage is valid and is initialized on first use.  It
+ * must not be moved or copied once in use. */
+typedef struct
+{
+  volatile long    state;
+  union
+  {
+    void*          pointer;
+    long long      integer;
+    double         real;
+    char           data[SPOO_COND_STORAGE_SIZE];
+  } storage;
+} SPOOcondstorage;
+
 /* Function pointer types */
 typedef void (*SPOOthreadfun)(void*);
+typedef void (*SPOOtlsfun)(void*);
+typedef void (*SPOOiofun)(int fd, int events, void* arg);
+typedef void (*SPOOfilefun)(SPOOfilerequest* request);
+typedef void (*SPOOreducefun)(void* partial, size_t first, size_t count, void* arg);
+typedef void (*SPOOcombinefun)(void* result, const void* value, void* arg);
+typedef void* (*SPOOstagefun)(void* item, void* arg);
+typedef size_t (*SPOOhashfun)(const void* key, void* arg);
+typedef int (*SPOOequalfun)(const void* a, const void* b, void* arg);
+typedef void (*SPOOreclaimfun)(void* pointer, void* arg);
+typedef void (*SPOOapplyfun)(void* request, void* arg);
+typedef int (*SPOOcomparefun)(const void* a, const void* b);
+typedef unsigned long long (*SPOOsortkeyfun)(const void* element, void* arg);
+
+/* Actor message, owned by the actor from sending until it is processed */
+typedef struct SPOOmessage
+{
+  struct SPOOmessage* volatile next;
+} SPOOmessage;
+
+typedef void (*SPOOactorfun)(SPOOactor actor, SPOOmessage* message, void* arg);
+
+/* One send or receive of a spooSelect call */
+typedef struct SPOOselectcase
+{
+  SPOOchannel      channel;
+  int              operation;
+  /* The element to send or the buffer to receive into */
+  void*            value;
+  /* Set to SPOO_CHANNEL_OK or SPOO_CHANNEL_CLOSED if this case fired */
+  int              result;
+} SPOOselectcase;
+
+/* Worker pool task, owned by the caller until its function is called */
+typedef struct SPOOtask
+{
+  struct SPOOtask* next;
+  SPOOthreadfun    fun;
+  void*            arg;
+} SPOOtask;
+
+/* Asynchronous file I/O request, owned by the caller until its callback is
+ * called */
+struct SPOOfilerequest
+{
+  /* Set by the caller */
+  int              fd;
+  void*            buffer;
+  size_t           size;
+  long long        offset;
+  SPOOfilefun      fun;
+  void*            arg;
+
+  /* The byte count or negative errno value, set before the callback.  As
+   * with pread and pwrite, the count may be less than the size */
+  long             result;
+
+  /* Used by Spoo */
+  SPOOtask         task;
+  SPOOfileio       service;
+  int              operation;
+};
 
 
 /*************************************************************************
@@ -101,14 +324,20 @@ void spooTerminate(void);
 /* Time */
 double spooGetTime(void);
 void spooSetTime(double time);
+unsigned long long spooGetTimerValue(void);
+unsigned long long spooGetTimerFrequency(void);
 void spooSleep(double time);
 
 /* Threading support */
 SPOOthread spooCreateThread(SPOOthreadfun fun, void* arg);
 void spooDestroyThread(SPOOthread ID);
+int  spooRequestCancel(SPOOthread ID);
+int  spooIsCancelRequested(void);
 int  spooWaitThread(SPOOthread ID, int waitmode);
 SPOOthread spooGetThreadID(void);
+int  spooSetThreadStackCache(size_t stackSize, int maxStacks, int flags);
 SPOOmutex spooCreateMutex(void);
+SPOOmutex spooCreateMutexKind(int kind);
 void spooDestroyMutex(SPOOmutex mutex);
 void spooLockMutex(SPOOmutex mutex);
 void spooUnlockMutex(SPOOmutex mutex);
@@ -117,8 +346,157 @@ void spooDestroyCond(SPOOcond cond);
 void spooWaitCond(SPOOcond cond, SPOOmutex mutex, double timeout);
 void spooSignalCond(SPOOcond cond);
 void spooBroadcastCond(SPOOcond cond);
+void spooInitMutexStorage(SPOOmutexstorage* mutex);
+void spooDeinitMutexStorage(SPOOmutexstorage* mutex);
+void spooLockMutexStorage(SPOOmutexstorage* mutex);
+void spooUnlockMutexStorage(SPOOmutexstorage* mutex);
+void spooInitCondStorage(SPOOcondstorage* cond);
+void spooDeinitCondStorage(SPOOcondstorage* cond);
+void spooWaitCondStorage(SPOOcondstorage* cond, SPOOmutexstorage* mutex, double timeout);
+void spooSignalCondStorage(SPOOcondstorage* cond);
+void spooBroadcastCondStorage(SPOOcondstorage* cond);
 int  spooGetCPUCoreCount(void);
 
+/* Mutex profiling (only available if built with SPOO_MUTEX_PROFILING) */
+void spooSetMutexName(SPOOmutex mutex, const char* name);
+int  spooGetMutexStats(SPOOmutexstats* stats, int count);
+void spooResetMutexStats(void);
+int  spooDumpMutexStats(const char* filename);
+
+/* Tracing */
+int  spooStartTrace(int eventsPerThread);
+void spooStopTrace(void);
+int  spooWriteTrace(const char* filename);
+
+/* Thread-local storage */
+SPOOtlskey spooCreateTLSKey(SPOOtlsfun destructor);
+void spooDestroyTLSKey(SPOOtlskey key);
+void spooSetTLS(SPOOtlskey key, void* value);
+void* spooGetTLS(SPOOtlskey key);
+
+/* Fibers */
+int  spooStartFibers(int threadCount, size_t stackSize);
+void spooStopFibers(void);
+SPOOfiber spooCreateFiber(SPOOthreadfun fun, void* arg);
+void spooWaitFiber(SPOOfiber fiber);
+SPOOfiber spooGetCurrentFiber(void);
+void spooYieldFiber(void);
+void spooSleepFiber(double time);
+SPOOfibermutex spooCreateFiberMutex(void);
+void spooDestroyFiberMutex(SPOOfibermutex mutex);
+void spooLockFiberMutex(SPOOfibermutex mutex);
+void spooUnlockFiberMutex(SPOOfibermutex mutex);
+SPOOfibercond spooCreateFiberCond(void);
+void spooDestroyFiberCond(SPOOfibercond cond);
+void spooWaitFiberCond(SPOOfibercond cond, SPOOfibermutex mutex, double timeout);
+void spooSignalFiberCond(SPOOfibercond cond);
+void spooBroadcastFiberCond(SPOOfibercond cond);
+
+/* Worker pools (a NULL pool is the shared default pool) */
+SPOOpool spooCreatePool(int threadCount);
+void spooDestroyPool(SPOOpool pool);
+int  spooGetPoolThreadCount(SPOOpool pool);
+void spooSubmitTask(SPOOpool pool, SPOOtask* task);
+void spooSubmitDelayedTask(SPOOpool pool, SPOOtask* task, double delay);
+int  spooRunPoolTask(SPOOpool pool);
+
+/* Parallel algorithms */
+int  spooParallelReduce(SPOOpool pool, size_t count, void* result, size_t size, SPOOreducefun reduce, SPOOcombinefun combine, void* arg);
+int  spooParallelScan(SPOOpool pool, const void* input, void* output, size_t count, size_t size, const void* identity, SPOOcombinefun combine, void* arg, int flags);
+int  spooParallelSort(SPOOpool pool, void* base, size_t count, size_t size, SPOOcomparefun compare);
+int  spooParallelRadixSort(SPOOpool pool, void* base, size_t count, size_t size, SPOOsortkeyfun key, void* arg);
+
+/* Channels */
+SPOOchannel spooCreateChannel(size_t size, int capacity);
+void spooDestroyChannel(SPOOchannel channel);
+void spooCloseChannel(SPOOchannel channel);
+int  spooSendChannel(SPOOchannel channel, const void* value);
+int  spooTrySendChannel(SPOOchannel channel, const void* value);
+int  spooTimedSendChannel(SPOOchannel channel, const void* value, double timeout);
+int  spooRecvChannel(SPOOchannel channel, void* value);
+int  spooTryRecvChannel(SPOOchannel channel, void* value);
+int  spooTimedRecvChannel(SPOOchannel channel, void* value, double timeout);
+int  spooSelect(SPOOselectcase* cases, int count, double timeout);
+
+/* Concurrent hash maps */
+SPOOhashmap spooCreateHashMap(size_t keySize, size_t valueSize, SPOOhashfun hash, SPOOequalfun equal, void* arg);
+void spooDestroyHashMap(SPOOhashmap map);
+int  spooLookupHashMap(SPOOhashmap map, const void* key, void* value);
+int  spooInsertHashMap(SPOOhashmap map, const void* key, const void* value);
+int  spooRemoveHashMap(SPOOhashmap map, const void* key);
+size_t spooGetHashMapCount(SPOOhashmap map);
+
+/* Hazard pointers */
+SPOOhazarddomain spooCreateHazardDomain(SPOOreclaimfun reclaim, void* arg);
+void spooDestroyHazardDomain(SPOOhazarddomain domain);
+void* spooProtectHazard(SPOOhazarddomain domain, int slot, void* volatile* source);
+void spooClearHazard(SPOOhazarddomain domain, int slot);
+void spooRetireHazard(SPOOhazarddomain domain, void* pointer);
+void spooScanHazards(SPOOhazarddomain domain);
+
+/* Flat combining */
+SPOOcombiner spooCreateCombiner(SPOOmutex mutex, SPOOapplyfun apply, void* arg);
+void spooDestroyCombiner(SPOOcombiner combiner);
+void spooApplyCombiner(SPOOcombiner combiner, void* request);
+
+/* Sharded counters */
+SPOOcounter spooCreateCounter(int kind);
+void spooDestroyCounter(SPOOcounter counter);
+void spooAddCounter(SPOOcounter counter, long long value);
+void spooSetCounter(SPOOcounter counter, long long value);
+long long spooGetCounter(SPOOcounter counter);
+
+/* Striped lock tables */
+SPOOlocktable spooCreateLockTable(int stripeCount);
+void spooDestroyLockTable(SPOOlocktable table);
+void spooLockTableKey(SPOOlocktable table, size_t key);
+void spooUnlockTableKey(SPOOlocktable table, size_t key);
+int  spooLockTableKeys(SPOOlocktable table, const size_t* keys, int count);
+void spooUnlockTableKeys(SPOOlocktable table, const size_t* keys, int count);
+size_t spooGetLockTableMemory(SPOOlocktable table);
+
+/* Histograms */
+SPOOhistogram spooCreateHistogram(void);
+void spooDestroyHistogram(SPOOhistogram histogram);
+void spooRecordHistogram(SPOOhistogram histogram, unsigned long long value);
+void spooMergeHistogram(SPOOhistogram target, SPOOhistogram source);
+void spooResetHistogram(SPOOhistogram histogram);
+unsigned long long spooGetHistogramCount(SPOOhistogram histogram);
+unsigned long long spooGetHistogramPercentile(SPOOhistogram histogram, double percentile);
+
+/* Actors */
+SPOOactor spooCreateActor(SPOOpool pool, SPOOactorfun fun, void* arg);
+void spooDestroyActor(SPOOactor actor);
+void spooSendActor(SPOOactor actor, SPOOmessage* message);
+
+/* Pipelines */
+SPOOpipeline spooCreatePipeline(SPOOpool pool);
+void spooDestroyPipeline(SPOOpipeline pipeline);
+int  spooAddPipelineStage(SPOOpipeline pipeline, int mode, SPOOstagefun fun, void* arg);
+int  spooRunPipeline(SPOOpipeline pipeline, int tokenCount);
+
+/* Task graphs */
+SPOOgraph spooCreateGraph(SPOOpool pool);
+void spooDestroyGraph(SPOOgraph graph);
+SPOOgraphnode spooAddGraphNode(SPOOgraph graph, SPOOthreadfun fun, void* arg);
+int  spooAddGraphEdge(SPOOgraphnode before, SPOOgraphnode after);
+int  spooRunGraph(SPOOgraph graph);
+
+/* I/O reactor (only available where epoll is) */
+SPOOreactor spooCreateReactor(SPOOpool pool, int shardCount);
+void spooDestroyReactor(SPOOreactor reactor);
+SPOOwatch spooAddWatch(SPOOreactor reactor, int fd, int events, SPOOiofun fun, void* arg);
+void spooRemoveWatch(SPOOwatch watch);
+
+/* Asynchronous file I/O */
+SPOOfileio spooCreateFileIO(SPOOpool pool, int queueDepth, int flags);
+void spooDestroyFileIO(SPOOfileio io);
+int  spooIsFileIOAsync(SPOOfileio io);
+void spooReadFile(SPOOfileio io, SPOOfilerequest* request);
+void spooWriteFile(SPOOfileio io, SPOOfilerequest* request);
+void spooSyncFile(SPOOfileio io, SPOOfilerequest* request);
+void spooSubmitFileIO(SPOOfileio io);
+
 
 #ifdef __cplusplus
 }
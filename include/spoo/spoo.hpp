@@ -0,0 +1,862 @@
+/************************************************************************
+ * Spoo - A threading library
+ *------------------------------------------------------------------------
+ * This software is based on parts of the GLFW 2.7 library
+ *
+ * Copyright (c) 2002-2006 Marcus Geelnard
+ * Copyright (c) 2006-2011 Camilla Berglund
+ *
+ * This software is provided 'as-is', without any express or implied
+ * warranty. In no event will the authors be held liable for any damages
+ * arising from the use of this software.
+ *
+ * Permission is granted to anyone to use this software for any purpose,
+ * including commercial applications, and to alter it and redistribute it
+ * freely, subject to the following restrictions:
+ *
+ * 1. The origin of this software must not be misrepresented; you must not
+ *    claim that you wrote the original software. If you use this software
+ *    in a product, an acknowledgment in the product documentation would
+ *    be appreciated but is not required.
+ *
+ * 2. Altered source versions must be plainly marked as such, and must not
+ *    be misrepresented as being the original software.
+ *
+ * 3. This notice may not be removed or altered from any source
+ *    distribution.
+ *
+ *************************************************************************/
+
+
+#ifndef __spoo_hpp__
+#define __spoo_hpp__
+
+/* C++20 coroutine support for Spoo worker pools
+ *
+ * Coroutines returning spoo::task<T> start when awaited, and can move
+ * themselves onto pool workers, sleep, and wait on spoo::async_mutex and
+ * spoo::async_cond without blocking a worker thread.  Coroutine frames are
+ * recycled through per-thread free lists, so steady-state awaiting does not
+ * allocate.
+ */
+
+#include "spoo.h"
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+
+namespace spoo
+{
+
+template <typename T = void> class task;
+
+
+namespace detail
+{
+
+/*************************************************************************
+ * Coroutine frame allocator
+ *************************************************************************/
+
+/* Recycles coroutine frames through per-thread free lists, one for each
+ * multiple of the size granularity.  Frames freed on another thread than
+ * they were allocated on simply migrate to that thread's lists.
+ */
+class frame_allocator
+{
+public:
+    static void* allocate(std::size_t size)
+    {
+        const std::size_t index = size_class(size);
+        if (index < class_count)
+        {
+            cache& c = local_cache();
+            if (node* n = c.lists[index])
+            {
+                c.lists[index] = n->next;
+                c.counts[index]--;
+                return n;
+            }
+
+            size = (index + 1) * granularity;
+        }
+
+        miss_count().fetch_add(1, std::memory_order_relaxed);
+
+        void* p = std::malloc(size);
+        if (!p)
+            throw std::bad_alloc();
+
+        return p;
+    }
+
+    static void deallocate(void* p, std::size_t size) noexcept
+    {
+        const std::size_t index = size_class(size);
+        if (index < class_count)
+        {
+            cache& c = local_cache();
+            if (c.counts[index] < max_cached)
+            {
+                node* n = static_cast<node*>(p);
+                n->next = c.lists[index];
+                c.lists[index] = n;
+                c.counts[index]++;
+                return;
+            }
+        }
+
+        std::free(p);
+    }
+
+    /* Returns the number of frames so far that could not be recycled and
+     * were allocated with std::malloc
+     */
+    static unsigned long misses() noexcept
+    {
+        return miss_count().load(std::memory_order_relaxed);
+    }
+
+private:
+    static constexpr std::size_t granularity = 64;
+    static constexpr std::size_t class_count = 64;
+    static constexpr int max_cached = 1024;
+
+    struct node
+    {
+        node* next;
+    };
+
+    struct cache
+    {
+        node* lists[class_count] = {};
+        int counts[class_count] = {};
+
+        ~cache()
+        {
+            for (node* n : lists)
+            {
+                while (n)
+                {
+                    node* next = n->next;
+                    std::free(n);
+                    n = next;
+                }
+            }
+        }
+    };
+
+    static std::size_t size_class(std::size_t size) noexcept
+    {
+        return (size - 1) / granularity;
+    }
+
+    static cache& local_cache() noexcept
+    {
+        static thread_local cache c;
+        return c;
+    }
+
+    static std::atomic<unsigned long>& miss_count() noexcept
+    {
+        static std::atomic<unsigned long> count(0);
+        return count;
+    }
+};
+
+/* Routes coroutine frame allocation through the frame allocator */
+struct frame_allocated
+{
+    static void* operator new(std::size_t size)
+    {
+        return frame_allocator::allocate(size);
+    }
+
+    static void operator delete(void* p, std::size_t size) noexcept
+    {
+        frame_allocator::deallocate(p, size);
+    }
+};
+
+
+/*************************************************************************
+ * Task promises
+ *************************************************************************/
+
+/* The awaiter and the finishing task race to set the flag, so that a task
+ * finishing before its awaiter has suspended continues the awaiter on the
+ * same stack instead of resuming it recursively
+ */
+struct promise_base : frame_allocated
+{
+    struct final_awaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename P>
+        void await_suspend(std::coroutine_handle<P> h) noexcept
+        {
+            promise_base& p = h.promise();
+            if (p.flag.exchange(true, std::memory_order_acq_rel))
+                p.continuation.resume();
+        }
+
+        void await_resume() const noexcept { }
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    final_awaiter final_suspend() const noexcept { return {}; }
+
+    void unhandled_exception() noexcept
+    {
+        exception = std::current_exception();
+    }
+
+    void rethrow_if_exception()
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+
+    std::coroutine_handle<> continuation;
+    std::exception_ptr exception;
+    std::atomic<bool> flag{false};
+};
+
+template <typename T>
+struct promise : promise_base
+{
+    task<T> get_return_object() noexcept;
+
+    template <typename U>
+    void return_value(U&& v)
+    {
+        value.emplace(std::forward<U>(v));
+    }
+
+    T result()
+    {
+        rethrow_if_exception();
+        return std::move(*value);
+    }
+
+    std::optional<T> value;
+};
+
+template <>
+struct promise<void> : promise_base
+{
+    task<void> get_return_object() noexcept;
+
+    void return_void() const noexcept { }
+
+    void result()
+    {
+        rethrow_if_exception();
+    }
+};
+
+
+/*************************************************************************
+ * Waiter queue entry
+ *************************************************************************/
+
+/* A suspended coroutine waiting for a mutex or condition, which is resumed
+ * by submitting its embedded task to a pool.  The task must be the first
+ * member, as the queues link waiters through it.
+ */
+struct waiter
+{
+    SPOOtask task;
+    SPOOpool pool;
+
+    void prepare(std::coroutine_handle<> h, SPOOpool p) noexcept
+    {
+        task.next = nullptr;
+        task.fun = &resume;
+        task.arg = h.address();
+        pool = p;
+    }
+
+    void submit() noexcept
+    {
+        spooSubmitTask(pool, &task);
+    }
+
+    static void resume(void* arg)
+    {
+        std::coroutine_handle<>::from_address(arg).resume();
+    }
+};
+
+/* An intrusive FIFO of waiters */
+struct waiter_queue
+{
+    void push(waiter* w) noexcept
+    {
+        w->task.next = nullptr;
+
+        if (tail)
+            tail->task.next = &w->task;
+        else
+            head = w;
+
+        tail = w;
+    }
+
+    waiter* pop() noexcept
+    {
+        waiter* w = head;
+        if (w)
+        {
+            head = reinterpret_cast<waiter*>(w->task.next);
+            if (!head)
+                tail = nullptr;
+        }
+
+        return w;
+    }
+
+    waiter* head = nullptr;
+    waiter* tail = nullptr;
+};
+
+} /* namespace detail */
+
+
+/*************************************************************************
+ * Task type
+ *************************************************************************/
+
+/* A lazily started coroutine producing a value of type T
+ * The coroutine starts running when the task is awaited, on the awaiting
+ * thread, and resumes its awaiter when it finishes.
+ */
+template <typename T>
+class task
+{
+public:
+    using promise_type = detail::promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    task() noexcept = default;
+
+    explicit task(handle_type h) noexcept : handle(h) { }
+
+    task(task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) { }
+
+    task& operator=(task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            if (handle)
+                handle.destroy();
+
+            handle = std::exchange(other.handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    ~task()
+    {
+        if (handle)
+            handle.destroy();
+    }
+
+    auto operator co_await() && noexcept
+    {
+        struct awaiter
+        {
+            bool await_ready() const noexcept { return !handle || handle.done(); }
+
+            bool await_suspend(std::coroutine_handle<> h) noexcept
+            {
+                handle.promise().continuation = h;
+                handle.resume();
+
+                // Only suspend if the task has not finished already
+                return !handle.promise().flag.exchange(true, std::memory_order_acq_rel);
+            }
+
+            T await_resume()
+            {
+                return handle.promise().result();
+            }
+
+            handle_type handle;
+        };
+
+        return awaiter{handle};
+    }
+
+private:
+    handle_type handle = nullptr;
+};
+
+namespace detail
+{
+
+template <typename T>
+inline task<T> promise<T>::get_return_object() noexcept
+{
+    return task<T>(std::coroutine_handle<promise<T>>::from_promise(*this));
+}
+
+inline task<void> promise<void>::get_return_object() noexcept
+{
+    return task<void>(std::coroutine_handle<promise<void>>::from_promise(*this));
+}
+
+} /* namespace detail */
+
+
+/*************************************************************************
+ * Scheduling and timers
+ *************************************************************************/
+
+/* Suspends the awaiting coroutine and resumes it on a worker of the pool,
+ * optionally after a delay
+ */
+class schedule_awaiter
+{
+public:
+    explicit schedule_awaiter(SPOOpool pool, double delay = 0.0) noexcept
+        : pool(pool), delay(delay), task() { }
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) noexcept
+    {
+        task.fun = &detail::waiter::resume;
+        task.arg = h.address();
+
+        if (delay > 0.0)
+            spooSubmitDelayedTask(pool, &task, delay);
+        else
+            spooSubmitTask(pool, &task);
+    }
+
+    void await_resume() const noexcept { }
+
+private:
+    SPOOpool pool;
+    double delay;
+    SPOOtask task;
+};
+
+/* Continue the awaiting coroutine on a worker of the pool
+ * A NULL pool is the shared default pool.
+ */
+inline schedule_awaiter schedule(SPOOpool pool = NULL) noexcept
+{
+    return schedule_awaiter(pool);
+}
+
+/* Continue the awaiting coroutine on a worker of the pool after the
+ * specified number of seconds, without blocking any thread meanwhile
+ */
+inline schedule_awaiter sleep_for(double seconds, SPOOpool pool = NULL) noexcept
+{
+    return schedule_awaiter(pool, seconds);
+}
+
+
+/*************************************************************************
+ * Mutexes and conditions
+ *************************************************************************/
+
+class async_cond;
+
+/* A mutex that suspends awaiting coroutines instead of blocking threads
+ * Ownership is handed directly to the first waiter on unlock, which is then
+ * resumed on its pool.
+ */
+class async_mutex
+{
+public:
+    class lock_awaiter
+    {
+    public:
+        lock_awaiter(async_mutex& mutex, SPOOpool pool) noexcept
+            : mutex(mutex), pool(pool) { }
+
+        bool await_ready() const noexcept { return mutex.try_lock(); }
+
+        bool await_suspend(std::coroutine_handle<> h) noexcept
+        {
+            w.prepare(h, pool);
+            return mutex.enqueue(&w);
+        }
+
+        void await_resume() const noexcept { }
+
+    protected:
+        async_mutex& mutex;
+        SPOOpool pool;
+        detail::waiter w;
+    };
+
+    /* Releases an async_mutex when destroyed */
+    class lock_guard
+    {
+    public:
+        explicit lock_guard(async_mutex& mutex) noexcept : mutex(&mutex) { }
+
+        lock_guard(lock_guard&& other) noexcept
+            : mutex(std::exchange(other.mutex, nullptr)) { }
+
+        lock_guard(const lock_guard&) = delete;
+        lock_guard& operator=(const lock_guard&) = delete;
+
+        ~lock_guard()
+        {
+            if (mutex)
+                mutex->unlock();
+        }
+
+    private:
+        async_mutex* mutex;
+    };
+
+    class scoped_lock_awaiter : public lock_awaiter
+    {
+    public:
+        using lock_awaiter::lock_awaiter;
+
+        lock_guard await_resume() const noexcept
+        {
+            return lock_guard(mutex);
+        }
+    };
+
+    async_mutex() : state(spooCreateMutex())
+    {
+        if (!state)
+            throw std::bad_alloc();
+    }
+
+    async_mutex(const async_mutex&) = delete;
+    async_mutex& operator=(const async_mutex&) = delete;
+
+    ~async_mutex()
+    {
+        spooDestroyMutex(state);
+    }
+
+    /* Acquire the mutex, resuming on the pool if we had to wait */
+    lock_awaiter lock(SPOOpool pool = NULL) noexcept
+    {
+        return lock_awaiter(*this, pool);
+    }
+
+    /* Acquire the mutex and return a guard that releases it */
+    scoped_lock_awaiter scoped_lock(SPOOpool pool = NULL) noexcept
+    {
+        return scoped_lock_awaiter(*this, pool);
+    }
+
+    bool try_lock() noexcept
+    {
+        spooLockMutex(state);
+        const bool acquired = !locked;
+        locked = true;
+        spooUnlockMutex(state);
+
+        return acquired;
+    }
+
+    void unlock() noexcept
+    {
+        spooLockMutex(state);
+        detail::waiter* w = waiters.pop();
+        if (!w)
+            locked = false;
+        spooUnlockMutex(state);
+
+        if (w)
+            w->submit();
+    }
+
+private:
+    friend class async_cond;
+
+    /* Queue the waiter, or acquire the mutex for it and return false */
+    bool enqueue(detail::waiter* w) noexcept
+    {
+        spooLockMutex(state);
+
+        if (!locked)
+        {
+            locked = true;
+            spooUnlockMutex(state);
+            return false;
+        }
+
+        waiters.push(w);
+        spooUnlockMutex(state);
+        return true;
+    }
+
+    /* Acquire the mutex for a suspended waiter, resuming it when acquired */
+    void acquire_for(detail::waiter* w) noexcept
+    {
+        if (!enqueue(w))
+            w->submit();
+    }
+
+    SPOOmutex state;
+    bool locked = false;
+    detail::waiter_queue waiters;
+};
+
+/* A condition variable for coroutines holding an async_mutex
+ * Signalled waiters are moved directly onto the queue of the mutex, so they
+ * are only resumed once they own it again.
+ */
+class async_cond
+{
+private:
+    /* The waiter must be the first member, as it is queued by address */
+    struct entry
+    {
+        detail::waiter w;
+        async_mutex* mutex;
+    };
+
+public:
+    class wait_awaiter
+    {
+    public:
+        wait_awaiter(async_cond& cond, async_mutex& mutex, SPOOpool pool) noexcept
+            : cond(cond), pool(pool)
+        {
+            e.mutex = &mutex;
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> h) noexcept
+        {
+            e.w.prepare(h, pool);
+            cond.enqueue(&e);
+            e.mutex->unlock();
+        }
+
+        void await_resume() const noexcept { }
+
+    private:
+        async_cond& cond;
+        SPOOpool pool;
+        entry e;
+    };
+
+    async_cond() : state(spooCreateMutex())
+    {
+        if (!state)
+            throw std::bad_alloc();
+    }
+
+    async_cond(const async_cond&) = delete;
+    async_cond& operator=(const async_cond&) = delete;
+
+    ~async_cond()
+    {
+        spooDestroyMutex(state);
+    }
+
+    /* Release the mutex, wait for a signal and reacquire the mutex */
+    wait_awaiter wait(async_mutex& mutex, SPOOpool pool = NULL) noexcept
+    {
+        return wait_awaiter(*this, mutex, pool);
+    }
+
+    void signal() noexcept
+    {
+        spooLockMutex(state);
+        entry* e = reinterpret_cast<entry*>(waiters.pop());
+        spooUnlockMutex(state);
+
+        if (e)
+            e->mutex->acquire_for(&e->w);
+    }
+
+    void broadcast() noexcept
+    {
+        spooLockMutex(state);
+        detail::waiter_queue all = waiters;
+        waiters = detail::waiter_queue();
+        spooUnlockMutex(state);
+
+        while (entry* e = reinterpret_cast<entry*>(all.pop()))
+            e->mutex->acquire_for(&e->w);
+    }
+
+private:
+    void enqueue(entry* e) noexcept
+    {
+        spooLockMutex(state);
+        waiters.push(&e->w);
+        spooUnlockMutex(state);
+    }
+
+    SPOOmutex state;
+    detail::waiter_queue waiters;
+};
+
+
+/*************************************************************************
+ * Running tasks
+ *************************************************************************/
+
+namespace detail
+{
+
+/* A coroutine that runs to completion on its own and frees itself */
+struct detached_task
+{
+    struct promise_type : frame_allocated
+    {
+        detached_task get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept { }
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+/* A one-shot event for blocking a thread until a coroutine finishes */
+class event
+{
+public:
+    event() : mutex(spooCreateMutex()), cond(spooCreateCond())
+    {
+        if (!mutex || !cond)
+        {
+            spooDestroyCond(cond);
+            spooDestroyMutex(mutex);
+            throw std::bad_alloc();
+        }
+    }
+
+    event(const event&) = delete;
+    event& operator=(const event&) = delete;
+
+    ~event()
+    {
+        spooDestroyCond(cond);
+        spooDestroyMutex(mutex);
+    }
+
+    void set() noexcept
+    {
+        spooLockMutex(mutex);
+        done = true;
+        spooSignalCond(cond);
+        spooUnlockMutex(mutex);
+    }
+
+    void wait() noexcept
+    {
+        spooLockMutex(mutex);
+        while (!done)
+            spooWaitCond(cond, mutex, SPOO_INFINITY);
+        spooUnlockMutex(mutex);
+    }
+
+private:
+    SPOOmutex mutex;
+    SPOOcond cond;
+    bool done = false;
+};
+
+template <typename T>
+struct sync_result
+{
+    std::optional<T> value;
+    std::exception_ptr exception;
+
+    T get()
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+
+        return std::move(*value);
+    }
+};
+
+template <>
+struct sync_result<void>
+{
+    std::exception_ptr exception;
+
+    void get()
+    {
+        if (exception)
+            std::rethrow_exception(exception);
+    }
+};
+
+template <typename T>
+detached_task run_and_signal(task<T> t, sync_result<T>& result, event& done)
+{
+    try
+    {
+        if constexpr (std::is_void_v<T>)
+            co_await std::move(t);
+        else
+            result.value.emplace(co_await std::move(t));
+    }
+    catch (...)
+    {
+        result.exception = std::current_exception();
+    }
+
+    done.set();
+}
+
+inline detached_task run_detached(task<void> t, SPOOpool pool)
+{
+    co_await schedule(pool);
+    co_await std::move(t);
+}
+
+} /* namespace detail */
+
+/* Run a task on the calling thread until it first suspends, then block the
+ * thread until the task has finished and return its result
+ */
+template <typename T>
+T sync_wait(task<T> t)
+{
+    detail::event done;
+    detail::sync_result<T> result;
+
+    detail::run_and_signal(std::move(t), result, done);
+    done.wait();
+
+    return result.get();
+}
+
+/* Start a task on a worker of the pool without waiting for it
+ * The task must not throw.
+ */
+inline void spawn(task<void> t, SPOOpool pool = NULL)
+{
+    detail::run_detached(std::move(t), pool);
+}
+
+} /* namespace spoo */
+
+#endif /* __spoo_hpp__ */
@@ -0,0 +1,204 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+
+
+// Number of messages an actor processes before giving up its worker
+#define BATCH_SIZE 64
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Append a message to the mailbox of an actor
+// This is safe to call from any number of threads at once
+//
+static void pushMessage(_SPOOactor* actor, SPOOmessage* message)
+{
+    SPOOmessage* previous;
+
+    message->next = NULL;
+    previous = (SPOOmessage*) _SPOO_ATOMIC_EXCHANGE_PTR(&actor->head, message);
+    _SPOO_ATOMIC_STORE(&previous->next, message);
+}
+
+// Remove the oldest message from the mailbox of an actor
+// Returns NULL if the mailbox is empty or a send is only half done, in
+// which case the head has already moved and the actor stays scheduled
+//
+static SPOOmessage* popMessage(_SPOOactor* actor)
+{
+    SPOOmessage* tail = actor->tail;
+    SPOOmessage* next = (SPOOmessage*) _SPOO_ATOMIC_LOAD(&tail->next);
+
+    if (tail == &actor->stub)
+    {
+        if (!next)
+            return NULL;
+
+        actor->tail = next;
+        tail = next;
+        next = (SPOOmessage*) _SPOO_ATOMIC_LOAD(&next->next);
+    }
+
+    if (next)
+    {
+        actor->tail = next;
+        return tail;
+    }
+
+    if (tail != (SPOOmessage*) _SPOO_ATOMIC_LOAD(&actor->head))
+        return NULL;
+
+    // Put the stub back behind the last message so it can be removed
+    pushMessage(actor, &actor->stub);
+
+    next = (SPOOmessage*) _SPOO_ATOMIC_LOAD(&tail->next);
+    if (next)
+    {
+        actor->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+// Submit an actor to its pool unless it is already scheduled
+//
+static void scheduleActor(_SPOOactor* actor)
+{
+    if (_SPOO_ATOMIC_CAS(&actor->scheduled, 0, 1))
+        spooSubmitTask(actor->pool, &actor->task);
+}
+
+// Process a batch of messages of an actor
+// This runs as a pool task
+//
+static void runActor(void* arg)
+{
+    int i;
+    SPOOmessage* message;
+    _SPOOactor* actor = (_SPOOactor*) arg;
+
+    _SPOO_ATOMIC_ADD(&actor->running, 1);
+
+    for (i = 0;  i < BATCH_SIZE;  i++)
+    {
+        message = popMessage(actor);
+        if (!message)
+            break;
+
+        actor->function((SPOOactor) actor, message, actor->arg);
+    }
+
+    // Let other actors run before the rest of a full mailbox
+    if (i == BATCH_SIZE)
+        spooSubmitTask(actor->pool, &actor->task);
+    else
+    {
+        _SPOO_ATOMIC_STORE(&actor->scheduled, 0);
+
+        // Pairs with the exchange in pushMessage, so a message sent while
+        // we were unscheduling is not left without anyone to process it
+        _SPOO_ATOMIC_FENCE();
+
+        if ((SPOOmessage*) _SPOO_ATOMIC_LOAD(&actor->head) != &actor->stub)
+            scheduleActor(actor);
+    }
+
+    // This is the last access, after which the actor may be destroyed
+    _SPOO_ATOMIC_ADD(&actor->running, -1);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create an actor whose function is called on a pool for each message
+// An actor processes one message at a time, in the order they were sent
+//
+SPOOactor spooCreateActor(SPOOpool pool, SPOOactorfun fun, void* arg)
+{
+    _SPOOactor* actor;
+
+    if (!_spooInitialized || !fun)
+        return NULL;
+
+    actor = (_SPOOactor*) calloc(1, sizeof(_SPOOactor));
+    if (!actor)
+        return NULL;
+
+    actor->task.fun = runActor;
+    actor->task.arg = actor;
+    actor->pool = pool;
+    actor->function = fun;
+    actor->arg = arg;
+    actor->head = &actor->stub;
+    actor->tail = &actor->stub;
+
+    return (SPOOactor) actor;
+}
+
+// Destroy an actor, waiting for its last activation to wind down
+// NOTE: The actor must have no unprocessed messages
+//
+void spooDestroyActor(SPOOactor handle)
+{
+    _SPOOactor* actor = (_SPOOactor*) handle;
+
+    if (!_spooInitialized || !actor)
+        return;
+
+    while (_SPOO_ATOMIC_LOAD(&actor->scheduled) ||
+           _SPOO_ATOMIC_LOAD(&actor->running))
+    {
+        spooSleep(0.0);
+    }
+
+    free(actor);
+}
+
+// Send a message to an actor, scheduling it if it was idle
+// The message must stay valid until the actor function is called with it
+//
+void spooSendActor(SPOOactor handle, SPOOmessage* message)
+{
+    _SPOOactor* actor = (_SPOOactor*) handle;
+
+    if (!_spooInitialized || !actor || !message)
+        return;
+
+    pushMessage(actor, message);
+    scheduleActor(actor);
+}
@@ -0,0 +1,894 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+// Number of select cases handled without allocating
+#define STATIC_CASE_COUNT 8
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Destroy the waiter of a thread
+// This is the destructor of the waiter TLS key
+//
+static void destroyWaiter(void* value)
+{
+    _SPOOchannelwaiter* waiter = (_SPOOchannelwaiter*) value;
+
+    spooDestroyCond(waiter->cond);
+    spooDestroyMutex(waiter->lock);
+    free(waiter);
+}
+
+// Return the waiter of the current thread, creating it if necessary
+//
+static _SPOOchannelwaiter* getWaiter(void)
+{
+    _SPOOchannelwaiter* waiter;
+
+    waiter = (_SPOOchannelwaiter*) _spooPlatformGetTLS(_spoo.channelWaiterKey);
+    if (waiter)
+        return waiter;
+
+    waiter = (_SPOOchannelwaiter*) calloc(1, sizeof(_SPOOchannelwaiter));
+    if (!waiter)
+        return NULL;
+
+    waiter->lock = spooCreateMutex();
+    waiter->cond = spooCreateCond();
+
+    if (!waiter->lock || !waiter->cond)
+    {
+        spooDestroyCond(waiter->cond);
+        spooDestroyMutex(waiter->lock);
+        free(waiter);
+        return NULL;
+    }
+
+    spooSetMutexName(waiter->lock, "channel waiter");
+
+    _spooPlatformSetTLS(_spoo.channelWaiterKey, waiter);
+    return waiter;
+}
+
+// Wake a waiter whose state has been set
+// This is done after unlocking the channel so the waiter does not wake up
+// only to block on the channel lock.  The waiter does not return before it
+// has been woken, so it cannot be freed before we are done.
+//
+static void wakeWaiter(_SPOOchannelwaiter* waiter)
+{
+    spooLockMutex(waiter->lock);
+    waiter->woken = SPOO_TRUE;
+    spooSignalCond(waiter->cond);
+    spooUnlockMutex(waiter->lock);
+}
+
+// Append an entry to a channel wait queue
+//
+static void linkEntry(_SPOOchannelentry** queue, _SPOOchannelentry* entry)
+{
+    if (*queue)
+    {
+        entry->prev = (*queue)->prev;
+        entry->next = NULL;
+        (*queue)->prev->next = entry;
+        (*queue)->prev = entry;
+    }
+    else
+    {
+        entry->prev = entry;
+        entry->next = NULL;
+        *queue = entry;
+    }
+
+    entry->linked = SPOO_TRUE;
+}
+
+// Remove an entry from a channel wait queue, if it is still in it
+//
+static void unlinkEntry(_SPOOchannelentry** queue, _SPOOchannelentry* entry)
+{
+    if (!entry->linked)
+        return;
+
+    if (entry == *queue)
+    {
+        *queue = entry->next;
+        if (*queue)
+            (*queue)->prev = entry->prev;
+    }
+    else
+    {
+        entry->prev->next = entry->next;
+        if (entry->next)
+            entry->next->prev = entry->prev;
+        else
+            (*queue)->prev = entry->prev;
+    }
+
+    entry->linked = SPOO_FALSE;
+}
+
+// Take the first entry of a wait queue whose waiter has not yet fired,
+// skipping those of the specified waiter
+// This is called with the channel locked
+//
+static _SPOOchannelentry* claimEntry(_SPOOchannelentry** queue,
+                                     _SPOOchannelwaiter* self)
+{
+    _SPOOchannelentry* entry;
+
+    for (entry = *queue;  entry;  entry = entry->next)
+    {
+        if (entry->waiter == self)
+            continue;
+
+        if (_SPOO_ATOMIC_CAS(&entry->waiter->state, 0, entry->index + 1))
+        {
+            unlinkEntry(queue, entry);
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+// Wake one waiter of a buffered channel to retry its operation
+//
+static void notifyWaiter(_SPOOchannel* channel, _SPOOchannelentry** queue)
+{
+    _SPOOchannelentry* entry;
+
+    spooLockMutex(channel->lock);
+
+    entry = claimEntry(queue, NULL);
+    if (entry)
+        entry->result = _SPOO_CHANNEL_RETRY;
+
+    spooUnlockMutex(channel->lock);
+
+    if (entry)
+        wakeWaiter(entry->waiter);
+}
+
+// Wake a receiver after adding an element to a buffered channel
+//
+static void notifyReceiver(_SPOOchannel* channel)
+{
+    // Pairs with the waiter count increment before the receiver retries
+    _SPOO_ATOMIC_FENCE();
+
+    if (_SPOO_ATOMIC_LOAD(&channel->recvWaiters))
+        notifyWaiter(channel, &channel->receivers);
+}
+
+// Wake a sender after removing an element from a buffered channel
+//
+static void notifySender(_SPOOchannel* channel)
+{
+    _SPOO_ATOMIC_FENCE();
+
+    if (_SPOO_ATOMIC_LOAD(&channel->sendWaiters))
+        notifyWaiter(channel, &channel->senders);
+}
+
+// Try to add an element to the ring of a buffered channel
+//
+static int pushElement(_SPOOchannel* channel, const void* value)
+{
+    long position, difference;
+    unsigned char* slot;
+
+    position = _SPOO_ATOMIC_LOAD(&channel->head);
+
+    for (;;)
+    {
+        slot = channel->slots + (position & channel->mask) * channel->stride;
+        difference = (long) ((unsigned long) _SPOO_ATOMIC_LOAD((volatile long*) slot) -
+                             (unsigned long) position);
+
+        if (difference == 0)
+        {
+            if (_SPOO_ATOMIC_CAS(&channel->head, position, position + 1))
+                break;
+
+            position = _SPOO_ATOMIC_LOAD(&channel->head);
+        }
+        else if (difference < 0)
+            return SPOO_FALSE;
+        else
+            position = _SPOO_ATOMIC_LOAD(&channel->head);
+    }
+
+    memcpy(slot + sizeof(long), value, channel->size);
+    _SPOO_ATOMIC_STORE((volatile long*) slot,
+                       (long) ((unsigned long) position + 1));
+    return SPOO_TRUE;
+}
+
+// Try to remove an element from the ring of a buffered channel
+//
+static int popElement(_SPOOchannel* channel, void* value)
+{
+    long position, difference;
+    unsigned char* slot;
+
+    position = _SPOO_ATOMIC_LOAD(&channel->tail);
+
+    for (;;)
+    {
+        slot = channel->slots + (position & channel->mask) * channel->stride;
+        difference = (long) ((unsigned long) _SPOO_ATOMIC_LOAD((volatile long*) slot) -
+                             ((unsigned long) position + 1));
+
+        if (difference == 0)
+        {
+            if (_SPOO_ATOMIC_CAS(&channel->tail, position, position + 1))
+                break;
+
+            position = _SPOO_ATOMIC_LOAD(&channel->tail);
+        }
+        else if (difference < 0)
+            return SPOO_FALSE;
+        else
+            position = _SPOO_ATOMIC_LOAD(&channel->tail);
+    }
+
+    memcpy(value, slot + sizeof(long), channel->size);
+    _SPOO_ATOMIC_STORE((volatile long*) slot,
+                       (long) ((unsigned long) position + channel->mask + 1));
+    return SPOO_TRUE;
+}
+
+// Try to send on a buffered channel without blocking
+// This does not need the channel lock
+//
+static int trySendBuffered(_SPOOchannel* channel, const void* value)
+{
+    if (_SPOO_ATOMIC_LOAD(&channel->closed))
+        return SPOO_CHANNEL_CLOSED;
+
+    if (!pushElement(channel, value))
+        return SPOO_CHANNEL_TIMEOUT;
+
+    return SPOO_CHANNEL_OK;
+}
+
+// Try to receive from a buffered channel without blocking
+// This does not need the channel lock
+//
+static int tryRecvBuffered(_SPOOchannel* channel, void* value)
+{
+    if (popElement(channel, value))
+        return SPOO_CHANNEL_OK;
+
+    if (!_SPOO_ATOMIC_LOAD(&channel->closed))
+        return SPOO_CHANNEL_TIMEOUT;
+
+    // Elements sent before the channel was closed are still delivered
+    if (popElement(channel, value))
+        return SPOO_CHANNEL_OK;
+
+    memset(value, 0, channel->size);
+    return SPOO_CHANNEL_CLOSED;
+}
+
+// Try to complete a select case without blocking
+// This is called with the channel of the case locked.  Any waiter that was
+// handed an element is returned for waking after the channel is unlocked.
+//
+static int attemptCase(SPOOselectcase* selectCase, _SPOOchannelwaiter* self,
+                       _SPOOchannelwaiter** wake)
+{
+    _SPOOchannelentry* entry;
+    _SPOOchannel* channel = (_SPOOchannel*) selectCase->channel;
+
+    if (selectCase->operation == SPOO_SELECT_SEND)
+    {
+        if (channel->buffered)
+            return trySendBuffered(channel, selectCase->value);
+
+        if (channel->closed)
+            return SPOO_CHANNEL_CLOSED;
+
+        entry = claimEntry(&channel->receivers, self);
+        if (!entry)
+            return SPOO_CHANNEL_TIMEOUT;
+
+        memcpy(entry->value, selectCase->value, channel->size);
+    }
+    else
+    {
+        if (channel->buffered)
+            return tryRecvBuffered(channel, selectCase->value);
+
+        entry = claimEntry(&channel->senders, self);
+        if (!entry)
+        {
+            if (!channel->closed)
+                return SPOO_CHANNEL_TIMEOUT;
+
+            memset(selectCase->value, 0, channel->size);
+            return SPOO_CHANNEL_CLOSED;
+        }
+
+        memcpy(selectCase->value, entry->value, channel->size);
+    }
+
+    entry->result = SPOO_CHANNEL_OK;
+    *wake = entry->waiter;
+    return SPOO_CHANNEL_OK;
+}
+
+// Wake a waiter that may now be able to complete after a select case
+//
+static void notifyAfterCase(SPOOselectcase* selectCase)
+{
+    _SPOOchannel* channel = (_SPOOchannel*) selectCase->channel;
+
+    if (!channel->buffered)
+        return;
+
+    if (selectCase->operation == SPOO_SELECT_SEND)
+        notifyReceiver(channel);
+    else
+        notifySender(channel);
+}
+
+// Add the entries of a select to the wait queues of their channels
+//
+static void registerEntries(SPOOselectcase* cases, _SPOOchannelentry* entries,
+                            int count)
+{
+    int i;
+    _SPOOchannel* channel;
+
+    for (i = 0;  i < count;  i++)
+    {
+        channel = (_SPOOchannel*) cases[i].channel;
+
+        if (cases[i].operation == SPOO_SELECT_SEND)
+        {
+            linkEntry(&channel->senders, entries + i);
+            if (channel->buffered)
+                _SPOO_ATOMIC_ADD(&channel->sendWaiters, 1);
+        }
+        else
+        {
+            linkEntry(&channel->receivers, entries + i);
+            if (channel->buffered)
+                _SPOO_ATOMIC_ADD(&channel->recvWaiters, 1);
+        }
+    }
+}
+
+// Remove the entries of a select from the wait queues of their channels
+//
+static void unregisterEntries(SPOOselectcase* cases, _SPOOchannelentry* entries,
+                              int count)
+{
+    int i;
+    _SPOOchannel* channel;
+
+    for (i = 0;  i < count;  i++)
+    {
+        channel = (_SPOOchannel*) cases[i].channel;
+
+        if (cases[i].operation == SPOO_SELECT_SEND)
+        {
+            unlinkEntry(&channel->senders, entries + i);
+            if (channel->buffered)
+                _SPOO_ATOMIC_ADD(&channel->sendWaiters, -1);
+        }
+        else
+        {
+            unlinkEntry(&channel->receivers, entries + i);
+            if (channel->buffered)
+                _SPOO_ATOMIC_ADD(&channel->recvWaiters, -1);
+        }
+    }
+}
+
+// Lock or unlock a sorted list of distinct channels
+//
+static void lockChannels(_SPOOchannel** channels, int count, int lock)
+{
+    int i;
+
+    for (i = 0;  i < count;  i++)
+    {
+        if (lock)
+            spooLockMutex(channels[i]->lock);
+        else
+            spooUnlockMutex(channels[count - i - 1]->lock);
+    }
+}
+
+// Sort the distinct channels of a select by address, which is the order
+// they are locked in
+//
+static int sortChannels(SPOOselectcase* cases, int count, _SPOOchannel** channels)
+{
+    int i, j, unique = 0;
+    _SPOOchannel* channel;
+
+    for (i = 0;  i < count;  i++)
+    {
+        channel = (_SPOOchannel*) cases[i].channel;
+
+        for (j = unique;  j > 0 && channels[j - 1] >= channel;  j--)
+        {
+            if (channels[j - 1] == channel)
+                break;
+        }
+
+        if (j > 0 && channels[j - 1] == channel)
+            continue;
+
+        memmove(channels + j + 1, channels + j, (unique - j) * sizeof(_SPOOchannel*));
+        channels[j] = channel;
+        unique++;
+    }
+
+    return unique;
+}
+
+// Wait for a waiter to be woken or the deadline to pass
+//
+static void waitForWaiter(_SPOOchannelwaiter* waiter, double timeout, double deadline)
+{
+    double remaining;
+
+    spooLockMutex(waiter->lock);
+
+    while (!waiter->woken)
+    {
+        if (timeout >= SPOO_INFINITY)
+            spooWaitCond(waiter->cond, waiter->lock, SPOO_INFINITY);
+        else
+        {
+            remaining = deadline - spooGetTime();
+            if (remaining <= 0.0)
+                break;
+
+            spooWaitCond(waiter->cond, waiter->lock, remaining);
+        }
+    }
+
+    spooUnlockMutex(waiter->lock);
+}
+
+// Complete one of a set of channel operations, waiting for at most the
+// specified time for one to become possible
+//
+static int selectCases(SPOOselectcase* cases, int count, double timeout)
+{
+    int i, state, unique, notified = -1, selected = -1;
+    double deadline = 0.0;
+    _SPOOchannelwaiter* waiter;
+    _SPOOchannelwaiter* wake = NULL;
+    _SPOOchannelentry staticEntries[STATIC_CASE_COUNT];
+    _SPOOchannel* staticChannels[STATIC_CASE_COUNT];
+    _SPOOchannelentry* entries = staticEntries;
+    _SPOOchannel** channels = staticChannels;
+
+    waiter = getWaiter();
+    if (!waiter)
+        return -1;
+
+    if (count > STATIC_CASE_COUNT)
+    {
+        entries = (_SPOOchannelentry*) malloc(count * sizeof(_SPOOchannelentry));
+        channels = (_SPOOchannel**) malloc(count * sizeof(_SPOOchannel*));
+
+        if (!entries || !channels)
+        {
+            free(entries);
+            free(channels);
+            return -1;
+        }
+    }
+
+    for (i = 0;  i < count;  i++)
+    {
+        entries[i].waiter = waiter;
+        entries[i].value = cases[i].value;
+        entries[i].index = i;
+        entries[i].linked = SPOO_FALSE;
+    }
+
+    if (timeout > 0.0 && timeout < SPOO_INFINITY)
+        deadline = spooGetTime() + timeout;
+
+    unique = sortChannels(cases, count, channels);
+    lockChannels(channels, unique, SPOO_TRUE);
+
+    for (;;)
+    {
+        _SPOO_ATOMIC_STORE(&waiter->state, 0);
+        waiter->woken = SPOO_FALSE;
+
+        // Register before checking, so that buffered operations completed
+        // without the lock either are seen here or see our entries
+        if (timeout > 0.0)
+            registerEntries(cases, entries, count);
+
+        for (i = 0;  i < count;  i++)
+        {
+            cases[i].result = attemptCase(cases + i, waiter, &wake);
+            if (cases[i].result != SPOO_CHANNEL_TIMEOUT)
+                break;
+        }
+
+        if (i < count || timeout <= 0.0)
+        {
+            if (timeout > 0.0)
+                unregisterEntries(cases, entries, count);
+
+            if (i < count)
+                selected = i;
+
+            break;
+        }
+
+        lockChannels(channels, unique, SPOO_FALSE);
+        waitForWaiter(waiter, timeout, deadline);
+        lockChannels(channels, unique, SPOO_TRUE);
+
+        unregisterEntries(cases, entries, count);
+
+        // Nobody can fire the waiter while we hold all its channel locks
+        state = (int) _SPOO_ATOMIC_LOAD(&waiter->state);
+        if (!state)
+            break;
+
+        // We timed out just as we fired, so wait for the wake to arrive
+        if (!waiter->woken)
+            waitForWaiter(waiter, SPOO_INFINITY, 0.0);
+
+        if (entries[state - 1].result != _SPOO_CHANNEL_RETRY)
+        {
+            selected = state - 1;
+            cases[selected].result = entries[selected].result;
+            break;
+        }
+
+        notified = state - 1;
+    }
+
+    lockChannels(channels, unique, SPOO_FALSE);
+
+    if (wake)
+        wakeWaiter(wake);
+
+    if (selected != -1)
+        notifyAfterCase(cases + selected);
+
+    // Pass on a wakeup we did not use to another waiter
+    if (notified != -1 && notified != selected)
+    {
+        _SPOOchannel* channel = (_SPOOchannel*) cases[notified].channel;
+
+        if (cases[notified].operation == SPOO_SELECT_SEND)
+            notifySender(channel);
+        else
+            notifyReceiver(channel);
+    }
+
+    if (entries != staticEntries)
+    {
+        free(entries);
+        free(channels);
+    }
+
+    return selected;
+}
+
+// Send or receive on a single channel
+//
+static int runSingleCase(SPOOchannel handle, int operation, void* value,
+                         double timeout)
+{
+    SPOOselectcase selectCase;
+    _SPOOchannel* channel = (_SPOOchannel*) handle;
+
+    // Buffered channels only need the lock to block
+    if (channel->buffered)
+    {
+        int result;
+
+        if (operation == SPOO_SELECT_SEND)
+            result = trySendBuffered(channel, value);
+        else
+            result = tryRecvBuffered(channel, value);
+
+        if (result == SPOO_CHANNEL_OK)
+        {
+            if (operation == SPOO_SELECT_SEND)
+                notifyReceiver(channel);
+            else
+                notifySender(channel);
+        }
+
+        if (result != SPOO_CHANNEL_TIMEOUT || timeout <= 0.0)
+            return result;
+    }
+
+    selectCase.channel = handle;
+    selectCase.operation = operation;
+    selectCase.value = value;
+
+    if (selectCases(&selectCase, 1, timeout) == -1)
+        return SPOO_CHANNEL_TIMEOUT;
+
+    return selectCase.result;
+}
+
+// Initialize channel support
+//
+int _spooInitChannels(void)
+{
+    _spoo.channelWaiterKey = _spooPlatformCreateTLSKey(destroyWaiter);
+    if (_spoo.channelWaiterKey == SPOO_INVALID_TLS_KEY)
+        return SPOO_FALSE;
+
+    return SPOO_TRUE;
+}
+
+// Terminate channel support
+//
+void _spooTerminateChannels(void)
+{
+    void* waiter = _spooPlatformGetTLS(_spoo.channelWaiterKey);
+    if (waiter)
+    {
+        _spooPlatformSetTLS(_spoo.channelWaiterKey, NULL);
+        destroyWaiter(waiter);
+    }
+
+    _spooPlatformDestroyTLSKey(_spoo.channelWaiterKey);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create a channel of elements of the specified size
+// Buffered channels round their capacity up to a power of two, while
+// unbuffered ones (capacity zero) hand each element directly to a receiver
+//
+SPOOchannel spooCreateChannel(size_t size, int capacity)
+{
+    long i;
+    unsigned long slotCount = 1;
+    _SPOOchannel* channel;
+
+    if (!_spooInitialized || !size || capacity < 0)
+        return NULL;
+
+    channel = (_SPOOchannel*) calloc(1, sizeof(_SPOOchannel));
+    if (!channel)
+        return NULL;
+
+    channel->size = size;
+    channel->buffered = capacity > 0;
+
+    if (channel->buffered)
+    {
+        while (slotCount < (unsigned long) capacity)
+            slotCount *= 2;
+
+        // Each slot is a sequence number followed by the element
+        channel->mask = slotCount - 1;
+        channel->stride = (sizeof(long) + size + sizeof(long) - 1) &
+                          ~(sizeof(long) - 1);
+
+        channel->slots = (unsigned char*) malloc(slotCount * channel->stride);
+        if (!channel->slots)
+        {
+            free(channel);
+            return NULL;
+        }
+
+        for (i = 0;  i < (long) slotCount;  i++)
+            *(long*) (channel->slots + i * channel->stride) = i;
+    }
+
+    channel->lock = spooCreateMutex();
+    if (!channel->lock)
+    {
+        free(channel->slots);
+        free(channel);
+        return NULL;
+    }
+
+    spooSetMutexName(channel->lock, "channel");
+
+    return (SPOOchannel) channel;
+}
+
+// Destroy a channel
+// NOTE: No thread may be using the channel
+//
+void spooDestroyChannel(SPOOchannel handle)
+{
+    _SPOOchannel* channel = (_SPOOchannel*) handle;
+
+    if (!_spooInitialized || !channel)
+        return;
+
+    spooDestroyMutex(channel->lock);
+    free(channel->slots);
+    free(channel);
+}
+
+// Close a channel, failing all later sends and waking all waiters
+// Receivers still get the elements buffered before the channel was closed
+//
+void spooCloseChannel(SPOOchannel handle)
+{
+    _SPOOchannelentry* entry;
+    _SPOOchannelentry* claimed = NULL;
+    _SPOOchannel* channel = (_SPOOchannel*) handle;
+
+    if (!_spooInitialized || !channel)
+        return;
+
+    spooLockMutex(channel->lock);
+
+    _SPOO_ATOMIC_STORE(&channel->closed, SPOO_TRUE);
+
+    // Buffered waiters retry and see the channel closed
+    while ((entry = claimEntry(&channel->senders, NULL)))
+    {
+        entry->result = channel->buffered ? _SPOO_CHANNEL_RETRY : SPOO_CHANNEL_CLOSED;
+        entry->next = claimed;
+        claimed = entry;
+    }
+
+    while ((entry = claimEntry(&channel->receivers, NULL)))
+    {
+        if (channel->buffered)
+            entry->result = _SPOO_CHANNEL_RETRY;
+        else
+        {
+            memset(entry->value, 0, channel->size);
+            entry->result = SPOO_CHANNEL_CLOSED;
+        }
+
+        entry->next = claimed;
+        claimed = entry;
+    }
+
+    spooUnlockMutex(channel->lock);
+
+    // Claimed entries stay valid until their waiters are woken
+    while (claimed)
+    {
+        entry = claimed;
+        claimed = entry->next;
+        wakeWaiter(entry->waiter);
+    }
+}
+
+// Send an element on a channel, waiting until it can be sent
+//
+int spooSendChannel(SPOOchannel channel, const void* value)
+{
+    if (!_spooInitialized || !channel || !value)
+        return SPOO_CHANNEL_CLOSED;
+
+    return runSingleCase(channel, SPOO_SELECT_SEND, (void*) value, SPOO_INFINITY);
+}
+
+// Send an element on a channel if that can be done without waiting
+//
+int spooTrySendChannel(SPOOchannel channel, const void* value)
+{
+    if (!_spooInitialized || !channel || !value)
+        return SPOO_CHANNEL_CLOSED;
+
+    return runSingleCase(channel, SPOO_SELECT_SEND, (void*) value, 0.0);
+}
+
+// Send an element on a channel, waiting at most the specified time
+//
+int spooTimedSendChannel(SPOOchannel channel, const void* value, double timeout)
+{
+    if (!_spooInitialized || !channel || !value)
+        return SPOO_CHANNEL_CLOSED;
+
+    return runSingleCase(channel, SPOO_SELECT_SEND, (void*) value, timeout);
+}
+
+// Receive an element from a channel, waiting until there is one
+//
+int spooRecvChannel(SPOOchannel channel, void* value)
+{
+    if (!_spooInitialized || !channel || !value)
+        return SPOO_CHANNEL_CLOSED;
+
+    return runSingleCase(channel, SPOO_SELECT_RECV, value, SPOO_INFINITY);
+}
+
+// Receive an element from a channel if there is one
+//
+int spooTryRecvChannel(SPOOchannel channel, void* value)
+{
+    if (!_spooInitialized || !channel || !value)
+        return SPOO_CHANNEL_CLOSED;
+
+    return runSingleCase(channel, SPOO_SELECT_RECV, value, 0.0);
+}
+
+// Receive an element from a channel, waiting at most the specified time
+//
+int spooTimedRecvChannel(SPOOchannel channel, void* value, double timeout)
+{
+    if (!_spooInitialized || !channel || !value)
+        return SPOO_CHANNEL_CLOSED;
+
+    return runSingleCase(channel, SPOO_SELECT_RECV, value, timeout);
+}
+
+// Complete whichever of a set of sends and receives can be done first,
+// waiting at most the specified time
+// Returns the index of the completed case, or -1 if none could be done in
+// time.  Cases are tried in order when several are ready.
+//
+int spooSelect(SPOOselectcase* cases, int count, double timeout)
+{
+    int i;
+
+    if (!_spooInitialized || !cases || count <= 0)
+        return -1;
+
+    for (i = 0;  i < count;  i++)
+    {
+        if (!cases[i].channel || !cases[i].value)
+            return -1;
+
+        if (cases[i].operation != SPOO_SELECT_SEND &&
+            cases[i].operation != SPOO_SELECT_RECV)
+        {
+            return -1;
+        }
+    }
+
+    return selectCases(cases, count, timeout);
+}
@@ -0,0 +1,209 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+
+
+// Number of times a waiter checks its request before yielding its CPU
+#define SPIN_COUNT 128
+
+// Maximum number of passes a combiner makes over the records
+#define COMBINE_PASSES 4
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Return the record of the calling thread in a combiner
+//
+static _SPOOcombinerrecord* getRecord(_SPOOcombiner* combiner)
+{
+    return (_SPOOcombinerrecord*) _spooGetRecord(_spoo.combinerKey, combiner,
+                                                 &combiner->records,
+                                                 sizeof(_SPOOcombinerrecord),
+                                                 NULL);
+}
+
+// Apply the published requests of all threads
+// The combiner mutex must be held by the caller
+//
+static void combine(_SPOOcombiner* combiner)
+{
+    int pass;
+    int applied;
+    void* request;
+    _SPOOrecord* record;
+
+    for (pass = 0;  pass < COMBINE_PASSES;  pass++)
+    {
+        applied = 0;
+
+        for (record = _SPOO_ATOMIC_LOAD(&combiner->records.head);  record;  record = record->next)
+        {
+            request = _SPOO_ATOMIC_LOAD(&((_SPOOcombinerrecord*) record)->request);
+            if (!request)
+                continue;
+
+            combiner->apply(request, combiner->arg);
+            applied++;
+
+            // The owner may return as soon as it sees the request cleared
+            _SPOO_ATOMIC_STORE(&((_SPOOcombinerrecord*) record)->request, NULL);
+        }
+
+        if (!applied)
+            break;
+    }
+}
+
+// Initialize flat combining support
+//
+int _spooInitCombiners(void)
+{
+    _spoo.combinerKey = _spooPlatformCreateTLSKey(NULL);
+    if (_spoo.combinerKey == SPOO_INVALID_TLS_KEY)
+        return SPOO_FALSE;
+
+    return SPOO_TRUE;
+}
+
+// Terminate flat combining support
+//
+void _spooTerminateCombiners(void)
+{
+    _spooLeaveCombiners();
+    _spooPlatformDestroyTLSKey(_spoo.combinerKey);
+}
+
+// Release the records of the calling thread so other threads can take them
+// over
+// This is called when a Spoo thread leaves runThread
+//
+void _spooLeaveCombiners(void)
+{
+    _spooLeaveRecords(_spoo.combinerKey, NULL, NULL);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create a flat combining object for a structure protected by a mutex
+// Whichever thread holds the mutex applies the requests of all threads
+// waiting for it, so the structure stays in the cache of one core.  The
+// mutex may still be locked directly to access the structure.
+//
+SPOOcombiner spooCreateCombiner(SPOOmutex mutex, SPOOapplyfun apply, void* arg)
+{
+    _SPOOcombiner* combiner;
+
+    if (!_spooInitialized || !mutex || !apply)
+        return NULL;
+
+    combiner = (_SPOOcombiner*) calloc(1, sizeof(_SPOOcombiner));
+    if (!combiner)
+        return NULL;
+
+    combiner->mutex = mutex;
+    combiner->apply = apply;
+    combiner->arg = arg;
+
+    return (SPOOcombiner) combiner;
+}
+
+// Destroy a flat combining object
+// NOTE: The mutex is not destroyed, and no thread may be using the combiner
+//
+void spooDestroyCombiner(SPOOcombiner handle)
+{
+    _SPOOcombiner* combiner = (_SPOOcombiner*) handle;
+
+    if (!_spooInitialized || !combiner)
+        return;
+
+    _spooReleaseRecords(&combiner->records, NULL, NULL);
+    free(combiner);
+}
+
+// Apply a request to the structure of a combiner, either directly or by
+// handing it to the thread currently holding the mutex
+// The request must not be NULL.  It has been applied when this returns.
+//
+void spooApplyCombiner(SPOOcombiner handle, void* request)
+{
+    int spins = 0;
+    _SPOOcombinerrecord* record;
+    _SPOOcombiner* combiner = (_SPOOcombiner*) handle;
+
+    if (!_spooInitialized || !combiner || !request)
+        return;
+
+    record = getRecord(combiner);
+    if (!record)
+    {
+        spooLockMutex(combiner->mutex);
+        combiner->apply(request, combiner->arg);
+        spooUnlockMutex(combiner->mutex);
+        return;
+    }
+
+    _SPOO_ATOMIC_STORE(&record->request, request);
+
+    // While another thread is combining it will likely apply our request,
+    // which is cheaper than queueing up for the mutex
+    while (_SPOO_ATOMIC_LOAD(&combiner->combining) &&
+           _SPOO_ATOMIC_LOAD(&record->request))
+    {
+        if (spins < SPIN_COUNT)
+        {
+            spins++;
+            _SPOO_CPU_RELAX();
+        }
+        else
+            _spooPlatformSleep(0.0);
+    }
+
+    if (!_SPOO_ATOMIC_LOAD(&record->request))
+        return;
+
+    spooLockMutex(combiner->mutex);
+
+    if (_SPOO_ATOMIC_LOAD(&record->request))
+    {
+        _SPOO_ATOMIC_STORE(&combiner->combining, SPOO_TRUE);
+        combine(combiner);
+        _SPOO_ATOMIC_STORE(&combiner->combining, SPOO_FALSE);
+    }
+
+    spooUnlockMutex(combiner->mutex);
+}
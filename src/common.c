@@ -29,13 +29,20 @@
 
 #include "internal.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 
+// States of by-value mutex and condition variable storage
+#define STORAGE_UNINITIALIZED 0
+#define STORAGE_INITIALIZING  1
+#define STORAGE_READY         2
+
+
 // The library initialization state
 //
-static int initialized = SPOO_FALSE;
+int _spooInitialized = SPOO_FALSE;
 
 // Library global state
 //
@@ -89,9 +96,413 @@ void _spooRemoveThread(_SPOOthread* thread)
     if (thread->next)
         thread->next->prev = thread->prev;
 
+    _spooTerminateThreadCancel(thread);
     free(thread);
 }
 
+// Call the destructors of any non-NULL thread-local values of the current
+// thread, repeating while destructors set new values (like POSIX does)
+//
+void _spooRunTLSDestructors(void)
+{
+    int i, key, called;
+    void* value;
+    SPOOtlsfun destructor;
+
+    for (i = 0;  i < _SPOO_TLS_DESTRUCTOR_ITERATIONS;  i++)
+    {
+        called = SPOO_FALSE;
+
+        for (key = 0;  key < SPOO_MAX_TLS_KEYS;  key++)
+        {
+            if (!_spoo.tlsKeys[key].used)
+                continue;
+
+            destructor = _spoo.tlsKeys[key].destructor;
+            if (!destructor)
+                continue;
+
+            value = _spooPlatformGetTLS(key);
+            if (!value)
+                continue;
+
+            _spooPlatformSetTLS(key, NULL);
+            destructor(value);
+            called = SPOO_TRUE;
+        }
+
+        if (!called)
+            break;
+    }
+}
+
+
+// Create the objects a thread is woken through when it is cancelled
+//
+int _spooInitThreadCancel(_SPOOthread* thread)
+{
+    thread->cancelRequested = SPOO_FALSE;
+    thread->waitCond = NULL;
+
+    thread->cancelLock = _spooPlatformCreateMutex();
+    thread->cancelCond = _spooPlatformCreateCond();
+
+    if (!thread->cancelLock || !thread->cancelCond)
+    {
+        _spooTerminateThreadCancel(thread);
+        return SPOO_FALSE;
+    }
+
+    return SPOO_TRUE;
+}
+
+// Destroy the cancellation objects of a thread
+//
+void _spooTerminateThreadCancel(_SPOOthread* thread)
+{
+    if (thread->cancelLock)
+        _spooPlatformDestroyMutex(thread->cancelLock);
+    if (thread->cancelCond)
+        _spooPlatformDestroyCond(thread->cancelCond);
+
+    thread->cancelLock = NULL;
+    thread->cancelCond = NULL;
+}
+
+// Request cancellation of a thread and wake it if it is sleeping or waiting
+// on a condition
+// The condition is raised without its mutex, which the caller may well be
+// holding.  Cancellable waits check for cancellation only once they are
+// waiting on the condition, so the broadcast cannot be missed.
+// NOTE: This must be called with the thread list locked
+//
+void _spooCancelThread(_SPOOthread* thread)
+{
+    _SPOO_ATOMIC_STORE(&thread->cancelRequested, SPOO_TRUE);
+
+    _spooPlatformLockMutex(thread->cancelLock);
+
+    _spooPlatformBroadcastCond(thread->cancelCond);
+
+    if (thread->waitCond)
+        _spooPlatformBroadcastCond(thread->waitCond);
+
+    _spooPlatformUnlockMutex(thread->cancelLock);
+}
+
+// Return the state of the calling thread, if it is a Spoo thread
+//
+static _SPOOthread* getCurrentThread(void)
+{
+    return (_SPOOthread*) _spooPlatformGetTLS(_spoo.threadKey);
+}
+
+// Record the condition the calling thread is about to wait on, so that a
+// cancellation request can wake it
+// Returns SPOO_FALSE if cancellation has already been requested
+//
+static int beginCancellableWait(_SPOOthread* thread, SPOOcond cond)
+{
+    int cancelled;
+
+    _spooPlatformLockMutex(thread->cancelLock);
+
+    cancelled = thread->cancelRequested;
+    if (!cancelled)
+        thread->waitCond = cond;
+
+    _spooPlatformUnlockMutex(thread->cancelLock);
+
+    return !cancelled;
+}
+
+// Forget the condition the calling thread waited on
+//
+static void endCancellableWait(_SPOOthread* thread)
+{
+    _spooPlatformLockMutex(thread->cancelLock);
+    thread->waitCond = NULL;
+    _spooPlatformUnlockMutex(thread->cancelLock);
+}
+
+// Sleep until the specified time has passed or cancellation is requested
+//
+static void sleepCancellable(_SPOOthread* thread, double time)
+{
+    double elapsed;
+    const double resolution = 1.0 / (double) _spooPlatformGetTimerFrequency();
+    const unsigned long long start = _spooPlatformGetTimerValue();
+
+    _spooPlatformLockMutex(thread->cancelLock);
+
+    while (!thread->cancelRequested)
+    {
+        elapsed = (double) (_spooPlatformGetTimerValue() - start) * resolution;
+        if (elapsed >= time)
+            break;
+
+        _spooPlatformWaitCond(thread->cancelCond, thread->cancelLock,
+                              time >= SPOO_INFINITY ? SPOO_INFINITY : time - elapsed);
+    }
+
+    _spooPlatformUnlockMutex(thread->cancelLock);
+}
+
+// Set up cancellation for the main thread
+//
+static int initCancellation(void)
+{
+    _spoo.threadKey = _spooPlatformCreateTLSKey(NULL);
+    if (_spoo.threadKey == SPOO_INVALID_TLS_KEY)
+        return SPOO_FALSE;
+
+    if (!_spooInitThreadCancel(&_spoo.first))
+    {
+        _spooPlatformDestroyTLSKey(_spoo.threadKey);
+        return SPOO_FALSE;
+    }
+
+    _spooPlatformSetTLS(_spoo.threadKey, &_spoo.first);
+    return SPOO_TRUE;
+}
+
+// Clean up cancellation for the main thread
+//
+static void terminateCancellation(void)
+{
+    _spooPlatformSetTLS(_spoo.threadKey, NULL);
+    _spooPlatformDestroyTLSKey(_spoo.threadKey);
+    _spooTerminateThreadCancel(&_spoo.first);
+}
+
+
+#if defined(_SPOO_MUTEX_PROFILING)
+
+// Create a platform mutex and add it to the list of profiled mutexes
+//
+static _SPOOprofiledmutex* createProfiledMutex(void)
+{
+    _SPOOprofiledmutex* profiled;
+
+    profiled = (_SPOOprofiledmutex*) calloc(1, sizeof(_SPOOprofiledmutex));
+    if (!profiled)
+        return NULL;
+
+    profiled->mutex = _spooPlatformCreateMutex();
+    if (!profiled->mutex)
+    {
+        free(profiled);
+        return NULL;
+    }
+
+    _spooPlatformLockMutex(_spoo.profiledLock);
+
+    profiled->next = _spoo.profiledMutexes;
+    if (profiled->next)
+        profiled->next->prev = profiled;
+    _spoo.profiledMutexes = profiled;
+
+    _spooPlatformUnlockMutex(_spoo.profiledLock);
+
+    return profiled;
+}
+
+// Remove a mutex from the list of profiled mutexes and destroy it
+//
+static void destroyProfiledMutex(_SPOOprofiledmutex* profiled)
+{
+    _spooPlatformLockMutex(_spoo.profiledLock);
+
+    if (profiled->prev)
+        profiled->prev->next = profiled->next;
+    else
+        _spoo.profiledMutexes = profiled->next;
+
+    if (profiled->next)
+        profiled->next->prev = profiled->prev;
+
+    _spooPlatformUnlockMutex(_spoo.profiledLock);
+
+    _spooPlatformDestroyMutex(profiled->mutex);
+    free(profiled);
+}
+
+// Lock a profiled mutex, recording whether we had to wait for it
+//
+static void lockProfiledMutex(_SPOOprofiledmutex* profiled)
+{
+    double start, wait;
+
+    if (_spooPlatformTryLockMutex(profiled->mutex))
+    {
+        profiled->lockTime = _spooPlatformGetTime();
+        profiled->acquisitions++;
+        return;
+    }
+
+    _SPOO_TRACE("spooLockMutex", _SPOO_TRACE_BEGIN);
+
+    start = _spooPlatformGetTime();
+    _spooPlatformLockMutex(profiled->mutex);
+    profiled->lockTime = _spooPlatformGetTime();
+
+    _SPOO_TRACE("spooLockMutex", _SPOO_TRACE_END);
+
+    wait = profiled->lockTime - start;
+
+    // The statistics are only modified while holding the mutex itself
+    profiled->acquisitions++;
+    profiled->contentions++;
+    profiled->totalWaitTime += wait;
+    if (wait > profiled->maxWaitTime)
+        profiled->maxWaitTime = wait;
+}
+
+// Record for how long a profiled mutex was held before it is released
+//
+static void releaseProfiledMutex(_SPOOprofiledmutex* profiled)
+{
+    double hold = _spooPlatformGetTime() - profiled->lockTime;
+
+    profiled->totalHoldTime += hold;
+    if (hold > profiled->maxHoldTime)
+        profiled->maxHoldTime = hold;
+}
+
+// Sort mutex statistics by decreasing contention
+//
+static int compareMutexStats(const void* first, const void* second)
+{
+    const SPOOmutexstats* a = (const SPOOmutexstats*) first;
+    const SPOOmutexstats* b = (const SPOOmutexstats*) second;
+
+    if (a->contentions != b->contentions)
+        return a->contentions > b->contentions ? -1 : 1;
+
+    if (a->totalWaitTime != b->totalWaitTime)
+        return a->totalWaitTime > b->totalWaitTime ? -1 : 1;
+
+    if (a->acquisitions != b->acquisitions)
+        return a->acquisitions > b->acquisitions ? -1 : 1;
+
+    return 0;
+}
+
+// Return a sorted snapshot of the statistics of all profiled mutexes
+// NOTE: The caller must free the returned array
+//
+static SPOOmutexstats* getSortedMutexStats(int* count)
+{
+    int i = 0;
+    SPOOmutexstats* stats;
+    _SPOOprofiledmutex* profiled;
+
+    _spooPlatformLockMutex(_spoo.profiledLock);
+
+    *count = 0;
+    for (profiled = _spoo.profiledMutexes;  profiled;  profiled = profiled->next)
+        (*count)++;
+
+    stats = (SPOOmutexstats*) calloc(*count ? *count : 1, sizeof(SPOOmutexstats));
+    if (!stats)
+    {
+        _spooPlatformUnlockMutex(_spoo.profiledLock);
+        *count = 0;
+        return NULL;
+    }
+
+    // NOTE: The values of mutexes currently in use may be slightly stale
+    for (profiled = _spoo.profiledMutexes;  profiled;  profiled = profiled->next)
+    {
+        stats[i].mutex         = (SPOOmutex) profiled;
+        stats[i].name          = profiled->name;
+        stats[i].acquisitions  = profiled->acquisitions;
+        stats[i].contentions   = profiled->contentions;
+        stats[i].totalWaitTime = profiled->totalWaitTime;
+        stats[i].maxWaitTime   = profiled->maxWaitTime;
+        stats[i].totalHoldTime = profiled->totalHoldTime;
+        stats[i].maxHoldTime   = profiled->maxHoldTime;
+        i++;
+    }
+
+    _spooPlatformUnlockMutex(_spoo.profiledLock);
+
+    qsort(stats, *count, sizeof(SPOOmutexstats), compareMutexStats);
+    return stats;
+}
+
+#else
+
+// Lock a mutex, recording a trace event if we have to wait for it
+//
+static void lockTracedMutex(SPOOmutex mutex)
+{
+    if (_spooPlatformTryLockMutex(mutex))
+        return;
+
+    _spooTraceEvent("spooLockMutex", _SPOO_TRACE_BEGIN);
+    _spooPlatformLockMutex(mutex);
+    _spooTraceEvent("spooLockMutex", _SPOO_TRACE_END);
+}
+
+#endif /*_SPOO_MUTEX_PROFILING*/
+
+
+// Return the platform mutex in by-value storage, initializing it on first
+// use
+//
+static SPOOmutex getStorageMutex(SPOOmutexstorage* mutex)
+{
+    if (_SPOO_ATOMIC_LOAD(&mutex->state) != STORAGE_READY)
+    {
+        if (_SPOO_ATOMIC_CAS(&mutex->state, STORAGE_UNINITIALIZED, STORAGE_INITIALIZING))
+        {
+            _spooPlatformInitMutexStorage(mutex->storage.data);
+            _SPOO_ATOMIC_STORE(&mutex->state, STORAGE_READY);
+        }
+        else
+        {
+            // Another thread got there first and is initializing it
+            while (_SPOO_ATOMIC_LOAD(&mutex->state) != STORAGE_READY)
+                _SPOO_CPU_RELAX();
+        }
+    }
+
+    return (SPOOmutex) mutex->storage.data;
+}
+
+// Return the platform condition variable in by-value storage, initializing
+// it on first use, or NULL if it could not be initialized
+//
+static SPOOcond getStorageCond(SPOOcondstorage* cond)
+{
+    long state;
+
+    for (;;)
+    {
+        state = _SPOO_ATOMIC_LOAD(&cond->state);
+        if (state == STORAGE_READY)
+            return (SPOOcond) cond->storage.data;
+
+        if (state == STORAGE_INITIALIZING)
+        {
+            _SPOO_CPU_RELAX();
+            continue;
+        }
+
+        if (!_SPOO_ATOMIC_CAS(&cond->state, STORAGE_UNINITIALIZED, STORAGE_INITIALIZING))
+            continue;
+
+        if (!_spooPlatformInitCondStorage(cond->storage.data))
+        {
+            _SPOO_ATOMIC_STORE(&cond->state, STORAGE_UNINITIALIZED);
+            return NULL;
+        }
+
+        _SPOO_ATOMIC_STORE(&cond->state, STORAGE_READY);
+    }
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 //////                      Spoo user functions                     //////
@@ -101,17 +512,136 @@ void _spooRemoveThread(_SPOOthread* thread)
 //
 int spooInit(void)
 {
-    if (initialized)
+    int key;
+    unsigned int generations[SPOO_MAX_TLS_KEYS];
+
+    if (_spooInitialized)
         return SPOO_TRUE;
 
+    // Threads keep the values they set before the library was terminated,
+    // so key generations must not start over or those values would match
+    for (key = 0;  key < SPOO_MAX_TLS_KEYS;  key++)
+        generations[key] = _spoo.tlsKeys[key].generation;
+
     memset(&_spoo, 0, sizeof(_spoo));
 
+    for (key = 0;  key < SPOO_MAX_TLS_KEYS;  key++)
+        _spoo.tlsKeys[key].generation = generations[key];
+
     if (!_spooPlatformInit())
         return SPOO_FALSE;
 
+    if (!initCancellation())
+    {
+        _spooPlatformTerminate();
+        return SPOO_FALSE;
+    }
+
+    if (!_spooInitTracing())
+    {
+        terminateCancellation();
+        _spooPlatformTerminate();
+        return SPOO_FALSE;
+    }
+
+    if (!_spooInitPools())
+    {
+        _spooTerminateTracing();
+        terminateCancellation();
+        _spooPlatformTerminate();
+        return SPOO_FALSE;
+    }
+
+    if (!_spooInitReactors())
+    {
+        _spooTerminatePools();
+        _spooTerminateTracing();
+        terminateCancellation();
+        _spooPlatformTerminate();
+        return SPOO_FALSE;
+    }
+
+    if (!_spooInitChannels())
+    {
+        _spooTerminateReactors();
+        _spooTerminatePools();
+        _spooTerminateTracing();
+        terminateCancellation();
+        _spooPlatformTerminate();
+        return SPOO_FALSE;
+    }
+
+    if (!_spooInitHazards())
+    {
+        _spooTerminateChannels();
+        _spooTerminateReactors();
+        _spooTerminatePools();
+        _spooTerminateTracing();
+        terminateCancellation();
+        _spooPlatformTerminate();
+        return SPOO_FALSE;
+    }
+
+    if (!_spooInitCombiners())
+    {
+        _spooTerminateHazards();
+        _spooTerminateChannels();
+        _spooTerminateReactors();
+        _spooTerminatePools();
+        _spooTerminateTracing();
+        terminateCancellation();
+        _spooPlatformTerminate();
+        return SPOO_FALSE;
+    }
+
+    if (!_spooInitCounters())
+    {
+        _spooTerminateCombiners();
+        _spooTerminateHazards();
+        _spooTerminateChannels();
+        _spooTerminateReactors();
+        _spooTerminatePools();
+        _spooTerminateTracing();
+        terminateCancellation();
+        _spooPlatformTerminate();
+        return SPOO_FALSE;
+    }
+
+    if (!_spooInitQueueMutexes())
+    {
+        _spooTerminateCounters();
+        _spooTerminateCombiners();
+        _spooTerminateHazards();
+        _spooTerminateChannels();
+        _spooTerminateReactors();
+        _spooTerminatePools();
+        _spooTerminateTracing();
+        terminateCancellation();
+        _spooPlatformTerminate();
+        return SPOO_FALSE;
+    }
+
+#if defined(_SPOO_MUTEX_PROFILING)
+    _spoo.profiledLock = _spooPlatformCreateMutex();
+    if (!_spoo.profiledLock)
+    {
+        _spooTerminateQueueMutexes();
+        _spooTerminateCounters();
+        _spooTerminateCombiners();
+        _spooTerminateHazards();
+        _spooTerminateChannels();
+        _spooTerminateReactors();
+        _spooTerminatePools();
+        _spooTerminateTracing();
+        terminateCancellation();
+        _spooPlatformTerminate();
+        return SPOO_FALSE;
+    }
+#endif /*_SPOO_MUTEX_PROFILING*/
+
     atexit(spooTerminate);
 
-    initialized = SPOO_TRUE;
+    _spooInitialized = SPOO_TRUE;
     return SPOO_TRUE;
 }
 
@@ -119,20 +649,50 @@ int spooInit(void)
 //
 void spooTerminate(void)
 {
-    if (!initialized)
+    if (!_spooInitialized)
         return;
 
+    // Reactor pollers block outside of Spoo, so they have to be stopped
+    // before their pools.  The default pool needs the library to wait for
+    // its workers.
+    _spooTerminateReactors();
+    _spooTerminatePools();
+
+    // Any other threads left running may still use the library, so they
+    // are asked to stop before anything else goes away.  Workers of other
+    // pools and of the fiber scheduler stop when asked.
+    _spooPlatformCancelAllThreads();
+
+    // The fiber workers have stopped, so this only frees the scheduler
+    spooStopFibers();
+
+    _spooTerminateChannels();
+    _spooTerminateHazards();
+    _spooTerminateCombiners();
+    _spooTerminateCounters();
+    _spooTerminateQueueMutexes();
+    terminateCancellation();
+
     if (!_spooPlatformTerminate())
         return;
 
-    initialized = SPOO_FALSE;
+#if defined(_SPOO_MUTEX_PROFILING)
+    while (_spoo.profiledMutexes)
+        destroyProfiledMutex(_spoo.profiledMutexes);
+
+    _spooPlatformDestroyMutex(_spoo.profiledLock);
+#endif /*_SPOO_MUTEX_PROFILING*/
+
+    _spooTerminateTracing();
+
+    _spooInitialized = SPOO_FALSE;
 }
 
 // Return timer value in seconds
 //
 double spooGetTime(void)
 {
-    if (!initialized)
+    if (!_spooInitialized)
         return 0.0;
 
     return _spooPlatformGetTime();
@@ -142,39 +702,85 @@ double spooGetTime(void)
 //
 void spooSetTime(double time)
 {
-    if (!initialized)
+    if (!_spooInitialized)
         return;
 
     _spooPlatformSetTime(time);
 }
 
+// Return the raw value of the high-resolution timer
+// This is cheaper than spooGetTime and does not lose precision over time
+//
+unsigned long long spooGetTimerValue(void)
+{
+    if (!_spooInitialized)
+        return 0;
+
+    return _spooPlatformGetTimerValue();
+}
+
+// Return the number of high-resolution timer ticks per second
+//
+unsigned long long spooGetTimerFrequency(void)
+{
+    if (!_spooInitialized)
+        return 0;
+
+    return _spooPlatformGetTimerFrequency();
+}
+
 // Create a new thread
 //
 SPOOthread spooCreateThread(SPOOthreadfun fun, void* arg)
 {
-    if (!initialized)
+    if (!_spooInitialized)
         return SPOO_INVALID_THREAD;
 
     return _spooPlatformCreateThread(fun, arg);
 }
 
+// Configure the cache of thread stacks
+// Stacks of exited threads are kept for new threads, up to the specified
+// number of them, sparing the mapping and page faults of fresh stacks.  A
+// zero stack size selects the default size, and a zero maximum disables the
+// cache.  Returns SPOO_FALSE where threads cannot be given cached stacks.
+//
+int spooSetThreadStackCache(size_t stackSize, int maxStacks, int flags)
+{
+    if (!_spooInitialized || maxStacks < 0)
+        return SPOO_FALSE;
+
+    return _spooPlatformSetThreadStackCache(stackSize, maxStacks, flags);
+}
+
 // Put the current thread to sleep for the specified amount of time
+// Spoo threads wake up early if cancellation of them is requested
 //
 void spooSleep(double time)
 {
-    if (!initialized)
+    _SPOOthread* thread;
+
+    if (!_spooInitialized)
         return;
 
-    _spooPlatformSleep(time);
+    _SPOO_TRACE("spooSleep", _SPOO_TRACE_BEGIN);
+
+    thread = getCurrentThread();
+    if (thread && time > 0.0)
+        sleepCancellable(thread, time);
+    else
+        _spooPlatformSleep(time);
+
+    _SPOO_TRACE("spooSleep", _SPOO_TRACE_END);
 }
 
-// Kill the specified thread
-// NOTE: This is a VERY DANGEROUS operation that should NOT BE USED except
-// in EXTREME SITUATIONS!
+// Request cancellation of the specified thread and wait for it to finish
+// NOTE: This only returns once the thread notices the request, either with
+// spooIsCancelRequested or by returning early from a sleep or wait
 //
 void spooDestroyThread(SPOOthread threadID)
 {
-    if (!initialized)
+    if (!_spooInitialized)
         return;
 
     // Is it a valid thread? (killing the main thread is not allowed)
@@ -184,17 +790,56 @@ void spooDestroyThread(SPOOthread threadID)
     _spooPlatformDestroyThread(threadID);
 }
 
+// Ask a thread to stop at its next cancellation check
+// Any spooSleep or spooWaitCond it is blocked in returns early, as will
+// all later ones.  Returns SPOO_FALSE if there is no such thread.
+//
+int spooRequestCancel(SPOOthread threadID)
+{
+    if (!_spooInitialized)
+        return SPOO_FALSE;
+
+    return _spooPlatformRequestCancel(threadID);
+}
+
+// Return SPOO_TRUE if cancellation of the calling thread has been requested
+//
+int spooIsCancelRequested(void)
+{
+    _SPOOthread* thread;
+
+    if (!_spooInitialized)
+        return SPOO_FALSE;
+
+    thread = getCurrentThread();
+    if (!thread)
+        return SPOO_FALSE;
+
+    return _SPOO_ATOMIC_LOAD(&thread->cancelRequested) != 0;
+}
+
 // Wait for a thread to die
 //
 int spooWaitThread(SPOOthread threadID, int waitmode)
 {
-    if (!initialized)
+    if (!_spooInitialized)
         return SPOO_TRUE;
 
     // Is it a valid thread? (waiting for the main thread is not allowed)
     if (threadID < 1)
         return SPOO_TRUE;
 
+    if (waitmode == SPOO_WAIT && _spoo.traceEnabled)
+    {
+        int result;
+
+        _spooTraceEvent("spooWaitThread", _SPOO_TRACE_BEGIN);
+        result = _spooPlatformWaitThread(threadID, waitmode);
+        _spooTraceEvent("spooWaitThread", _SPOO_TRACE_END);
+
+        return result;
+    }
+
     return _spooPlatformWaitThread(threadID, waitmode);
 }
 
@@ -202,7 +847,7 @@ int spooWaitThread(SPOOthread threadID, int waitmode)
 //
 SPOOthread spooGetThreadID(void)
 {
-    if (!initialized)
+    if (!_spooInitialized)
         return (SPOOthread) 0;
 
     return _spooPlatformGetThreadID();
@@ -212,47 +857,100 @@ SPOOthread spooGetThreadID(void)
 //
 SPOOmutex spooCreateMutex(void)
 {
-    if (!initialized)
+    if (!_spooInitialized)
         return (SPOOmutex) 0;
 
+#if defined(_SPOO_MUTEX_PROFILING)
+    return (SPOOmutex) createProfiledMutex();
+#else
     return _spooPlatformCreateMutex();
+#endif /*_SPOO_MUTEX_PROFILING*/
+}
+
+// Create a mutual exclusion object of the specified kind
+// Ticket and MCS locks hand the mutex to waiting threads in arrival order,
+// but are not profiled
+//
+SPOOmutex spooCreateMutexKind(int kind)
+{
+    if (!_spooInitialized)
+        return (SPOOmutex) 0;
+
+    if (kind == SPOO_MUTEX_TICKET || kind == SPOO_MUTEX_MCS)
+        return _spooCreateQueueMutex(kind);
+
+    return spooCreateMutex();
 }
 
 // Destroy a mutual exclusion object
 //
 void spooDestroyMutex(SPOOmutex mutex)
 {
-    if (!initialized || !mutex)
+    if (!_spooInitialized || !mutex)
         return;
 
+    if (_SPOO_IS_QUEUE_MUTEX(mutex))
+    {
+        _spooDestroyQueueMutex(_SPOO_GET_QUEUE_MUTEX(mutex));
+        return;
+    }
+
+#if defined(_SPOO_MUTEX_PROFILING)
+    destroyProfiledMutex((_SPOOprofiledmutex*) mutex);
+#else
     _spooPlatformDestroyMutex(mutex);
+#endif /*_SPOO_MUTEX_PROFILING*/
 }
 
 // Request access to a mutex
 //
 void spooLockMutex(SPOOmutex mutex)
 {
-    if (!initialized && !mutex)
+    if (!_spooInitialized && !mutex)
         return;
 
-    _spooPlatformLockMutex(mutex);
+    if (_SPOO_IS_QUEUE_MUTEX(mutex))
+    {
+        _spooLockQueueMutex(_SPOO_GET_QUEUE_MUTEX(mutex));
+        return;
+    }
+
+#if defined(_SPOO_MUTEX_PROFILING)
+    lockProfiledMutex((_SPOOprofiledmutex*) mutex);
+#else
+    if (_spoo.traceEnabled)
+        lockTracedMutex(mutex);
+    else
+        _spooPlatformLockMutex(mutex);
+#endif /*_SPOO_MUTEX_PROFILING*/
 }
 
 // Release a mutex
 //
 void spooUnlockMutex(SPOOmutex mutex)
 {
-    if (!initialized && !mutex)
+    if (!_spooInitialized && !mutex)
         return;
 
+    if (_SPOO_IS_QUEUE_MUTEX(mutex))
+    {
+        _spooUnlockQueueMutex(_SPOO_GET_QUEUE_MUTEX(mutex));
+        return;
+    }
+
+#if defined(_SPOO_MUTEX_PROFILING)
+    releaseProfiledMutex((_SPOOprofiledmutex*) mutex);
+    _spooPlatformUnlockMutex(((_SPOOprofiledmutex*) mutex)->mutex);
+#else
     _spooPlatformUnlockMutex(mutex);
+#endif /*_SPOO_MUTEX_PROFILING*/
 }
 
 // Create a new condition variable object
 //
 SPOOcond spooCreateCond(void)
 {
-    if (!initialized)
+    if (!_spooInitialized)
         return (SPOOcond) 0;
 
     return _spooPlatformCreateCond();
@@ -262,27 +960,70 @@ SPOOcond spooCreateCond(void)
 //
 void spooDestroyCond(SPOOcond cond)
 {
-    if (!initialized || !cond)
+    if (!_spooInitialized || !cond)
         return;
 
     _spooPlatformDestroyCond(cond);
 }
 
 // Wait for a condition to be raised
+// Spoo threads return early, with the mutex locked, if cancellation of them
+// is requested
 //
 void spooWaitCond(SPOOcond cond, SPOOmutex mutex, double timeout)
 {
-    if (!initialized || !cond || !mutex)
+    SPOOmutex platformMutex = mutex;
+    _SPOOthread* thread;
+    volatile long* cancelled = NULL;
+
+    if (!_spooInitialized || !cond || !mutex)
         return;
 
-    _spooPlatformWaitCond(cond, mutex, timeout);
+    if (_SPOO_IS_QUEUE_MUTEX(mutex))
+        platformMutex = _SPOO_GET_QUEUE_MUTEX(mutex)->mutex;
+#if defined(_SPOO_MUTEX_PROFILING)
+    else
+        platformMutex = ((_SPOOprofiledmutex*) mutex)->mutex;
+#endif /*_SPOO_MUTEX_PROFILING*/
+
+    thread = getCurrentThread();
+    if (thread)
+    {
+        if (!beginCancellableWait(thread, cond))
+            return;
+
+        cancelled = &thread->cancelRequested;
+    }
+
+    _SPOO_TRACE("spooWaitCond", _SPOO_TRACE_BEGIN);
+
+    if (_SPOO_IS_QUEUE_MUTEX(mutex))
+        _spooWaitQueueMutexCond(cond, _SPOO_GET_QUEUE_MUTEX(mutex), timeout, cancelled);
+    else
+    {
+#if defined(_SPOO_MUTEX_PROFILING)
+        _SPOOprofiledmutex* profiled = (_SPOOprofiledmutex*) mutex;
+
+        // The mutex is not held while waiting for the condition
+        releaseProfiledMutex(profiled);
+        _spooPlatformWaitCondCancellable(cond, platformMutex, timeout, cancelled);
+        profiled->lockTime = _spooPlatformGetTime();
+#else
+        _spooPlatformWaitCondCancellable(cond, platformMutex, timeout, cancelled);
+#endif /*_SPOO_MUTEX_PROFILING*/
+    }
+
+    _SPOO_TRACE("spooWaitCond", _SPOO_TRACE_END);
+
+    if (thread)
+        endCancellableWait(thread);
 }
 
 // Signal a condition to one waiting thread
 //
 void spooSignalCond(SPOOcond cond)
 {
-    if (!initialized || !cond)
+    if (!_spooInitialized || !cond)
         return;
 
     _spooPlatformSignalCond(cond);
@@ -292,21 +1033,326 @@ void spooSignalCond(SPOOcond cond)
 //
 void spooBroadcastCond(SPOOcond cond)
 {
-    if (!initialized || !cond)
+    if (!_spooInitialized || !cond)
         return;
 
     _spooPlatformBroadcastCond(cond);
 }
 
+// Initialize a by-value mutex
+// This may be done before spooInit, as may all use of by-value mutexes and
+// condition variables
+//
+void spooInitMutexStorage(SPOOmutexstorage* mutex)
+{
+    if (!mutex)
+        return;
+
+    _spooPlatformInitMutexStorage(mutex->storage.data);
+    mutex->state = STORAGE_READY;
+}
+
+// Deinitialize a by-value mutex
+// NOTE: The mutex must not be locked
+//
+void spooDeinitMutexStorage(SPOOmutexstorage* mutex)
+{
+    if (!mutex || mutex->state != STORAGE_READY)
+        return;
+
+    _spooPlatformDeinitMutexStorage((SPOOmutex) mutex->storage.data);
+    mutex->state = STORAGE_UNINITIALIZED;
+}
+
+// Request access to a by-value mutex
+//
+void spooLockMutexStorage(SPOOmutexstorage* mutex)
+{
+    if (!mutex)
+        return;
+
+    _spooPlatformLockMutex(getStorageMutex(mutex));
+}
+
+// Release a by-value mutex
+//
+void spooUnlockMutexStorage(SPOOmutexstorage* mutex)
+{
+    if (!mutex)
+        return;
+
+    _spooPlatformUnlockMutex((SPOOmutex) mutex->storage.data);
+}
+
+// Initialize a by-value condition variable
+//
+void spooInitCondStorage(SPOOcondstorage* cond)
+{
+    if (!cond)
+        return;
+
+    // If this fails it is tried again on first use
+    if (_spooPlatformInitCondStorage(cond->storage.data))
+        cond->state = STORAGE_READY;
+    else
+        cond->state = STORAGE_UNINITIALIZED;
+}
+
+// Deinitialize a by-value condition variable
+// NOTE: No thread may be waiting for the condition
+//
+void spooDeinitCondStorage(SPOOcondstorage* cond)
+{
+    if (!cond || cond->state != STORAGE_READY)
+        return;
+
+    _spooPlatformDeinitCondStorage((SPOOcond) cond->storage.data);
+    cond->state = STORAGE_UNINITIALIZED;
+}
+
+// Wait for a by-value condition to be raised
+// As with spooWaitCond, Spoo threads return early if cancellation of them is
+// requested
+//
+void spooWaitCondStorage(SPOOcondstorage* cond, SPOOmutexstorage* mutex, double timeout)
+{
+    SPOOcond platformCond;
+    SPOOmutex platformMutex;
+    _SPOOthread* thread = NULL;
+
+    if (!cond || !mutex)
+        return;
+
+    // A condition that cannot be initialized behaves as a spurious wakeup
+    platformCond = getStorageCond(cond);
+    if (!platformCond)
+        return;
+
+    platformMutex = (SPOOmutex) mutex->storage.data;
+
+    if (_spooInitialized)
+    {
+        thread = getCurrentThread();
+        if (thread && !beginCancellableWait(thread, platformCond))
+            return;
+    }
+
+    _spooPlatformWaitCondCancellable(platformCond, platformMutex, timeout,
+                                     thread ? &thread->cancelRequested : NULL);
+
+    if (thread)
+        endCancellableWait(thread);
+}
+
+// Signal a by-value condition to one waiting thread
+//
+void spooSignalCondStorage(SPOOcondstorage* cond)
+{
+    SPOOcond platformCond;
+
+    if (!cond)
+        return;
+
+    platformCond = getStorageCond(cond);
+    if (platformCond)
+        _spooPlatformSignalCond(platformCond);
+}
+
+// Broadcast a by-value condition to all waiting threads
+//
+void spooBroadcastCondStorage(SPOOcondstorage* cond)
+{
+    SPOOcond platformCond;
+
+    if (!cond)
+        return;
+
+    platformCond = getStorageCond(cond);
+    if (platformCond)
+        _spooPlatformBroadcastCond(platformCond);
+}
+
 // Return the number of CPU cores in the system
 // This information can be useful for determining the optimal number of
 // threads to use for performing certain tasks
 //
 int spooGetCPUCoreCount(void)
 {
-    if (!initialized)
+    if (!_spooInitialized)
         return 0;
 
     return _spooPlatformGetCPUCoreCount();
 }
 
+
+// Create a thread-local storage key
+// The destructor, if any, is called with the value of the key when a Spoo
+// thread with a non-NULL value exits
+//
+SPOOtlskey spooCreateTLSKey(SPOOtlsfun destructor)
+{
+    if (!_spooInitialized)
+        return SPOO_INVALID_TLS_KEY;
+
+    return _spooPlatformCreateTLSKey(destructor);
+}
+
+// Destroy a thread-local storage key
+// NOTE: No destructors are called for the values of the key
+//
+void spooDestroyTLSKey(SPOOtlskey key)
+{
+    if (!_spooInitialized || key < 0 || key >= SPOO_MAX_TLS_KEYS)
+        return;
+
+    _spooPlatformDestroyTLSKey(key);
+}
+
+// Set the value of a thread-local storage key for the current thread
+//
+void spooSetTLS(SPOOtlskey key, void* value)
+{
+    if (!_spooInitialized || key < 0 || key >= SPOO_MAX_TLS_KEYS)
+        return;
+
+    _spooPlatformSetTLS(key, value);
+}
+
+// Return the value of a thread-local storage key for the current thread
+//
+void* spooGetTLS(SPOOtlskey key)
+{
+    if (!_spooInitialized || key < 0 || key >= SPOO_MAX_TLS_KEYS)
+        return NULL;
+
+    return _spooPlatformGetTLS(key);
+}
+
+// Set the name used for a mutex in its contention statistics
+// NOTE: The string is not copied and must remain valid
+//
+void spooSetMutexName(SPOOmutex mutex, const char* name)
+{
+    if (!_spooInitialized || !mutex)
+        return;
+
+#if defined(_SPOO_MUTEX_PROFILING)
+    if (!_SPOO_IS_QUEUE_MUTEX(mutex))
+        ((_SPOOprofiledmutex*) mutex)->name = name;
+#endif /*_SPOO_MUTEX_PROFILING*/
+}
+
+// Retrieve the contention statistics of the most contended mutexes
+// Returns the total number of profiled mutexes, of which at most count are
+// written to the array, sorted by decreasing contention
+//
+int spooGetMutexStats(SPOOmutexstats* stats, int count)
+{
+#if defined(_SPOO_MUTEX_PROFILING)
+    int total;
+    SPOOmutexstats* sorted;
+
+    if (!_spooInitialized)
+        return 0;
+
+    sorted = getSortedMutexStats(&total);
+    if (!sorted)
+        return 0;
+
+    if (stats && count > 0)
+        memcpy(stats, sorted, (count < total ? count : total) * sizeof(SPOOmutexstats));
+
+    free(sorted);
+    return total;
+#else
+    return 0;
+#endif /*_SPOO_MUTEX_PROFILING*/
+}
+
+// Reset the contention statistics of all mutexes
+//
+void spooResetMutexStats(void)
+{
+#if defined(_SPOO_MUTEX_PROFILING)
+    _SPOOprofiledmutex* profiled;
+
+    if (!_spooInitialized)
+        return;
+
+    _spooPlatformLockMutex(_spoo.profiledLock);
+
+    for (profiled = _spoo.profiledMutexes;  profiled;  profiled = profiled->next)
+    {
+        profiled->acquisitions  = 0;
+        profiled->contentions   = 0;
+        profiled->totalWaitTime = 0.0;
+        profiled->maxWaitTime   = 0.0;
+        profiled->totalHoldTime = 0.0;
+        profiled->maxHoldTime   = 0.0;
+    }
+
+    _spooPlatformUnlockMutex(_spoo.profiledLock);
+#endif /*_SPOO_MUTEX_PROFILING*/
+}
+
+// Write the contention statistics of all mutexes as a table, sorted by
+// decreasing contention, to the specified file or to stderr if NULL
+//
+int spooDumpMutexStats(const char* filename)
+{
+#if defined(_SPOO_MUTEX_PROFILING)
+    int i, count;
+    FILE* file;
+    SPOOmutexstats* stats;
+
+    if (!_spooInitialized)
+        return SPOO_FALSE;
+
+    if (filename)
+    {
+        file = fopen(filename, "w");
+        if (!file)
+            return SPOO_FALSE;
+    }
+    else
+        file = stderr;
+
+    stats = getSortedMutexStats(&count);
+    if (!stats)
+    {
+        if (file != stderr)
+            fclose(file);
+
+        return SPOO_FALSE;
+    }
+
+    fprintf(file, "%-24s %12s %12s %12s %12s %12s %12s\n",
+            "mutex", "acquired", "contended",
+            "wait (ms)", "max wait", "hold (ms)", "max hold");
+
+    for (i = 0;  i < count;  i++)
+    {
+        if (stats[i].name)
+            fprintf(file, "%-24s", stats[i].name);
+        else
+            fprintf(file, "%-24p", stats[i].mutex);
+
+        fprintf(file, " %12lu %12lu %12.3f %12.3f %12.3f %12.3f\n",
+                stats[i].acquisitions,
+                stats[i].contentions,
+                stats[i].totalWaitTime * 1000.0,
+                stats[i].maxWaitTime * 1000.0,
+                stats[i].totalHoldTime * 1000.0,
+                stats[i].maxHoldTime * 1000.0);
+    }
+
+    free(stats);
+
+    if (file != stderr)
+        fclose(file);
+
+    return SPOO_TRUE;
+#else
+    return SPOO_FALSE;
+#endif /*_SPOO_MUTEX_PROFILING*/
+}
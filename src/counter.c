@@ -0,0 +1,210 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Return the shard index of the calling thread, which is its current CPU
+// Without a way to find the current CPU, each thread is given an index of
+// its own when it first asks for one
+//
+long _spooGetShardIndex(void)
+{
+    long index = _spooPlatformGetCurrentCPU();
+    if (index < 0)
+    {
+        // The index is stored plus one so zero means no index yet
+        index = (long) (size_t) _spooPlatformGetTLS(_spoo.counterShardKey) - 1;
+        if (index < 0)
+        {
+            index = _SPOO_ATOMIC_ADD(&_spoo.nextCounterShard, 1) - 1;
+            _spooPlatformSetTLS(_spoo.counterShardKey, (void*) (size_t) (index + 1));
+        }
+    }
+
+    return index;
+}
+
+// Initialize counter support
+//
+int _spooInitCounters(void)
+{
+    _spoo.counterShardKey = _spooPlatformCreateTLSKey(NULL);
+    if (_spoo.counterShardKey == SPOO_INVALID_TLS_KEY)
+        return SPOO_FALSE;
+
+    return SPOO_TRUE;
+}
+
+// Terminate counter support
+//
+void _spooTerminateCounters(void)
+{
+    _spooPlatformDestroyTLSKey(_spoo.counterShardKey);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create a sharded counter starting at zero
+// Sum counters add up every value added, which also makes them gauges when
+// values are negative, while max counters keep the largest value added
+//
+SPOOcounter spooCreateCounter(int kind)
+{
+    unsigned long shardCount = 1;
+    _SPOOcounter* counter;
+
+    if (!_spooInitialized)
+        return NULL;
+
+    if (kind != SPOO_COUNTER_SUM && kind != SPOO_COUNTER_MAX)
+        return NULL;
+
+    counter = (_SPOOcounter*) calloc(1, sizeof(_SPOOcounter));
+    if (!counter)
+        return NULL;
+
+    while (shardCount < (unsigned long) spooGetCPUCoreCount())
+        shardCount *= 2;
+
+    // Over-allocate by a cache line so the shards can be aligned to one
+    counter->allocation = calloc(shardCount + 1, sizeof(_SPOOcountershard));
+    if (!counter->allocation)
+    {
+        free(counter);
+        return NULL;
+    }
+
+    counter->kind = kind;
+    counter->shardMask = shardCount - 1;
+    counter->shards = (_SPOOcountershard*)
+        (((size_t) counter->allocation + _SPOO_CACHE_LINE_SIZE - 1) &
+         ~((size_t) _SPOO_CACHE_LINE_SIZE - 1));
+
+    return (SPOOcounter) counter;
+}
+
+// Destroy a sharded counter
+//
+void spooDestroyCounter(SPOOcounter handle)
+{
+    _SPOOcounter* counter = (_SPOOcounter*) handle;
+
+    if (!_spooInitialized || !counter)
+        return;
+
+    free(counter->allocation);
+    free(counter);
+}
+
+// Add a value to a sum counter, or raise a max counter to it
+// This only touches the shard of the current CPU
+//
+void spooAddCounter(SPOOcounter handle, long long value)
+{
+    long long current;
+    _SPOOcountershard* shard;
+    _SPOOcounter* counter = (_SPOOcounter*) handle;
+
+    if (!_spooInitialized || !counter)
+        return;
+
+    shard = counter->shards + (_spooGetShardIndex() & counter->shardMask);
+
+    if (counter->kind == SPOO_COUNTER_SUM)
+        _SPOO_ATOMIC_ADD64(&shard->value, value);
+    else
+    {
+        do
+        {
+            current = _SPOO_ATOMIC_LOAD(&shard->value);
+            if (current >= value)
+                break;
+        }
+        while (!_SPOO_ATOMIC_CAS64(&shard->value, current, value));
+    }
+}
+
+// Set the value of a counter
+// Values added while the counter is being set may be lost
+//
+void spooSetCounter(SPOOcounter handle, long long value)
+{
+    unsigned long i;
+    long long current;
+    _SPOOcounter* counter = (_SPOOcounter*) handle;
+
+    if (!_spooInitialized || !counter)
+        return;
+
+    for (i = 0;  i <= counter->shardMask;  i++)
+    {
+        // A sum is kept in the first shard, but every shard holds the max
+        do
+            current = _SPOO_ATOMIC_LOAD(&counter->shards[i].value);
+        while (!_SPOO_ATOMIC_CAS64(&counter->shards[i].value, current,
+                                   (i == 0 || counter->kind == SPOO_COUNTER_MAX) ?
+                                   value : 0));
+    }
+}
+
+// Return the value of a counter, combining all of its shards
+//
+long long spooGetCounter(SPOOcounter handle)
+{
+    unsigned long i;
+    long long value, result;
+    _SPOOcounter* counter = (_SPOOcounter*) handle;
+
+    if (!_spooInitialized || !counter)
+        return 0;
+
+    result = _SPOO_ATOMIC_LOAD(&counter->shards[0].value);
+
+    for (i = 1;  i <= counter->shardMask;  i++)
+    {
+        value = _SPOO_ATOMIC_LOAD(&counter->shards[i].value);
+
+        if (counter->kind == SPOO_COUNTER_SUM)
+            result += value;
+        else if (value > result)
+            result = value;
+    }
+
+    return result;
+}
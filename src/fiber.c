@@ -0,0 +1,868 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+// Default fiber stack size
+//
+#define DEFAULT_STACK_SIZE (64 * 1024)
+
+// Fiber states
+//
+#define FIBER_READY    0
+#define FIBER_RUNNING  1
+#define FIBER_BLOCKED  2
+#define FIBER_FINISHED 3
+
+// Fiber mutex states
+//
+#define MUTEX_UNLOCKED  0
+#define MUTEX_LOCKED    1
+#define MUTEX_CONTENDED 2
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Return the fiber worker state of the current thread, if any
+//
+static _SPOOfiberworker* getWorker(void)
+{
+    if (!_spoo.fibers.running)
+        return NULL;
+
+    return (_SPOOfiberworker*) _spooPlatformGetTLS(_spoo.fibers.workerKey);
+}
+
+// Return the currently running fiber, if any
+//
+static _SPOOfiber* getCurrentFiber(void)
+{
+    _SPOOfiberworker* worker = getWorker();
+    if (!worker)
+        return NULL;
+
+    return worker->current;
+}
+
+// Append a fiber to a queue
+//
+static void pushFiber(_SPOOfiberqueue* queue, _SPOOfiber* fiber)
+{
+    fiber->next = NULL;
+
+    if (queue->tail)
+        queue->tail->next = fiber;
+    else
+        queue->head = fiber;
+
+    queue->tail = fiber;
+}
+
+// Remove the first fiber of a queue
+//
+static _SPOOfiber* popFiber(_SPOOfiberqueue* queue)
+{
+    _SPOOfiber* fiber = queue->head;
+    if (!fiber)
+        return NULL;
+
+    queue->head = fiber->next;
+    if (!queue->head)
+        queue->tail = NULL;
+
+    fiber->next = NULL;
+    return fiber;
+}
+
+// Remove a specific fiber from a queue
+//
+static void removeFiber(_SPOOfiberqueue* queue, _SPOOfiber* fiber)
+{
+    _SPOOfiber* prev = NULL;
+    _SPOOfiber* node;
+
+    for (node = queue->head;  node;  prev = node, node = node->next)
+    {
+        if (node == fiber)
+        {
+            if (prev)
+                prev->next = node->next;
+            else
+                queue->head = node->next;
+
+            if (queue->tail == node)
+                queue->tail = prev;
+
+            node->next = NULL;
+            return;
+        }
+    }
+}
+
+// Swap two entries of the timer heap
+//
+static void swapTimers(int a, int b)
+{
+    _SPOOfiber* fiber = _spoo.fibers.timers[a];
+
+    _spoo.fibers.timers[a] = _spoo.fibers.timers[b];
+    _spoo.fibers.timers[a]->timerIndex = a;
+    _spoo.fibers.timers[b] = fiber;
+    fiber->timerIndex = b;
+}
+
+// Restore the heap property of the timer heap around the specified entry
+//
+static void fixTimer(int index)
+{
+    int child, parent;
+    _SPOOfiber** timers = _spoo.fibers.timers;
+
+    while (index > 0)
+    {
+        parent = (index - 1) / 2;
+        if (timers[parent]->wakeTime <= timers[index]->wakeTime)
+            break;
+
+        swapTimers(index, parent);
+        index = parent;
+    }
+
+    for (;;)
+    {
+        child = index * 2 + 1;
+        if (child >= _spoo.fibers.timerCount)
+            break;
+
+        if (child + 1 < _spoo.fibers.timerCount &&
+            timers[child + 1]->wakeTime < timers[child]->wakeTime)
+        {
+            child++;
+        }
+
+        if (timers[index]->wakeTime <= timers[child]->wakeTime)
+            break;
+
+        swapTimers(index, child);
+        index = child;
+    }
+}
+
+// Add a fiber to the timer heap
+//
+static int addTimer(_SPOOfiber* fiber, double time)
+{
+    _SPOOfiber** timers;
+
+    if (_spoo.fibers.timerCount == _spoo.fibers.timerCapacity)
+    {
+        int capacity = _spoo.fibers.timerCapacity * 2;
+        if (!capacity)
+            capacity = 64;
+
+        timers = (_SPOOfiber**) realloc(_spoo.fibers.timers,
+                                        capacity * sizeof(_SPOOfiber*));
+        if (!timers)
+            return SPOO_FALSE;
+
+        _spoo.fibers.timers = timers;
+        _spoo.fibers.timerCapacity = capacity;
+    }
+
+    fiber->wakeTime = _spooPlatformGetTime() + time;
+    fiber->timerIndex = _spoo.fibers.timerCount++;
+    _spoo.fibers.timers[fiber->timerIndex] = fiber;
+
+    fixTimer(fiber->timerIndex);
+    return SPOO_TRUE;
+}
+
+// Remove a fiber from the timer heap, if it is in it
+//
+static void removeTimer(_SPOOfiber* fiber)
+{
+    int index = fiber->timerIndex;
+    if (index < 0)
+        return;
+
+    fiber->timerIndex = -1;
+
+    _spoo.fibers.timerCount--;
+    if (index == _spoo.fibers.timerCount)
+        return;
+
+    _spoo.fibers.timers[index] = _spoo.fibers.timers[_spoo.fibers.timerCount];
+    _spoo.fibers.timers[index]->timerIndex = index;
+    fixTimer(index);
+}
+
+// Make a fiber runnable and wake a worker to run it
+//
+static void makeReady(_SPOOfiber* fiber)
+{
+    fiber->state = FIBER_READY;
+    pushFiber(&_spoo.fibers.ready, fiber);
+
+    spooSignalCond(_spoo.fibers.cond);
+}
+
+// Make any fibers whose timers have expired runnable, and return the time
+// until the next timer expires
+//
+static double fireTimers(void)
+{
+    double now;
+    _SPOOfiber* fiber;
+
+    if (!_spoo.fibers.timerCount)
+        return SPOO_INFINITY;
+
+    now = _spooPlatformGetTime();
+
+    while (_spoo.fibers.timerCount)
+    {
+        fiber = _spoo.fibers.timers[0];
+        if (fiber->wakeTime > now)
+            return fiber->wakeTime - now;
+
+        removeTimer(fiber);
+
+        // The fiber timed out while waiting on a condition
+        if (fiber->waitQueue)
+        {
+            removeFiber(fiber->waitQueue, fiber);
+            fiber->waitQueue = NULL;
+        }
+
+        makeReady(fiber);
+    }
+
+    return SPOO_INFINITY;
+}
+
+// Switch from the current fiber back to its worker
+// NOTE: The scheduler lock must be held, and is held again on return,
+// possibly on another worker thread
+//
+static void blockFiber(_SPOOfiber* fiber, int state)
+{
+    _SPOOfiberworker* worker = getWorker();
+
+    fiber->state = state;
+    _spooPlatformSwitchContext(&fiber->context, &worker->context);
+}
+
+// Release a fiber mutex, handing it to the first waiting fiber if any
+// NOTE: The scheduler lock must be held
+//
+static void releaseFiberMutex(_SPOOfibermutex* mutex)
+{
+    _SPOOfiber* waiter;
+
+    if (_SPOO_ATOMIC_CAS(&mutex->state, MUTEX_LOCKED, MUTEX_UNLOCKED))
+        return;
+
+    waiter = popFiber(&mutex->waiters);
+    if (!waiter)
+    {
+        _SPOO_ATOMIC_STORE(&mutex->state, MUTEX_UNLOCKED);
+        return;
+    }
+
+    // The waiter now owns the mutex
+    waiter->waitQueue = NULL;
+
+    if (mutex->waiters.head)
+        _SPOO_ATOMIC_STORE(&mutex->state, MUTEX_CONTENDED);
+    else
+        _SPOO_ATOMIC_STORE(&mutex->state, MUTEX_LOCKED);
+
+    makeReady(waiter);
+}
+
+// Mark a fiber as finished and wake anyone waiting for it
+// NOTE: The scheduler lock must be held
+//
+static void finishFiber(_SPOOfiber* fiber)
+{
+    fiber->state = FIBER_FINISHED;
+    _spoo.fibers.liveCount--;
+
+    if (fiber->joiner)
+    {
+        makeReady(fiber->joiner);
+        fiber->joiner = NULL;
+    }
+
+    spooBroadcastCond(_spoo.fibers.joinCond);
+
+    // Let the workers exit if this was the last fiber
+    if (_spoo.fibers.stopping && _spoo.fibers.liveCount == 0)
+        spooBroadcastCond(_spoo.fibers.cond);
+}
+
+// Run fiber functions for as long as the fiber object is reused
+//
+static void fiberEntry(void* arg)
+{
+    _SPOOfiber* fiber = (_SPOOfiber*) arg;
+
+    for (;;)
+    {
+        // Fibers are resumed with the scheduler lock held
+        spooUnlockMutex(_spoo.fibers.lock);
+
+        fiber->function(fiber->arg);
+
+        spooLockMutex(_spoo.fibers.lock);
+        finishFiber(fiber);
+
+        // This returns when the fiber object is reused for a new fiber
+        blockFiber(fiber, FIBER_FINISHED);
+    }
+}
+
+// Run fibers until the scheduler is stopped
+//
+static void workerMain(void* arg)
+{
+    double timeout;
+    _SPOOfiber* fiber;
+    _SPOOfiberworker* worker = (_SPOOfiberworker*) arg;
+
+    _spooPlatformSetTLS(_spoo.fibers.workerKey, worker);
+
+    if (!_spooPlatformInitThreadContext(&worker->context))
+        return;
+
+    spooLockMutex(_spoo.fibers.lock);
+
+    for (;;)
+    {
+        timeout = fireTimers();
+
+        fiber = popFiber(&_spoo.fibers.ready);
+        if (fiber)
+        {
+            worker->current = fiber;
+            fiber->state = FIBER_RUNNING;
+
+            _spooPlatformSwitchContext(&worker->context, &fiber->context);
+
+            worker->current = NULL;
+            continue;
+        }
+
+        if (_spoo.fibers.stopping && _spoo.fibers.liveCount == 0)
+            break;
+
+        // Waits return at once after cancellation, so stop instead of
+        // spinning, as spooTerminate does to a scheduler left running
+        if (spooIsCancelRequested())
+            break;
+
+        spooWaitCond(_spoo.fibers.cond, _spoo.fibers.lock, timeout);
+    }
+
+    spooUnlockMutex(_spoo.fibers.lock);
+
+    _spooPlatformTerminateThreadContext(&worker->context);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Start the fiber scheduler with the specified number of worker threads
+// (or one per CPU core if zero) and fiber stack size (or a default size if
+// zero)
+//
+int spooStartFibers(int threadCount, size_t stackSize)
+{
+    int i;
+
+    if (!_spooInitialized || _spoo.fibers.running)
+        return SPOO_FALSE;
+
+    if (threadCount <= 0)
+        threadCount = _spooPlatformGetCPUCoreCount();
+    if (threadCount < 1)
+        threadCount = 1;
+
+    if (stackSize == 0)
+        stackSize = DEFAULT_STACK_SIZE;
+
+    memset(&_spoo.fibers, 0, sizeof(_spoo.fibers));
+    _spoo.fibers.stackSize = stackSize;
+
+    _spoo.fibers.workerKey = _spooPlatformCreateTLSKey(NULL);
+    if (_spoo.fibers.workerKey == SPOO_INVALID_TLS_KEY)
+        return SPOO_FALSE;
+
+    _spoo.fibers.lock = spooCreateMutex();
+    _spoo.fibers.cond = spooCreateCond();
+    _spoo.fibers.joinCond = spooCreateCond();
+    _spoo.fibers.workers = (_SPOOfiberworker*) calloc(threadCount,
+                                                      sizeof(_SPOOfiberworker));
+
+    if (!_spoo.fibers.lock || !_spoo.fibers.cond ||
+        !_spoo.fibers.joinCond || !_spoo.fibers.workers)
+    {
+        spooDestroyMutex(_spoo.fibers.lock);
+        spooDestroyCond(_spoo.fibers.cond);
+        spooDestroyCond(_spoo.fibers.joinCond);
+        free(_spoo.fibers.workers);
+        _spooPlatformDestroyTLSKey(_spoo.fibers.workerKey);
+        return SPOO_FALSE;
+    }
+
+    spooSetMutexName(_spoo.fibers.lock, "fiber scheduler");
+
+    _spoo.fibers.running = SPOO_TRUE;
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        _spoo.fibers.workers[i].thread = spooCreateThread(workerMain,
+                                                          _spoo.fibers.workers + i);
+        if (_spoo.fibers.workers[i].thread == SPOO_INVALID_THREAD)
+            break;
+
+        _spoo.fibers.workerCount++;
+    }
+
+    if (_spoo.fibers.workerCount == 0)
+    {
+        spooStopFibers();
+        return SPOO_FALSE;
+    }
+
+    return SPOO_TRUE;
+}
+
+// Wait for all fibers to finish, then stop the fiber scheduler
+// NOTE: This must not be called from a fiber
+//
+void spooStopFibers(void)
+{
+    int i;
+    _SPOOfiber* fiber;
+
+    if (!_spooInitialized || !_spoo.fibers.running || getWorker())
+        return;
+
+    spooLockMutex(_spoo.fibers.lock);
+    _spoo.fibers.stopping = SPOO_TRUE;
+    spooBroadcastCond(_spoo.fibers.cond);
+    spooUnlockMutex(_spoo.fibers.lock);
+
+    for (i = 0;  i < _spoo.fibers.workerCount;  i++)
+        spooWaitThread(_spoo.fibers.workers[i].thread, SPOO_WAIT);
+
+    while (_spoo.fibers.all)
+    {
+        fiber = _spoo.fibers.all;
+        _spoo.fibers.all = fiber->allNext;
+
+        _spooPlatformDestroyContext(&fiber->context);
+        free(fiber);
+    }
+
+    spooDestroyCond(_spoo.fibers.joinCond);
+    spooDestroyCond(_spoo.fibers.cond);
+    spooDestroyMutex(_spoo.fibers.lock);
+    _spooPlatformDestroyTLSKey(_spoo.fibers.workerKey);
+
+    free(_spoo.fibers.workers);
+    free(_spoo.fibers.timers);
+
+    memset(&_spoo.fibers, 0, sizeof(_spoo.fibers));
+}
+
+// Create a new fiber and make it runnable
+// The fiber must be waited for with spooWaitFiber to be reused
+//
+SPOOfiber spooCreateFiber(SPOOthreadfun fun, void* arg)
+{
+    _SPOOfiber* fiber;
+
+    if (!_spooInitialized || !_spoo.fibers.running)
+        return NULL;
+
+    spooLockMutex(_spoo.fibers.lock);
+
+    // Reuse a finished fiber, which already has its stack and context
+    fiber = _spoo.fibers.unused;
+    if (fiber)
+        _spoo.fibers.unused = fiber->next;
+    else
+    {
+        fiber = (_SPOOfiber*) calloc(1, sizeof(_SPOOfiber));
+        if (!fiber)
+        {
+            spooUnlockMutex(_spoo.fibers.lock);
+            return NULL;
+        }
+
+        fiber->context.entry = fiberEntry;
+        fiber->context.arg = fiber;
+
+        if (!_spooPlatformCreateContext(&fiber->context, _spoo.fibers.stackSize))
+        {
+            spooUnlockMutex(_spoo.fibers.lock);
+            free(fiber);
+            return NULL;
+        }
+
+        fiber->allNext = _spoo.fibers.all;
+        _spoo.fibers.all = fiber;
+    }
+
+    fiber->function = fun;
+    fiber->arg = arg;
+    fiber->timerIndex = -1;
+    fiber->waitQueue = NULL;
+    fiber->joiner = NULL;
+
+    _spoo.fibers.liveCount++;
+    makeReady(fiber);
+
+    spooUnlockMutex(_spoo.fibers.lock);
+
+    return (SPOOfiber) fiber;
+}
+
+// Wait for a fiber to finish
+// This blocks only the calling fiber if called from a fiber
+//
+void spooWaitFiber(SPOOfiber handle)
+{
+    _SPOOfiber* fiber = (_SPOOfiber*) handle;
+    _SPOOfiber* current;
+
+    if (!_spooInitialized || !_spoo.fibers.running || !fiber)
+        return;
+
+    current = getCurrentFiber();
+
+    spooLockMutex(_spoo.fibers.lock);
+
+    while (fiber->state != FIBER_FINISHED)
+    {
+        if (current)
+        {
+            fiber->joiner = current;
+            blockFiber(current, FIBER_BLOCKED);
+        }
+        else
+            spooWaitCond(_spoo.fibers.joinCond, _spoo.fibers.lock, SPOO_INFINITY);
+    }
+
+    // The fiber object can now be reused
+    fiber->next = _spoo.fibers.unused;
+    _spoo.fibers.unused = fiber;
+
+    spooUnlockMutex(_spoo.fibers.lock);
+}
+
+// Return the currently running fiber, or NULL if not called from a fiber
+//
+SPOOfiber spooGetCurrentFiber(void)
+{
+    if (!_spooInitialized)
+        return NULL;
+
+    return (SPOOfiber) getCurrentFiber();
+}
+
+// Let other fibers run on this worker thread
+//
+void spooYieldFiber(void)
+{
+    _SPOOfiber* fiber;
+
+    if (!_spooInitialized)
+        return;
+
+    fiber = getCurrentFiber();
+    if (!fiber)
+    {
+        _spooPlatformSleep(0.0);
+        return;
+    }
+
+    spooLockMutex(_spoo.fibers.lock);
+
+    // Go to the back of the ready queue without waking another worker
+    fiber->state = FIBER_READY;
+    pushFiber(&_spoo.fibers.ready, fiber);
+    blockFiber(fiber, FIBER_READY);
+
+    spooUnlockMutex(_spoo.fibers.lock);
+}
+
+// Put the current fiber to sleep for the specified amount of time
+//
+void spooSleepFiber(double time)
+{
+    _SPOOfiber* fiber;
+
+    if (!_spooInitialized)
+        return;
+
+    fiber = getCurrentFiber();
+    if (!fiber)
+    {
+        spooSleep(time);
+        return;
+    }
+
+    if (time <= 0.0)
+    {
+        spooYieldFiber();
+        return;
+    }
+
+    spooLockMutex(_spoo.fibers.lock);
+
+    if (addTimer(fiber, time))
+        blockFiber(fiber, FIBER_BLOCKED);
+
+    spooUnlockMutex(_spoo.fibers.lock);
+}
+
+// Create a fiber-aware mutual exclusion object
+//
+SPOOfibermutex spooCreateFiberMutex(void)
+{
+    if (!_spooInitialized)
+        return NULL;
+
+    return (SPOOfibermutex) calloc(1, sizeof(_SPOOfibermutex));
+}
+
+// Destroy a fiber-aware mutual exclusion object
+//
+void spooDestroyFiberMutex(SPOOfibermutex mutex)
+{
+    if (!_spooInitialized)
+        return;
+
+    free(mutex);
+}
+
+// Request access to a fiber-aware mutex
+// This blocks only the calling fiber if called from a fiber
+//
+void spooLockFiberMutex(SPOOfibermutex handle)
+{
+    long state;
+    _SPOOfiber* fiber;
+    _SPOOfibermutex* mutex = (_SPOOfibermutex*) handle;
+
+    if (!_spooInitialized || !mutex)
+        return;
+
+    if (_SPOO_ATOMIC_CAS(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED))
+        return;
+
+    fiber = getCurrentFiber();
+    if (!fiber)
+    {
+        // Plain threads can only poll for the mutex
+        while (!_SPOO_ATOMIC_CAS(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED))
+            _spooPlatformSleep(0.0);
+
+        return;
+    }
+
+    spooLockMutex(_spoo.fibers.lock);
+
+    for (;;)
+    {
+        state = _SPOO_ATOMIC_LOAD(&mutex->state);
+
+        if (state == MUTEX_UNLOCKED)
+        {
+            if (_SPOO_ATOMIC_CAS(&mutex->state, MUTEX_UNLOCKED, MUTEX_LOCKED))
+                break;
+
+            continue;
+        }
+
+        // Mark the mutex as contended so that the owner hands it over to us
+        // through the scheduler when it is released
+        if (state == MUTEX_LOCKED &&
+            !_SPOO_ATOMIC_CAS(&mutex->state, MUTEX_LOCKED, MUTEX_CONTENDED))
+        {
+            continue;
+        }
+
+        pushFiber(&mutex->waiters, fiber);
+        fiber->waitQueue = &mutex->waiters;
+        blockFiber(fiber, FIBER_BLOCKED);
+
+        // The mutex was handed to us by releaseFiberMutex
+        break;
+    }
+
+    spooUnlockMutex(_spoo.fibers.lock);
+}
+
+// Release a fiber-aware mutex
+//
+void spooUnlockFiberMutex(SPOOfibermutex handle)
+{
+    _SPOOfibermutex* mutex = (_SPOOfibermutex*) handle;
+
+    if (!_spooInitialized || !mutex)
+        return;
+
+    if (_SPOO_ATOMIC_CAS(&mutex->state, MUTEX_LOCKED, MUTEX_UNLOCKED))
+        return;
+
+    spooLockMutex(_spoo.fibers.lock);
+    releaseFiberMutex(mutex);
+    spooUnlockMutex(_spoo.fibers.lock);
+}
+
+// Create a fiber-aware condition variable object
+//
+SPOOfibercond spooCreateFiberCond(void)
+{
+    if (!_spooInitialized)
+        return NULL;
+
+    return (SPOOfibercond) calloc(1, sizeof(_SPOOfibercond));
+}
+
+// Destroy a fiber-aware condition variable object
+//
+void spooDestroyFiberCond(SPOOfibercond cond)
+{
+    if (!_spooInitialized)
+        return;
+
+    free(cond);
+}
+
+// Wait for a fiber-aware condition to be raised
+// This blocks only the calling fiber if called from a fiber, while plain
+// threads only get a spurious wakeup after yielding
+//
+void spooWaitFiberCond(SPOOfibercond handle, SPOOfibermutex mutex, double timeout)
+{
+    _SPOOfiber* fiber;
+    _SPOOfibercond* cond = (_SPOOfibercond*) handle;
+
+    if (!_spooInitialized || !cond || !mutex)
+        return;
+
+    fiber = getCurrentFiber();
+    if (!fiber)
+    {
+        spooUnlockFiberMutex(mutex);
+        _spooPlatformSleep(0.0);
+        spooLockFiberMutex(mutex);
+        return;
+    }
+
+    spooLockMutex(_spoo.fibers.lock);
+
+    pushFiber(&cond->waiters, fiber);
+    fiber->waitQueue = &cond->waiters;
+
+    if (timeout < SPOO_INFINITY && !addTimer(fiber, timeout))
+    {
+        removeFiber(&cond->waiters, fiber);
+        fiber->waitQueue = NULL;
+        spooUnlockMutex(_spoo.fibers.lock);
+        return;
+    }
+
+    // Release the mutex while holding the scheduler lock, so that no signal
+    // can be missed
+    releaseFiberMutex((_SPOOfibermutex*) mutex);
+    blockFiber(fiber, FIBER_BLOCKED);
+
+    spooUnlockMutex(_spoo.fibers.lock);
+
+    spooLockFiberMutex(mutex);
+}
+
+// Signal a fiber-aware condition to one waiting fiber
+//
+void spooSignalFiberCond(SPOOfibercond handle)
+{
+    _SPOOfiber* fiber;
+    _SPOOfibercond* cond = (_SPOOfibercond*) handle;
+
+    if (!_spooInitialized || !cond)
+        return;
+
+    spooLockMutex(_spoo.fibers.lock);
+
+    fiber = popFiber(&cond->waiters);
+    if (fiber)
+    {
+        fiber->waitQueue = NULL;
+        removeTimer(fiber);
+        makeReady(fiber);
+    }
+
+    spooUnlockMutex(_spoo.fibers.lock);
+}
+
+// Broadcast a fiber-aware condition to all waiting fibers
+//
+void spooBroadcastFiberCond(SPOOfibercond handle)
+{
+    _SPOOfiber* fiber;
+    _SPOOfibercond* cond = (_SPOOfibercond*) handle;
+
+    if (!_spooInitialized || !cond)
+        return;
+
+    spooLockMutex(_spoo.fibers.lock);
+
+    while ((fiber = popFiber(&cond->waiters)))
+    {
+        fiber->waitQueue = NULL;
+        removeTimer(fiber);
+        makeReady(fiber);
+    }
+
+    spooUnlockMutex(_spoo.fibers.lock);
+}
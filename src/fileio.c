@@ -0,0 +1,589 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+
+#if defined(_SPOO_HAS_IO_URING)
+ #include <errno.h>
+ #include <stdint.h>
+ #include <string.h>
+ #include <unistd.h>
+ #include <linux/io_uring.h>
+ #include <sys/mman.h>
+ #include <sys/syscall.h>
+#endif
+
+
+// Default number of requests in flight
+#define DEFAULT_QUEUE_DEPTH 64
+
+// Maximum number of threads for blocking file I/O
+#define MAX_IO_THREADS 32
+
+// Largest transfer of an io_uring request, which is the most Linux moves in
+// one read or write and fits the result of a completion
+#define MAX_RING_TRANSFER 0x7ffff000
+
+// Request operations
+#define OPERATION_READ  1
+#define OPERATION_WRITE 2
+#define OPERATION_SYNC  3
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Call the callback of a completed request
+//
+static void runCallback(void* arg)
+{
+    SPOOfilerequest* request = (SPOOfilerequest*) arg;
+    _SPOOfileio* io = (_SPOOfileio*) request->service;
+
+    request->fun(request);
+
+    // The request may be gone now, but the service is still here
+    if (_SPOO_ATOMIC_ADD(&io->outstanding, -1) == 0)
+    {
+        spooLockMutex(io->lock);
+        spooBroadcastCond(io->cond);
+        spooUnlockMutex(io->lock);
+    }
+}
+
+// Hand a completed request to the pool for its callback
+//
+static void completeRequest(SPOOfilerequest* request, long result)
+{
+    _SPOOfileio* io = (_SPOOfileio*) request->service;
+
+    request->result = result;
+    request->task.fun = runCallback;
+    request->task.arg = request;
+
+    spooSubmitTask(io->pool, &request->task);
+}
+
+// Perform a request with blocking I/O
+// This runs as a task on the blocking I/O pool
+//
+static void runBlocking(void* arg)
+{
+    long result = 0;
+    SPOOfilerequest* request = (SPOOfilerequest*) arg;
+
+    switch (request->operation)
+    {
+        case OPERATION_READ:
+            result = _spooPlatformReadFile(request->fd, request->buffer,
+                                           request->size, request->offset);
+            break;
+        case OPERATION_WRITE:
+            result = _spooPlatformWriteFile(request->fd, request->buffer,
+                                            request->size, request->offset);
+            break;
+        case OPERATION_SYNC:
+            result = _spooPlatformSyncFile(request->fd);
+            break;
+    }
+
+    completeRequest(request, result);
+}
+
+#if defined(_SPOO_HAS_IO_URING)
+
+// The io_uring system calls, which the C library may not wrap
+//
+static int setupRing(unsigned int entries, struct io_uring_params* params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int enterRing(int fd, unsigned int submit, unsigned int complete,
+                     unsigned int flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, submit, complete, flags,
+                         NULL, 0);
+}
+
+// Unmap and close an io_uring instance
+//
+static void destroyRing(_SPOOuring* ring)
+{
+    if (ring->sqes)
+        munmap(ring->sqes, ring->sqesSize);
+    if (ring->cqRing && ring->cqRing != ring->sqRing)
+        munmap(ring->cqRing, ring->cqRingSize);
+    if (ring->sqRing)
+        munmap(ring->sqRing, ring->sqRingSize);
+
+    close(ring->fd);
+}
+
+// Create an io_uring instance and map its rings
+//
+static int createRing(_SPOOuring* ring, unsigned int entries)
+{
+    struct io_uring_params params;
+    char* sq;
+    char* cq;
+
+    memset(ring, 0, sizeof(_SPOOuring));
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = setupRing(entries, &params);
+    if (ring->fd < 0)
+        return SPOO_FALSE;
+
+    // Plain reads and writes need a kernel with this feature or later ones
+    if (!(params.features & IORING_FEAT_RW_CUR_POS))
+    {
+        close(ring->fd);
+        return SPOO_FALSE;
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (ring->cqRingSize > ring->sqRingSize)
+            ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    }
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sqRing == MAP_FAILED)
+    {
+        ring->sqRing = NULL;
+        destroyRing(ring);
+        return SPOO_FALSE;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+        ring->cqRing = ring->sqRing;
+    else
+    {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cqRing == MAP_FAILED)
+        {
+            ring->cqRing = NULL;
+            destroyRing(ring);
+            return SPOO_FALSE;
+        }
+    }
+
+    ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        destroyRing(ring);
+        return SPOO_FALSE;
+    }
+
+    sq = (char*) ring->sqRing;
+    cq = (char*) ring->cqRing;
+
+    ring->sqHead = (unsigned int*) (sq + params.sq_off.head);
+    ring->sqTail = (unsigned int*) (sq + params.sq_off.tail);
+    ring->sqArray = (unsigned int*) (sq + params.sq_off.array);
+    ring->sqMask = *(unsigned int*) (sq + params.sq_off.ring_mask);
+    ring->cqHead = (unsigned int*) (cq + params.cq_off.head);
+    ring->cqTail = (unsigned int*) (cq + params.cq_off.tail);
+    ring->cqMask = *(unsigned int*) (cq + params.cq_off.ring_mask);
+    ring->cqes = cq + params.cq_off.cqes;
+
+    return SPOO_TRUE;
+}
+
+// Add a submission queue entry for a request, or a no-op if it is NULL
+// NOTE: The service lock must be held and there must be room in the ring
+//
+static void pushEntry(_SPOOfileio* io, SPOOfilerequest* request)
+{
+    _SPOOuring* ring = &io->ring;
+    unsigned int tail = *ring->sqTail;
+    unsigned int index = tail & ring->sqMask;
+    struct io_uring_sqe* sqe = (struct io_uring_sqe*) ring->sqes + index;
+    unsigned int length;
+
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+    if (request)
+    {
+        // Larger requests complete short, as they would with pread or pwrite
+        if (request->size > MAX_RING_TRANSFER)
+            length = MAX_RING_TRANSFER;
+        else
+            length = (unsigned int) request->size;
+
+        sqe->fd = request->fd;
+
+        switch (request->operation)
+        {
+            case OPERATION_READ:
+                sqe->opcode = IORING_OP_READ;
+                sqe->addr = (uintptr_t) request->buffer;
+                sqe->len = length;
+                sqe->off = (unsigned long long) request->offset;
+                break;
+            case OPERATION_WRITE:
+                sqe->opcode = IORING_OP_WRITE;
+                sqe->addr = (uintptr_t) request->buffer;
+                sqe->len = length;
+                sqe->off = (unsigned long long) request->offset;
+                break;
+            case OPERATION_SYNC:
+                sqe->opcode = IORING_OP_FSYNC;
+                break;
+        }
+    }
+    else
+        sqe->opcode = IORING_OP_NOP;
+
+    sqe->user_data = (uintptr_t) request;
+    ring->sqArray[index] = index;
+
+    // The kernel must see the entry before the new tail
+    __atomic_store_n(ring->sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    io->queued++;
+    io->inflight++;
+}
+
+// Submit all queued entries to the kernel in one call
+// NOTE: The service lock must be held
+//
+static void flushEntries(_SPOOfileio* io)
+{
+    int result;
+
+    while (io->queued)
+    {
+        result = enterRing(io->ring.fd, io->queued, 0, 0);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // The completion thread retries once the kernel catches up
+            break;
+        }
+
+        io->queued -= result;
+    }
+}
+
+// Wait for completions and hand them to the pool, refilling the ring from
+// the backlog as it drains
+//
+static void completerMain(void* arg)
+{
+    unsigned int head, tail, count;
+    int stopping = SPOO_FALSE;
+    struct io_uring_cqe* cqe;
+    SPOOfilerequest* request;
+    _SPOOfileio* io = (_SPOOfileio*) arg;
+    _SPOOuring* ring = &io->ring;
+
+    while (!stopping)
+    {
+        if (enterRing(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0)
+        {
+            if (errno != EINTR)
+                break;
+        }
+
+        head = *ring->cqHead;
+        tail = __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE);
+        count = 0;
+
+        while (head != tail)
+        {
+            cqe = (struct io_uring_cqe*) ring->cqes + (head & ring->cqMask);
+            request = (SPOOfilerequest*) (uintptr_t) cqe->user_data;
+
+            // Only the no-op used for shutdown has no request
+            if (request)
+                completeRequest(request, cqe->res);
+            else
+                stopping = SPOO_TRUE;
+
+            head++;
+            count++;
+        }
+
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+
+        if (count)
+        {
+            spooLockMutex(io->lock);
+
+            io->inflight -= count;
+
+            while (io->backlogHead && io->inflight < ring->entries)
+            {
+                request = io->backlogHead;
+                io->backlogHead = (SPOOfilerequest*) request->task.arg;
+                if (!io->backlogHead)
+                    io->backlogTail = NULL;
+
+                pushEntry(io, request);
+            }
+
+            flushEntries(io);
+
+            spooUnlockMutex(io->lock);
+        }
+    }
+}
+
+#endif /*_SPOO_HAS_IO_URING*/
+
+// Start a request, either on the ring or on the blocking I/O pool
+//
+static void submitRequest(SPOOfileio handle, SPOOfilerequest* request, int operation)
+{
+    _SPOOfileio* io = (_SPOOfileio*) handle;
+
+    request->service = handle;
+    request->operation = operation;
+    request->result = 0;
+
+    _SPOO_ATOMIC_ADD(&io->outstanding, 1);
+
+#if defined(_SPOO_HAS_IO_URING)
+    if (io->useRing)
+    {
+        spooLockMutex(io->lock);
+
+        if (io->inflight < io->ring.entries)
+        {
+            pushEntry(io, request);
+
+            // Submit once the ring is full, even if the batch isn't done
+            if (io->queued == io->ring.entries)
+                flushEntries(io);
+        }
+        else
+        {
+            // Wait for room in the ring, linked through the unused task
+            request->task.arg = NULL;
+
+            if (io->backlogTail)
+                io->backlogTail->task.arg = request;
+            else
+                io->backlogHead = request;
+
+            io->backlogTail = request;
+        }
+
+        spooUnlockMutex(io->lock);
+        return;
+    }
+#endif /*_SPOO_HAS_IO_URING*/
+
+    request->task.fun = runBlocking;
+    request->task.arg = request;
+
+    spooSubmitTask(io->ioPool, &request->task);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create an asynchronous file I/O service calling its callbacks on a pool
+// It uses io_uring where available, unless blocking I/O threads were
+// requested, with at most the specified number of requests in flight
+//
+SPOOfileio spooCreateFileIO(SPOOpool pool, int queueDepth, int flags)
+{
+    _SPOOfileio* io;
+
+    if (!_spooInitialized)
+        return NULL;
+
+    if (queueDepth <= 0)
+        queueDepth = DEFAULT_QUEUE_DEPTH;
+
+    io = (_SPOOfileio*) calloc(1, sizeof(_SPOOfileio));
+    if (!io)
+        return NULL;
+
+    io->pool = pool;
+    io->lock = spooCreateMutex();
+    io->cond = spooCreateCond();
+
+    if (!io->lock || !io->cond)
+    {
+        spooDestroyCond(io->cond);
+        spooDestroyMutex(io->lock);
+        free(io);
+        return NULL;
+    }
+
+    spooSetMutexName(io->lock, "file I/O");
+
+#if defined(_SPOO_HAS_IO_URING)
+    if (!(flags & SPOO_FILE_IO_THREADS) && createRing(&io->ring, queueDepth))
+    {
+        io->completer = spooCreateThread(completerMain, io);
+        if (io->completer != SPOO_INVALID_THREAD)
+        {
+            io->useRing = SPOO_TRUE;
+            return (SPOOfileio) io;
+        }
+
+        destroyRing(&io->ring);
+    }
+#endif /*_SPOO_HAS_IO_URING*/
+
+    if (queueDepth > MAX_IO_THREADS)
+        queueDepth = MAX_IO_THREADS;
+
+    io->ioPool = spooCreatePool(queueDepth);
+    if (!io->ioPool)
+    {
+        spooDestroyCond(io->cond);
+        spooDestroyMutex(io->lock);
+        free(io);
+        return NULL;
+    }
+
+    return (SPOOfileio) io;
+}
+
+// Destroy an asynchronous file I/O service after all of its requests have
+// completed
+// NOTE: This must not be called from a callback
+//
+void spooDestroyFileIO(SPOOfileio handle)
+{
+    _SPOOfileio* io = (_SPOOfileio*) handle;
+
+    if (!_spooInitialized || !io)
+        return;
+
+    spooSubmitFileIO(handle);
+
+    spooLockMutex(io->lock);
+    while (_SPOO_ATOMIC_LOAD(&io->outstanding))
+        spooWaitCond(io->cond, io->lock, SPOO_INFINITY);
+    spooUnlockMutex(io->lock);
+
+#if defined(_SPOO_HAS_IO_URING)
+    if (io->useRing)
+    {
+        // Wake the completion thread with a no-op and let it exit
+        spooLockMutex(io->lock);
+        pushEntry(io, NULL);
+        flushEntries(io);
+        spooUnlockMutex(io->lock);
+
+        spooWaitThread(io->completer, SPOO_WAIT);
+        destroyRing(&io->ring);
+    }
+#endif /*_SPOO_HAS_IO_URING*/
+
+    spooDestroyPool(io->ioPool);
+    spooDestroyCond(io->cond);
+    spooDestroyMutex(io->lock);
+    free(io);
+}
+
+// Return whether requests are handled by the kernel rather than threads
+//
+int spooIsFileIOAsync(SPOOfileio handle)
+{
+    _SPOOfileio* io = (_SPOOfileio*) handle;
+
+    if (!_spooInitialized || !io)
+        return SPOO_FALSE;
+
+    return io->useRing;
+}
+
+// Queue a read of request->size bytes at request->offset into
+// request->buffer
+//
+void spooReadFile(SPOOfileio io, SPOOfilerequest* request)
+{
+    if (!_spooInitialized || !io || !request)
+        return;
+
+    submitRequest(io, request, OPERATION_READ);
+}
+
+// Queue a write of request->size bytes from request->buffer at
+// request->offset
+//
+void spooWriteFile(SPOOfileio io, SPOOfilerequest* request)
+{
+    if (!_spooInitialized || !io || !request)
+        return;
+
+    submitRequest(io, request, OPERATION_WRITE);
+}
+
+// Queue a flush of the data of a file to its storage device
+//
+void spooSyncFile(SPOOfileio io, SPOOfilerequest* request)
+{
+    if (!_spooInitialized || !io || !request)
+        return;
+
+    submitRequest(io, request, OPERATION_SYNC);
+}
+
+// Submit all queued requests to the kernel as one batch
+// Queued requests are only guaranteed to start after this is called
+//
+void spooSubmitFileIO(SPOOfileio handle)
+{
+    _SPOOfileio* io = (_SPOOfileio*) handle;
+
+    if (!_spooInitialized || !io || !io->useRing)
+        return;
+
+#if defined(_SPOO_HAS_IO_URING)
+    spooLockMutex(io->lock);
+    flushEntries(io);
+    spooUnlockMutex(io->lock);
+#endif /*_SPOO_HAS_IO_URING*/
+}
@@ -0,0 +1,331 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Grow a pointer array to hold at least one more element
+//
+static int growArray(void*** array, int count, int* capacity)
+{
+    void** elements;
+    int size;
+
+    if (count < *capacity)
+        return SPOO_TRUE;
+
+    size = *capacity * 2;
+    if (!size)
+        size = 4;
+
+    elements = (void**) realloc(*array, size * sizeof(void*));
+    if (!elements)
+        return SPOO_FALSE;
+
+    *array = elements;
+    *capacity = size;
+    return SPOO_TRUE;
+}
+
+// Check that the graph has no cycles, using Kahn's algorithm with the
+// dependency counters as scratch space
+//
+static int isAcyclic(_SPOOgraph* graph)
+{
+    int i, j, head = 0, tail = 0;
+    _SPOOgraphnode* node;
+    _SPOOgraphnode** order = graph->order;
+
+    for (i = 0;  i < graph->nodeCount;  i++)
+    {
+        node = graph->nodes[i];
+        node->remaining = node->predecessorCount;
+
+        if (!node->predecessorCount)
+            order[tail++] = node;
+    }
+
+    while (head < tail)
+    {
+        node = order[head++];
+
+        for (j = 0;  j < node->successorCount;  j++)
+        {
+            if (--node->successors[j]->remaining == 0)
+                order[tail++] = node->successors[j];
+        }
+    }
+
+    return tail == graph->nodeCount;
+}
+
+// Mark a node of a running graph as finished
+// The runner only returns once the last node has set the done flag, so the
+// graph stays valid until its lock is released here
+//
+static void finishNode(_SPOOgraph* graph)
+{
+    if (_SPOO_ATOMIC_ADD(&graph->remaining, -1))
+        return;
+
+    spooLockMutex(graph->lock);
+    graph->done = SPOO_TRUE;
+    spooBroadcastCond(graph->cond);
+    spooUnlockMutex(graph->lock);
+}
+
+// Run a graph node and release any successors it was the last input for
+// This runs as a pool task
+//
+static void runNode(void* arg)
+{
+    int i;
+    _SPOOgraphnode* next;
+    _SPOOgraphnode* node = (_SPOOgraphnode*) arg;
+    _SPOOgraph* graph = node->graph;
+
+    while (node)
+    {
+        node->function(node->arg);
+
+        // Run the first released successor directly instead of queueing it
+        next = NULL;
+
+        for (i = 0;  i < node->successorCount;  i++)
+        {
+            _SPOOgraphnode* successor = node->successors[i];
+
+            if (_SPOO_ATOMIC_ADD(&successor->remaining, -1))
+                continue;
+
+            if (next)
+                spooSubmitTask(graph->pool, &next->task);
+
+            next = successor;
+        }
+
+        finishNode(graph);
+        node = next;
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create an empty task graph running its tasks on a pool
+//
+SPOOgraph spooCreateGraph(SPOOpool pool)
+{
+    _SPOOgraph* graph;
+
+    if (!_spooInitialized)
+        return NULL;
+
+    graph = (_SPOOgraph*) calloc(1, sizeof(_SPOOgraph));
+    if (!graph)
+        return NULL;
+
+    graph->pool = pool;
+    graph->lock = spooCreateMutex();
+    graph->cond = spooCreateCond();
+
+    if (!graph->lock || !graph->cond)
+    {
+        spooDestroyCond(graph->cond);
+        spooDestroyMutex(graph->lock);
+        free(graph);
+        return NULL;
+    }
+
+    spooSetMutexName(graph->lock, "graph");
+
+    return (SPOOgraph) graph;
+}
+
+// Destroy a task graph and all of its nodes
+// NOTE: The graph must not be running
+//
+void spooDestroyGraph(SPOOgraph handle)
+{
+    int i;
+    _SPOOgraph* graph = (_SPOOgraph*) handle;
+
+    if (!_spooInitialized || !graph)
+        return;
+
+    for (i = 0;  i < graph->nodeCount;  i++)
+    {
+        free(graph->nodes[i]->successors);
+        free(graph->nodes[i]);
+    }
+
+    spooDestroyCond(graph->cond);
+    spooDestroyMutex(graph->lock);
+
+    free(graph->nodes);
+    free(graph->order);
+    free(graph);
+}
+
+// Add a task to a graph
+//
+SPOOgraphnode spooAddGraphNode(SPOOgraph handle, SPOOthreadfun fun, void* arg)
+{
+    _SPOOgraphnode* node;
+    _SPOOgraph* graph = (_SPOOgraph*) handle;
+
+    if (!_spooInitialized || !graph || !fun)
+        return NULL;
+
+    if (!growArray((void***) &graph->nodes, graph->nodeCount, &graph->nodeCapacity))
+        return NULL;
+
+    node = (_SPOOgraphnode*) calloc(1, sizeof(_SPOOgraphnode));
+    if (!node)
+        return NULL;
+
+    node->task.fun = runNode;
+    node->task.arg = node;
+    node->graph = graph;
+    node->function = fun;
+    node->arg = arg;
+
+    graph->nodes[graph->nodeCount++] = node;
+    graph->validated = SPOO_FALSE;
+
+    return (SPOOgraphnode) node;
+}
+
+// Make a graph node wait for another node to finish before it starts
+//
+int spooAddGraphEdge(SPOOgraphnode before, SPOOgraphnode after)
+{
+    _SPOOgraphnode* from = (_SPOOgraphnode*) before;
+    _SPOOgraphnode* to = (_SPOOgraphnode*) after;
+
+    if (!_spooInitialized || !from || !to || from->graph != to->graph)
+        return SPOO_FALSE;
+
+    if (!growArray((void***) &from->successors, from->successorCount,
+                   &from->successorCapacity))
+    {
+        return SPOO_FALSE;
+    }
+
+    from->successors[from->successorCount++] = to;
+    to->predecessorCount++;
+
+    from->graph->validated = SPOO_FALSE;
+    return SPOO_TRUE;
+}
+
+// Run all tasks of a graph, each as soon as its predecessors are done, and
+// wait for them to finish, helping the pool meanwhile
+// The graph can be run any number of times.  Returns SPOO_FALSE if the
+// graph has a cycle.
+//
+int spooRunGraph(SPOOgraph handle)
+{
+    int i;
+    _SPOOgraphnode* node;
+    _SPOOgraph* graph = (_SPOOgraph*) handle;
+
+    if (!_spooInitialized || !graph)
+        return SPOO_FALSE;
+
+    if (!graph->nodeCount)
+        return SPOO_TRUE;
+
+    // Only check for cycles after the graph has changed
+    if (!graph->validated)
+    {
+        if (graph->orderCapacity < graph->nodeCount)
+        {
+            _SPOOgraphnode** order;
+
+            order = (_SPOOgraphnode**) realloc(graph->order,
+                                               graph->nodeCount * sizeof(_SPOOgraphnode*));
+            if (!order)
+                return SPOO_FALSE;
+
+            graph->order = order;
+            graph->orderCapacity = graph->nodeCount;
+        }
+
+        if (!isAcyclic(graph))
+            return SPOO_FALSE;
+
+        graph->validated = SPOO_TRUE;
+    }
+
+    for (i = 0;  i < graph->nodeCount;  i++)
+    {
+        node = graph->nodes[i];
+        node->remaining = node->predecessorCount;
+    }
+
+    graph->done = SPOO_FALSE;
+    _SPOO_ATOMIC_STORE(&graph->remaining, graph->nodeCount);
+
+    // Release the roots
+    for (i = 0;  i < graph->nodeCount;  i++)
+    {
+        node = graph->nodes[i];
+        if (!node->predecessorCount)
+            spooSubmitTask(graph->pool, &node->task);
+    }
+
+    while (_SPOO_ATOMIC_LOAD(&graph->remaining))
+    {
+        if (spooRunPoolTask(graph->pool))
+            continue;
+
+        spooLockMutex(graph->lock);
+        if (!graph->done)
+            spooWaitCond(graph->cond, graph->lock, SPOO_INFINITY);
+        spooUnlockMutex(graph->lock);
+    }
+
+    // The last node to finish may still be signalling, so wait until it is
+    // done with the graph
+    spooLockMutex(graph->lock);
+    while (!graph->done)
+        spooWaitCond(graph->cond, graph->lock, SPOO_INFINITY);
+    spooUnlockMutex(graph->lock);
+
+    return SPOO_TRUE;
+}
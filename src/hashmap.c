@@ -0,0 +1,607 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+// Number of buckets per stripe in a new map
+#define INITIAL_STRIPE_BUCKETS 4
+
+// Average number of entries per bucket before the table is doubled
+#define LOAD_FACTOR 2
+
+// Number of old buckets each write moves while the table is being doubled
+#define MIGRATE_BATCH 4
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Return the key stored in a node
+//
+static unsigned char* getNodeKey(_SPOOhashnode* node)
+{
+    return (unsigned char*) (node + 1);
+}
+
+// Return the value stored in a node
+//
+static unsigned char* getNodeValue(_SPOOhashmap* map, _SPOOhashnode* node)
+{
+    return getNodeKey(node) + ((map->keySize + sizeof(void*) - 1) & ~(sizeof(void*) - 1));
+}
+
+// Return the size of a node with its key and value
+//
+static size_t getNodeSize(_SPOOhashmap* map)
+{
+    return sizeof(_SPOOhashnode) +
+           ((map->keySize + sizeof(void*) - 1) & ~(sizeof(void*) - 1)) +
+           map->valueSize;
+}
+
+// Hash a key with the user function or FNV-1a over its bytes
+//
+static size_t hashKey(_SPOOhashmap* map, const void* key)
+{
+    size_t i;
+    unsigned long long hash = 14695981039346656037ull;
+
+    if (map->hash)
+        return map->hash(key, map->arg);
+
+    for (i = 0;  i < map->keySize;  i++)
+    {
+        hash ^= ((const unsigned char*) key)[i];
+        hash *= 1099511628211ull;
+    }
+
+    // Fold the upper bits into the ones used for bucket indices
+    return (size_t) (hash ^ (hash >> 32));
+}
+
+// Compare two keys with the user function or by their bytes
+//
+static int keysEqual(_SPOOhashmap* map, const void* a, const void* b)
+{
+    if (map->equal)
+        return map->equal(a, b, map->arg);
+
+    return memcmp(a, b, map->keySize) == 0;
+}
+
+// Create an empty table with the specified number of buckets
+//
+static _SPOOhashtable* createTable(unsigned long size)
+{
+    _SPOOhashtable* table;
+
+    table = (_SPOOhashtable*) calloc(1, sizeof(_SPOOhashtable));
+    if (!table)
+        return NULL;
+
+    table->buckets = (_SPOOhashnode* volatile*) calloc(size, sizeof(_SPOOhashnode*));
+    if (!table->buckets)
+    {
+        free(table);
+        return NULL;
+    }
+
+    table->mask = size - 1;
+    return table;
+}
+
+// Free a table, but not its nodes
+//
+static void freeTable(_SPOOhashtable* table)
+{
+    free((void*) table->migrated);
+    free((void*) table->buckets);
+    free(table);
+}
+
+// Free all nodes of a chain
+//
+static void freeNodes(_SPOOhashnode* node)
+{
+    _SPOOhashnode* next;
+
+    while (node)
+    {
+        next = node->next;
+        free(node);
+        node = next;
+    }
+}
+
+// Move the nodes of an old bucket into the table replacing it
+// This is called with the stripe of the bucket locked.  Returns SPOO_TRUE
+// if this was the last bucket to move.
+//
+static int migrateBucket(_SPOOhashstripe* stripe, _SPOOhashtable* table,
+                         _SPOOhashtable* old, unsigned long index)
+{
+    _SPOOhashnode* node;
+    _SPOOhashnode* next;
+    _SPOOhashnode* volatile* target;
+
+    _SPOO_ATOMIC_ADD(&stripe->sequence, 1);
+
+    for (node = old->buckets[index];  node;  node = next)
+    {
+        next = node->next;
+        target = table->buckets + (node->hash & table->mask);
+
+        node->next = *target;
+        _SPOO_ATOMIC_STORE(target, node);
+    }
+
+    old->buckets[index] = NULL;
+    _SPOO_ATOMIC_STORE(old->migrated + index, 1);
+
+    _SPOO_ATOMIC_ADD(&stripe->sequence, 1);
+
+    return _SPOO_ATOMIC_ADD(&table->migratedCount, 1) == (long) old->mask + 1;
+}
+
+// Retire the old table once all of its buckets have moved
+//
+static void finishResize(_SPOOhashmap* map, _SPOOhashtable* table)
+{
+    _SPOOhashtable* old;
+
+    spooLockMutex(map->resizeLock);
+
+    old = table->old;
+    if (old)
+    {
+        // Readers may still be looking at it, so it is kept until the end
+        _SPOO_ATOMIC_STORE(&table->old, NULL);
+        old->retired = map->retired;
+        map->retired = old;
+    }
+
+    spooUnlockMutex(map->resizeLock);
+}
+
+// Start doubling a table, unless another thread already has
+//
+static void startResize(_SPOOhashmap* map, _SPOOhashtable* table)
+{
+    _SPOOhashtable* larger;
+
+    spooLockMutex(map->resizeLock);
+
+    if (_SPOO_ATOMIC_LOAD(&map->table) == table && !table->old)
+    {
+        larger = createTable((table->mask + 1) * 2);
+        if (larger)
+        {
+            table->migrated = (volatile long*) calloc(table->mask + 1, sizeof(long));
+            if (table->migrated)
+            {
+                larger->old = table;
+                _SPOO_ATOMIC_STORE(&map->table, larger);
+            }
+            else
+                freeTable(larger);
+        }
+    }
+
+    spooUnlockMutex(map->resizeLock);
+}
+
+// Move a few old buckets while the table is being doubled
+// This is called after every write, with no stripe locked
+//
+static void helpResize(_SPOOhashmap* map)
+{
+    int i, last;
+    long index;
+    _SPOOhashstripe* stripe;
+    _SPOOhashtable* table = _SPOO_ATOMIC_LOAD(&map->table);
+    _SPOOhashtable* old = _SPOO_ATOMIC_LOAD(&table->old);
+
+    if (!old)
+        return;
+
+    for (i = 0;  i < MIGRATE_BATCH;  i++)
+    {
+        index = _SPOO_ATOMIC_ADD(&table->migrateCursor, 1) - 1;
+        if (index > (long) old->mask)
+            break;
+
+        stripe = map->stripes + (index & map->stripeMask);
+        last = SPOO_FALSE;
+
+        spooLockMutex(stripe->lock);
+        if (!old->migrated[index])
+            last = migrateBucket(stripe, table, old, index);
+        spooUnlockMutex(stripe->lock);
+
+        if (last)
+            finishResize(map, table);
+    }
+}
+
+// Return the bucket of a hash for a writer, first moving the old bucket
+// it comes from if the table is being doubled
+// This is called with the stripe of the hash locked
+//
+static _SPOOhashnode* volatile* getWriteBucket(_SPOOhashstripe* stripe,
+                                               _SPOOhashtable* table,
+                                               size_t hash, int* last)
+{
+    unsigned long index;
+    _SPOOhashtable* old = table->old;
+
+    *last = SPOO_FALSE;
+
+    if (old)
+    {
+        index = hash & old->mask;
+        if (!old->migrated[index])
+            *last = migrateBucket(stripe, table, old, index);
+    }
+
+    return table->buckets + (hash & table->mask);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create a concurrent hash map storing copies of fixed size keys and values
+// Without a hash or equal function keys are hashed and compared by bytes.
+// Lookups may call the functions on keys that are being changed, so they
+// must not follow pointers that may have been freed.
+//
+SPOOhashmap spooCreateHashMap(size_t keySize, size_t valueSize,
+                              SPOOhashfun hash, SPOOequalfun equal, void* arg)
+{
+    unsigned long i, stripeCount = 16;
+    _SPOOhashmap* map;
+
+    if (!_spooInitialized || !keySize)
+        return NULL;
+
+    map = (_SPOOhashmap*) calloc(1, sizeof(_SPOOhashmap));
+    if (!map)
+        return NULL;
+
+    map->keySize = keySize;
+    map->valueSize = valueSize;
+    map->hash = hash;
+    map->equal = equal;
+    map->arg = arg;
+
+    // Enough stripes that writers on different cores rarely collide
+    while (stripeCount < (unsigned long) spooGetCPUCoreCount() * 4)
+        stripeCount *= 2;
+
+    map->stripeMask = stripeCount - 1;
+    map->stripes = (_SPOOhashstripe*) calloc(stripeCount, sizeof(_SPOOhashstripe));
+    map->table = createTable(stripeCount * INITIAL_STRIPE_BUCKETS);
+    map->resizeLock = spooCreateMutex();
+
+    if (!map->stripes || !map->table || !map->resizeLock)
+    {
+        spooDestroyMutex(map->resizeLock);
+        if (map->table)
+            freeTable(map->table);
+        free(map->stripes);
+        free(map);
+        return NULL;
+    }
+
+    spooSetMutexName(map->resizeLock, "hash map resize");
+
+    for (i = 0;  i < stripeCount;  i++)
+    {
+        map->stripes[i].lock = spooCreateMutex();
+        if (!map->stripes[i].lock)
+        {
+            spooDestroyHashMap((SPOOhashmap) map);
+            return NULL;
+        }
+
+        spooSetMutexName(map->stripes[i].lock, "hash map stripe");
+    }
+
+    return (SPOOhashmap) map;
+}
+
+// Destroy a hash map
+// NOTE: No thread may be using the map
+//
+void spooDestroyHashMap(SPOOhashmap handle)
+{
+    unsigned long i;
+    _SPOOhashtable* table;
+    _SPOOhashmap* map = (_SPOOhashmap*) handle;
+
+    if (!_spooInitialized || !map)
+        return;
+
+    table = map->table;
+
+    for (i = 0;  i <= table->mask;  i++)
+        freeNodes(table->buckets[i]);
+
+    // The map may be destroyed while its table is being doubled
+    if (table->old)
+    {
+        for (i = 0;  i <= table->old->mask;  i++)
+            freeNodes(table->old->buckets[i]);
+
+        freeTable(table->old);
+    }
+
+    freeTable(table);
+
+    while (map->retired)
+    {
+        table = map->retired;
+        map->retired = table->retired;
+        freeTable(table);
+    }
+
+    for (i = 0;  i <= map->stripeMask;  i++)
+    {
+        freeNodes(map->stripes[i].freeNodes);
+        spooDestroyMutex(map->stripes[i].lock);
+    }
+
+    spooDestroyMutex(map->resizeLock);
+    free(map->stripes);
+    free(map);
+}
+
+// Copy the value of a key into the specified buffer
+// Returns SPOO_FALSE if the map has no such key.  This takes no locks.
+//
+int spooLookupHashMap(SPOOhashmap handle, const void* key, void* value)
+{
+    int found;
+    long sequence;
+    size_t hash;
+    unsigned long index;
+    _SPOOhashnode* node;
+    _SPOOhashtable* table;
+    _SPOOhashtable* old;
+    _SPOOhashstripe* stripe;
+    _SPOOhashmap* map = (_SPOOhashmap*) handle;
+
+    if (!_spooInitialized || !map || !key)
+        return SPOO_FALSE;
+
+    hash = hashKey(map, key);
+    stripe = map->stripes + (hash & map->stripeMask);
+
+    for (;;)
+    {
+        // An odd sequence number means a writer is changing the stripe
+        sequence = _SPOO_ATOMIC_LOAD(&stripe->sequence);
+        if (sequence & 1)
+        {
+            _SPOO_CPU_RELAX();
+            continue;
+        }
+
+        table = _SPOO_ATOMIC_LOAD(&map->table);
+        old = _SPOO_ATOMIC_LOAD(&table->old);
+
+        if (old)
+        {
+            index = hash & old->mask;
+            if (_SPOO_ATOMIC_LOAD(old->migrated + index))
+                old = NULL;
+        }
+
+        if (old)
+            node = _SPOO_ATOMIC_LOAD(old->buckets + index);
+        else
+            node = _SPOO_ATOMIC_LOAD(table->buckets + (hash & table->mask));
+
+        found = SPOO_FALSE;
+
+        while (node)
+        {
+            if (node->hash == hash && keysEqual(map, key, getNodeKey(node)))
+            {
+                if (value)
+                    memcpy(value, getNodeValue(map, node), map->valueSize);
+
+                found = SPOO_TRUE;
+                break;
+            }
+
+            node = _SPOO_ATOMIC_LOAD(&node->next);
+
+            // A stale chain may lead anywhere, so give up on it early
+            if (_SPOO_ATOMIC_LOAD(&stripe->sequence) != sequence)
+                break;
+        }
+
+        // Make sure the reads above are done before the final check
+        _SPOO_ATOMIC_FENCE();
+
+        if (_SPOO_ATOMIC_LOAD(&stripe->sequence) == sequence)
+            return found;
+    }
+}
+
+// Set the value of a key, adding the key if necessary
+// Returns SPOO_FALSE if memory for the key could not be allocated
+//
+int spooInsertHashMap(SPOOhashmap handle, const void* key, const void* value)
+{
+    int last, grow = SPOO_FALSE;
+    size_t hash;
+    _SPOOhashnode* node;
+    _SPOOhashnode* volatile* bucket;
+    _SPOOhashtable* table;
+    _SPOOhashstripe* stripe;
+    _SPOOhashmap* map = (_SPOOhashmap*) handle;
+
+    if (!_spooInitialized || !map || !key)
+        return SPOO_FALSE;
+
+    hash = hashKey(map, key);
+    stripe = map->stripes + (hash & map->stripeMask);
+
+    spooLockMutex(stripe->lock);
+
+    table = map->table;
+    bucket = getWriteBucket(stripe, table, hash, &last);
+
+    for (node = *bucket;  node;  node = node->next)
+    {
+        if (node->hash == hash && keysEqual(map, key, getNodeKey(node)))
+            break;
+    }
+
+    if (node)
+    {
+        _SPOO_ATOMIC_ADD(&stripe->sequence, 1);
+        memcpy(getNodeValue(map, node), value, map->valueSize);
+        _SPOO_ATOMIC_ADD(&stripe->sequence, 1);
+    }
+    else
+    {
+        node = stripe->freeNodes;
+        if (node)
+            stripe->freeNodes = node->next;
+        else
+            node = (_SPOOhashnode*) malloc(getNodeSize(map));
+
+        if (node)
+        {
+            _SPOO_ATOMIC_ADD(&stripe->sequence, 1);
+            node->hash = hash;
+            memcpy(getNodeKey(node), key, map->keySize);
+            memcpy(getNodeValue(map, node), value, map->valueSize);
+            node->next = *bucket;
+            _SPOO_ATOMIC_STORE(bucket, node);
+            _SPOO_ATOMIC_ADD(&stripe->sequence, 1);
+
+            // Stripes see an even share of the keys, so one full stripe
+            // means the table is full
+            stripe->count++;
+            grow = stripe->count > (table->mask + 1) / (map->stripeMask + 1) * LOAD_FACTOR;
+        }
+    }
+
+    spooUnlockMutex(stripe->lock);
+
+    if (last)
+        finishResize(map, table);
+    if (grow)
+        startResize(map, table);
+
+    helpResize(map);
+    return node != NULL;
+}
+
+// Remove a key from a hash map
+// Returns SPOO_FALSE if the map has no such key
+//
+int spooRemoveHashMap(SPOOhashmap handle, const void* key)
+{
+    int last;
+    size_t hash;
+    _SPOOhashnode* node;
+    _SPOOhashnode* volatile* link;
+    _SPOOhashtable* table;
+    _SPOOhashstripe* stripe;
+    _SPOOhashmap* map = (_SPOOhashmap*) handle;
+
+    if (!_spooInitialized || !map || !key)
+        return SPOO_FALSE;
+
+    hash = hashKey(map, key);
+    stripe = map->stripes + (hash & map->stripeMask);
+
+    spooLockMutex(stripe->lock);
+
+    table = map->table;
+    link = getWriteBucket(stripe, table, hash, &last);
+
+    for (node = *link;  node;  node = node->next)
+    {
+        if (node->hash == hash && keysEqual(map, key, getNodeKey(node)))
+            break;
+
+        link = &node->next;
+    }
+
+    if (node)
+    {
+        _SPOO_ATOMIC_ADD(&stripe->sequence, 1);
+        _SPOO_ATOMIC_STORE(link, node->next);
+        _SPOO_ATOMIC_ADD(&stripe->sequence, 1);
+
+        // Readers may still be looking at the node, so it is kept for reuse
+        // by this stripe instead of being freed
+        node->next = stripe->freeNodes;
+        stripe->freeNodes = node;
+        stripe->count--;
+    }
+
+    spooUnlockMutex(stripe->lock);
+
+    if (last)
+        finishResize(map, table);
+
+    helpResize(map);
+    return node != NULL;
+}
+
+// Return the number of keys in a hash map
+// The result is only exact when no other thread is changing the map
+//
+size_t spooGetHashMapCount(SPOOhashmap handle)
+{
+    unsigned long i;
+    size_t count = 0;
+    _SPOOhashmap* map = (_SPOOhashmap*) handle;
+
+    if (!_spooInitialized || !map)
+        return 0;
+
+    for (i = 0;  i <= map->stripeMask;  i++)
+        count += map->stripes[i].count;
+
+    return count;
+}
@@ -0,0 +1,348 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+
+
+// Minimum number of retired pointers a thread collects before scanning
+#define SCAN_THRESHOLD 64
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Order pointers by address for qsort and bsearch
+//
+static int comparePointers(const void* a, const void* b)
+{
+    const char* x = *(char* const*) a;
+    const char* y = *(char* const*) b;
+
+    return (x > y) - (x < y);
+}
+
+// Free a record and its lists
+//
+static void freeRecord(_SPOOrecord* base)
+{
+    _SPOOhazardrecord* record = (_SPOOhazardrecord*) base;
+
+    free(record->retired);
+    free(record->scratch);
+    free(record);
+}
+
+// Reclaim the retired pointers of a record that no thread protects
+//
+static void scanRecord(_SPOOhazarddomain* domain, _SPOOhazardrecord* record)
+{
+    int i;
+    void* hazard;
+    void** scratch;
+    unsigned long index, count = 0, kept = 0;
+    _SPOOrecord* other;
+
+    // Pointers were unlinked before they were retired, so any hazard set
+    // on them before this fence is visible after it
+    _SPOO_ATOMIC_FENCE();
+
+    for (other = _SPOO_ATOMIC_LOAD(&domain->records.head);  other;  other = other->next)
+    {
+        for (i = 0;  i < SPOO_HAZARD_SLOTS;  i++)
+        {
+            hazard = _SPOO_ATOMIC_LOAD(((_SPOOhazardrecord*) other)->hazards + i);
+            if (!hazard)
+                continue;
+
+            if (count == record->scratchCapacity)
+            {
+                scratch = (void**) realloc(record->scratch,
+                                           (count * 2 + SPOO_HAZARD_SLOTS) * sizeof(void*));
+                if (!scratch)
+                    return;
+
+                record->scratch = scratch;
+                record->scratchCapacity = count * 2 + SPOO_HAZARD_SLOTS;
+            }
+
+            record->scratch[count++] = hazard;
+        }
+    }
+
+    // With no hazards set there may be no scratch list to search
+    if (!count)
+    {
+        for (index = 0;  index < record->retiredCount;  index++)
+            domain->reclaim(record->retired[index], domain->arg);
+
+        record->retiredCount = 0;
+        return;
+    }
+
+    qsort(record->scratch, count, sizeof(void*), comparePointers);
+
+    for (index = 0;  index < record->retiredCount;  index++)
+    {
+        if (bsearch(record->retired + index, record->scratch, count,
+                    sizeof(void*), comparePointers))
+        {
+            record->retired[kept++] = record->retired[index];
+        }
+        else
+            domain->reclaim(record->retired[index], domain->arg);
+    }
+
+    record->retiredCount = kept;
+}
+
+// Return the record of the calling thread in a domain
+//
+static _SPOOhazardrecord* getRecord(_SPOOhazarddomain* domain)
+{
+    return (_SPOOhazardrecord*) _spooGetRecord(_spoo.hazardKey, domain,
+                                               &domain->records,
+                                               sizeof(_SPOOhazardrecord),
+                                               freeRecord);
+}
+
+// Clear the hazards of a record whose thread is leaving and reclaim what
+// it can of its retired pointers
+//
+static void leaveRecord(_SPOOrecord* base)
+{
+    int i;
+    _SPOOhazardrecord* record = (_SPOOhazardrecord*) base;
+
+    for (i = 0;  i < SPOO_HAZARD_SLOTS;  i++)
+        _SPOO_ATOMIC_STORE(record->hazards + i, NULL);
+
+    scanRecord((_SPOOhazarddomain*) base->owner, record);
+}
+
+// Reclaim all retired pointers of a record whose domain is being destroyed
+//
+static void releaseRecord(_SPOOrecord* base)
+{
+    unsigned long index;
+    _SPOOhazardrecord* record = (_SPOOhazardrecord*) base;
+    _SPOOhazarddomain* domain = (_SPOOhazarddomain*) base->owner;
+
+    for (index = 0;  index < record->retiredCount;  index++)
+        domain->reclaim(record->retired[index], domain->arg);
+
+    record->retiredCount = 0;
+}
+
+// Initialize hazard pointer support
+//
+int _spooInitHazards(void)
+{
+    _spoo.hazardKey = _spooPlatformCreateTLSKey(NULL);
+    if (_spoo.hazardKey == SPOO_INVALID_TLS_KEY)
+        return SPOO_FALSE;
+
+    return SPOO_TRUE;
+}
+
+// Terminate hazard pointer support
+//
+void _spooTerminateHazards(void)
+{
+    _spooLeaveHazardDomains();
+    _spooPlatformDestroyTLSKey(_spoo.hazardKey);
+}
+
+// Release the records of the calling thread so other threads can take them
+// over, together with any retired pointers that are still protected
+// This is called when a Spoo thread leaves runThread
+//
+void _spooLeaveHazardDomains(void)
+{
+    _spooLeaveRecords(_spoo.hazardKey, leaveRecord, freeRecord);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create a hazard pointer domain
+// Retired pointers are passed to the reclaim function once no thread has a
+// hazard pointer set to them.  The reclaim function must not retire
+// pointers to the same domain.
+//
+SPOOhazarddomain spooCreateHazardDomain(SPOOreclaimfun reclaim, void* arg)
+{
+    _SPOOhazarddomain* domain;
+
+    if (!_spooInitialized || !reclaim)
+        return NULL;
+
+    domain = (_SPOOhazarddomain*) calloc(1, sizeof(_SPOOhazarddomain));
+    if (!domain)
+        return NULL;
+
+    domain->reclaim = reclaim;
+    domain->arg = arg;
+
+    return (SPOOhazarddomain) domain;
+}
+
+// Destroy a hazard pointer domain, reclaiming all retired pointers
+// NOTE: No thread may be using the domain
+//
+void spooDestroyHazardDomain(SPOOhazarddomain handle)
+{
+    _SPOOhazarddomain* domain = (_SPOOhazarddomain*) handle;
+
+    if (!_spooInitialized || !domain)
+        return;
+
+    _spooReleaseRecords(&domain->records, releaseRecord, freeRecord);
+    free(domain);
+}
+
+// Set a hazard pointer of the calling thread to the pointer at the
+// specified location and return it, once it is known to have been
+// protected before it could be retired
+//
+void* spooProtectHazard(SPOOhazarddomain handle, int slot, void* volatile* source)
+{
+    void* pointer;
+    void* current;
+    _SPOOhazardrecord* record;
+    _SPOOhazarddomain* domain = (_SPOOhazarddomain*) handle;
+
+    if (!_spooInitialized || !domain || slot < 0 || slot >= SPOO_HAZARD_SLOTS)
+        return NULL;
+
+    record = getRecord(domain);
+    if (!record)
+        return NULL;
+
+    pointer = _SPOO_ATOMIC_LOAD(source);
+
+    for (;;)
+    {
+        // The exchange is a full barrier, so the hazard is visible before
+        // the source is read again
+        (void) _SPOO_ATOMIC_EXCHANGE_PTR(record->hazards + slot, pointer);
+
+        current = _SPOO_ATOMIC_LOAD(source);
+        if (current == pointer)
+            return pointer;
+
+        pointer = current;
+    }
+}
+
+// Clear a hazard pointer of the calling thread
+//
+void spooClearHazard(SPOOhazarddomain handle, int slot)
+{
+    _SPOOhazardrecord* record;
+    _SPOOhazarddomain* domain = (_SPOOhazarddomain*) handle;
+
+    if (!_spooInitialized || !domain || slot < 0 || slot >= SPOO_HAZARD_SLOTS)
+        return;
+
+    record = getRecord(domain);
+    if (record)
+        _SPOO_ATOMIC_STORE(record->hazards + slot, NULL);
+}
+
+// Retire a pointer that has been unlinked from the shared structure
+// It is reclaimed by a later scan of the calling thread, or of whichever
+// thread takes over its record
+//
+void spooRetireHazard(SPOOhazarddomain handle, void* pointer)
+{
+    void** retired;
+    unsigned long capacity;
+    _SPOOhazardrecord* record;
+    _SPOOhazarddomain* domain = (_SPOOhazarddomain*) handle;
+
+    if (!_spooInitialized || !domain || !pointer)
+        return;
+
+    record = getRecord(domain);
+
+    // Without a record there is nowhere to keep the pointer, so wait for
+    // memory to become available
+    while (!record)
+    {
+        spooSleep(0.0);
+        record = getRecord(domain);
+    }
+
+    while (record->retiredCount == record->retiredCapacity)
+    {
+        capacity = record->retiredCapacity * 2 + SCAN_THRESHOLD;
+        retired = (void**) realloc(record->retired, capacity * sizeof(void*));
+        if (retired)
+        {
+            record->retired = retired;
+            record->retiredCapacity = capacity;
+        }
+        else
+        {
+            scanRecord(domain, record);
+            spooSleep(0.0);
+        }
+    }
+
+    record->retired[record->retiredCount++] = pointer;
+
+    // Scanning costs time proportional to the number of hazard pointers, so
+    // wait until that many pointers can be reclaimed
+    if (record->retiredCount >= SCAN_THRESHOLD &&
+        record->retiredCount >= 2 * SPOO_HAZARD_SLOTS *
+                                (unsigned long) _SPOO_ATOMIC_LOAD(&domain->records.count))
+    {
+        scanRecord(domain, record);
+    }
+}
+
+// Reclaim the pointers retired by the calling thread that no thread protects
+//
+void spooScanHazards(SPOOhazarddomain handle)
+{
+    _SPOOhazardrecord* record;
+    _SPOOhazarddomain* domain = (_SPOOhazarddomain*) handle;
+
+    if (!_spooInitialized || !domain)
+        return;
+
+    record = getRecord(domain);
+    if (record)
+        scanRecord(domain, record);
+}
@@ -0,0 +1,288 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+
+
+// Each power of two is split into 2^SUB_BUCKET_BITS buckets, bounding the
+// relative error of recorded values to 2^-SUB_BUCKET_BITS
+#define SUB_BUCKET_BITS 6
+#define SUB_BUCKET_COUNT (1 << SUB_BUCKET_BITS)
+
+// Values at or above 2^MAX_VALUE_BITS (about 4.9 hours of nanoseconds)
+// are recorded in the last bucket
+#define MAX_VALUE_BITS 44
+
+#define BUCKET_COUNT ((MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS)
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Return the index of the highest set bit of a non-zero value
+//
+static int getHighestBit(unsigned long long value)
+{
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+
+    while (value >>= 1)
+        bit++;
+
+    return bit;
+#endif
+}
+
+// Return the bucket a value is recorded in
+//
+static int getBucketIndex(unsigned long long value)
+{
+    int shift;
+
+    if (value < SUB_BUCKET_COUNT)
+        return (int) value;
+
+    if (value >> MAX_VALUE_BITS)
+        return BUCKET_COUNT - 1;
+
+    shift = getHighestBit(value) - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS) +
+           (int) ((value >> shift) - SUB_BUCKET_COUNT);
+}
+
+// Return the largest value recorded in a bucket
+//
+static unsigned long long getBucketLimit(int index)
+{
+    int shift;
+    unsigned long long sub;
+
+    if (index < SUB_BUCKET_COUNT)
+        return (unsigned long long) index;
+
+    shift = (index >> SUB_BUCKET_BITS) - 1;
+    sub = (unsigned long long) (index & (SUB_BUCKET_COUNT - 1)) + SUB_BUCKET_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+// Return the count of a bucket, adding up all shards
+//
+static unsigned long long getBucketCount(_SPOOhistogram* histogram, int index)
+{
+    unsigned long shard;
+    long long count = 0;
+
+    for (shard = 0;  shard <= histogram->shardMask;  shard++)
+        count += _SPOO_ATOMIC_LOAD(histogram->counts + shard * BUCKET_COUNT + index);
+
+    return (unsigned long long) count;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create an empty histogram
+// Its memory is fixed when created and grows only with the CPU count
+//
+SPOOhistogram spooCreateHistogram(void)
+{
+    unsigned long shardCount = 1;
+    _SPOOhistogram* histogram;
+
+    if (!_spooInitialized)
+        return NULL;
+
+    histogram = (_SPOOhistogram*) calloc(1, sizeof(_SPOOhistogram));
+    if (!histogram)
+        return NULL;
+
+    while (shardCount < (unsigned long) spooGetCPUCoreCount())
+        shardCount *= 2;
+
+    // Over-allocate by a cache line so the shards can be aligned to one
+    histogram->allocation = calloc(shardCount * BUCKET_COUNT * sizeof(long long) +
+                                   _SPOO_CACHE_LINE_SIZE, 1);
+    if (!histogram->allocation)
+    {
+        free(histogram);
+        return NULL;
+    }
+
+    histogram->shardMask = shardCount - 1;
+    histogram->counts = (volatile long long*)
+        (((size_t) histogram->allocation + _SPOO_CACHE_LINE_SIZE - 1) &
+         ~((size_t) _SPOO_CACHE_LINE_SIZE - 1));
+
+    return (SPOOhistogram) histogram;
+}
+
+// Destroy a histogram
+//
+void spooDestroyHistogram(SPOOhistogram handle)
+{
+    _SPOOhistogram* histogram = (_SPOOhistogram*) handle;
+
+    if (!_spooInitialized || !histogram)
+        return;
+
+    free(histogram->allocation);
+    free(histogram);
+}
+
+// Record a value, usually a difference of spooGetTimerValue results
+// This only touches the buckets of the current CPU
+//
+void spooRecordHistogram(SPOOhistogram handle, unsigned long long value)
+{
+    unsigned long shard;
+    _SPOOhistogram* histogram = (_SPOOhistogram*) handle;
+
+    if (!_spooInitialized || !histogram)
+        return;
+
+    shard = _spooGetShardIndex() & histogram->shardMask;
+    _SPOO_ATOMIC_ADD64(histogram->counts + shard * BUCKET_COUNT + getBucketIndex(value), 1);
+}
+
+// Add the values recorded in one histogram to another
+// Both may be recorded to while this runs
+//
+void spooMergeHistogram(SPOOhistogram targetHandle, SPOOhistogram sourceHandle)
+{
+    int index;
+    unsigned long shard;
+    unsigned long long count;
+    _SPOOhistogram* target = (_SPOOhistogram*) targetHandle;
+    _SPOOhistogram* source = (_SPOOhistogram*) sourceHandle;
+
+    if (!_spooInitialized || !target || !source || target == source)
+        return;
+
+    shard = _spooGetShardIndex() & target->shardMask;
+
+    for (index = 0;  index < BUCKET_COUNT;  index++)
+    {
+        count = getBucketCount(source, index);
+        if (count)
+            _SPOO_ATOMIC_ADD64(target->counts + shard * BUCKET_COUNT + index, (long long) count);
+    }
+}
+
+// Remove all values from a histogram
+// Values recorded while it is being reset may or may not be kept
+//
+void spooResetHistogram(SPOOhistogram handle)
+{
+    unsigned long i;
+    long long count;
+    _SPOOhistogram* histogram = (_SPOOhistogram*) handle;
+
+    if (!_spooInitialized || !histogram)
+        return;
+
+    for (i = 0;  i < (histogram->shardMask + 1) * BUCKET_COUNT;  i++)
+    {
+        // Subtract what was there instead of storing zero, so concurrent
+        // records are not lost
+        count = _SPOO_ATOMIC_LOAD(histogram->counts + i);
+        if (count)
+            _SPOO_ATOMIC_ADD64(histogram->counts + i, -count);
+    }
+}
+
+// Return the number of values recorded in a histogram
+//
+unsigned long long spooGetHistogramCount(SPOOhistogram handle)
+{
+    int index;
+    unsigned long long count = 0;
+    _SPOOhistogram* histogram = (_SPOOhistogram*) handle;
+
+    if (!_spooInitialized || !histogram)
+        return 0;
+
+    for (index = 0;  index < BUCKET_COUNT;  index++)
+        count += getBucketCount(histogram, index);
+
+    return count;
+}
+
+// Return the value below or at which the specified percentage of recorded
+// values lie, rounded up to the largest value of its bucket
+//
+unsigned long long spooGetHistogramPercentile(SPOOhistogram handle, double percentile)
+{
+    int index;
+    double rank;
+    unsigned long long total, target, count = 0;
+    _SPOOhistogram* histogram = (_SPOOhistogram*) handle;
+
+    if (!_spooInitialized || !histogram)
+        return 0;
+
+    total = spooGetHistogramCount(handle);
+    if (!total)
+        return 0;
+
+    if (percentile < 0.0)
+        percentile = 0.0;
+    else if (percentile > 100.0)
+        percentile = 100.0;
+
+    rank = percentile / 100.0 * (double) total;
+    target = (unsigned long long) rank;
+    if ((double) target < rank)
+        target++;
+
+    if (target < 1)
+        target = 1;
+    else if (target > total)
+        target = total;
+
+    for (index = 0;  index < BUCKET_COUNT;  index++)
+    {
+        count += getBucketCount(histogram, index);
+        if (count >= target)
+            break;
+    }
+
+    // Values recorded between the two passes may push the target past the
+    // last bucket counted
+    if (index == BUCKET_COUNT)
+        index = BUCKET_COUNT - 1;
+
+    return getBucketLimit(index);
+}
@@ -42,6 +42,60 @@
 #endif
 
 
+// Maximum number of passes over the thread-local storage destructors
+#define _SPOO_TLS_DESTRUCTOR_ITERATIONS 4
+
+// Assumed size of a CPU cache line, used to pad data shared between threads
+#define _SPOO_CACHE_LINE_SIZE 64
+
+
+//========================================================================
+// Atomic operations
+// NOTE: Variables accessed through these must be declared volatile, and
+// integers must be long (or long long for the 64-bit variants) for MSVC
+//========================================================================
+
+#if defined(__GNUC__)
+
+ #define _SPOO_ATOMIC_LOAD(p)           __atomic_load_n((p), __ATOMIC_ACQUIRE)
+ #define _SPOO_ATOMIC_STORE(p, v)       __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+ #define _SPOO_ATOMIC_ADD(p, v)         __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+ #define _SPOO_ATOMIC_ADD64(p, v)       __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+ #define _SPOO_ATOMIC_EXCHANGE(p, v)    __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+ #define _SPOO_ATOMIC_CAS(p, e, d)      __sync_bool_compare_and_swap((p), (e), (d))
+ #define _SPOO_ATOMIC_CAS64(p, e, d)    __sync_bool_compare_and_swap((p), (e), (d))
+ #define _SPOO_ATOMIC_EXCHANGE_PTR(p, v) __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+ #define _SPOO_ATOMIC_CAS_PTR(p, e, d)  __sync_bool_compare_and_swap((p), (e), (d))
+ #define _SPOO_ATOMIC_FENCE()           __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+ #if defined(__i386__) || defined(__x86_64__)
+  #define _SPOO_CPU_RELAX()             __builtin_ia32_pause()
+ #elif defined(__aarch64__) || defined(__arm__)
+  #define _SPOO_CPU_RELAX()             __asm__ __volatile__("yield")
+ #else
+  #define _SPOO_CPU_RELAX()             __asm__ __volatile__("" ::: "memory")
+ #endif
+
+#elif defined(_MSC_VER)
+
+ // MSVC gives volatile accesses acquire and release semantics
+ #define _SPOO_ATOMIC_LOAD(p)           (*(p))
+ #define _SPOO_ATOMIC_STORE(p, v)       (*(p) = (v))
+ #define _SPOO_ATOMIC_ADD(p, v)         (InterlockedExchangeAdd((p), (v)) + (v))
+ #define _SPOO_ATOMIC_ADD64(p, v)       (InterlockedExchangeAdd64((p), (v)) + (v))
+ #define _SPOO_ATOMIC_EXCHANGE(p, v)    InterlockedExchange((p), (v))
+ #define _SPOO_ATOMIC_CAS(p, e, d)      (InterlockedCompareExchange((p), (d), (e)) == (e))
+ #define _SPOO_ATOMIC_CAS64(p, e, d)    (InterlockedCompareExchange64((p), (d), (e)) == (e))
+ #define _SPOO_ATOMIC_EXCHANGE_PTR(p, v) InterlockedExchangePointer((PVOID volatile*) (p), (v))
+ #define _SPOO_ATOMIC_CAS_PTR(p, e, d)  (InterlockedCompareExchangePointer((PVOID volatile*) (p), (d), (e)) == (e))
+ #define _SPOO_ATOMIC_FENCE()           MemoryBarrier()
+ #define _SPOO_CPU_RELAX()              YieldProcessor()
+
+#else
+ #error "No atomic operations available for this compiler"
+#endif
+
+
 //========================================================================
 // Internal types
 //========================================================================
@@ -59,10 +113,803 @@ struct _SPOOthread
   SPOOthread        ID;
   SPOOthreadfun     function;
 
+  // Cancellation requests wake the thread through these, and through the
+  // condition it is waiting on, if any
+  volatile long     cancelRequested;
+  SPOOmutex         cancelLock;
+  SPOOcond          cancelCond;
+  SPOOcond          waitCond;
+
   _SPOO_PLATFORM_THREAD_STATE;
 };
 
 
+//------------------------------------------------------------------------
+// Spoo queue lock state
+// Queue lock mutexes are tagged in the lowest bit of their handle.  They
+// also hold a platform mutex, taken once the queue lock is acquired, which
+// is what conditions wait with.
+//------------------------------------------------------------------------
+
+#define _SPOO_QUEUE_MUTEX_TAG 1
+
+#define _SPOO_IS_QUEUE_MUTEX(m) (((size_t) (m)) & _SPOO_QUEUE_MUTEX_TAG)
+#define _SPOO_GET_QUEUE_MUTEX(m) \
+    ((_SPOOqueuemutex*) ((size_t) (m) & ~(size_t) _SPOO_QUEUE_MUTEX_TAG))
+
+typedef struct _SPOOmcsnode _SPOOmcsnode;
+
+struct _SPOOmcsnode
+{
+  _SPOOmcsnode* volatile next;
+  volatile long     locked;
+  // Next node in the free list of the owning thread
+  _SPOOmcsnode*     free;
+  void*             allocation;
+};
+
+typedef struct _SPOOqueuemutex
+{
+  int               kind;
+  SPOOmutex         mutex;
+  _SPOOmcsnode*     owner;
+  void*             allocation;
+  // Arriving threads and the lock holder touch different cache lines
+  char              padding0[_SPOO_CACHE_LINE_SIZE];
+  volatile long     nextTicket;
+  _SPOOmcsnode* volatile tail;
+  char              padding1[_SPOO_CACHE_LINE_SIZE];
+  volatile long     nowServing;
+} _SPOOqueuemutex;
+
+
+//------------------------------------------------------------------------
+// Spoo thread-local storage key state
+//------------------------------------------------------------------------
+
+typedef struct _SPOOtlskey
+{
+  int               used;
+  unsigned int      generation;
+  SPOOtlsfun        destructor;
+
+  _SPOO_PLATFORM_TLS_KEY_STATE;
+} _SPOOtlskey;
+
+
+//------------------------------------------------------------------------
+// Spoo thread-local storage value
+// This is only used when the compiler provides thread-local variables
+//------------------------------------------------------------------------
+
+typedef struct _SPOOtlsvalue
+{
+  void*             value;
+  unsigned int      generation;
+} _SPOOtlsvalue;
+
+
+//------------------------------------------------------------------------
+// Spoo profiled mutex state
+// This wraps every platform mutex when mutex profiling is enabled
+//------------------------------------------------------------------------
+
+typedef struct _SPOOprofiledmutex _SPOOprofiledmutex;
+
+struct _SPOOprofiledmutex
+{
+  _SPOOprofiledmutex* prev;
+  _SPOOprofiledmutex* next;
+  SPOOmutex         mutex;
+  const char*       name;
+  double            lockTime;
+
+  unsigned long     acquisitions;
+  unsigned long     contentions;
+  double            totalWaitTime;
+  double            maxWaitTime;
+  double            totalHoldTime;
+  double            maxHoldTime;
+};
+
+
+//------------------------------------------------------------------------
+// Spoo trace event
+//------------------------------------------------------------------------
+
+typedef struct _SPOOtraceevent
+{
+  double            time;
+  const char*       name;
+  char              phase;
+} _SPOOtraceevent;
+
+
+//------------------------------------------------------------------------
+// Spoo per-thread trace event ring buffer
+// Each buffer is written only by its thread and read by the exporter.  A
+// thread leaving hands its buffer on to the next one needing a buffer.
+//------------------------------------------------------------------------
+
+typedef struct _SPOOtracebuffer _SPOOtracebuffer;
+
+struct _SPOOtracebuffer
+{
+  _SPOOtracebuffer* next;
+  SPOOthread        threadID;
+  long              generation;
+  unsigned long     capacity;
+  volatile long     active;
+  volatile unsigned long head;
+  _SPOOtraceevent*  events;
+};
+
+
+//------------------------------------------------------------------------
+// Spoo user-mode execution context
+//------------------------------------------------------------------------
+
+typedef void (*_SPOOcontextfun)(void*);
+
+typedef struct _SPOOcontext
+{
+  _SPOOcontextfun   entry;
+  void*             arg;
+
+  _SPOO_PLATFORM_CONTEXT_STATE;
+} _SPOOcontext;
+
+
+//------------------------------------------------------------------------
+// Spoo fiber state
+//------------------------------------------------------------------------
+
+typedef struct _SPOOfiber _SPOOfiber;
+
+typedef struct _SPOOfiberqueue
+{
+  _SPOOfiber*       head;
+  _SPOOfiber*       tail;
+} _SPOOfiberqueue;
+
+struct _SPOOfiber
+{
+  _SPOOfiber*       next;
+  _SPOOfiber*       allNext;
+  _SPOOcontext      context;
+  SPOOthreadfun     function;
+  void*             arg;
+  int               state;
+  int               timerIndex;
+  double            wakeTime;
+  _SPOOfiberqueue*  waitQueue;
+  _SPOOfiber*       joiner;
+};
+
+
+//------------------------------------------------------------------------
+// Spoo fiber mutex and condition variable state
+//------------------------------------------------------------------------
+
+typedef struct _SPOOfibermutex
+{
+  volatile long     state;
+  _SPOOfiberqueue   waiters;
+} _SPOOfibermutex;
+
+typedef struct _SPOOfibercond
+{
+  _SPOOfiberqueue   waiters;
+} _SPOOfibercond;
+
+
+//------------------------------------------------------------------------
+// Spoo fiber worker thread state
+//------------------------------------------------------------------------
+
+typedef struct _SPOOfiberworker
+{
+  _SPOOcontext      context;
+  _SPOOfiber*       current;
+  SPOOthread        thread;
+} _SPOOfiberworker;
+
+
+//------------------------------------------------------------------------
+// Spoo fiber scheduler state
+// Everything here is protected by the scheduler lock
+//------------------------------------------------------------------------
+
+typedef struct _SPOOfibers
+{
+  int               running;
+  int               stopping;
+  size_t            stackSize;
+  SPOOmutex         lock;
+  SPOOcond          cond;
+  SPOOcond          joinCond;
+  SPOOtlskey        workerKey;
+  _SPOOfiberworker* workers;
+  int               workerCount;
+  _SPOOfiberqueue   ready;
+  _SPOOfiber**      timers;
+  int               timerCount;
+  int               timerCapacity;
+  _SPOOfiber*       unused;
+  _SPOOfiber*       all;
+  int               liveCount;
+} _SPOOfibers;
+
+
+//------------------------------------------------------------------------
+// Spoo worker pool state
+//------------------------------------------------------------------------
+
+typedef struct _SPOOpool _SPOOpool;
+
+// Each worker has its own task queue, padded to avoid false sharing
+typedef struct _SPOOpoolworker
+{
+  _SPOOpool*        pool;
+  int               index;
+  SPOOthread        thread;
+  SPOOmutex         lock;
+  SPOOtask* volatile head;
+  SPOOtask*         tail;
+  char              padding[_SPOO_CACHE_LINE_SIZE];
+} _SPOOpoolworker;
+
+typedef struct _SPOOpooltimer
+{
+  double            time;
+  SPOOtask*         task;
+} _SPOOpooltimer;
+
+struct _SPOOpool
+{
+  _SPOOpoolworker*  workers;
+  int               workerCount;
+  volatile long     nextWorker;
+  volatile long     pending;
+  volatile long     sleepers;
+
+  // These are protected by the pool lock
+  SPOOmutex         lock;
+  SPOOcond          cond;
+  int               stopping;
+  _SPOOpooltimer*   timers;
+  volatile long     timerCount;
+  long              timerCapacity;
+};
+
+
+//------------------------------------------------------------------------
+// Spoo I/O reactor state
+//------------------------------------------------------------------------
+
+typedef struct _SPOOreactor _SPOOreactor;
+typedef struct _SPOOreactorshard _SPOOreactorshard;
+
+// A watch is referenced by its registration and by its queued dispatch task
+// Removed watches are kept on a list of their shard until its poller is done
+// with the events it may still hold for them
+typedef struct _SPOOwatch
+{
+  SPOOtask          task;
+  _SPOOreactorshard* shard;
+  struct _SPOOwatch* nextRemoved;
+  int               fd;
+  SPOOiofun         function;
+  void*             arg;
+  volatile long     ready;
+  volatile long     queued;
+  volatile long     refs;
+  volatile long     removed;
+} _SPOOwatch;
+
+// Each shard has its own poller thread and lock, padded to avoid false
+// sharing
+struct _SPOOreactorshard
+{
+  _SPOOreactor*     reactor;
+  int               pollFD;
+  int               wakeFD;
+  SPOOthread        thread;
+  SPOOmutex         lock;
+  struct _SPOOwatch* removed;
+  char              padding[_SPOO_CACHE_LINE_SIZE];
+};
+
+struct _SPOOreactor
+{
+  _SPOOreactor*     next;
+  SPOOpool          pool;
+  _SPOOreactorshard* shards;
+  int               shardCount;
+  volatile long     nextShard;
+  volatile long     stopping;
+};
+
+
+//------------------------------------------------------------------------
+// Spoo channel state
+// Buffered channels move elements through a lock-free ring and only use
+// the lock to wake waiters; unbuffered channels hand elements over directly
+// between a waiting entry and its counterpart under the lock
+//------------------------------------------------------------------------
+
+// Entry result telling a woken waiter to retry its buffered operation
+#define _SPOO_CHANNEL_RETRY -1
+
+// Per-thread state of a blocked send, receive or select
+typedef struct _SPOOchannelwaiter
+{
+  SPOOmutex         lock;
+  SPOOcond          cond;
+  // Zero while waiting, otherwise the index of the firing case plus one
+  volatile long     state;
+  // Set under the waiter lock once whoever fired the waiter is done with it
+  int               woken;
+} _SPOOchannelwaiter;
+
+typedef struct _SPOOchannelentry _SPOOchannelentry;
+
+struct _SPOOchannelentry
+{
+  _SPOOchannelentry* next;
+  _SPOOchannelentry* prev;
+  _SPOOchannelwaiter* waiter;
+  void*             value;
+  int               index;
+  int               linked;
+  int               result;
+};
+
+typedef struct _SPOOchannel
+{
+  size_t            size;
+  size_t            stride;
+  unsigned long     mask;
+  unsigned char*    slots;
+  int               buffered;
+  volatile long     closed;
+  volatile long     sendWaiters;
+  volatile long     recvWaiters;
+  SPOOmutex         lock;
+  _SPOOchannelentry* senders;
+  _SPOOchannelentry* receivers;
+
+  // Send and receive positions on their own cache lines
+  char              padding1[_SPOO_CACHE_LINE_SIZE];
+  volatile long     head;
+  char              padding2[_SPOO_CACHE_LINE_SIZE];
+  volatile long     tail;
+  char              padding3[_SPOO_CACHE_LINE_SIZE];
+} _SPOOchannel;
+
+
+//------------------------------------------------------------------------
+// Spoo task graph state
+//------------------------------------------------------------------------
+
+typedef struct _SPOOgraph _SPOOgraph;
+typedef struct _SPOOgraphnode _SPOOgraphnode;
+
+struct _SPOOgraphnode
+{
+  SPOOtask          task;
+  _SPOOgraph*       graph;
+  SPOOthreadfun     function;
+  void*             arg;
+  int               predecessorCount;
+  volatile long     remaining;
+  _SPOOgraphnode**  successors;
+  int               successorCount;
+  int               successorCapacity;
+};
+
+struct _SPOOgraph
+{
+  SPOOpool          pool;
+  _SPOOgraphnode**  nodes;
+  int               nodeCount;
+  int               nodeCapacity;
+  volatile long     remaining;
+  SPOOmutex         lock;
+  SPOOcond          cond;
+  // Set under the lock by the last node to finish
+  int               done;
+
+  // Scratch space for checking that the graph is acyclic
+  int               validated;
+  _SPOOgraphnode**  order;
+  int               orderCapacity;
+};
+
+
+//------------------------------------------------------------------------
+// Spoo concurrent hash map state
+// Writers lock the stripe of a bucket and bump its sequence number around
+// every change, so readers can search without locking and retry if the
+// stripe changed under them.  Nodes and bucket arrays are only freed with
+// the map, so a reader following a stale pointer still reads valid memory.
+//------------------------------------------------------------------------
+
+typedef struct _SPOOhashnode _SPOOhashnode;
+typedef struct _SPOOhashtable _SPOOhashtable;
+
+struct _SPOOhashnode
+{
+  _SPOOhashnode* volatile next;
+  size_t            hash;
+  // Followed by the key and then the value
+};
+
+struct _SPOOhashtable
+{
+  unsigned long     mask;
+  _SPOOhashnode* volatile* buckets;
+  // The table being migrated into this one, bucket by bucket
+  _SPOOhashtable* volatile old;
+  volatile long     migrateCursor;
+  volatile long     migratedCount;
+  // Per-bucket flags set once a bucket has moved to the next table
+  volatile long*    migrated;
+  _SPOOhashtable*   retired;
+};
+
+typedef struct _SPOOhashstripe
+{
+  SPOOmutex         lock;
+  volatile long     sequence;
+  unsigned long     count;
+  _SPOOhashnode*    freeNodes;
+  char              padding[_SPOO_CACHE_LINE_SIZE];
+} _SPOOhashstripe;
+
+typedef struct _SPOOhashmap
+{
+  size_t            keySize;
+  size_t            valueSize;
+  SPOOhashfun       hash;
+  SPOOequalfun      equal;
+  void*             arg;
+  _SPOOhashstripe*  stripes;
+  unsigned long     stripeMask;
+  _SPOOhashtable* volatile table;
+  SPOOmutex         resizeLock;
+  _SPOOhashtable*   retired;
+} _SPOOhashmap;
+
+
+//------------------------------------------------------------------------
+// Spoo per-thread record state
+// Objects used by many threads give each thread its own record, which is
+// embedded at the start of a larger record.  Records are only unlinked from
+// their owner when it is destroyed; a thread leaving hands its records to
+// the next ones.  The records of a thread are chained from a TLS key.
+//------------------------------------------------------------------------
+
+typedef struct _SPOOrecord _SPOOrecord;
+
+struct _SPOOrecord
+{
+  // Next record of the same owner
+  _SPOOrecord*      next;
+  // Next record of the same thread
+  _SPOOrecord*      nextOwned;
+  void*             owner;
+  // Whether a thread holds the record, see record.c
+  volatile long     active;
+};
+
+typedef struct _SPOOrecordlist
+{
+  _SPOOrecord* volatile head;
+  volatile long     count;
+} _SPOOrecordlist;
+
+typedef void (*_SPOOrecordfun)(_SPOOrecord* record);
+
+
+//------------------------------------------------------------------------
+// Spoo hazard pointer state
+// Each thread using a domain owns one record, holding its hazard slots and
+// the pointers it has retired.
+//------------------------------------------------------------------------
+
+typedef struct _SPOOhazarddomain _SPOOhazarddomain;
+typedef struct _SPOOhazardrecord _SPOOhazardrecord;
+
+struct _SPOOhazardrecord
+{
+  _SPOOrecord       record;
+  void* volatile    hazards[SPOO_HAZARD_SLOTS];
+  void**            retired;
+  unsigned long     retiredCount;
+  unsigned long     retiredCapacity;
+  void**            scratch;
+  unsigned long     scratchCapacity;
+};
+
+struct _SPOOhazarddomain
+{
+  SPOOreclaimfun    reclaim;
+  void*             arg;
+  _SPOOrecordlist   records;
+};
+
+
+//------------------------------------------------------------------------
+// Spoo flat combining state
+// Each thread using a combiner owns one record, where it publishes its
+// request.
+//------------------------------------------------------------------------
+
+typedef struct _SPOOcombiner _SPOOcombiner;
+typedef struct _SPOOcombinerrecord _SPOOcombinerrecord;
+
+struct _SPOOcombinerrecord
+{
+  _SPOOrecord       record;
+  void* volatile    request;
+  // Keep records of different threads off each other's cache lines
+  char              padding[_SPOO_CACHE_LINE_SIZE];
+};
+
+struct _SPOOcombiner
+{
+  SPOOmutex         mutex;
+  SPOOapplyfun      apply;
+  void*             arg;
+  _SPOOrecordlist   records;
+  volatile long     combining;
+};
+
+
+//------------------------------------------------------------------------
+// Spoo sharded counter state
+// Each shard sits on its own cache line and is updated by the threads
+// running on one CPU, so updates rarely move lines between cores
+//------------------------------------------------------------------------
+
+typedef struct _SPOOcountershard
+{
+  volatile long long value;
+  char              padding[_SPOO_CACHE_LINE_SIZE - sizeof(long long)];
+} _SPOOcountershard;
+
+typedef struct _SPOOcounter
+{
+  int               kind;
+  unsigned long     shardMask;
+  _SPOOcountershard* shards;
+  void*             allocation;
+} _SPOOcounter;
+
+
+//------------------------------------------------------------------------
+// Spoo lock table state
+// The stripes are platform mutexes initialized in place, each padded to a
+// whole number of cache lines.  The handle of a platform mutex initialized
+// in caller-provided storage is the address of that storage.
+//------------------------------------------------------------------------
+
+typedef struct _SPOOlocktable
+{
+  char*             stripes;
+  size_t            stripeSize;
+  unsigned long     stripeCount;
+  int               shift;
+  void*             allocation;
+} _SPOOlocktable;
+
+
+//------------------------------------------------------------------------
+// Spoo histogram state
+// Buckets are log-linear: each power of two is split into the same number
+// of linear sub-buckets.  Like counters, each CPU records into its own copy
+// of the buckets and queries add them up.
+//------------------------------------------------------------------------
+
+typedef struct _SPOOhistogram
+{
+  unsigned long     shardMask;
+  volatile long long* counts;
+  void*             allocation;
+} _SPOOhistogram;
+
+
+//------------------------------------------------------------------------
+// Spoo actor state
+// The mailbox is an intrusive MPSC queue with a stub node; producers only
+// touch the head and the actor only the tail
+//------------------------------------------------------------------------
+
+typedef struct _SPOOactor
+{
+  SPOOtask          task;
+  SPOOpool          pool;
+  SPOOactorfun      function;
+  void*             arg;
+  volatile long     scheduled;
+  volatile long     running;
+  SPOOmessage*      tail;
+  SPOOmessage       stub;
+  char              padding[_SPOO_CACHE_LINE_SIZE];
+  SPOOmessage* volatile head;
+} _SPOOactor;
+
+
+//------------------------------------------------------------------------
+// Spoo pipeline state
+// Each token carries one item through all stages as a pool task, parking
+// itself on a serial stage that is busy or waiting for an earlier item
+//------------------------------------------------------------------------
+
+typedef struct _SPOOpipeline _SPOOpipeline;
+typedef struct _SPOOpipelinetoken _SPOOpipelinetoken;
+
+struct _SPOOpipelinetoken
+{
+  SPOOtask          task;
+  _SPOOpipeline*    pipeline;
+  _SPOOpipelinetoken* next;
+  void*             item;
+  unsigned long     sequence;
+  int               stage;
+  // Set when the token was handed a serial stage while parked on it
+  int               resumed;
+};
+
+typedef struct _SPOOpipelinestage
+{
+  int               mode;
+  SPOOstagefun      function;
+  void*             arg;
+  // Serial stage state, protected by the lock
+  SPOOmutex         lock;
+  int               busy;
+  unsigned long     nextSequence;
+  _SPOOpipelinetoken* waitingHead;
+  _SPOOpipelinetoken* waitingTail;
+} _SPOOpipelinestage;
+
+struct _SPOOpipeline
+{
+  SPOOpool          pool;
+  _SPOOpipelinestage* stages;
+  int               stageCount;
+  int               stageCapacity;
+  _SPOOpipelinetoken* tokens;
+  int               tokenCapacity;
+  volatile long     activeTokens;
+  int               inputDone;
+  unsigned long     inputSequence;
+  SPOOmutex         lock;
+  SPOOcond          cond;
+  // Set under the lock by the last token to retire
+  int               done;
+};
+
+
+//------------------------------------------------------------------------
+// Spoo parallel algorithm job
+// The array is split into blocks that the calling thread and a set of pool
+// tasks claim in order; the job is freed by whoever drops the last reference
+//------------------------------------------------------------------------
+
+typedef struct _SPOOparallel _SPOOparallel;
+
+struct _SPOOparallel
+{
+  void              (*function)(_SPOOparallel* job, long block);
+  void*             data;
+  long              blockCount;
+  volatile long     nextBlock;
+  volatile long     doneBlocks;
+  volatile long     refs;
+  SPOOmutex         lock;
+  SPOOcond          cond;
+  SPOOtask*         tasks;
+};
+
+typedef struct _SPOOreduce
+{
+  size_t            count;
+  size_t            blockSize;
+  unsigned char*    partials;
+  size_t            stride;
+  SPOOreducefun     reduce;
+  void*             arg;
+} _SPOOreduce;
+
+// Each partial slot holds a block total or carry followed by scratch space
+typedef struct _SPOOscan
+{
+  const unsigned char* input;
+  unsigned char*    output;
+  size_t            count;
+  size_t            size;
+  size_t            blockSize;
+  unsigned char*    partials;
+  size_t            stride;
+  SPOOcombinefun    combine;
+  void*             arg;
+  int               flags;
+} _SPOOscan;
+
+// Sorts move elements between the array and a buffer of the same size
+typedef struct _SPOOsort
+{
+  unsigned char*    source;
+  unsigned char*    target;
+  size_t            count;
+  size_t            size;
+  size_t            blockSize;
+  size_t            runLength;
+  SPOOcomparefun    compare;
+  SPOOsortkeyfun    key;
+  void*             arg;
+  unsigned long long* keys;
+  unsigned long long* targetKeys;
+  size_t*           offsets;
+  int               shift;
+} _SPOOsort;
+
+
+//------------------------------------------------------------------------
+// Spoo io_uring instance
+// The ring pointers point into memory shared with the kernel
+//------------------------------------------------------------------------
+
+typedef struct _SPOOuring
+{
+  int               fd;
+  unsigned int      entries;
+  void*             sqRing;
+  size_t            sqRingSize;
+  void*             cqRing;
+  size_t            cqRingSize;
+  void*             sqes;
+  size_t            sqesSize;
+  unsigned int*     sqHead;
+  unsigned int*     sqTail;
+  unsigned int*     sqArray;
+  unsigned int      sqMask;
+  unsigned int*     cqHead;
+  unsigned int*     cqTail;
+  unsigned int      cqMask;
+  void*             cqes;
+} _SPOOuring;
+
+
+//------------------------------------------------------------------------
+// Spoo asynchronous file I/O service state
+//------------------------------------------------------------------------
+
+typedef struct _SPOOfileio
+{
+  SPOOpool          pool;
+  volatile long     outstanding;
+
+  // Only used by the blocking fallback
+  SPOOpool          ioPool;
+
+  // Only used with io_uring, protected by the lock
+  int               useRing;
+  _SPOOuring        ring;
+  SPOOthread        completer;
+  SPOOmutex         lock;
+  SPOOcond          cond;
+  int               stopping;
+  unsigned int      inflight;
+  unsigned int      queued;
+  SPOOfilerequest*  backlogHead;
+  SPOOfilerequest*  backlogTail;
+} _SPOOfileio;
+
+
 //------------------------------------------------------------------------
 // Spoo library state
 //------------------------------------------------------------------------
@@ -72,6 +919,39 @@ typedef struct _SPOOlibrary
   _SPOOthread       first;
   SPOOthread        nextID;
 
+  _SPOOtlskey       tlsKeys[SPOO_MAX_TLS_KEYS];
+  SPOOtlskey        threadKey;
+
+  _SPOOfibers       fibers;
+
+  _SPOOpool* volatile defaultPool;
+  SPOOtlskey        poolWorkerKey;
+
+  _SPOOreactor*     reactors;
+  SPOOmutex         reactorLock;
+
+  SPOOtlskey        channelWaiterKey;
+
+  SPOOtlskey        hazardKey;
+
+  SPOOtlskey        combinerKey;
+
+  SPOOtlskey        mcsNodeKey;
+
+  SPOOtlskey        counterShardKey;
+  volatile long     nextCounterShard;
+
+  volatile long     traceEnabled;
+  volatile long     traceGeneration;
+  unsigned long     traceCapacity;
+  SPOOtlskey        traceKey;
+  _SPOOtracebuffer* volatile traceBuffers;
+
+#if defined(_SPOO_MUTEX_PROFILING)
+  SPOOmutex         profiledLock;
+  _SPOOprofiledmutex* profiledMutexes;
+#endif /*_SPOO_MUTEX_PROFILING*/
+
   _SPOO_PLATFORM_LIBRARY_STATE;
 } _SPOOlibrary;
 
@@ -82,6 +962,23 @@ typedef struct _SPOOlibrary
 
 extern _SPOOlibrary _spoo;
 
+// The library initialization state
+extern int _spooInitialized;
+
+
+//========================================================================
+// Tracing
+//========================================================================
+
+// Trace event phases, using the Chrome trace event format letters
+#define _SPOO_TRACE_BEGIN       'B'
+#define _SPOO_TRACE_END         'E'
+#define _SPOO_TRACE_INSTANT     'i'
+
+// Record a trace event for the current thread if tracing is enabled
+#define _SPOO_TRACE(name, phase) \
+        do { if (_spoo.traceEnabled) _spooTraceEvent(name, phase); } while (0)
+
 
 //========================================================================
 // Prototypes for platform-specific functions
@@ -94,23 +991,55 @@ int _spooPlatformTerminate(void);
 // Time
 double _spooPlatformGetTime(void);
 void _spooPlatformSetTime(double time);
+unsigned long long _spooPlatformGetTimerValue(void);
+unsigned long long _spooPlatformGetTimerFrequency(void);
 void _spooPlatformSleep(double time);
 
 // Threads
 SPOOthread _spooPlatformCreateThread(SPOOthreadfun fun, void* arg);
+int _spooPlatformSetThreadStackCache(size_t stackSize, int maxStacks, int flags);
 void _spooPlatformDestroyThread(SPOOthread ID);
+int _spooPlatformRequestCancel(SPOOthread ID);
+void _spooPlatformCancelAllThreads(void);
 int _spooPlatformWaitThread(SPOOthread ID, int waitmode);
 SPOOthread _spooPlatformGetThreadID(void);
 SPOOmutex _spooPlatformCreateMutex(void);
 void _spooPlatformDestroyMutex(SPOOmutex mutex);
+size_t _spooPlatformGetMutexStorageSize(void);
+void _spooPlatformInitMutexStorage(void* storage);
+void _spooPlatformDeinitMutexStorage(SPOOmutex mutex);
 void _spooPlatformLockMutex(SPOOmutex mutex);
+int _spooPlatformTryLockMutex(SPOOmutex mutex);
 void _spooPlatformUnlockMutex(SPOOmutex mutex);
 SPOOcond _spooPlatformCreateCond(void);
 void _spooPlatformDestroyCond(SPOOcond cond);
+int _spooPlatformInitCondStorage(void* storage);
+void _spooPlatformDeinitCondStorage(SPOOcond cond);
 void _spooPlatformWaitCond(SPOOcond cond, SPOOmutex mutex, double timeout);
+void _spooPlatformWaitCondCancellable(SPOOcond cond, SPOOmutex mutex, double timeout,
+                                      volatile long* cancelled);
 void _spooPlatformSignalCond(SPOOcond cond);
 void _spooPlatformBroadcastCond(SPOOcond cond);
 int _spooPlatformGetCPUCoreCount(void);
+int _spooPlatformGetCurrentCPU(void);
+
+// Thread-local storage
+SPOOtlskey _spooPlatformCreateTLSKey(SPOOtlsfun destructor);
+void _spooPlatformDestroyTLSKey(SPOOtlskey key);
+void _spooPlatformSetTLS(SPOOtlskey key, void* value);
+void* _spooPlatformGetTLS(SPOOtlskey key);
+
+// Execution contexts
+int _spooPlatformCreateContext(_SPOOcontext* context, size_t stackSize);
+void _spooPlatformDestroyContext(_SPOOcontext* context);
+int _spooPlatformInitThreadContext(_SPOOcontext* context);
+void _spooPlatformTerminateThreadContext(_SPOOcontext* context);
+void _spooPlatformSwitchContext(_SPOOcontext* from, _SPOOcontext* to);
+
+// Blocking file I/O, returning a byte count or a negative errno value
+long _spooPlatformReadFile(int fd, void* buffer, size_t size, long long offset);
+long _spooPlatformWriteFile(int fd, const void* buffer, size_t size, long long offset);
+long _spooPlatformSyncFile(int fd);
 
 
 //========================================================================
@@ -120,6 +1049,46 @@ int _spooPlatformGetCPUCoreCount(void);
 _SPOOthread* _spooGetThreadPointer(int ID);
 void _spooAppendThread(_SPOOthread* thread);
 void _spooRemoveThread(_SPOOthread* thread);
+void _spooRunTLSDestructors(void);
+int _spooInitThreadCancel(_SPOOthread* thread);
+void _spooTerminateThreadCancel(_SPOOthread* thread);
+void _spooCancelThread(_SPOOthread* thread);
+
+// Tracing
+int _spooInitTracing(void);
+void _spooTerminateTracing(void);
+void _spooTraceEvent(const char* name, char phase);
+void _spooLeaveTracing(void);
+
+// Worker pools
+int _spooInitPools(void);
+void _spooTerminatePools(void);
+int _spooInitReactors(void);
+void _spooTerminateReactors(void);
+int _spooInitChannels(void);
+void _spooTerminateChannels(void);
+_SPOOrecord* _spooGetRecord(SPOOtlskey key, void* owner, _SPOOrecordlist* list,
+                           size_t size, _SPOOrecordfun destroy);
+void _spooLeaveRecords(SPOOtlskey key, _SPOOrecordfun leave, _SPOOrecordfun destroy);
+void _spooReleaseRecords(_SPOOrecordlist* list, _SPOOrecordfun release,
+                         _SPOOrecordfun destroy);
+int _spooInitHazards(void);
+void _spooTerminateHazards(void);
+void _spooLeaveHazardDomains(void);
+int _spooInitCombiners(void);
+void _spooTerminateCombiners(void);
+void _spooLeaveCombiners(void);
+int _spooInitQueueMutexes(void);
+void _spooTerminateQueueMutexes(void);
+SPOOmutex _spooCreateQueueMutex(int kind);
+void _spooDestroyQueueMutex(_SPOOqueuemutex* mutex);
+void _spooLockQueueMutex(_SPOOqueuemutex* mutex);
+void _spooUnlockQueueMutex(_SPOOqueuemutex* mutex);
+void _spooWaitQueueMutexCond(SPOOcond cond, _SPOOqueuemutex* mutex, double timeout,
+                             volatile long* cancelled);
+int _spooInitCounters(void);
+void _spooTerminateCounters(void);
+long _spooGetShardIndex(void);
 
 
 #endif // __spoo_internal_h__
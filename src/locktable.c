@@ -0,0 +1,280 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+// Number of stripes per CPU core when no stripe count is specified
+#define STRIPES_PER_CORE 64
+
+// Number of keys a multi-key lock can sort without allocating
+#define LOCAL_KEYS 16
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Return the stripe index of a key
+// Fibonacci hashing spreads sequential keys and pointers over the stripes
+//
+static unsigned long getStripeIndex(_SPOOlocktable* table, size_t key)
+{
+    if (!table->shift)
+        return 0;
+
+    return (unsigned long) (((unsigned long long) key * 0x9e3779b97f4a7c15ULL) >>
+                            (64 - table->shift));
+}
+
+// Return the mutex of a stripe
+//
+static SPOOmutex getStripe(_SPOOlocktable* table, unsigned long index)
+{
+    return (SPOOmutex) (table->stripes + index * table->stripeSize);
+}
+
+// Fill an array with the distinct stripe indices of a set of keys, in
+// ascending order, and return their number
+//
+static int getStripeIndices(_SPOOlocktable* table, const size_t* keys, int count,
+                            unsigned long* indices)
+{
+    int i, j, distinct = 0;
+    unsigned long index;
+
+    // Insertion sort, as the key sets locked together are usually small
+    for (i = 0;  i < count;  i++)
+    {
+        index = getStripeIndex(table, keys[i]);
+
+        for (j = distinct;  j > 0 && indices[j - 1] > index;  j--)
+            ;
+
+        if (j > 0 && indices[j - 1] == index)
+            continue;
+
+        memmove(indices + j + 1, indices + j, (distinct - j) * sizeof(unsigned long));
+        indices[j] = index;
+        distinct++;
+    }
+
+    return distinct;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create a striped lock table
+// Keys are hashed to one of a fixed number of mutexes, so any number of keys
+// can be locked using a fixed amount of memory.  The stripe count is rounded
+// up to a power of two, with zero selecting a count based on the number of
+// CPU cores.
+//
+SPOOlocktable spooCreateLockTable(int stripeCount)
+{
+    unsigned long index, count = 1;
+    _SPOOlocktable* table;
+
+    if (!_spooInitialized || stripeCount < 0)
+        return NULL;
+
+    if (!stripeCount)
+        stripeCount = spooGetCPUCoreCount() * STRIPES_PER_CORE;
+
+    table = (_SPOOlocktable*) calloc(1, sizeof(_SPOOlocktable));
+    if (!table)
+        return NULL;
+
+    while (count < (unsigned long) stripeCount)
+    {
+        count *= 2;
+        table->shift++;
+    }
+
+    table->stripeCount = count;
+    table->stripeSize = (_spooPlatformGetMutexStorageSize() + _SPOO_CACHE_LINE_SIZE - 1) &
+                        ~((size_t) _SPOO_CACHE_LINE_SIZE - 1);
+
+    // Over-allocate by a cache line so the stripes can be aligned to one
+    table->allocation = malloc(count * table->stripeSize + _SPOO_CACHE_LINE_SIZE);
+    if (!table->allocation)
+    {
+        free(table);
+        return NULL;
+    }
+
+    table->stripes = (char*) (((size_t) table->allocation + _SPOO_CACHE_LINE_SIZE - 1) &
+                              ~((size_t) _SPOO_CACHE_LINE_SIZE - 1));
+
+    for (index = 0;  index < count;  index++)
+        _spooPlatformInitMutexStorage(getStripe(table, index));
+
+    return (SPOOlocktable) table;
+}
+
+// Destroy a striped lock table
+// NOTE: No key of the table may be locked
+//
+void spooDestroyLockTable(SPOOlocktable handle)
+{
+    unsigned long index;
+    _SPOOlocktable* table = (_SPOOlocktable*) handle;
+
+    if (!_spooInitialized || !table)
+        return;
+
+    for (index = 0;  index < table->stripeCount;  index++)
+        _spooPlatformDeinitMutexStorage(getStripe(table, index));
+
+    free(table->allocation);
+    free(table);
+}
+
+// Lock the stripe of a key
+// NOTE: Keys sharing a stripe share its mutex, so a thread holding the lock
+// of one key must use spooLockTableKeys to lock more
+//
+void spooLockTableKey(SPOOlocktable handle, size_t key)
+{
+    _SPOOlocktable* table = (_SPOOlocktable*) handle;
+
+    if (!_spooInitialized || !table)
+        return;
+
+    _spooPlatformLockMutex(getStripe(table, getStripeIndex(table, key)));
+}
+
+// Unlock the stripe of a key
+//
+void spooUnlockTableKey(SPOOlocktable handle, size_t key)
+{
+    _SPOOlocktable* table = (_SPOOlocktable*) handle;
+
+    if (!_spooInitialized || !table)
+        return;
+
+    _spooPlatformUnlockMutex(getStripe(table, getStripeIndex(table, key)));
+}
+
+// Lock the stripes of a set of keys
+// Stripes are locked once each and in ascending order, so threads locking
+// overlapping sets cannot deadlock
+//
+int spooLockTableKeys(SPOOlocktable handle, const size_t* keys, int count)
+{
+    int i, distinct;
+    unsigned long local[LOCAL_KEYS];
+    unsigned long* indices = local;
+    _SPOOlocktable* table = (_SPOOlocktable*) handle;
+
+    if (!_spooInitialized || !table || !keys || count < 0)
+        return SPOO_FALSE;
+
+    if (count > LOCAL_KEYS)
+    {
+        indices = (unsigned long*) malloc(count * sizeof(unsigned long));
+        if (!indices)
+            return SPOO_FALSE;
+    }
+
+    distinct = getStripeIndices(table, keys, count, indices);
+
+    for (i = 0;  i < distinct;  i++)
+        _spooPlatformLockMutex(getStripe(table, indices[i]));
+
+    if (indices != local)
+        free(indices);
+
+    return SPOO_TRUE;
+}
+
+// Unlock the stripes of a set of keys locked with spooLockTableKeys
+//
+void spooUnlockTableKeys(SPOOlocktable handle, const size_t* keys, int count)
+{
+    int i, j, distinct;
+    unsigned long index;
+    unsigned long local[LOCAL_KEYS];
+    unsigned long* indices = local;
+    _SPOOlocktable* table = (_SPOOlocktable*) handle;
+
+    if (!_spooInitialized || !table || !keys || count < 0)
+        return;
+
+    if (count > LOCAL_KEYS)
+        indices = (unsigned long*) malloc(count * sizeof(unsigned long));
+
+    if (indices)
+    {
+        distinct = getStripeIndices(table, keys, count, indices);
+
+        for (i = 0;  i < distinct;  i++)
+            _spooPlatformUnlockMutex(getStripe(table, indices[i]));
+
+        if (indices != local)
+            free(indices);
+
+        return;
+    }
+
+    // Without memory to sort the stripes, unlock each one through the first
+    // key that maps to it
+    for (i = 0;  i < count;  i++)
+    {
+        index = getStripeIndex(table, keys[i]);
+
+        for (j = 0;  j < i;  j++)
+        {
+            if (getStripeIndex(table, keys[j]) == index)
+                break;
+        }
+
+        if (j == i)
+            _spooPlatformUnlockMutex(getStripe(table, index));
+    }
+}
+
+// Return the number of bytes used by a striped lock table
+//
+size_t spooGetLockTableMemory(SPOOlocktable handle)
+{
+    _SPOOlocktable* table = (_SPOOlocktable*) handle;
+
+    if (!_spooInitialized || !table)
+        return 0;
+
+    return sizeof(_SPOOlocktable) + table->stripeCount * table->stripeSize +
+           _SPOO_CACHE_LINE_SIZE;
+}
@@ -0,0 +1,766 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+// Arrays are split into at most this many blocks of at least this many
+// elements, depending only on the element count so results are repeatable
+#define MIN_BLOCK_SIZE 4096
+#define MAX_BLOCK_COUNT 256
+
+// Comparison sorts start by sorting blocks that fit in a typical L2 cache
+#define SORT_BLOCK_BYTES (256 * 1024)
+
+// Radix sorts move elements by eight key bits per pass
+#define RADIX_BITS 8
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Choose the block size for an array of the specified length
+//
+static size_t getBlockSize(size_t count)
+{
+    size_t blockCount = (count + MIN_BLOCK_SIZE - 1) /
+                        MIN_BLOCK_SIZE;
+
+    if (blockCount > MAX_BLOCK_COUNT)
+        blockCount = MAX_BLOCK_COUNT;
+    if (blockCount < 1)
+        blockCount = 1;
+
+    return (count + blockCount - 1) / blockCount;
+}
+
+// Allocate cache line aligned partials, each a copy of the identity
+// The returned pointer is the one to free
+//
+static void* allocatePartials(long count, size_t size, size_t* stride,
+                              const void* identity, unsigned char** partials)
+{
+    long i;
+    void* memory;
+
+    *stride = (size + _SPOO_CACHE_LINE_SIZE - 1) & ~(size_t) (_SPOO_CACHE_LINE_SIZE - 1);
+
+    memory = malloc(count * *stride + _SPOO_CACHE_LINE_SIZE);
+    if (!memory)
+        return NULL;
+
+    *partials = (unsigned char*) (((size_t) memory + _SPOO_CACHE_LINE_SIZE - 1) &
+                                  ~(size_t) (_SPOO_CACHE_LINE_SIZE - 1));
+
+    if (identity)
+    {
+        for (i = 0;  i < count;  i++)
+            memcpy(*partials + i * *stride, identity, size);
+    }
+
+    return memory;
+}
+
+// Drop a reference to a job, freeing it if it was the last one
+//
+static void releaseJob(_SPOOparallel* job)
+{
+    if (_SPOO_ATOMIC_ADD(&job->refs, -1))
+        return;
+
+    spooDestroyCond(job->cond);
+    spooDestroyMutex(job->lock);
+    free(job);
+}
+
+// Claim and run blocks of a job until there are none left
+//
+static void runBlocks(_SPOOparallel* job)
+{
+    long block;
+
+    for (;;)
+    {
+        block = _SPOO_ATOMIC_ADD(&job->nextBlock, 1) - 1;
+        if (block >= job->blockCount)
+            break;
+
+        job->function(job, block);
+
+        if (_SPOO_ATOMIC_ADD(&job->doneBlocks, 1) == job->blockCount)
+        {
+            spooLockMutex(job->lock);
+            spooBroadcastCond(job->cond);
+            spooUnlockMutex(job->lock);
+        }
+    }
+}
+
+// Help run the blocks of a job
+// This runs as a pool task
+//
+static void runHelper(void* arg)
+{
+    _SPOOparallel* job = (_SPOOparallel*) arg;
+
+    runBlocks(job);
+    releaseJob(job);
+}
+
+// Run all blocks of a job on the calling thread and a pool, returning when
+// they are done
+//
+static int runJob(SPOOpool pool, long blockCount,
+                  void (*function)(_SPOOparallel*, long), void* data)
+{
+    int i, helpers;
+    _SPOOparallel* job;
+
+    if (blockCount == 1)
+    {
+        _SPOOparallel single;
+
+        single.data = data;
+        function(&single, 0);
+        return SPOO_TRUE;
+    }
+
+    helpers = spooGetPoolThreadCount(pool);
+    if (helpers > blockCount - 1)
+        helpers = (int) blockCount - 1;
+
+    job = (_SPOOparallel*) calloc(1, sizeof(_SPOOparallel) +
+                                     helpers * sizeof(SPOOtask));
+    if (!job)
+        return SPOO_FALSE;
+
+    job->function = function;
+    job->data = data;
+    job->blockCount = blockCount;
+    job->refs = helpers + 1;
+    job->tasks = (SPOOtask*) (job + 1);
+    job->lock = spooCreateMutex();
+    job->cond = spooCreateCond();
+
+    if (!job->lock || !job->cond)
+    {
+        spooDestroyCond(job->cond);
+        spooDestroyMutex(job->lock);
+        free(job);
+        return SPOO_FALSE;
+    }
+
+    spooSetMutexName(job->lock, "parallel");
+
+    for (i = 0;  i < helpers;  i++)
+    {
+        job->tasks[i].fun = runHelper;
+        job->tasks[i].arg = job;
+        spooSubmitTask(pool, job->tasks + i);
+    }
+
+    runBlocks(job);
+
+    // Blocks claimed by helpers may still be running
+    if (_SPOO_ATOMIC_LOAD(&job->doneBlocks) < blockCount)
+    {
+        spooLockMutex(job->lock);
+        while (_SPOO_ATOMIC_LOAD(&job->doneBlocks) < blockCount)
+            spooWaitCond(job->cond, job->lock, SPOO_INFINITY);
+        spooUnlockMutex(job->lock);
+    }
+
+    releaseJob(job);
+    return SPOO_TRUE;
+}
+
+// Reduce one block into its partial
+//
+static void reduceBlock(_SPOOparallel* job, long block)
+{
+    _SPOOreduce* reduce = (_SPOOreduce*) job->data;
+    const size_t first = block * reduce->blockSize;
+    size_t count = reduce->count - first;
+
+    if (count > reduce->blockSize)
+        count = reduce->blockSize;
+
+    reduce->reduce(reduce->partials + block * reduce->stride,
+                   first, count, reduce->arg);
+}
+
+// Scan a range of elements starting from the specified carry
+//
+static void scanRange(_SPOOscan* scan, size_t first, size_t count,
+                      unsigned char* carry, unsigned char* scratch)
+{
+    size_t i;
+    const size_t size = scan->size;
+    const unsigned char* input = scan->input + first * size;
+    unsigned char* output = scan->output + first * size;
+
+    if (scan->flags & SPOO_SCAN_EXCLUSIVE)
+    {
+        // The input is copied first as it may be the output
+        for (i = 0;  i < count;  i++)
+        {
+            memcpy(scratch, input + i * size, size);
+            memcpy(output + i * size, carry, size);
+            scan->combine(carry, scratch, scan->arg);
+        }
+    }
+    else
+    {
+        for (i = 0;  i < count;  i++)
+        {
+            scan->combine(carry, input + i * size, scan->arg);
+            memcpy(output + i * size, carry, size);
+        }
+    }
+}
+
+// Sum up one block of a scan
+//
+static void totalBlock(_SPOOparallel* job, long block)
+{
+    size_t i, count;
+    _SPOOscan* scan = (_SPOOscan*) job->data;
+    const size_t first = block * scan->blockSize;
+    const unsigned char* input = scan->input + first * scan->size;
+    unsigned char* total = scan->partials + block * scan->stride;
+
+    count = scan->count - first;
+    if (count > scan->blockSize)
+        count = scan->blockSize;
+
+    for (i = 0;  i < count;  i++)
+        scan->combine(total, input + i * scan->size, scan->arg);
+}
+
+// Scan one block starting from the total of all blocks before it
+//
+static void scanBlock(_SPOOparallel* job, long block)
+{
+    size_t count;
+    _SPOOscan* scan = (_SPOOscan*) job->data;
+    const size_t first = block * scan->blockSize;
+    unsigned char* carry = scan->partials + block * scan->stride;
+
+    count = scan->count - first;
+    if (count > scan->blockSize)
+        count = scan->blockSize;
+
+    scanRange(scan, first, count, carry, carry + scan->size);
+}
+
+
+// Copy an array element, letting common sizes become single moves
+//
+static void copyElement(unsigned char* target, const unsigned char* source,
+                        size_t size)
+{
+    switch (size)
+    {
+        case 4:
+            memcpy(target, source, 4);
+            break;
+        case 8:
+            memcpy(target, source, 8);
+            break;
+        case 16:
+            memcpy(target, source, 16);
+            break;
+        default:
+            memcpy(target, source, size);
+            break;
+    }
+}
+
+// Return the number of elements in a block of a sort job
+//
+static size_t getSortBlockCount(_SPOOsort* sort, long block)
+{
+    const size_t first = block * sort->blockSize;
+    const size_t count = sort->count - first;
+
+    if (count > sort->blockSize)
+        return sort->blockSize;
+
+    return count;
+}
+
+// Sort one block in place
+//
+static void sortBlock(_SPOOparallel* job, long block)
+{
+    _SPOOsort* sort = (_SPOOsort*) job->data;
+
+    qsort(sort->source + block * sort->blockSize * sort->size,
+          getSortBlockCount(sort, block), sort->size, sort->compare);
+}
+
+// Produce one block of the merge of two adjacent sorted runs, starting
+// where the merge path crosses the first output element of the block
+//
+static void mergeBlock(_SPOOparallel* job, long block)
+{
+    size_t i, j, k, lo, hi, na, nb, first, end;
+    _SPOOsort* sort = (_SPOOsort*) job->data;
+    const size_t size = sort->size;
+    const size_t start = block * sort->blockSize;
+    const size_t pairStart = start / (sort->runLength * 2) * (sort->runLength * 2);
+    const unsigned char* a = sort->source + pairStart * size;
+    const unsigned char* b;
+    unsigned char* output = sort->target + start * size;
+
+    na = sort->count - pairStart;
+    if (na > sort->runLength)
+        na = sort->runLength;
+
+    nb = sort->count - pairStart - na;
+    if (nb > sort->runLength)
+        nb = sort->runLength;
+
+    b = a + na * size;
+
+    first = start - pairStart;
+    end = first + getSortBlockCount(sort, block);
+
+    // Find how many elements of the first run precede this output block,
+    // taking elements from the first run on ties to keep the merge stable
+    lo = first > nb ? first - nb : 0;
+    hi = first < na ? first : na;
+
+    while (lo < hi)
+    {
+        i = lo + (hi - lo) / 2;
+        j = first - i;
+
+        if (sort->compare(a + i * size, b + (j - 1) * size) <= 0)
+            lo = i + 1;
+        else
+            hi = i;
+    }
+
+    i = lo;
+    j = first - lo;
+
+    for (k = first;  k < end;  k++)
+    {
+        if (j >= nb || (i < na && sort->compare(a + i * size, b + j * size) <= 0))
+            copyElement(output, a + i++ * size, size);
+        else
+            copyElement(output, b + j++ * size, size);
+
+        output += size;
+    }
+}
+
+// Copy one block from the source to the target
+//
+static void copyBlock(_SPOOparallel* job, long block)
+{
+    _SPOOsort* sort = (_SPOOsort*) job->data;
+    const size_t offset = block * sort->blockSize * sort->size;
+
+    memcpy(sort->target + offset, sort->source + offset,
+           getSortBlockCount(sort, block) * sort->size);
+}
+
+// Extract the keys of one block
+//
+static void extractBlockKeys(_SPOOparallel* job, long block)
+{
+    size_t i;
+    _SPOOsort* sort = (_SPOOsort*) job->data;
+    const size_t first = block * sort->blockSize;
+    const size_t end = first + getSortBlockCount(sort, block);
+
+    for (i = first;  i < end;  i++)
+        sort->keys[i] = sort->key(sort->source + i * sort->size, sort->arg);
+}
+
+// Count the current digits of the keys of one block
+//
+static void countBlockDigits(_SPOOparallel* job, long block)
+{
+    size_t i;
+    _SPOOsort* sort = (_SPOOsort*) job->data;
+    const size_t first = block * sort->blockSize;
+    const size_t end = first + getSortBlockCount(sort, block);
+    size_t* counts = sort->offsets + block * RADIX_SIZE;
+
+    memset(counts, 0, RADIX_SIZE * sizeof(size_t));
+
+    for (i = first;  i < end;  i++)
+        counts[(sort->keys[i] >> sort->shift) & (RADIX_SIZE - 1)]++;
+}
+
+// Move the elements of one block to their places for the current digit
+//
+static void scatterBlock(_SPOOparallel* job, long block)
+{
+    size_t i, digit, target;
+    size_t offsets[RADIX_SIZE];
+    _SPOOsort* sort = (_SPOOsort*) job->data;
+    const size_t size = sort->size;
+    const size_t first = block * sort->blockSize;
+    const size_t end = first + getSortBlockCount(sort, block);
+
+    memcpy(offsets, sort->offsets + block * RADIX_SIZE, sizeof(offsets));
+
+    for (i = first;  i < end;  i++)
+    {
+        digit = (sort->keys[i] >> sort->shift) & (RADIX_SIZE - 1);
+        target = offsets[digit]++;
+
+        sort->targetKeys[target] = sort->keys[i];
+        copyElement(sort->target + target * size, sort->source + i * size, size);
+    }
+}
+
+// Turn per-block digit counts into per-block target offsets
+// Returns SPOO_FALSE if all keys have the same digit
+//
+static int prepareScatter(_SPOOsort* sort, long blockCount)
+{
+    long block;
+    size_t digit, count, total, position = 0;
+
+    for (digit = 0;  digit < RADIX_SIZE;  digit++)
+    {
+        total = 0;
+
+        for (block = 0;  block < blockCount;  block++)
+            total += sort->offsets[block * RADIX_SIZE + digit];
+
+        if (total == sort->count)
+            return SPOO_FALSE;
+    }
+
+    for (digit = 0;  digit < RADIX_SIZE;  digit++)
+    {
+        for (block = 0;  block < blockCount;  block++)
+        {
+            count = sort->offsets[block * RADIX_SIZE + digit];
+            sort->offsets[block * RADIX_SIZE + digit] = position;
+            position += count;
+        }
+    }
+
+    return SPOO_TRUE;
+}
+
+// Run the passes of a radix sort, leaving the elements in the source
+//
+static int radixSort(SPOOpool pool, _SPOOsort* sort, long blockCount)
+{
+    void* swap;
+
+    if (!runJob(pool, blockCount, extractBlockKeys, sort))
+        return SPOO_FALSE;
+
+    for (sort->shift = 0;
+         sort->shift < (int) sizeof(unsigned long long) * 8;
+         sort->shift += RADIX_BITS)
+    {
+        if (!runJob(pool, blockCount, countBlockDigits, sort))
+            return SPOO_FALSE;
+
+        if (!prepareScatter(sort, blockCount))
+            continue;
+
+        if (!runJob(pool, blockCount, scatterBlock, sort))
+            return SPOO_FALSE;
+
+        swap = sort->source;
+        sort->source = sort->target;
+        sort->target = (unsigned char*) swap;
+
+        swap = sort->keys;
+        sort->keys = sort->targetKeys;
+        sort->targetKeys = (unsigned long long*) swap;
+    }
+
+    return SPOO_TRUE;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Reduce the index range [0, count) in parallel, with the result starting
+// out as the identity and partial results combined in index order
+//
+int spooParallelReduce(SPOOpool pool, size_t count, void* result, size_t size,
+                       SPOOreducefun reduce, SPOOcombinefun combine, void* arg)
+{
+    long i, blockCount;
+    void* memory;
+    _SPOOreduce state;
+
+    if (!_spooInitialized || !result || !reduce || !combine)
+        return SPOO_FALSE;
+
+    if (!count)
+        return SPOO_TRUE;
+
+    state.count = count;
+    state.blockSize = getBlockSize(count);
+    state.reduce = reduce;
+    state.arg = arg;
+
+    blockCount = (long) ((count + state.blockSize - 1) / state.blockSize);
+
+    memory = allocatePartials(blockCount, size, &state.stride, result,
+                              &state.partials);
+    if (!memory)
+        return SPOO_FALSE;
+
+    if (!runJob(pool, blockCount, reduceBlock, &state))
+    {
+        free(memory);
+        return SPOO_FALSE;
+    }
+
+    for (i = 0;  i < blockCount;  i++)
+        combine(result, state.partials + i * state.stride, arg);
+
+    free(memory);
+    return SPOO_TRUE;
+}
+
+// Compute the inclusive or exclusive prefix sums of an array in parallel
+// The output may be the same array as the input
+//
+int spooParallelScan(SPOOpool pool, const void* input, void* output,
+                     size_t count, size_t size, const void* identity,
+                     SPOOcombinefun combine, void* arg, int flags)
+{
+    long i, blockCount;
+    void* memory;
+    unsigned char* carry;
+    unsigned char* total;
+    _SPOOscan state;
+
+    if (!_spooInitialized || !input || !output || !identity || !combine)
+        return SPOO_FALSE;
+
+    if (!count)
+        return SPOO_TRUE;
+
+    state.input = (const unsigned char*) input;
+    state.output = (unsigned char*) output;
+    state.count = count;
+    state.size = size;
+    state.blockSize = getBlockSize(count);
+    state.combine = combine;
+    state.arg = arg;
+    state.flags = flags;
+
+    blockCount = (long) ((count + state.blockSize - 1) / state.blockSize);
+
+    // One extra slot holds the running carry between the passes
+    memory = allocatePartials(blockCount + 1, size * 2, &state.stride, NULL,
+                              &state.partials);
+    if (!memory)
+        return SPOO_FALSE;
+
+    for (i = 0;  i <= blockCount;  i++)
+        memcpy(state.partials + i * state.stride, identity, size);
+
+    if (blockCount == 1)
+    {
+        scanRange(&state, 0, count, state.partials, state.partials + size);
+        free(memory);
+        return SPOO_TRUE;
+    }
+
+    // The last block total is never needed
+    if (!runJob(pool, blockCount - 1, totalBlock, &state))
+    {
+        free(memory);
+        return SPOO_FALSE;
+    }
+
+    // Turn the block totals into the carry into each block
+    carry = state.partials + blockCount * state.stride;
+
+    for (i = 0;  i < blockCount;  i++)
+    {
+        total = state.partials + i * state.stride;
+
+        memcpy(total + size, total, size);
+        memcpy(total, carry, size);
+        combine(carry, total + size, arg);
+    }
+
+    if (!runJob(pool, blockCount, scanBlock, &state))
+    {
+        free(memory);
+        return SPOO_FALSE;
+    }
+
+    free(memory);
+    return SPOO_TRUE;
+}
+
+// Sort an array in parallel like qsort
+// Blocks are sorted with qsort and then merged in parallel passes
+//
+int spooParallelSort(SPOOpool pool, void* base, size_t count, size_t size,
+                     SPOOcomparefun compare)
+{
+    int result = SPOO_TRUE;
+    long blockCount;
+    unsigned char* buffer;
+    unsigned char* swap;
+    _SPOOsort state;
+
+    if (!_spooInitialized || !base || !size || !compare)
+        return SPOO_FALSE;
+
+    memset(&state, 0, sizeof(state));
+    state.source = (unsigned char*) base;
+    state.count = count;
+    state.size = size;
+    state.compare = compare;
+
+    state.blockSize = SORT_BLOCK_BYTES / size;
+    if (state.blockSize < 16)
+        state.blockSize = 16;
+
+    if (count <= state.blockSize)
+    {
+        qsort(base, count, size, compare);
+        return SPOO_TRUE;
+    }
+
+    blockCount = (long) ((count + state.blockSize - 1) / state.blockSize);
+
+    buffer = (unsigned char*) malloc(count * size);
+    if (!buffer)
+        return SPOO_FALSE;
+
+    state.target = buffer;
+
+    if (!runJob(pool, blockCount, sortBlock, &state))
+    {
+        free(buffer);
+        return SPOO_FALSE;
+    }
+
+    // Runs are a power of two blocks long, so merge blocks never straddle
+    // two pairs of runs
+    for (state.runLength = state.blockSize;
+         state.runLength < count;
+         state.runLength *= 2)
+    {
+        if (!runJob(pool, blockCount, mergeBlock, &state))
+        {
+            result = SPOO_FALSE;
+            break;
+        }
+
+        swap = state.source;
+        state.source = state.target;
+        state.target = swap;
+    }
+
+    // Make sure the elements end up back in the array even on failure
+    if (state.source != (unsigned char*) base)
+    {
+        if (!runJob(pool, blockCount, copyBlock, &state))
+            memcpy(base, state.source, count * size);
+    }
+
+    free(buffer);
+    return result;
+}
+
+// Sort an array in parallel by an unsigned integer key of each element
+// This is a stable least significant digit radix sort that skips digits
+// all keys share
+//
+int spooParallelRadixSort(SPOOpool pool, void* base, size_t count, size_t size,
+                          SPOOsortkeyfun key, void* arg)
+{
+    int result;
+    long blockCount;
+    unsigned char* buffer;
+    _SPOOsort state;
+
+    if (!_spooInitialized || !base || !size || !key)
+        return SPOO_FALSE;
+
+    if (count < 2)
+        return SPOO_TRUE;
+
+    memset(&state, 0, sizeof(state));
+    state.source = (unsigned char*) base;
+    state.count = count;
+    state.size = size;
+    state.blockSize = getBlockSize(count);
+    state.key = key;
+    state.arg = arg;
+
+    blockCount = (long) ((count + state.blockSize - 1) / state.blockSize);
+
+    buffer = (unsigned char*) malloc(count * size);
+    state.target = buffer;
+    state.keys = (unsigned long long*) malloc(count * sizeof(unsigned long long));
+    state.targetKeys = (unsigned long long*) malloc(count * sizeof(unsigned long long));
+    state.offsets = (size_t*) malloc(blockCount * RADIX_SIZE * sizeof(size_t));
+
+    if (buffer && state.keys && state.targetKeys && state.offsets)
+        result = radixSort(pool, &state, blockCount);
+    else
+        result = SPOO_FALSE;
+
+    // Make sure the elements end up back in the array even on failure
+    if (state.source != (unsigned char*) base)
+    {
+        state.target = (unsigned char*) base;
+
+        if (!runJob(pool, blockCount, copyBlock, &state))
+            memcpy(base, state.source, count * size);
+    }
+
+    free(buffer);
+    free(state.keys);
+    free(state.targetKeys);
+    free(state.offsets);
+    return result;
+}
@@ -0,0 +1,381 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Retire a token that will carry no more items
+// The runner only returns once the last token has set the done flag, so the
+// pipeline stays valid until its lock is released here
+//
+static void retireToken(_SPOOpipeline* pipeline)
+{
+    if (_SPOO_ATOMIC_ADD(&pipeline->activeTokens, -1))
+        return;
+
+    spooLockMutex(pipeline->lock);
+    pipeline->done = SPOO_TRUE;
+    spooBroadcastCond(pipeline->cond);
+    spooUnlockMutex(pipeline->lock);
+}
+
+// Check whether a token may enter a serial stage next
+// This is called with the stage locked
+//
+static int isTokensTurn(_SPOOpipelinestage* stage, int index,
+                        _SPOOpipelinetoken* token)
+{
+    // The input stage assigns the sequence numbers, so any token will do
+    if (index == 0 || stage->mode == SPOO_STAGE_SERIAL_OUT_OF_ORDER)
+        return SPOO_TRUE;
+
+    return token->sequence == stage->nextSequence;
+}
+
+// Enter a serial stage, or park the token on it if it cannot go yet
+//
+static int enterStage(_SPOOpipelinestage* stage, int index,
+                      _SPOOpipelinetoken* token)
+{
+    spooLockMutex(stage->lock);
+
+    if (!stage->busy && isTokensTurn(stage, index, token))
+    {
+        stage->busy = SPOO_TRUE;
+        spooUnlockMutex(stage->lock);
+        return SPOO_TRUE;
+    }
+
+    token->next = NULL;
+    if (stage->waitingTail)
+        stage->waitingTail->next = token;
+    else
+        stage->waitingHead = token;
+    stage->waitingTail = token;
+
+    spooUnlockMutex(stage->lock);
+    return SPOO_FALSE;
+}
+
+// Leave a serial stage and resume the parked token whose turn it now is
+//
+static void leaveStage(_SPOOpipeline* pipeline, _SPOOpipelinestage* stage,
+                       int index)
+{
+    _SPOOpipelinetoken* token;
+    _SPOOpipelinetoken* previous = NULL;
+
+    spooLockMutex(stage->lock);
+
+    stage->busy = SPOO_FALSE;
+    stage->nextSequence++;
+
+    for (token = stage->waitingHead;  token;  token = token->next)
+    {
+        if (isTokensTurn(stage, index, token))
+            break;
+
+        previous = token;
+    }
+
+    if (token)
+    {
+        if (previous)
+            previous->next = token->next;
+        else
+            stage->waitingHead = token->next;
+
+        if (stage->waitingTail == token)
+            stage->waitingTail = previous;
+
+        stage->busy = SPOO_TRUE;
+        token->resumed = SPOO_TRUE;
+    }
+
+    spooUnlockMutex(stage->lock);
+
+    // The resumed token already owns the stage
+    if (token)
+        spooSubmitTask(pipeline->pool, &token->task);
+}
+
+// Carry the item of a token through the stages, starting at its current
+// stage, and then go back for another item
+// This runs as a pool task
+//
+static void runToken(void* arg)
+{
+    _SPOOpipelinestage* stage;
+    _SPOOpipelinetoken* token = (_SPOOpipelinetoken*) arg;
+    _SPOOpipeline* pipeline = token->pipeline;
+
+    // A token resumed on a serial stage already owns it
+    int owned = token->resumed;
+
+    token->resumed = SPOO_FALSE;
+
+    for (;;)
+    {
+        stage = pipeline->stages + token->stage;
+
+        if (stage->mode != SPOO_STAGE_PARALLEL || token->stage == 0)
+        {
+            if (!owned && !enterStage(stage, token->stage, token))
+                return;
+        }
+
+        owned = SPOO_FALSE;
+
+        if (token->stage == 0)
+        {
+            if (!pipeline->inputDone)
+            {
+                token->item = stage->function(NULL, stage->arg);
+                if (token->item)
+                    token->sequence = pipeline->inputSequence++;
+                else
+                    pipeline->inputDone = SPOO_TRUE;
+            }
+
+            if (!token->item)
+            {
+                leaveStage(pipeline, stage, 0);
+                retireToken(pipeline);
+                return;
+            }
+        }
+        else if (token->item)
+        {
+            // Items dropped by an earlier stage still take their turn
+            token->item = stage->function(token->item, stage->arg);
+        }
+
+        if (stage->mode != SPOO_STAGE_PARALLEL || token->stage == 0)
+            leaveStage(pipeline, stage, token->stage);
+
+        token->stage++;
+
+        if (token->stage == pipeline->stageCount)
+        {
+            token->stage = 0;
+            token->item = NULL;
+        }
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create an empty pipeline running its stages on a pool
+//
+SPOOpipeline spooCreatePipeline(SPOOpool pool)
+{
+    _SPOOpipeline* pipeline;
+
+    if (!_spooInitialized)
+        return NULL;
+
+    pipeline = (_SPOOpipeline*) calloc(1, sizeof(_SPOOpipeline));
+    if (!pipeline)
+        return NULL;
+
+    pipeline->pool = pool;
+    pipeline->lock = spooCreateMutex();
+    pipeline->cond = spooCreateCond();
+
+    if (!pipeline->lock || !pipeline->cond)
+    {
+        spooDestroyCond(pipeline->cond);
+        spooDestroyMutex(pipeline->lock);
+        free(pipeline);
+        return NULL;
+    }
+
+    spooSetMutexName(pipeline->lock, "pipeline");
+
+    return (SPOOpipeline) pipeline;
+}
+
+// Destroy a pipeline
+// NOTE: The pipeline must not be running
+//
+void spooDestroyPipeline(SPOOpipeline handle)
+{
+    int i;
+    _SPOOpipeline* pipeline = (_SPOOpipeline*) handle;
+
+    if (!_spooInitialized || !pipeline)
+        return;
+
+    for (i = 0;  i < pipeline->stageCount;  i++)
+        spooDestroyMutex(pipeline->stages[i].lock);
+
+    spooDestroyCond(pipeline->cond);
+    spooDestroyMutex(pipeline->lock);
+
+    free(pipeline->stages);
+    free(pipeline->tokens);
+    free(pipeline);
+}
+
+// Append a stage to a pipeline
+// The first stage is always serial and produces the items, returning NULL
+// when there are no more.  Later stages transform items, and an item they
+// return NULL for is dropped.
+//
+int spooAddPipelineStage(SPOOpipeline handle, int mode, SPOOstagefun fun, void* arg)
+{
+    _SPOOpipelinestage* stage;
+    _SPOOpipeline* pipeline = (_SPOOpipeline*) handle;
+
+    if (!_spooInitialized || !pipeline || !fun)
+        return SPOO_FALSE;
+
+    if (mode != SPOO_STAGE_PARALLEL &&
+        mode != SPOO_STAGE_SERIAL_IN_ORDER &&
+        mode != SPOO_STAGE_SERIAL_OUT_OF_ORDER)
+    {
+        return SPOO_FALSE;
+    }
+
+    if (pipeline->stageCount == pipeline->stageCapacity)
+    {
+        int capacity = pipeline->stageCapacity ? pipeline->stageCapacity * 2 : 4;
+
+        stage = (_SPOOpipelinestage*) realloc(pipeline->stages,
+                                              capacity * sizeof(_SPOOpipelinestage));
+        if (!stage)
+            return SPOO_FALSE;
+
+        pipeline->stages = stage;
+        pipeline->stageCapacity = capacity;
+    }
+
+    stage = pipeline->stages + pipeline->stageCount;
+    memset(stage, 0, sizeof(_SPOOpipelinestage));
+
+    stage->mode = mode;
+    stage->function = fun;
+    stage->arg = arg;
+
+    if (mode != SPOO_STAGE_PARALLEL || pipeline->stageCount == 0)
+    {
+        stage->lock = spooCreateMutex();
+        if (!stage->lock)
+            return SPOO_FALSE;
+
+        spooSetMutexName(stage->lock, "pipeline stage");
+    }
+
+    pipeline->stageCount++;
+    return SPOO_TRUE;
+}
+
+// Run a pipeline until its first stage runs out of items, with at most the
+// specified number of items in flight, helping the pool meanwhile
+//
+int spooRunPipeline(SPOOpipeline handle, int tokenCount)
+{
+    int i;
+    _SPOOpipelinetoken* token;
+    _SPOOpipeline* pipeline = (_SPOOpipeline*) handle;
+
+    if (!_spooInitialized || !pipeline || tokenCount < 1)
+        return SPOO_FALSE;
+
+    if (!pipeline->stageCount)
+        return SPOO_TRUE;
+
+    if (pipeline->tokenCapacity < tokenCount)
+    {
+        token = (_SPOOpipelinetoken*) realloc(pipeline->tokens,
+                                              tokenCount * sizeof(_SPOOpipelinetoken));
+        if (!token)
+            return SPOO_FALSE;
+
+        pipeline->tokens = token;
+        pipeline->tokenCapacity = tokenCount;
+    }
+
+    for (i = 0;  i < pipeline->stageCount;  i++)
+    {
+        pipeline->stages[i].busy = SPOO_FALSE;
+        pipeline->stages[i].nextSequence = 0;
+        pipeline->stages[i].waitingHead = NULL;
+        pipeline->stages[i].waitingTail = NULL;
+    }
+
+    pipeline->inputDone = SPOO_FALSE;
+    pipeline->inputSequence = 0;
+    pipeline->done = SPOO_FALSE;
+    _SPOO_ATOMIC_STORE(&pipeline->activeTokens, tokenCount);
+
+    // All tokens start out queued for the input stage
+    for (i = 0;  i < tokenCount;  i++)
+    {
+        token = pipeline->tokens + i;
+        token->task.fun = runToken;
+        token->task.arg = token;
+        token->pipeline = pipeline;
+        token->item = NULL;
+        token->stage = 0;
+        token->resumed = SPOO_FALSE;
+
+        spooSubmitTask(pipeline->pool, &token->task);
+    }
+
+    while (_SPOO_ATOMIC_LOAD(&pipeline->activeTokens))
+    {
+        if (spooRunPoolTask(pipeline->pool))
+            continue;
+
+        spooLockMutex(pipeline->lock);
+        if (!pipeline->done)
+            spooWaitCond(pipeline->cond, pipeline->lock, SPOO_INFINITY);
+        spooUnlockMutex(pipeline->lock);
+    }
+
+    // The last token to retire may still be signalling, so wait until it is
+    // done with the pipeline
+    spooLockMutex(pipeline->lock);
+    while (!pipeline->done)
+        spooWaitCond(pipeline->cond, pipeline->lock, SPOO_INFINITY);
+    spooUnlockMutex(pipeline->lock);
+
+    return SPOO_TRUE;
+}
@@ -0,0 +1,605 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+
+
+// Number of tasks a busy worker runs between checks for expired timers
+#define TIMER_CHECK_INTERVAL 64
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Return the worker state of the current thread if it belongs to the pool
+//
+static _SPOOpoolworker* getWorker(_SPOOpool* pool)
+{
+    _SPOOpoolworker* worker;
+
+    worker = (_SPOOpoolworker*) _spooPlatformGetTLS(_spoo.poolWorkerKey);
+    if (worker && worker->pool == pool)
+        return worker;
+
+    return NULL;
+}
+
+// Append a task to the queue of a worker
+//
+static void pushTask(_SPOOpoolworker* worker, SPOOtask* task)
+{
+    task->next = NULL;
+
+    spooLockMutex(worker->lock);
+
+    if (worker->tail)
+        worker->tail->next = task;
+    else
+        worker->head = task;
+
+    worker->tail = task;
+
+    spooUnlockMutex(worker->lock);
+}
+
+// Remove the first task from the queue of a worker
+//
+static SPOOtask* popTask(_SPOOpoolworker* worker)
+{
+    SPOOtask* task;
+
+    // This unlocked check is only a hint, but avoids taking the locks of
+    // idle workers while looking for work
+    if (!worker->head)
+        return NULL;
+
+    spooLockMutex(worker->lock);
+
+    task = worker->head;
+    if (task)
+    {
+        worker->head = task->next;
+        if (!worker->head)
+            worker->tail = NULL;
+    }
+
+    spooUnlockMutex(worker->lock);
+
+    if (task)
+        _SPOO_ATOMIC_ADD(&worker->pool->pending, -1);
+
+    return task;
+}
+
+// Find a task to run, starting with the queue of the specified worker
+//
+static SPOOtask* findTask(_SPOOpool* pool, int start)
+{
+    int i;
+    SPOOtask* task;
+
+    for (i = 0;  i < pool->workerCount;  i++)
+    {
+        task = popTask(pool->workers + (start + i) % pool->workerCount);
+        if (task)
+            return task;
+    }
+
+    return NULL;
+}
+
+// Run a task
+// NOTE: The task may be reused or freed by its function, so it must not be
+// touched once the function has been called
+//
+static void runTask(SPOOtask* task)
+{
+    SPOOthreadfun function = task->fun;
+    void* arg = task->arg;
+
+    _SPOO_TRACE("Task", _SPOO_TRACE_BEGIN);
+    function(arg);
+    _SPOO_TRACE("Task", _SPOO_TRACE_END);
+}
+
+// Wake a sleeping worker, if there is one
+//
+static void wakeWorker(_SPOOpool* pool)
+{
+    // Pairs with the fence in workerMain, so that either the worker sees
+    // the new task or we see the sleeping worker
+    _SPOO_ATOMIC_FENCE();
+
+    if (!_SPOO_ATOMIC_LOAD(&pool->sleepers))
+        return;
+
+    spooLockMutex(pool->lock);
+    spooSignalCond(pool->cond);
+    spooUnlockMutex(pool->lock);
+}
+
+// Make a task runnable on the specified worker
+//
+static void queueTask(_SPOOpoolworker* worker, SPOOtask* task)
+{
+    pushTask(worker, task);
+    _SPOO_ATOMIC_ADD(&worker->pool->pending, 1);
+}
+
+// Swap two entries of the timer heap
+//
+static void swapTimers(_SPOOpool* pool, long a, long b)
+{
+    _SPOOpooltimer timer = pool->timers[a];
+
+    pool->timers[a] = pool->timers[b];
+    pool->timers[b] = timer;
+}
+
+// Add a timer to the heap
+// NOTE: The pool lock must be held
+//
+static int addTimer(_SPOOpool* pool, SPOOtask* task, double time)
+{
+    long index, parent;
+    _SPOOpooltimer* timers;
+
+    if (pool->timerCount == pool->timerCapacity)
+    {
+        long capacity = pool->timerCapacity * 2;
+        if (!capacity)
+            capacity = 64;
+
+        timers = (_SPOOpooltimer*) realloc(pool->timers,
+                                           capacity * sizeof(_SPOOpooltimer));
+        if (!timers)
+            return SPOO_FALSE;
+
+        pool->timers = timers;
+        pool->timerCapacity = capacity;
+    }
+
+    index = pool->timerCount++;
+    pool->timers[index].time = time;
+    pool->timers[index].task = task;
+
+    while (index > 0)
+    {
+        parent = (index - 1) / 2;
+        if (pool->timers[parent].time <= pool->timers[index].time)
+            break;
+
+        swapTimers(pool, index, parent);
+        index = parent;
+    }
+
+    return SPOO_TRUE;
+}
+
+// Remove the earliest timer from the heap
+// NOTE: The pool lock must be held
+//
+static void removeFirstTimer(_SPOOpool* pool)
+{
+    long index = 0, child;
+
+    pool->timerCount--;
+    pool->timers[0] = pool->timers[pool->timerCount];
+
+    for (;;)
+    {
+        child = index * 2 + 1;
+        if (child >= pool->timerCount)
+            break;
+
+        if (child + 1 < pool->timerCount &&
+            pool->timers[child + 1].time < pool->timers[child].time)
+        {
+            child++;
+        }
+
+        if (pool->timers[index].time <= pool->timers[child].time)
+            break;
+
+        swapTimers(pool, index, child);
+        index = child;
+    }
+}
+
+// Queue the tasks of all expired timers on the specified worker, and return
+// the time until the next timer expires
+// NOTE: The pool lock must be held
+//
+static double fireTimers(_SPOOpoolworker* worker)
+{
+    double now;
+    int fired = 0;
+    _SPOOpool* pool = worker->pool;
+
+    if (!pool->timerCount)
+        return SPOO_INFINITY;
+
+    now = _spooPlatformGetTime();
+
+    while (pool->timerCount)
+    {
+        if (pool->timers[0].time > now)
+            break;
+
+        queueTask(worker, pool->timers[0].task);
+        removeFirstTimer(pool);
+        fired++;
+    }
+
+    // Let other workers steal the rest
+    if (fired > 1)
+        spooBroadcastCond(pool->cond);
+
+    if (!pool->timerCount)
+        return SPOO_INFINITY;
+
+    return pool->timers[0].time - now;
+}
+
+// Run pool tasks until the pool is destroyed
+//
+static void workerMain(void* arg)
+{
+    int count = 0;
+    double timeout;
+    SPOOtask* task;
+    _SPOOpoolworker* worker = (_SPOOpoolworker*) arg;
+    _SPOOpool* pool = worker->pool;
+
+    _spooPlatformSetTLS(_spoo.poolWorkerKey, worker);
+
+    for (;;)
+    {
+        if (++count == TIMER_CHECK_INTERVAL)
+        {
+            count = 0;
+
+            if (_SPOO_ATOMIC_LOAD(&pool->timerCount))
+            {
+                spooLockMutex(pool->lock);
+                fireTimers(worker);
+                spooUnlockMutex(pool->lock);
+            }
+        }
+
+        task = findTask(pool, worker->index);
+        if (task)
+        {
+            runTask(task);
+            continue;
+        }
+
+        spooLockMutex(pool->lock);
+
+        _SPOO_ATOMIC_ADD(&pool->sleepers, 1);
+        _SPOO_ATOMIC_FENCE();
+
+        timeout = fireTimers(worker);
+
+        if (!_SPOO_ATOMIC_LOAD(&pool->pending))
+        {
+            // Waits return at once after cancellation, so stop instead of
+            // spinning, as spooTerminate does to pools left running
+            if ((pool->stopping && !pool->timerCount) || spooIsCancelRequested())
+            {
+                _SPOO_ATOMIC_ADD(&pool->sleepers, -1);
+                spooUnlockMutex(pool->lock);
+                break;
+            }
+
+            spooWaitCond(pool->cond, pool->lock, timeout);
+        }
+
+        _SPOO_ATOMIC_ADD(&pool->sleepers, -1);
+
+        spooUnlockMutex(pool->lock);
+    }
+
+    _spooPlatformSetTLS(_spoo.poolWorkerKey, NULL);
+}
+
+// Destroy a pool and its worker threads, waiting for the remaining tasks
+//
+static void destroyPool(_SPOOpool* pool)
+{
+    int i;
+
+    spooLockMutex(pool->lock);
+    pool->stopping = SPOO_TRUE;
+    spooBroadcastCond(pool->cond);
+    spooUnlockMutex(pool->lock);
+
+    for (i = 0;  i < pool->workerCount;  i++)
+        spooWaitThread(pool->workers[i].thread, SPOO_WAIT);
+
+    for (i = 0;  i < pool->workerCount;  i++)
+        spooDestroyMutex(pool->workers[i].lock);
+
+    spooDestroyCond(pool->cond);
+    spooDestroyMutex(pool->lock);
+
+    free(pool->timers);
+    free(pool->workers);
+    free(pool);
+}
+
+// Create a pool with the specified number of worker threads
+//
+static _SPOOpool* createPool(int threadCount)
+{
+    int i;
+    _SPOOpool* pool;
+
+    if (threadCount <= 0)
+        threadCount = _spooPlatformGetCPUCoreCount();
+    if (threadCount < 1)
+        threadCount = 1;
+
+    pool = (_SPOOpool*) calloc(1, sizeof(_SPOOpool));
+    if (!pool)
+        return NULL;
+
+    pool->workers = (_SPOOpoolworker*) calloc(threadCount,
+                                              sizeof(_SPOOpoolworker));
+    pool->lock = spooCreateMutex();
+    pool->cond = spooCreateCond();
+
+    if (!pool->workers || !pool->lock || !pool->cond)
+    {
+        spooDestroyCond(pool->cond);
+        spooDestroyMutex(pool->lock);
+        free(pool->workers);
+        free(pool);
+        return NULL;
+    }
+
+    spooSetMutexName(pool->lock, "pool");
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        pool->workers[i].lock = spooCreateMutex();
+        if (!pool->workers[i].lock)
+            break;
+
+        spooSetMutexName(pool->workers[i].lock, "pool queue");
+
+        pool->workers[i].thread = spooCreateThread(workerMain,
+                                                   pool->workers + i);
+        if (pool->workers[i].thread == SPOO_INVALID_THREAD)
+        {
+            spooDestroyMutex(pool->workers[i].lock);
+            break;
+        }
+
+        pool->workerCount++;
+    }
+
+    if (pool->workerCount < threadCount)
+    {
+        destroyPool(pool);
+        return NULL;
+    }
+
+    return pool;
+}
+
+// Return the specified pool, or the default pool if none was specified
+//
+static _SPOOpool* getPool(SPOOpool handle)
+{
+    _SPOOpool* pool;
+
+    if (handle)
+        return (_SPOOpool*) handle;
+
+    pool = (_SPOOpool*) _SPOO_ATOMIC_LOAD(&_spoo.defaultPool);
+    if (pool)
+        return pool;
+
+    pool = createPool(0);
+    if (!pool)
+        return NULL;
+
+    // Another thread may have beaten us to it
+    if (!_SPOO_ATOMIC_CAS_PTR(&_spoo.defaultPool, NULL, pool))
+    {
+        destroyPool(pool);
+        pool = (_SPOOpool*) _SPOO_ATOMIC_LOAD(&_spoo.defaultPool);
+    }
+
+    return pool;
+}
+
+// Initialize worker pool support
+//
+int _spooInitPools(void)
+{
+    _spoo.poolWorkerKey = _spooPlatformCreateTLSKey(NULL);
+    if (_spoo.poolWorkerKey == SPOO_INVALID_TLS_KEY)
+        return SPOO_FALSE;
+
+    return SPOO_TRUE;
+}
+
+// Destroy the default pool and terminate worker pool support
+//
+void _spooTerminatePools(void)
+{
+    if (_spoo.defaultPool)
+    {
+        destroyPool(_spoo.defaultPool);
+        _spoo.defaultPool = NULL;
+    }
+
+    _spooPlatformDestroyTLSKey(_spoo.poolWorkerKey);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create a pool of worker threads (one per CPU core if zero)
+//
+SPOOpool spooCreatePool(int threadCount)
+{
+    if (!_spooInitialized)
+        return NULL;
+
+    return (SPOOpool) createPool(threadCount);
+}
+
+// Destroy a pool after all of its tasks have been run
+// NOTE: This must not be called from one of the workers of the pool
+//
+void spooDestroyPool(SPOOpool pool)
+{
+    if (!_spooInitialized || !pool)
+        return;
+
+    destroyPool((_SPOOpool*) pool);
+}
+
+// Return the number of worker threads of a pool
+//
+int spooGetPoolThreadCount(SPOOpool handle)
+{
+    _SPOOpool* pool;
+
+    if (!_spooInitialized)
+        return 0;
+
+    pool = getPool(handle);
+    if (!pool)
+        return 0;
+
+    return pool->workerCount;
+}
+
+// Queue a task to be run by a pool
+// The task must stay valid until its function is called
+//
+void spooSubmitTask(SPOOpool handle, SPOOtask* task)
+{
+    _SPOOpool* pool;
+    _SPOOpoolworker* worker;
+
+    if (!_spooInitialized || !task)
+        return;
+
+    pool = getPool(handle);
+    if (!pool)
+        return;
+
+    // Workers queue tasks locally, while other threads spread them out
+    worker = getWorker(pool);
+    if (!worker)
+    {
+        long index = _SPOO_ATOMIC_ADD(&pool->nextWorker, 1);
+        worker = pool->workers + (unsigned long) index % pool->workerCount;
+    }
+
+    queueTask(worker, task);
+    wakeWorker(pool);
+}
+
+// Queue a task to be run by a pool after the specified delay
+// The task must stay valid until its function is called
+//
+void spooSubmitDelayedTask(SPOOpool handle, SPOOtask* task, double delay)
+{
+    int added;
+    _SPOOpool* pool;
+
+    if (!_spooInitialized || !task)
+        return;
+
+    if (delay <= 0.0)
+    {
+        spooSubmitTask(handle, task);
+        return;
+    }
+
+    pool = getPool(handle);
+    if (!pool)
+        return;
+
+    spooLockMutex(pool->lock);
+
+    added = addTimer(pool, task, _spooPlatformGetTime() + delay);
+
+    // Let a sleeping worker recompute its timeout
+    if (added && pool->timers[0].task == task)
+        spooSignalCond(pool->cond);
+
+    spooUnlockMutex(pool->lock);
+
+    // Better early than never
+    if (!added)
+        spooSubmitTask(handle, task);
+}
+
+// Run one queued task of a pool on the calling thread, if there is one
+// This lets threads waiting on pool tasks help instead of blocking
+//
+int spooRunPoolTask(SPOOpool handle)
+{
+    int start = 0;
+    SPOOtask* task;
+    _SPOOpool* pool;
+    _SPOOpoolworker* worker;
+
+    if (!_spooInitialized)
+        return SPOO_FALSE;
+
+    pool = getPool(handle);
+    if (!pool)
+        return SPOO_FALSE;
+
+    worker = getWorker(pool);
+    if (worker)
+        start = worker->index;
+
+    task = findTask(pool, start);
+    if (!task)
+        return SPOO_FALSE;
+
+    runTask(task);
+    return SPOO_TRUE;
+}
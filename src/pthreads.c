@@ -56,9 +56,23 @@
 #include <sys/sysctl.h>
 #endif /*_SPOO_HAS_SYSCTL*/
 
+#include <sys/mman.h>
 #include <sys/time.h>
-#include <signal.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(_SPOO_HAS_RSEQ)
+#include <sys/rseq.h>
+#endif /*_SPOO_HAS_RSEQ*/
+
+#if defined(_SPOO_USE_FUTEX)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif /*_SPOO_USE_FUTEX*/
 
 // Macros for encapsulating critical code sections (i.e. making parts
 // of Spoo thread safe)
@@ -68,6 +82,41 @@
 #define LEAVE_THREAD_CRITICAL_SECTION \
         pthread_mutex_unlock(&_spoo.posix.criticalSection)
 
+// Size and alignment of stacks backed by transparent huge pages
+//
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+#if !defined(_SPOO_USE_FUTEX)
+
+// Longest time in seconds a cancellable condition wait blocks for
+//
+#define CANCEL_CHECK_INTERVAL 0.1
+
+#endif /*_SPOO_USE_FUTEX*/
+
+#if defined(_SPOO_USE_FUTEX)
+
+// Futex mutex states
+//
+#define FUTEX_UNLOCKED  0
+#define FUTEX_LOCKED    1
+#define FUTEX_CONTENDED 2
+
+// Number of times to check a locked futex mutex before sleeping
+//
+#define FUTEX_SPIN_COUNT 100
+
+#endif /*_SPOO_USE_FUTEX*/
+
+#if defined(_SPOO_THREAD_LOCAL)
+
+// Thread-local values of the current thread, used instead of POSIX keys
+// when the compiler supports thread-local variables
+//
+static _SPOO_THREAD_LOCAL _SPOOtlsvalue tlsValues[SPOO_MAX_TLS_KEYS];
+
+#endif /*_SPOO_THREAD_LOCAL*/
+
 
 //////////////////////////////////////////////////////////////////////////
 //////                   Spoo internal functions                    //////
@@ -85,11 +134,42 @@ static void* runThread(void* arg)
     if (!thread)
         return NULL;
 
+    _spooPlatformSetTLS(_spoo.threadKey, thread);
+
+    _SPOO_TRACE("Thread", _SPOO_TRACE_BEGIN);
+
     // Call the user thread function
     thread->function(arg);
 
+    _SPOO_TRACE("Thread", _SPOO_TRACE_END);
+
+    // Clean up any thread-local values
+    _spooRunTLSDestructors();
+
+    // Hand over hazard pointer records and what they still have retired
+    _spooLeaveHazardDomains();
+
+    // Hand over flat combining records
+    _spooLeaveCombiners();
+
+    // Hand over the trace buffer
+    _spooLeaveTracing();
+
+    _spooPlatformSetTLS(_spoo.threadKey, NULL);
+
     // Remove thread from thread list
     ENTER_THREAD_CRITICAL_SECTION;
+
+    // Without a waiting thread to join us and return our stack, leave it to
+    // be joined when the cache next needs a stack or by a later wait
+    if (thread->posix.stack && !thread->posix.joining)
+    {
+        thread->posix.stack->posixID = thread->posix.ID;
+        thread->posix.stack->threadID = thread->ID;
+        thread->posix.stack->next = _spoo.posix.exitedStacks;
+        _spoo.posix.exitedStacks = thread->posix.stack;
+    }
+
     _spooRemoveThread(thread);
     LEAVE_THREAD_CRITICAL_SECTION;
 
@@ -97,6 +177,184 @@ static void* runThread(void* arg)
     return NULL;
 }
 
+// Map a thread stack with a guard page below it
+//
+static _SPOOthreadstack* mapStack(void)
+{
+    char* mapping;
+    char* stack;
+    size_t offset, mappingSize, stackSize;
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    size_t alignment = pageSize;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    _SPOOthreadstack* record;
+
+    record = (_SPOOthreadstack*) calloc(1, sizeof(_SPOOthreadstack));
+    if (!record)
+        return NULL;
+
+    if (_spoo.posix.stackFlags & SPOO_STACK_HUGE_PAGES)
+    {
+        // Huge pages need the stack aligned to and sized in huge pages
+        alignment = HUGE_PAGE_SIZE;
+    }
+    else
+    {
+#if defined(MAP_STACK)
+        // Newer kernels never back MAP_STACK mappings with huge pages
+        flags |= MAP_STACK;
+#endif
+    }
+
+    stackSize = (_spoo.posix.stackSize + alignment - 1) / alignment * alignment;
+
+    // Map enough to place an aligned stack after the guard page, then trim
+    mappingSize = stackSize + alignment;
+
+    mapping = (char*) mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+        free(record);
+        return NULL;
+    }
+
+    stack = (char*) (((size_t) mapping + pageSize + alignment - 1) & ~(alignment - 1));
+
+    offset = (size_t) (stack - pageSize - mapping);
+    if (offset)
+        munmap(mapping, offset);
+
+    if (mappingSize > offset + pageSize + stackSize)
+        munmap(stack + stackSize, mappingSize - offset - pageSize - stackSize);
+
+    mprotect(stack - pageSize, pageSize, PROT_NONE);
+
+#if defined(MADV_HUGEPAGE)
+    if (_spoo.posix.stackFlags & SPOO_STACK_HUGE_PAGES)
+        madvise(stack, stackSize, MADV_HUGEPAGE);
+#endif
+
+    // Touch every page from the top, the way the stack grows, so threads
+    // given this stack take no page faults
+    if (_spoo.posix.stackFlags & SPOO_STACK_PREFAULT)
+    {
+        for (offset = stackSize;  offset > 0;  offset -= pageSize)
+            stack[offset - pageSize] = 0;
+    }
+
+    record->mapping = stack - pageSize;
+    record->mappingSize = stackSize + pageSize;
+    record->stack = stack;
+    record->stackSize = stackSize;
+    record->generation = _spoo.posix.stackGeneration;
+
+    return record;
+}
+
+// Unmap a thread stack
+//
+static void unmapStack(_SPOOthreadstack* stack)
+{
+    munmap(stack->mapping, stack->mappingSize);
+    free(stack);
+}
+
+// Return a stack for a new thread, or NULL to use a default thread stack
+// NOTE: This must be called from inside the thread critical section
+//
+static _SPOOthreadstack* acquireStack(void)
+{
+    _SPOOthreadstack* stack;
+
+    if (!_spoo.posix.maxStacks)
+        return NULL;
+
+    stack = _spoo.posix.freeStacks;
+    if (stack)
+    {
+        _spoo.posix.freeStacks = stack->next;
+        _spoo.posix.freeStackCount--;
+        return stack;
+    }
+
+    // Threads that exited without being waited for keep their stacks until
+    // they have been joined
+    while ((stack = _spoo.posix.exitedStacks))
+    {
+        _spoo.posix.exitedStacks = stack->next;
+        pthread_join(stack->posixID, NULL);
+
+        if (stack->generation == _spoo.posix.stackGeneration)
+            return stack;
+
+        unmapStack(stack);
+    }
+
+    return mapStack();
+}
+
+// Return the stack of a joined thread to the cache
+// NOTE: This must be called from inside the thread critical section
+//
+static void releaseStack(_SPOOthreadstack* stack)
+{
+    if (stack->generation != _spoo.posix.stackGeneration ||
+        _spoo.posix.freeStackCount >= _spoo.posix.maxStacks)
+    {
+        unmapStack(stack);
+        return;
+    }
+
+    stack->next = _spoo.posix.freeStacks;
+    _spoo.posix.freeStacks = stack;
+    _spoo.posix.freeStackCount++;
+}
+
+// Remove the stack left by an exited thread that has not been joined
+// NOTE: This must be called from inside the thread critical section
+//
+static _SPOOthreadstack* takeExitedStack(SPOOthread ID)
+{
+    _SPOOthreadstack* stack;
+    _SPOOthreadstack** prev = &_spoo.posix.exitedStacks;
+
+    for (stack = *prev;  stack;  stack = stack->next)
+    {
+        if (stack->threadID == ID)
+        {
+            *prev = stack->next;
+            return stack;
+        }
+
+        prev = &stack->next;
+    }
+
+    return NULL;
+}
+
+// Unmap all cached stacks, joining any exited threads still using theirs
+// NOTE: This must be called from inside the thread critical section
+//
+static void flushStacks(void)
+{
+    _SPOOthreadstack* stack;
+
+    while ((stack = _spoo.posix.freeStacks))
+    {
+        _spoo.posix.freeStacks = stack->next;
+        unmapStack(stack);
+    }
+
+    _spoo.posix.freeStackCount = 0;
+
+    while ((stack = _spoo.posix.exitedStacks))
+    {
+        _spoo.posix.exitedStacks = stack->next;
+        pthread_join(stack->posixID, NULL);
+        unmapStack(stack);
+    }
+}
+
 // Set up a timespec struct to a time duration seconds after now
 //
 static void makeWaitTime(struct timespec* result, double duration)
@@ -118,6 +376,119 @@ static void makeWaitTime(struct timespec* result, double duration)
     result->tv_sec = tv.tv_sec + dt_sec;
 }
 
+#if defined(_SPOO_USE_FUTEX)
+
+// Set up a timespec struct to a time duration
+//
+static void makeRelativeTime(struct timespec* result, double duration)
+{
+    if (duration < 0.0)
+        duration = 0.0;
+
+    result->tv_sec = (time_t) duration;
+    result->tv_nsec = (long) ((duration - (double) result->tv_sec) * 1e9);
+}
+
+// Make a futex system call, as there is no C library wrapper for it
+//
+static int futex(volatile int* address, int op, int value,
+                 const struct timespec* timeout,
+                 volatile int* address2, int value3)
+{
+    return (int) syscall(SYS_futex, address, op, value,
+                         timeout, address2, value3);
+}
+
+// Wait for a futex mutex that was found to be locked
+//
+static void lockContendedFutexMutex(_SPOOfutexmutex* mutex)
+{
+    int i, state = mutex->state;
+
+    // Spin briefly, as the mutex is often released very quickly
+    for (i = 0;  i < FUTEX_SPIN_COUNT && state != FUTEX_UNLOCKED;  i++)
+    {
+        _SPOO_CPU_RELAX();
+        state = _SPOO_ATOMIC_LOAD(&mutex->state);
+    }
+
+    if (state == FUTEX_UNLOCKED &&
+        _SPOO_ATOMIC_CAS(&mutex->state, FUTEX_UNLOCKED, FUTEX_LOCKED))
+    {
+        return;
+    }
+
+    // Mark the mutex as contended, so that the owner wakes us on release
+    while (_SPOO_ATOMIC_EXCHANGE(&mutex->state, FUTEX_CONTENDED) != FUTEX_UNLOCKED)
+        futex(&mutex->state, FUTEX_WAIT_PRIVATE, FUTEX_CONTENDED, NULL, NULL, 0);
+}
+
+#endif /*_SPOO_USE_FUTEX*/
+
+#if defined(_SPOO_CONTEXT_X86_64)
+
+// Save the callee-saved registers of the current context on its stack and
+// restore those of the target context from its stack
+// void _spooSwitchStack(void** from, void* to)
+//
+__asm__(".text\n"
+        ".p2align 4\n"
+        ".globl _spooSwitchStack\n"
+        ".hidden _spooSwitchStack\n"
+        ".type _spooSwitchStack, @function\n"
+        "_spooSwitchStack:\n"
+        "    pushq %rbp\n"
+        "    pushq %rbx\n"
+        "    pushq %r12\n"
+        "    pushq %r13\n"
+        "    pushq %r14\n"
+        "    pushq %r15\n"
+        "    subq $8, %rsp\n"
+        "    stmxcsr (%rsp)\n"
+        "    fnstcw 4(%rsp)\n"
+        "    movq %rsp, (%rdi)\n"
+        "    movq %rsi, %rsp\n"
+        "    ldmxcsr (%rsp)\n"
+        "    fldcw 4(%rsp)\n"
+        "    addq $8, %rsp\n"
+        "    popq %r15\n"
+        "    popq %r14\n"
+        "    popq %r13\n"
+        "    popq %r12\n"
+        "    popq %rbx\n"
+        "    popq %rbp\n"
+        "    ret\n"
+        ".size _spooSwitchStack, .-_spooSwitchStack\n"
+        "\n"
+        ".p2align 4\n"
+        ".globl _spooStartContext\n"
+        ".hidden _spooStartContext\n"
+        ".type _spooStartContext, @function\n"
+        "_spooStartContext:\n"
+        "    movq %rbx, %rdi\n"
+        "    callq *%r12\n"
+        "    ud2\n"
+        ".size _spooStartContext, .-_spooStartContext\n");
+
+void _spooSwitchStack(void** from, void* to);
+void _spooStartContext(void);
+
+#else
+
+// Call the entry point of a new context, with the context pointer split
+// into two ints as makecontext only passes int arguments
+//
+static void startContext(unsigned int high, unsigned int low)
+{
+    _SPOOcontext* context;
+
+    context = (_SPOOcontext*) (((unsigned long long) high << 32) |
+                               (unsigned long long) low);
+    context->entry(context->arg);
+}
+
+#endif /*_SPOO_CONTEXT_X86_64*/
+
 // Returns the current raw time
 //
 long long getCurrentRawTime(void)
@@ -163,20 +534,12 @@ int _spooPlatformInit(void)
 //
 int _spooPlatformTerminate(void)
 {
-    _SPOOthread* thread;
-
     // Only the main thread is allowed to do this
     if (pthread_self() != _spoo.first.posix.ID)
         return SPOO_FALSE;
 
     ENTER_THREAD_CRITICAL_SECTION;
-
-    // Kill all remaining threads created by Spoo
-    // NOTE: The user should wait for all threads to die BEFORE calling
-    // spooTerminate.  Any work we need to do here is really an error.
-    while (thread = _spoo.first.next)
-        _spooPlatformDestroyThread(thread->ID);
-
+    flushStacks();
     LEAVE_THREAD_CRITICAL_SECTION;
 
     // Delete critical section handle
@@ -203,6 +566,30 @@ void _spooPlatformSetTime(double time)
     _spoo.posix.baseTime = getCurrentRawTime() - offset;
 }
 
+// Return the raw value of the high-resolution timer in nanoseconds
+//
+unsigned long long _spooPlatformGetTimerValue(void)
+{
+#if defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    {
+        return (unsigned long long) ts.tv_sec * 1000000000ull +
+               (unsigned long long) ts.tv_nsec;
+    }
+#endif /*CLOCK_MONOTONIC*/
+
+    return (unsigned long long) getCurrentRawTime() * 1000ull;
+}
+
+// Return the number of high-resolution timer ticks per second
+//
+unsigned long long _spooPlatformGetTimerFrequency(void)
+{
+    return 1000000000ull;
+}
+
 // Put the current thread to sleep for the specified amount of time
 //
 void _spooPlatformSleep(double time)
@@ -246,7 +633,10 @@ void _spooPlatformSleep(double time)
 //
 SPOOthread _spooPlatformCreateThread(SPOOthreadfun fun, void* arg)
 {
+    int result;
+    SPOOthread ID;
     _SPOOthread* thread;
+    pthread_attr_t attributes;
 
     ENTER_THREAD_CRITICAL_SECTION;
 
@@ -262,12 +652,39 @@ SPOOthread _spooPlatformCreateThread(SPOOthreadfun fun, void* arg)
     thread->ID = _spoo.nextID++;
     thread->function = fun;
 
+    if (!_spooInitThreadCancel(thread))
+    {
+        free(thread);
+        LEAVE_THREAD_CRITICAL_SECTION;
+        return SPOO_INVALID_THREAD;
+    }
+
+    thread->posix.stack = acquireStack();
+    thread->posix.joining = SPOO_FALSE;
+
+    pthread_attr_init(&attributes);
+
+    if (thread->posix.stack)
+    {
+        pthread_attr_setstack(&attributes,
+                              thread->posix.stack->stack,
+                              thread->posix.stack->stackSize);
+    }
+
+    result = pthread_create(&thread->posix.ID, // POSIX thread handle
+                            &attributes,       // Thread attributes
+                            runThread,         // Internal thread function
+                            arg);              // Argument to thread user function
+
+    pthread_attr_destroy(&attributes);
+
     // Did the thread creation fail?
-    if (pthread_create(&thread->posix.ID, // POSIX thread handle
-                       NULL,              // Default thread attributes
-                       runThread,         // Internal thread function
-                       arg) != 0)         // Argument to thread user function
+    if (result != 0)
     {
+        if (thread->posix.stack)
+            releaseStack(thread->posix.stack);
+
+        _spooTerminateThreadCancel(thread);
         free(thread);
         LEAVE_THREAD_CRITICAL_SECTION;
         return SPOO_INVALID_THREAD;
@@ -275,16 +692,61 @@ SPOOthread _spooPlatformCreateThread(SPOOthreadfun fun, void* arg)
 
     _spooAppendThread(thread);
 
+    // The thread may finish and free its state as soon as we leave
+    ID = thread->ID;
+
     LEAVE_THREAD_CRITICAL_SECTION;
 
-    return thread->ID;
+    return ID;
+}
+
+// Configure the cache of thread stacks
+//
+int _spooPlatformSetThreadStackCache(size_t stackSize, int maxStacks, int flags)
+{
+    pthread_attr_t attributes;
+
+    if (!stackSize)
+    {
+        pthread_attr_init(&attributes);
+        pthread_attr_getstacksize(&attributes, &stackSize);
+        pthread_attr_destroy(&attributes);
+    }
+
+#if defined(PTHREAD_STACK_MIN)
+    if (stackSize < (size_t) PTHREAD_STACK_MIN)
+        stackSize = (size_t) PTHREAD_STACK_MIN;
+#endif
+
+    ENTER_THREAD_CRITICAL_SECTION;
+
+    // Stacks of the old settings are unmapped as they come back
+    flushStacks();
+
+    _spoo.posix.stackSize = stackSize;
+    _spoo.posix.maxStacks = maxStacks;
+    _spoo.posix.stackFlags = flags;
+    _spoo.posix.stackGeneration++;
+
+    LEAVE_THREAD_CRITICAL_SECTION;
+
+    return SPOO_TRUE;
 }
 
-// Kill a running thread
-// NOTE: This is a VERY DANGEROUS operation that should NOT BE USED except
-// in EXTREME SITUATIONS!
+// Stop a running thread
+// Signals like SIGKILL take down the whole process rather than the thread,
+// so the thread is asked to stop and waited for instead
 //
 void _spooPlatformDestroyThread(SPOOthread ID)
+{
+    // The thread may have stopped by itself, but it must still be joined
+    _spooPlatformRequestCancel(ID);
+    _spooPlatformWaitThread(ID, SPOO_WAIT);
+}
+
+// Request cancellation of a thread
+//
+int _spooPlatformRequestCancel(SPOOthread ID)
 {
     _SPOOthread* thread;
 
@@ -294,16 +756,45 @@ void _spooPlatformDestroyThread(SPOOthread ID)
     if (!thread)
     {
         LEAVE_THREAD_CRITICAL_SECTION;
-        return;
+        return SPOO_FALSE;
     }
 
-    // Simply murder the process
-    pthread_kill(thread->posix.ID, SIGKILL);
+    _spooCancelThread(thread);
 
-    // Remove thread from thread list
-    _spooRemoveThread(thread);
+    LEAVE_THREAD_CRITICAL_SECTION;
+    return SPOO_TRUE;
+}
+
+// Stop all remaining threads created by Spoo
+// NOTE: The user should wait for all threads to die BEFORE calling
+// spooTerminate.  Any work we need to do here is really an error.
+//
+void _spooPlatformCancelAllThreads(void)
+{
+    _SPOOthread* thread;
+    SPOOthread ID;
+
+    // Request cancellation of all threads first so they stop in parallel
+    ENTER_THREAD_CRITICAL_SECTION;
+
+    for (thread = _spoo.first.next;  thread;  thread = thread->next)
+        _spooCancelThread(thread);
 
     LEAVE_THREAD_CRITICAL_SECTION;
+
+    for (;;)
+    {
+        ENTER_THREAD_CRITICAL_SECTION;
+        thread = _spoo.first.next;
+        ID = thread ? thread->ID : SPOO_INVALID_THREAD;
+        LEAVE_THREAD_CRITICAL_SECTION;
+
+        if (!thread)
+            break;
+
+        // Threads started since we asked are asked too, then waited for
+        _spooPlatformDestroyThread(ID);
+    }
 }
 
 // Wait for a thread to die
@@ -311,6 +802,8 @@ void _spooPlatformDestroyThread(SPOOthread ID)
 int _spooPlatformWaitThread(SPOOthread ID, int waitmode)
 {
     _SPOOthread* thread;
+    _SPOOthreadstack* stack = NULL;
+    pthread_t posixID;
 
     ENTER_THREAD_CRITICAL_SECTION;
 
@@ -319,7 +812,21 @@ int _spooPlatformWaitThread(SPOOthread ID, int waitmode)
     // Is the thread already dead?
     if (!thread)
     {
+        // If it left a cached stack behind, join it and take the stack back
+        if (waitmode == SPOO_WAIT)
+            stack = takeExitedStack(ID);
+
         LEAVE_THREAD_CRITICAL_SECTION;
+
+        if (stack)
+        {
+            pthread_join(stack->posixID, NULL);
+
+            ENTER_THREAD_CRITICAL_SECTION;
+            releaseStack(stack);
+            LEAVE_THREAD_CRITICAL_SECTION;
+        }
+
         return SPOO_TRUE;
     }
 
@@ -330,10 +837,28 @@ int _spooPlatformWaitThread(SPOOthread ID, int waitmode)
         return SPOO_FALSE;
     }
 
+    // The thread frees its state when it finishes, which may happen as soon
+    // as we leave the critical section
+    posixID = thread->posix.ID;
+
+    // Only one waiting thread returns the stack, once the thread is joined
+    if (!thread->posix.joining)
+    {
+        stack = thread->posix.stack;
+        thread->posix.joining = SPOO_TRUE;
+    }
+
     LEAVE_THREAD_CRITICAL_SECTION;
 
     // Wait for thread to die
-    pthread_join(thread->posix.ID, NULL);
+    pthread_join(posixID, NULL);
+
+    if (stack)
+    {
+        ENTER_THREAD_CRITICAL_SECTION;
+        releaseStack(stack);
+        LEAVE_THREAD_CRITICAL_SECTION;
+    }
 
     return SPOO_TRUE;
 }
@@ -367,17 +892,43 @@ SPOOthread _spooPlatformGetThreadID(void)
     return threadID;
 }
 
+#if defined(_SPOO_USE_FUTEX)
+
+// The by-value storage types must be able to hold the platform objects
+typedef char _spooCheckMutexStorage[sizeof(_SPOOfutexmutex) <= SPOO_MUTEX_STORAGE_SIZE ? 1 : -1];
+typedef char _spooCheckCondStorage[sizeof(_SPOOfutexcond) <= SPOO_COND_STORAGE_SIZE ? 1 : -1];
+
+// Return the size of the storage for a mutual exclusion object
+//
+size_t _spooPlatformGetMutexStorageSize(void)
+{
+    return sizeof(_SPOOfutexmutex);
+}
+
+// Initialize a mutual exclusion object in caller-provided storage
+//
+void _spooPlatformInitMutexStorage(void* storage)
+{
+    ((_SPOOfutexmutex*) storage)->state = FUTEX_UNLOCKED;
+}
+
+// Deinitialize a mutual exclusion object in caller-provided storage
+//
+void _spooPlatformDeinitMutexStorage(SPOOmutex mutex)
+{
+}
+
 // Create a mutual exclusion object
 //
 SPOOmutex _spooPlatformCreateMutex(void)
 {
-    pthread_mutex_t* mutex;
+    void* mutex;
 
-    mutex = (pthread_mutex_t*) malloc(sizeof(pthread_mutex_t));
+    mutex = malloc(sizeof(_SPOOfutexmutex));
     if (!mutex)
         return NULL;
 
-    pthread_mutex_init(mutex, NULL);
+    _spooPlatformInitMutexStorage(mutex);
 
     return (SPOOmutex) mutex;
 }
@@ -385,8 +936,212 @@ SPOOmutex _spooPlatformCreateMutex(void)
 // Destroy a mutual exclusion object
 //
 void _spooPlatformDestroyMutex(SPOOmutex mutex)
+{
+    free(mutex);
+}
+
+// Request access to a mutex
+//
+void _spooPlatformLockMutex(SPOOmutex handle)
+{
+    _SPOOfutexmutex* mutex = (_SPOOfutexmutex*) handle;
+
+    if (_SPOO_ATOMIC_CAS(&mutex->state, FUTEX_UNLOCKED, FUTEX_LOCKED))
+        return;
+
+    lockContendedFutexMutex(mutex);
+}
+
+// Request access to a mutex without waiting
+//
+int _spooPlatformTryLockMutex(SPOOmutex handle)
+{
+    _SPOOfutexmutex* mutex = (_SPOOfutexmutex*) handle;
+
+    return _SPOO_ATOMIC_CAS(&mutex->state, FUTEX_UNLOCKED, FUTEX_LOCKED);
+}
+
+// Release a mutex
+//
+void _spooPlatformUnlockMutex(SPOOmutex handle)
+{
+    _SPOOfutexmutex* mutex = (_SPOOfutexmutex*) handle;
+
+    // Only enter the kernel if someone may be waiting
+    if (_SPOO_ATOMIC_EXCHANGE(&mutex->state, FUTEX_UNLOCKED) == FUTEX_CONTENDED)
+        futex(&mutex->state, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// Initialize a condition variable object in caller-provided storage
+//
+int _spooPlatformInitCondStorage(void* storage)
+{
+    memset(storage, 0, sizeof(_SPOOfutexcond));
+    return SPOO_TRUE;
+}
+
+// Deinitialize a condition variable object in caller-provided storage
+//
+void _spooPlatformDeinitCondStorage(SPOOcond cond)
+{
+}
+
+// Create a new condition variable object
+//
+SPOOcond _spooPlatformCreateCond(void)
+{
+    _SPOOfutexcond* cond;
+
+    cond = (_SPOOfutexcond*) calloc(1, sizeof(_SPOOfutexcond));
+    if (!cond)
+        return NULL;
+
+    return (SPOOcond) cond;
+}
+
+// Destroy a condition variable object
+//
+void _spooPlatformDestroyCond(SPOOcond cond)
+{
+    free(cond);
+}
+
+// Wait for a condition to be raised
+//
+void _spooPlatformWaitCond(SPOOcond cond, SPOOmutex mutex, double timeout)
+{
+    _spooPlatformWaitCondCancellable(cond, mutex, timeout, NULL);
+}
+
+// Wait for a condition to be raised, unless the cancellation flag is set
+//
+void _spooPlatformWaitCondCancellable(SPOOcond handle, SPOOmutex mutexHandle,
+                                      double timeout, volatile long* cancelled)
+{
+    int sequence;
+    struct timespec wait;
+    _SPOOfutexcond* cond = (_SPOOfutexcond*) handle;
+    _SPOOfutexmutex* mutex = (_SPOOfutexmutex*) mutexHandle;
+
+    // Remember the mutex so that broadcasts can requeue waiters onto it
+    cond->mutex = mutex;
+
+    _SPOO_ATOMIC_ADD(&cond->waiters, 1);
+    sequence = _SPOO_ATOMIC_LOAD(&cond->sequence);
+
+    // The flag is set before the condition is raised, so if it is not set
+    // yet the broadcast will change the sequence number read above
+    if (cancelled && _SPOO_ATOMIC_LOAD(cancelled))
+    {
+        _SPOO_ATOMIC_ADD(&cond->waiters, -1);
+        return;
+    }
+
+    _spooPlatformUnlockMutex(mutex);
+
+    // The wait fails immediately if the condition was raised after we read
+    // the sequence number, so no wakeups are lost
+    if (timeout >= SPOO_INFINITY)
+        futex(&cond->sequence, FUTEX_WAIT_PRIVATE, sequence, NULL, NULL, 0);
+    else
+    {
+        makeRelativeTime(&wait, timeout);
+        futex(&cond->sequence, FUTEX_WAIT_PRIVATE, sequence, &wait, NULL, 0);
+    }
+
+    _SPOO_ATOMIC_ADD(&cond->waiters, -1);
+
+    // We may have been requeued onto the mutex behind other waiters, so
+    // lock it as contended to make sure they are woken in turn
+    while (_SPOO_ATOMIC_EXCHANGE(&mutex->state, FUTEX_CONTENDED) != FUTEX_UNLOCKED)
+        futex(&mutex->state, FUTEX_WAIT_PRIVATE, FUTEX_CONTENDED, NULL, NULL, 0);
+}
+
+// Signal a condition to one waiting thread
+//
+void _spooPlatformSignalCond(SPOOcond handle)
+{
+    _SPOOfutexcond* cond = (_SPOOfutexcond*) handle;
+
+    _SPOO_ATOMIC_ADD(&cond->sequence, 1);
+
+    if (_SPOO_ATOMIC_LOAD(&cond->waiters) > 0)
+        futex(&cond->sequence, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// Broadcast a condition to all waiting threads
+//
+void _spooPlatformBroadcastCond(SPOOcond handle)
+{
+    int sequence;
+    _SPOOfutexcond* cond = (_SPOOfutexcond*) handle;
+    _SPOOfutexmutex* mutex;
+
+    sequence = _SPOO_ATOMIC_ADD(&cond->sequence, 1);
+
+    if (_SPOO_ATOMIC_LOAD(&cond->waiters) == 0)
+        return;
+
+    mutex = cond->mutex;
+
+    // Wake one waiter and move the rest directly to the mutex, as only one
+    // of them can get it anyway (wait morphing)
+    if (futex(&cond->sequence, FUTEX_CMP_REQUEUE_PRIVATE, 1,
+              (const struct timespec*) (long) INT_MAX,
+              &mutex->state, sequence) == -1)
+    {
+        // The sequence changed under us, so fall back to waking everyone
+        futex(&cond->sequence, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+#else
+
+// The by-value storage types must be able to hold the platform objects
+typedef char _spooCheckMutexStorage[sizeof(pthread_mutex_t) <= SPOO_MUTEX_STORAGE_SIZE ? 1 : -1];
+typedef char _spooCheckCondStorage[sizeof(pthread_cond_t) <= SPOO_COND_STORAGE_SIZE ? 1 : -1];
+
+// Return the size of the storage for a mutual exclusion object
+//
+size_t _spooPlatformGetMutexStorageSize(void)
+{
+    return sizeof(pthread_mutex_t);
+}
+
+// Initialize a mutual exclusion object in caller-provided storage
+//
+void _spooPlatformInitMutexStorage(void* storage)
+{
+    pthread_mutex_init((pthread_mutex_t*) storage, NULL);
+}
+
+// Deinitialize a mutual exclusion object in caller-provided storage
+//
+void _spooPlatformDeinitMutexStorage(SPOOmutex mutex)
 {
     pthread_mutex_destroy((pthread_mutex_t*) mutex);
+}
+
+// Create a mutual exclusion object
+//
+SPOOmutex _spooPlatformCreateMutex(void)
+{
+    void* mutex;
+
+    mutex = malloc(sizeof(pthread_mutex_t));
+    if (!mutex)
+        return NULL;
+
+    _spooPlatformInitMutexStorage(mutex);
+
+    return (SPOOmutex) mutex;
+}
+
+// Destroy a mutual exclusion object
+//
+void _spooPlatformDestroyMutex(SPOOmutex mutex)
+{
+    _spooPlatformDeinitMutexStorage(mutex);
 
     free(mutex);
 }
@@ -398,6 +1153,13 @@ void _spooPlatformLockMutex(SPOOmutex mutex)
     pthread_mutex_lock((pthread_mutex_t*) mutex);
 }
 
+// Request access to a mutex without waiting
+//
+int _spooPlatformTryLockMutex(SPOOmutex mutex)
+{
+    return pthread_mutex_trylock((pthread_mutex_t*) mutex) == 0;
+}
+
 // Release a mutex
 //
 void _spooPlatformUnlockMutex(SPOOmutex mutex)
@@ -405,17 +1167,35 @@ void _spooPlatformUnlockMutex(SPOOmutex mutex)
     pthread_mutex_unlock((pthread_mutex_t*) mutex);
 }
 
+// Initialize a condition variable object in caller-provided storage
+//
+int _spooPlatformInitCondStorage(void* storage)
+{
+    return pthread_cond_init((pthread_cond_t*) storage, NULL) == 0;
+}
+
+// Deinitialize a condition variable object in caller-provided storage
+//
+void _spooPlatformDeinitCondStorage(SPOOcond cond)
+{
+    pthread_cond_destroy((pthread_cond_t*) cond);
+}
+
 // Create a new condition variable object
 //
 SPOOcond _spooPlatformCreateCond(void)
 {
-    pthread_cond_t* cond;
+    void* cond;
 
-    cond = (pthread_cond_t*) malloc(sizeof(pthread_cond_t));
+    cond = malloc(sizeof(pthread_cond_t));
     if (!cond)
         return NULL;
 
-    pthread_cond_init(cond, NULL);
+    if (!_spooPlatformInitCondStorage(cond))
+    {
+        free(cond);
+        return NULL;
+    }
 
     return (SPOOcond) cond;
 }
@@ -424,7 +1204,7 @@ SPOOcond _spooPlatformCreateCond(void)
 //
 void _spooPlatformDestroyCond(SPOOcond cond)
 {
-    pthread_cond_destroy((pthread_cond_t*) cond);
+    _spooPlatformDeinitCondStorage(cond);
 
     free(cond);
 }
@@ -432,9 +1212,28 @@ void _spooPlatformDestroyCond(SPOOcond cond)
 // Wait for a condition to be raised
 //
 void _spooPlatformWaitCond(SPOOcond cond, SPOOmutex mutex, double timeout)
+{
+    _spooPlatformWaitCondCancellable(cond, mutex, timeout, NULL);
+}
+
+// Wait for a condition to be raised, unless the cancellation flag is set
+// A POSIX condition raised just before we block on it stays silent, so
+// cancellable waits return regularly to check the flag again
+//
+void _spooPlatformWaitCondCancellable(SPOOcond cond, SPOOmutex mutex,
+                                      double timeout, volatile long* cancelled)
 {
     struct timespec wait;
 
+    if (cancelled)
+    {
+        if (_SPOO_ATOMIC_LOAD(cancelled))
+            return;
+
+        if (timeout > CANCEL_CHECK_INTERVAL)
+            timeout = CANCEL_CHECK_INTERVAL;
+    }
+
     // Select infinite or timed wait
     if (timeout >= SPOO_INFINITY)
     {
@@ -467,6 +1266,8 @@ void _spooPlatformBroadcastCond(SPOOcond cond)
     pthread_cond_broadcast((pthread_cond_t*) cond);
 }
 
+#endif /*_SPOO_USE_FUTEX*/
+
 // Return the number of processors in the system
 //
 int _spooPlatformGetCPUCoreCount(void)
@@ -498,3 +1299,248 @@ int _spooPlatformGetCPUCoreCount(void)
     return count;
 }
 
+// Return the CPU the calling thread is running on, or -1 if unknown
+//
+int _spooPlatformGetCurrentCPU(void)
+{
+#if defined(_SPOO_HAS_RSEQ)
+    volatile struct rseq* area;
+
+    // The kernel keeps the current CPU of each thread up to date in its
+    // rseq area, so this costs no system call
+    if (__rseq_size)
+    {
+        area = (volatile struct rseq*) ((char*) __builtin_thread_pointer() + __rseq_offset);
+        return (int) area->cpu_id;
+    }
+#endif /*_SPOO_HAS_RSEQ*/
+
+    return -1;
+}
+
+
+// Create a thread-local storage key
+//
+SPOOtlskey _spooPlatformCreateTLSKey(SPOOtlsfun destructor)
+{
+    SPOOtlskey key;
+
+    ENTER_THREAD_CRITICAL_SECTION;
+
+    for (key = 0;  key < SPOO_MAX_TLS_KEYS;  key++)
+    {
+        if (!_spoo.tlsKeys[key].used)
+            break;
+    }
+
+    if (key == SPOO_MAX_TLS_KEYS)
+    {
+        LEAVE_THREAD_CRITICAL_SECTION;
+        return SPOO_INVALID_TLS_KEY;
+    }
+
+#if !defined(_SPOO_THREAD_LOCAL)
+    // Destructors are called by Spoo and not by the POSIX implementation,
+    // so that they are run the same way on all platforms
+    if (pthread_key_create(&_spoo.tlsKeys[key].posix.key, NULL) != 0)
+    {
+        LEAVE_THREAD_CRITICAL_SECTION;
+        return SPOO_INVALID_TLS_KEY;
+    }
+#endif /*_SPOO_THREAD_LOCAL*/
+
+    _spoo.tlsKeys[key].used = SPOO_TRUE;
+    _spoo.tlsKeys[key].generation++;
+    _spoo.tlsKeys[key].destructor = destructor;
+
+    LEAVE_THREAD_CRITICAL_SECTION;
+
+    return key;
+}
+
+// Destroy a thread-local storage key
+//
+void _spooPlatformDestroyTLSKey(SPOOtlskey key)
+{
+    ENTER_THREAD_CRITICAL_SECTION;
+
+    if (_spoo.tlsKeys[key].used)
+    {
+#if !defined(_SPOO_THREAD_LOCAL)
+        pthread_key_delete(_spoo.tlsKeys[key].posix.key);
+#endif /*_SPOO_THREAD_LOCAL*/
+
+        // Invalidate any values left behind in other threads
+        _spoo.tlsKeys[key].used = SPOO_FALSE;
+        _spoo.tlsKeys[key].generation++;
+        _spoo.tlsKeys[key].destructor = NULL;
+    }
+
+    LEAVE_THREAD_CRITICAL_SECTION;
+}
+
+// Set the value of a thread-local storage key for the current thread
+//
+void _spooPlatformSetTLS(SPOOtlskey key, void* value)
+{
+#if defined(_SPOO_THREAD_LOCAL)
+    tlsValues[key].value = value;
+    tlsValues[key].generation = _spoo.tlsKeys[key].generation;
+#else
+    pthread_setspecific(_spoo.tlsKeys[key].posix.key, value);
+#endif /*_SPOO_THREAD_LOCAL*/
+}
+
+// Return the value of a thread-local storage key for the current thread
+//
+void* _spooPlatformGetTLS(SPOOtlskey key)
+{
+#if defined(_SPOO_THREAD_LOCAL)
+    if (tlsValues[key].generation != _spoo.tlsKeys[key].generation)
+        return NULL;
+
+    return tlsValues[key].value;
+#else
+    return pthread_getspecific(_spoo.tlsKeys[key].posix.key);
+#endif /*_SPOO_THREAD_LOCAL*/
+}
+
+// Create an execution context that runs its entry function on a new stack
+// The stack has a guard page at its end to catch overflows
+//
+int _spooPlatformCreateContext(_SPOOcontext* context, size_t stackSize)
+{
+    char* stack;
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+
+    stackSize = (stackSize + pageSize - 1) / pageSize * pageSize;
+
+    stack = (char*) mmap(NULL, stackSize + pageSize,
+                         PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS,
+                         -1, 0);
+    if (stack == MAP_FAILED)
+        return SPOO_FALSE;
+
+    mprotect(stack, pageSize, PROT_NONE);
+
+    context->posix.stack = stack;
+    context->posix.stackSize = stackSize + pageSize;
+
+#if defined(_SPOO_CONTEXT_X86_64)
+    {
+        void** top = (void**) (stack + stackSize + pageSize);
+
+        // Lay out the stack as if _spooSwitchStack had been called from
+        // the start of _spooStartContext, with the entry point and its
+        // argument in the callee-saved registers it restores
+        *(--top) = (void*) _spooStartContext;   // Return address
+        *(--top) = NULL;                        // rbp
+        *(--top) = context->arg;                // rbx
+        *(--top) = (void*) context->entry;      // r12
+        *(--top) = NULL;                        // r13
+        *(--top) = NULL;                        // r14
+        *(--top) = NULL;                        // r15
+        *(--top) = (void*) 0x0000037f00001f80ull; // x87 control word, MXCSR
+
+        context->posix.stackPointer = top;
+    }
+#else
+    if (getcontext(&context->posix.context) != 0)
+    {
+        munmap(stack, stackSize + pageSize);
+        return SPOO_FALSE;
+    }
+
+    context->posix.context.uc_stack.ss_sp = stack + pageSize;
+    context->posix.context.uc_stack.ss_size = stackSize;
+    context->posix.context.uc_link = NULL;
+
+    makecontext(&context->posix.context, (void (*)(void)) startContext, 2,
+                (unsigned int) ((unsigned long long) (size_t) context >> 32),
+                (unsigned int) (size_t) context);
+#endif /*_SPOO_CONTEXT_X86_64*/
+
+    return SPOO_TRUE;
+}
+
+// Destroy an execution context and free its stack
+//
+void _spooPlatformDestroyContext(_SPOOcontext* context)
+{
+    munmap(context->posix.stack, context->posix.stackSize);
+}
+
+// Make the current thread able to switch to other contexts
+//
+int _spooPlatformInitThreadContext(_SPOOcontext* context)
+{
+    context->posix.stack = NULL;
+    context->posix.stackSize = 0;
+
+    return SPOO_TRUE;
+}
+
+// Make the current thread a plain thread again
+//
+void _spooPlatformTerminateThreadContext(_SPOOcontext* context)
+{
+}
+
+// Save the current context and switch to another
+//
+void _spooPlatformSwitchContext(_SPOOcontext* from, _SPOOcontext* to)
+{
+#if defined(_SPOO_CONTEXT_X86_64)
+    _spooSwitchStack(&from->posix.stackPointer, to->posix.stackPointer);
+#else
+    swapcontext(&from->posix.context, &to->posix.context);
+#endif /*_SPOO_CONTEXT_X86_64*/
+}
+
+
+// Read from a file at the specified offset
+//
+long _spooPlatformReadFile(int fd, void* buffer, size_t size, long long offset)
+{
+    ssize_t result;
+
+    do
+    {
+        result = pread(fd, buffer, size, (off_t) offset);
+    }
+    while (result < 0 && errno == EINTR);
+
+    if (result < 0)
+        return -errno;
+
+    return (long) result;
+}
+
+// Write to a file at the specified offset
+//
+long _spooPlatformWriteFile(int fd, const void* buffer, size_t size, long long offset)
+{
+    ssize_t result;
+
+    do
+    {
+        result = pwrite(fd, buffer, size, (off_t) offset);
+    }
+    while (result < 0 && errno == EINTR);
+
+    if (result < 0)
+        return -errno;
+
+    return (long) result;
+}
+
+// Flush the data of a file to its storage device
+//
+long _spooPlatformSyncFile(int fd)
+{
+    if (fsync(fd) != 0)
+        return -errno;
+
+    return 0;
+}
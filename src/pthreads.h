@@ -32,6 +32,14 @@
 
 #include <pthread.h>
 
+// Use hand-written context switching where we have it, as swapcontext
+// makes a system call for the signal mask on every switch
+#if defined(__GNUC__) && defined(__x86_64__) && defined(__ELF__)
+ #define _SPOO_CONTEXT_X86_64 1
+#else
+ #include <ucontext.h>
+#endif
+
 
 //========================================================================
 // Spoo platform-specific types
@@ -39,18 +47,94 @@
 
 #define _SPOO_PLATFORM_THREAD_STATE  _SPOOthreadPOSIX posix
 #define _SPOO_PLATFORM_LIBRARY_STATE _SPOOlibraryPOSIX posix
+#define _SPOO_PLATFORM_TLS_KEY_STATE _SPOOtlskeyPOSIX posix
+#define _SPOO_PLATFORM_CONTEXT_STATE _SPOOcontextPOSIX posix
 
 //------------------------------------------------------------------------
 // Platform-specific Spoo thread state
 //------------------------------------------------------------------------
 
+typedef struct _SPOOthreadstack _SPOOthreadstack;
+
 typedef struct
 {
     pthread_t ID;
 
+    // The cached stack of the thread, if any, and whether a waiting thread
+    // has taken over returning it to the cache
+    _SPOOthreadstack* stack;
+    int               joining;
+
 } _SPOOthreadPOSIX;
 
 
+//------------------------------------------------------------------------
+// Thread stack from the stack cache, with a guard page below it
+//------------------------------------------------------------------------
+
+struct _SPOOthreadstack
+{
+    _SPOOthreadstack*   next;
+    char*               mapping;
+    size_t              mappingSize;
+    char*               stack;
+    size_t              stackSize;
+    int                 generation;
+
+    // The thread still using the stack, once it has exited but before it
+    // has been joined
+    pthread_t           posixID;
+    int                 threadID;
+};
+
+
+//------------------------------------------------------------------------
+// Platform-specific Spoo thread-local storage key state
+//------------------------------------------------------------------------
+
+typedef struct
+{
+    pthread_key_t key;
+
+} _SPOOtlskeyPOSIX;
+
+
+//------------------------------------------------------------------------
+// Platform-specific Spoo execution context state
+//------------------------------------------------------------------------
+
+typedef struct
+{
+    void*         stack;
+    size_t        stackSize;
+#if defined(_SPOO_CONTEXT_X86_64)
+    void*         stackPointer;
+#else
+    ucontext_t    context;
+#endif
+
+} _SPOOcontextPOSIX;
+
+
+//------------------------------------------------------------------------
+// Futex based mutex and condition variable objects
+//------------------------------------------------------------------------
+
+typedef struct
+{
+    volatile int        state;
+
+} _SPOOfutexmutex;
+
+typedef struct
+{
+    volatile int        sequence;
+    volatile int        waiters;
+    _SPOOfutexmutex*    mutex;
+
+} _SPOOfutexcond;
+
+
 //------------------------------------------------------------------------
 // Platform-specific Spoo library state
 //------------------------------------------------------------------------
@@ -62,6 +146,17 @@ typedef struct
     double              timerRes;
     long long           baseTime;
 
+    // Thread stack cache settings, where a zero maximum disables the cache
+    size_t              stackSize;
+    int                 maxStacks;
+    int                 stackFlags;
+    int                 stackGeneration;
+
+    // Cached stacks, and stacks of threads that exited without being waited
+    _SPOOthreadstack*   freeStacks;
+    int                 freeStackCount;
+    _SPOOthreadstack*   exitedStacks;
+
 } _SPOOlibraryPOSIX;
 
 
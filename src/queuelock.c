@@ -0,0 +1,269 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+
+
+// Number of times a waiter checks the lock before yielding its CPU
+#define SPIN_COUNT 128
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Allocate memory aligned to a cache line, storing the block to free
+//
+static void* allocateAligned(size_t size, void** allocation)
+{
+    *allocation = calloc(1, size + _SPOO_CACHE_LINE_SIZE);
+    if (!*allocation)
+        return NULL;
+
+    return (void*) (((size_t) *allocation + _SPOO_CACHE_LINE_SIZE - 1) &
+                    ~((size_t) _SPOO_CACHE_LINE_SIZE - 1));
+}
+
+// Free the queue nodes of a thread
+//
+static void freeNodes(void* value)
+{
+    _SPOOmcsnode* node = (_SPOOmcsnode*) value;
+    _SPOOmcsnode* next;
+
+    while (node)
+    {
+        next = node->free;
+        free(node->allocation);
+        node = next;
+    }
+}
+
+// Take a queue node from the free list of the calling thread
+// A thread needs one node for each MCS lock it holds
+//
+static _SPOOmcsnode* acquireNode(void)
+{
+    void* allocation;
+    _SPOOmcsnode* node;
+
+    node = (_SPOOmcsnode*) _spooPlatformGetTLS(_spoo.mcsNodeKey);
+    if (node)
+    {
+        _spooPlatformSetTLS(_spoo.mcsNodeKey, node->free);
+        return node;
+    }
+
+    // Each node gets its own cache line, as its waiter spins on it
+    while (!(node = (_SPOOmcsnode*) allocateAligned(_SPOO_CACHE_LINE_SIZE, &allocation)))
+        _spooPlatformSleep(0.0);
+
+    node->allocation = allocation;
+    return node;
+}
+
+// Return a queue node to the free list of the calling thread
+//
+static void releaseNode(_SPOOmcsnode* node)
+{
+    node->free = (_SPOOmcsnode*) _spooPlatformGetTLS(_spoo.mcsNodeKey);
+    _spooPlatformSetTLS(_spoo.mcsNodeKey, node);
+}
+
+// Wait a little for the lock, spinning at first and then yielding so a
+// preempted holder or predecessor can run
+//
+static void backOff(int* spins)
+{
+    if (*spins < SPIN_COUNT)
+    {
+        (*spins)++;
+        _SPOO_CPU_RELAX();
+    }
+    else
+        _spooPlatformSleep(0.0);
+}
+
+// Acquire the queue part of a queue lock mutex
+//
+static void acquireQueue(_SPOOqueuemutex* mutex)
+{
+    int spins = 0;
+    long ticket;
+    _SPOOmcsnode* node;
+    _SPOOmcsnode* prev;
+
+    if (mutex->kind == SPOO_MUTEX_TICKET)
+    {
+        ticket = _SPOO_ATOMIC_ADD(&mutex->nextTicket, 1) - 1;
+
+        while (_SPOO_ATOMIC_LOAD(&mutex->nowServing) != ticket)
+            backOff(&spins);
+    }
+    else
+    {
+        node = acquireNode();
+        node->next = NULL;
+        node->locked = SPOO_TRUE;
+
+        prev = _SPOO_ATOMIC_EXCHANGE_PTR(&mutex->tail, node);
+        if (prev)
+        {
+            // Each waiter spins on its own node until its predecessor
+            // hands the lock over
+            _SPOO_ATOMIC_STORE(&prev->next, node);
+
+            while (_SPOO_ATOMIC_LOAD(&node->locked))
+                backOff(&spins);
+        }
+
+        mutex->owner = node;
+    }
+}
+
+// Release the queue part of a queue lock mutex
+//
+static void releaseQueue(_SPOOqueuemutex* mutex)
+{
+    _SPOOmcsnode* node;
+    _SPOOmcsnode* next;
+
+    if (mutex->kind == SPOO_MUTEX_TICKET)
+    {
+        // Only the holder changes the serving number
+        _SPOO_ATOMIC_STORE(&mutex->nowServing, mutex->nowServing + 1);
+    }
+    else
+    {
+        node = mutex->owner;
+
+        next = _SPOO_ATOMIC_LOAD(&node->next);
+        if (!next)
+        {
+            if (_SPOO_ATOMIC_CAS_PTR(&mutex->tail, node, NULL))
+            {
+                releaseNode(node);
+                return;
+            }
+
+            // A thread has queued up behind us but not yet linked itself
+            while (!(next = _SPOO_ATOMIC_LOAD(&node->next)))
+                _SPOO_CPU_RELAX();
+        }
+
+        _SPOO_ATOMIC_STORE(&next->locked, SPOO_FALSE);
+        releaseNode(node);
+    }
+}
+
+// Initialize queue lock support
+//
+int _spooInitQueueMutexes(void)
+{
+    _spoo.mcsNodeKey = _spooPlatformCreateTLSKey(freeNodes);
+    if (_spoo.mcsNodeKey == SPOO_INVALID_TLS_KEY)
+        return SPOO_FALSE;
+
+    return SPOO_TRUE;
+}
+
+// Terminate queue lock support
+//
+void _spooTerminateQueueMutexes(void)
+{
+    freeNodes(_spooPlatformGetTLS(_spoo.mcsNodeKey));
+    _spooPlatformSetTLS(_spoo.mcsNodeKey, NULL);
+    _spooPlatformDestroyTLSKey(_spoo.mcsNodeKey);
+}
+
+// Create a ticket or MCS lock mutex, returning its tagged handle
+//
+SPOOmutex _spooCreateQueueMutex(int kind)
+{
+    void* allocation;
+    _SPOOqueuemutex* mutex;
+
+    mutex = (_SPOOqueuemutex*) allocateAligned(sizeof(_SPOOqueuemutex), &allocation);
+    if (!mutex)
+        return NULL;
+
+    mutex->kind = kind;
+    mutex->allocation = allocation;
+
+    mutex->mutex = _spooPlatformCreateMutex();
+    if (!mutex->mutex)
+    {
+        free(allocation);
+        return NULL;
+    }
+
+    return (SPOOmutex) ((size_t) mutex | _SPOO_QUEUE_MUTEX_TAG);
+}
+
+// Destroy a queue lock mutex
+//
+void _spooDestroyQueueMutex(_SPOOqueuemutex* mutex)
+{
+    _spooPlatformDestroyMutex(mutex->mutex);
+    free(mutex->allocation);
+}
+
+// Lock a queue lock mutex
+// The platform mutex is uncontended once the queue lock is held
+//
+void _spooLockQueueMutex(_SPOOqueuemutex* mutex)
+{
+    acquireQueue(mutex);
+    _spooPlatformLockMutex(mutex->mutex);
+}
+
+// Unlock a queue lock mutex
+//
+void _spooUnlockQueueMutex(_SPOOqueuemutex* mutex)
+{
+    _spooPlatformUnlockMutex(mutex->mutex);
+    releaseQueue(mutex);
+}
+
+// Wait for a condition with a locked queue lock mutex
+// The platform mutex stays locked until the wait has started, so signals
+// sent by threads holding the mutex cannot be missed
+//
+void _spooWaitQueueMutexCond(SPOOcond cond, _SPOOqueuemutex* mutex, double timeout,
+                             volatile long* cancelled)
+{
+    releaseQueue(mutex);
+    _spooPlatformWaitCondCancellable(cond, mutex->mutex, timeout, cancelled);
+
+    // The queue lock comes first, so let go of the platform mutex to take it
+    _spooPlatformUnlockMutex(mutex->mutex);
+    _spooLockQueueMutex(mutex);
+}
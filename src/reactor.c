@@ -0,0 +1,498 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+
+#if defined(_SPOO_HAS_EPOLL)
+ #include <errno.h>
+ #include <stdint.h>
+ #include <unistd.h>
+ #include <sys/epoll.h>
+ #include <sys/eventfd.h>
+#endif
+
+
+#if defined(_SPOO_HAS_EPOLL)
+
+// Maximum number of events handled per poll
+#define MAX_EVENTS 64
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Drop a reference to a watch, freeing it if it was the last one
+//
+static void releaseWatch(_SPOOwatch* watch)
+{
+    if (_SPOO_ATOMIC_ADD(&watch->refs, -1) == 0)
+        free(watch);
+}
+
+// Release the watches removed from a shard
+// NOTE: The shard lock must be held, and its poller must not be holding any
+// events for them
+//
+static void releaseRemovedWatches(_SPOOreactorshard* shard)
+{
+    _SPOOwatch* watch;
+
+    while ((watch = shard->removed))
+    {
+        shard->removed = watch->nextRemoved;
+        releaseWatch(watch);
+    }
+}
+
+// Run the callback of a watch for all events gathered since it last ran
+// This runs as a pool task, and at most one instance runs per watch
+//
+static void runWatch(void* arg)
+{
+    long events;
+    _SPOOwatch* watch = (_SPOOwatch*) arg;
+
+    for (;;)
+    {
+        events = _SPOO_ATOMIC_EXCHANGE(&watch->ready, 0);
+        if (events && !_SPOO_ATOMIC_LOAD(&watch->removed))
+            watch->function(watch->fd, (int) events, watch->arg);
+
+        _SPOO_ATOMIC_STORE(&watch->queued, 0);
+        _SPOO_ATOMIC_FENCE();
+
+        // Handle events that arrived while the callback ran, unless the
+        // poller has already queued another run for them
+        if (!_SPOO_ATOMIC_LOAD(&watch->ready) ||
+            _SPOO_ATOMIC_LOAD(&watch->removed) ||
+            _SPOO_ATOMIC_EXCHANGE(&watch->queued, 1))
+        {
+            break;
+        }
+    }
+
+    releaseWatch(watch);
+}
+
+// Record events for a watch and queue its callback if it isn't already
+// NOTE: The shard lock must be held
+//
+static void dispatchWatch(_SPOOwatch* watch, long events)
+{
+    long ready;
+
+    do
+    {
+        ready = _SPOO_ATOMIC_LOAD(&watch->ready);
+    }
+    while (!_SPOO_ATOMIC_CAS(&watch->ready, ready, ready | events));
+
+    _SPOO_ATOMIC_FENCE();
+
+    if (_SPOO_ATOMIC_EXCHANGE(&watch->queued, 1))
+        return;
+
+    _SPOO_ATOMIC_ADD(&watch->refs, 1);
+    spooSubmitTask(watch->shard->reactor->pool, &watch->task);
+}
+
+// Translate epoll events to Spoo I/O events
+//
+static long translateEvents(unsigned int events)
+{
+    long result = 0;
+
+    if (events & EPOLLIN)
+        result |= SPOO_IO_READ;
+    if (events & EPOLLOUT)
+        result |= SPOO_IO_WRITE;
+    if (events & (EPOLLERR | EPOLLHUP))
+        result |= SPOO_IO_ERROR;
+
+    return result;
+}
+
+// Wait for I/O events on a shard and hand them to the pool in batches
+//
+static void pollerMain(void* arg)
+{
+    int i, count;
+    uint64_t value;
+    _SPOOwatch* watch;
+    struct epoll_event events[MAX_EVENTS];
+    _SPOOreactorshard* shard = (_SPOOreactorshard*) arg;
+
+    while (!_SPOO_ATOMIC_LOAD(&shard->reactor->stopping))
+    {
+        count = epoll_wait(shard->pollFD, events, MAX_EVENTS, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        // Removed watches are not freed until we are done with these events,
+        // and the lock keeps them from being removed while we dispatch
+        spooLockMutex(shard->lock);
+
+        for (i = 0;  i < count;  i++)
+        {
+            // The wakeup event has no watch
+            watch = (_SPOOwatch*) events[i].data.ptr;
+            if (!watch)
+            {
+                // Reset the wakeup count so the event does not fire again
+                while (read(shard->wakeFD, &value, sizeof(value)) == sizeof(value))
+                    ;
+
+                continue;
+            }
+
+            if (_SPOO_ATOMIC_LOAD(&watch->removed))
+                continue;
+
+            dispatchWatch(watch, translateEvents(events[i].events));
+        }
+
+        // Watches removed before now can no longer be returned by epoll_wait
+        releaseRemovedWatches(shard);
+
+        spooUnlockMutex(shard->lock);
+    }
+}
+
+// Wake the poller thread of a shard
+// A full wakeup count means the poller is already due to wake up.
+//
+static int wakePoller(_SPOOreactorshard* shard)
+{
+    uint64_t value = 1;
+
+    while (write(shard->wakeFD, &value, sizeof(value)) != sizeof(value))
+    {
+        if (errno == EAGAIN)
+            break;
+        if (errno != EINTR)
+            return SPOO_FALSE;
+    }
+
+    return SPOO_TRUE;
+}
+
+// Destroy a reactor, stopping its poller threads
+//
+static void destroyReactor(_SPOOreactor* reactor, int count)
+{
+    int i;
+    _SPOOreactor** link;
+    _SPOOreactorshard* shard;
+
+    _spooPlatformLockMutex(_spoo.reactorLock);
+
+    for (link = &_spoo.reactors;  *link;  link = &(*link)->next)
+    {
+        if (*link == reactor)
+        {
+            *link = reactor->next;
+            break;
+        }
+    }
+
+    _spooPlatformUnlockMutex(_spoo.reactorLock);
+
+    _SPOO_ATOMIC_STORE(&reactor->stopping, 1);
+
+    for (i = 0;  i < count;  i++)
+    {
+        shard = reactor->shards + i;
+
+        // The poller must be joined before its descriptors are closed, as
+        // they may otherwise be reused while it still waits on them
+        if (shard->thread != SPOO_INVALID_THREAD)
+        {
+            wakePoller(shard);
+            spooWaitThread(shard->thread, SPOO_WAIT);
+        }
+
+        // The poller has stopped, so nothing holds removed watches any more
+        if (shard->lock)
+        {
+            spooLockMutex(shard->lock);
+            releaseRemovedWatches(shard);
+            spooUnlockMutex(shard->lock);
+        }
+
+        close(shard->wakeFD);
+        close(shard->pollFD);
+        spooDestroyMutex(shard->lock);
+    }
+
+    free(reactor->shards);
+    free(reactor);
+}
+
+// Initialize a reactor shard and start its poller thread
+//
+static int initShard(_SPOOreactor* reactor, _SPOOreactorshard* shard)
+{
+    struct epoll_event event;
+
+    shard->reactor = reactor;
+    shard->thread = SPOO_INVALID_THREAD;
+
+    shard->pollFD = epoll_create1(EPOLL_CLOEXEC);
+    shard->wakeFD = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    shard->lock = spooCreateMutex();
+
+    if (shard->pollFD == -1 || shard->wakeFD == -1 || !shard->lock)
+        return SPOO_FALSE;
+
+    spooSetMutexName(shard->lock, "reactor shard");
+
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+
+    if (epoll_ctl(shard->pollFD, EPOLL_CTL_ADD, shard->wakeFD, &event) != 0)
+        return SPOO_FALSE;
+
+    shard->thread = spooCreateThread(pollerMain, shard);
+    if (shard->thread == SPOO_INVALID_THREAD)
+        return SPOO_FALSE;
+
+    return SPOO_TRUE;
+}
+
+// Initialize reactor support
+//
+int _spooInitReactors(void)
+{
+    _spoo.reactors = NULL;
+
+    _spoo.reactorLock = _spooPlatformCreateMutex();
+    if (!_spoo.reactorLock)
+        return SPOO_FALSE;
+
+    return SPOO_TRUE;
+}
+
+// Destroy any reactors left and terminate reactor support
+// Their pollers block in epoll_wait, where cancellation cannot reach them
+//
+void _spooTerminateReactors(void)
+{
+    while (_spoo.reactors)
+        destroyReactor(_spoo.reactors, _spoo.reactors->shardCount);
+
+    _spooPlatformDestroyMutex(_spoo.reactorLock);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Create an I/O reactor dispatching readiness callbacks to a pool
+// File descriptors are spread over the shards, which each have their own
+// poller thread (one per pool worker if zero)
+//
+SPOOreactor spooCreateReactor(SPOOpool pool, int shardCount)
+{
+    int i;
+    _SPOOreactor* reactor;
+
+    if (!_spooInitialized)
+        return NULL;
+
+    if (shardCount <= 0)
+        shardCount = spooGetPoolThreadCount(pool);
+    if (shardCount < 1)
+        shardCount = 1;
+
+    reactor = (_SPOOreactor*) calloc(1, sizeof(_SPOOreactor));
+    if (!reactor)
+        return NULL;
+
+    reactor->pool = pool;
+    reactor->shards = (_SPOOreactorshard*) calloc(shardCount,
+                                                  sizeof(_SPOOreactorshard));
+    if (!reactor->shards)
+    {
+        free(reactor);
+        return NULL;
+    }
+
+    for (i = 0;  i < shardCount;  i++)
+    {
+        if (!initShard(reactor, reactor->shards + i))
+        {
+            destroyReactor(reactor, i + 1);
+            return NULL;
+        }
+    }
+
+    reactor->shardCount = shardCount;
+
+    _spooPlatformLockMutex(_spoo.reactorLock);
+    reactor->next = _spoo.reactors;
+    _spoo.reactors = reactor;
+    _spooPlatformUnlockMutex(_spoo.reactorLock);
+
+    return (SPOOreactor) reactor;
+}
+
+// Destroy an I/O reactor
+// NOTE: All watches must have been removed first
+//
+void spooDestroyReactor(SPOOreactor handle)
+{
+    _SPOOreactor* reactor = (_SPOOreactor*) handle;
+
+    if (!_spooInitialized || !reactor)
+        return;
+
+    destroyReactor(reactor, reactor->shardCount);
+}
+
+// Start watching a file descriptor for I/O readiness
+// Watches are edge-triggered, so the callback must read or write until the
+// call would block.  Callbacks for a watch never run concurrently.
+//
+SPOOwatch spooAddWatch(SPOOreactor handle, int fd, int events,
+                       SPOOiofun fun, void* arg)
+{
+    long index;
+    _SPOOwatch* watch;
+    struct epoll_event event;
+    _SPOOreactor* reactor = (_SPOOreactor*) handle;
+
+    if (!_spooInitialized || !reactor || !fun)
+        return NULL;
+
+    watch = (_SPOOwatch*) calloc(1, sizeof(_SPOOwatch));
+    if (!watch)
+        return NULL;
+
+    index = _SPOO_ATOMIC_ADD(&reactor->nextShard, 1);
+
+    watch->task.fun = runWatch;
+    watch->task.arg = watch;
+    watch->shard = reactor->shards + (unsigned long) index % reactor->shardCount;
+    watch->fd = fd;
+    watch->function = fun;
+    watch->arg = arg;
+    watch->refs = 1;
+
+    event.events = EPOLLET;
+    if (events & SPOO_IO_READ)
+        event.events |= EPOLLIN | EPOLLRDHUP;
+    if (events & SPOO_IO_WRITE)
+        event.events |= EPOLLOUT;
+    event.data.ptr = watch;
+
+    if (epoll_ctl(watch->shard->pollFD, EPOLL_CTL_ADD, fd, &event) != 0)
+    {
+        free(watch);
+        return NULL;
+    }
+
+    return (SPOOwatch) watch;
+}
+
+// Stop watching a file descriptor
+// No new callbacks are started once this returns, but one may still be
+// running if this is called from outside the callback
+//
+void spooRemoveWatch(SPOOwatch handle)
+{
+    _SPOOreactorshard* shard;
+    _SPOOwatch* watch = (_SPOOwatch*) handle;
+
+    if (!_spooInitialized || !watch)
+        return;
+
+    shard = watch->shard;
+
+    // The poller may have fetched events for the watch that it has yet to
+    // look at, so it drops the registration reference once it is done
+    spooLockMutex(shard->lock);
+    epoll_ctl(shard->pollFD, EPOLL_CTL_DEL, watch->fd, NULL);
+    _SPOO_ATOMIC_STORE(&watch->removed, 1);
+    watch->nextRemoved = shard->removed;
+    shard->removed = watch;
+    spooUnlockMutex(shard->lock);
+
+    // Wake the poller so the watch is not kept until the next event
+    wakePoller(shard);
+}
+
+#else /*_SPOO_HAS_EPOLL*/
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+int _spooInitReactors(void)
+{
+    return SPOO_TRUE;
+}
+
+void _spooTerminateReactors(void)
+{
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+SPOOreactor spooCreateReactor(SPOOpool pool, int shardCount)
+{
+    return NULL;
+}
+
+void spooDestroyReactor(SPOOreactor reactor)
+{
+}
+
+SPOOwatch spooAddWatch(SPOOreactor reactor, int fd, int events,
+                       SPOOiofun fun, void* arg)
+{
+    return NULL;
+}
+
+void spooRemoveWatch(SPOOwatch watch)
+{
+}
+
+#endif /*_SPOO_HAS_EPOLL*/
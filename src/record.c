@@ -0,0 +1,211 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdlib.h>
+
+
+// States of a record
+#define RECORD_FREE      0
+#define RECORD_HELD      1
+#define RECORD_LEAVING   2
+#define RECORD_RELEASING 3
+#define RECORD_ORPHANED  4
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Free a record with the destroy function, if any
+//
+static void destroyRecord(_SPOOrecord* record, _SPOOrecordfun destroy)
+{
+    if (destroy)
+        destroy(record);
+    else
+        free(record);
+}
+
+// Return the record of the calling thread for an owner, claiming a record
+// left by a thread that has exited or adding a new one if it has none
+// Records orphaned by destroyed owners are freed along the way.
+//
+_SPOOrecord* _spooGetRecord(SPOOtlskey key, void* owner, _SPOOrecordlist* list,
+                           size_t size, _SPOOrecordfun destroy)
+{
+    _SPOOrecord* head;
+    _SPOOrecord* first;
+    _SPOOrecord* record;
+    _SPOOrecord* found = NULL;
+    _SPOOrecord** link;
+
+    first = head = (_SPOOrecord*) _spooPlatformGetTLS(key);
+
+    for (link = &head;  *link;  )
+    {
+        record = *link;
+
+        // The address of a destroyed owner may have been reused, so its
+        // records must be freed before comparing owners
+        if (_SPOO_ATOMIC_LOAD(&record->active) == RECORD_ORPHANED)
+        {
+            *link = record->nextOwned;
+            destroyRecord(record, destroy);
+            continue;
+        }
+
+        if (record->owner == owner)
+            found = record;
+
+        link = &record->nextOwned;
+    }
+
+    // The key must never be left pointing at a freed record
+    if (head != first)
+        _spooPlatformSetTLS(key, head);
+
+    if (found)
+        return found;
+
+    for (record = _SPOO_ATOMIC_LOAD(&list->head);  record;  record = record->next)
+    {
+        if (_SPOO_ATOMIC_LOAD(&record->active) == RECORD_FREE &&
+            _SPOO_ATOMIC_CAS(&record->active, RECORD_FREE, RECORD_HELD))
+        {
+            break;
+        }
+    }
+
+    if (!record)
+    {
+        record = (_SPOOrecord*) calloc(1, size);
+        if (!record)
+            return NULL;
+
+        record->owner = owner;
+        record->active = RECORD_HELD;
+
+        do
+            record->next = _SPOO_ATOMIC_LOAD(&list->head);
+        while (!_SPOO_ATOMIC_CAS_PTR(&list->head, record->next, record));
+
+        _SPOO_ATOMIC_ADD(&list->count, 1);
+    }
+
+    record->nextOwned = head;
+    _spooPlatformSetTLS(key, record);
+    return record;
+}
+
+// Release the records of the calling thread so other threads can take them
+// over, calling the leave function on those whose owner still exists
+//
+void _spooLeaveRecords(SPOOtlskey key, _SPOOrecordfun leave, _SPOOrecordfun destroy)
+{
+    _SPOOrecord* record;
+    _SPOOrecord* next;
+
+    record = (_SPOOrecord*) _spooPlatformGetTLS(key);
+    _spooPlatformSetTLS(key, NULL);
+
+    for (;  record;  record = next)
+    {
+        next = record->nextOwned;
+        record->nextOwned = NULL;
+
+        // Marking the record as leaving keeps its owner from being destroyed
+        // until the leave function is done with it
+        while (!_SPOO_ATOMIC_CAS(&record->active, RECORD_HELD, RECORD_LEAVING))
+        {
+            if (_SPOO_ATOMIC_LOAD(&record->active) == RECORD_ORPHANED)
+                break;
+
+            _spooPlatformSleep(0.0);
+        }
+
+        if (_SPOO_ATOMIC_LOAD(&record->active) == RECORD_ORPHANED)
+        {
+            destroyRecord(record, destroy);
+            continue;
+        }
+
+        if (leave)
+            leave(record);
+
+        _SPOO_ATOMIC_STORE(&record->active, RECORD_FREE);
+    }
+}
+
+// Unlink all records from an owner that is being destroyed, calling the
+// release function on each of them first
+// Records held by threads are orphaned and freed by those threads, while
+// threads that are leaving are waited for
+// NOTE: No thread may be using the owner
+//
+void _spooReleaseRecords(_SPOOrecordlist* list, _SPOOrecordfun release,
+                         _SPOOrecordfun destroy)
+{
+    _SPOOrecord* record;
+    _SPOOrecord* next;
+
+    for (record = list->head;  record;  record = next)
+    {
+        next = record->next;
+
+        for (;;)
+        {
+            if (_SPOO_ATOMIC_CAS(&record->active, RECORD_FREE, RECORD_ORPHANED))
+            {
+                if (release)
+                    release(record);
+
+                destroyRecord(record, destroy);
+                break;
+            }
+
+            // The owning thread frees the record when it next looks at it
+            if (_SPOO_ATOMIC_CAS(&record->active, RECORD_HELD, RECORD_RELEASING))
+            {
+                if (release)
+                    release(record);
+
+                _SPOO_ATOMIC_STORE(&record->active, RECORD_ORPHANED);
+                break;
+            }
+
+            // Wait for a leaving thread to be done with the owner
+            _spooPlatformSleep(0.0);
+        }
+    }
+
+    list->head = NULL;
+    list->count = 0;
+}
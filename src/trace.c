@@ -0,0 +1,309 @@
+//========================================================================
+// Spoo - A threading library
+//------------------------------------------------------------------------
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+
+#include "internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+
+// Default number of events kept per thread
+//
+#define DEFAULT_CAPACITY 65536
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                   Spoo internal functions                    //////
+//////////////////////////////////////////////////////////////////////////
+
+// Return the trace buffer of the current thread for the current trace,
+// creating it if necessary
+//
+static _SPOOtracebuffer* getTraceBuffer(void)
+{
+    _SPOOtracebuffer* buffer;
+    long generation = _SPOO_ATOMIC_LOAD(&_spoo.traceGeneration);
+
+    buffer = (_SPOOtracebuffer*) _spooPlatformGetTLS(_spoo.traceKey);
+    if (buffer)
+    {
+        if (buffer->generation == generation)
+            return buffer;
+
+        // A new trace was started since this thread last recorded an event
+        if (buffer->capacity == _spoo.traceCapacity)
+        {
+            buffer->generation = generation;
+            _SPOO_ATOMIC_STORE(&buffer->head, 0);
+            return buffer;
+        }
+
+        // The new trace needs a buffer of another size
+        _spooPlatformSetTLS(_spoo.traceKey, NULL);
+        _SPOO_ATOMIC_STORE(&buffer->active, 0);
+    }
+
+    // Buffers stay in the list until termination, as the exporter may be
+    // reading them, so take over one left by another thread if possible
+    for (buffer = _SPOO_ATOMIC_LOAD(&_spoo.traceBuffers);  buffer;  buffer = buffer->next)
+    {
+        if (buffer->capacity == _spoo.traceCapacity &&
+            !_SPOO_ATOMIC_LOAD(&buffer->active) &&
+            _SPOO_ATOMIC_CAS(&buffer->active, 0, 1))
+        {
+            // Events of the previous thread would be exported as ours, so
+            // they are dropped
+            buffer->threadID = _spooPlatformGetThreadID();
+            buffer->generation = generation;
+            _SPOO_ATOMIC_STORE(&buffer->head, 0);
+
+            _spooPlatformSetTLS(_spoo.traceKey, buffer);
+            return buffer;
+        }
+    }
+
+    buffer = (_SPOOtracebuffer*) calloc(1, sizeof(_SPOOtracebuffer) +
+                                           _spoo.traceCapacity *
+                                           sizeof(_SPOOtraceevent));
+    if (!buffer)
+        return NULL;
+
+    buffer->threadID = _spooPlatformGetThreadID();
+    buffer->generation = generation;
+    buffer->capacity = _spoo.traceCapacity;
+    buffer->active = 1;
+    buffer->events = (_SPOOtraceevent*) (buffer + 1);
+
+    do
+        buffer->next = _spoo.traceBuffers;
+    while (!_SPOO_ATOMIC_CAS_PTR(&_spoo.traceBuffers, buffer->next, buffer));
+
+    _spooPlatformSetTLS(_spoo.traceKey, buffer);
+    return buffer;
+}
+
+// Write the events of a single trace buffer in Chrome trace event format
+//
+static void writeTraceBuffer(FILE* file, _SPOOtracebuffer* buffer, int tid)
+{
+    unsigned long i, start, first, head;
+    _SPOOtraceevent* events;
+    _SPOOtraceevent* event;
+
+    head = _SPOO_ATOMIC_LOAD(&buffer->head);
+    start = head > buffer->capacity ? head - buffer->capacity : 0;
+
+    // Copy the events before formatting, as the thread may still be
+    // writing to the buffer
+    events = (_SPOOtraceevent*) malloc((head - start + 1) * sizeof(_SPOOtraceevent));
+    if (!events)
+        return;
+
+    for (i = start;  i < head;  i++)
+        events[i - start] = buffer->events[i & (buffer->capacity - 1)];
+
+    // Drop any events that were overwritten while we were copying, along
+    // with the slot that may have been in the middle of being written
+    _SPOO_ATOMIC_FENCE();
+    first = _SPOO_ATOMIC_LOAD(&buffer->head);
+    if (first >= buffer->capacity && first - buffer->capacity + 1 > start)
+        first = first - buffer->capacity + 1;
+    else
+        first = start;
+
+    fprintf(file,
+            ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,"
+            "\"args\":{\"name\":\"Spoo thread %i\"}}",
+            tid, buffer->threadID);
+
+    for (i = first;  i < head;  i++)
+    {
+        event = events + (i - start);
+
+        fprintf(file,
+                ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%i",
+                event->name, event->phase, event->time * 1e6, tid);
+
+        if (event->phase == _SPOO_TRACE_INSTANT)
+            fputs(",\"s\":\"t\"", file);
+
+        fputc('}', file);
+    }
+
+    free(events);
+}
+
+// Initialize tracing state
+//
+int _spooInitTracing(void)
+{
+    _spoo.traceCapacity = DEFAULT_CAPACITY;
+
+    _spoo.traceKey = _spooPlatformCreateTLSKey(NULL);
+    if (_spoo.traceKey == SPOO_INVALID_TLS_KEY)
+        return SPOO_FALSE;
+
+    return SPOO_TRUE;
+}
+
+// Free all trace buffers
+// NOTE: No other threads may be recording events at this point
+//
+void _spooTerminateTracing(void)
+{
+    _SPOOtracebuffer* buffer;
+
+    _spoo.traceEnabled = SPOO_FALSE;
+
+    while (_spoo.traceBuffers)
+    {
+        buffer = _spoo.traceBuffers;
+        _spoo.traceBuffers = buffer->next;
+        free(buffer);
+    }
+
+    _spooPlatformDestroyTLSKey(_spoo.traceKey);
+}
+
+// Record a trace event for the current thread
+//
+void _spooTraceEvent(const char* name, char phase)
+{
+    unsigned long head;
+    _SPOOtraceevent* event;
+    _SPOOtracebuffer* buffer;
+
+    buffer = getTraceBuffer();
+    if (!buffer)
+        return;
+
+    head = buffer->head;
+    event = buffer->events + (head & (buffer->capacity - 1));
+    event->time = _spooPlatformGetTime();
+    event->name = name;
+    event->phase = phase;
+
+    // Publish the event to the exporter
+    _SPOO_ATOMIC_STORE(&buffer->head, head + 1);
+}
+
+// Hand over the trace buffer of the calling thread to the next thread that
+// needs one
+// This is called when a Spoo thread leaves runThread
+//
+void _spooLeaveTracing(void)
+{
+    _SPOOtracebuffer* buffer;
+
+    buffer = (_SPOOtracebuffer*) _spooPlatformGetTLS(_spoo.traceKey);
+    if (!buffer)
+        return;
+
+    _spooPlatformSetTLS(_spoo.traceKey, NULL);
+    _SPOO_ATOMIC_STORE(&buffer->active, 0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//////                      Spoo user functions                     //////
+//////////////////////////////////////////////////////////////////////////
+
+// Start recording trace events, discarding any previously recorded events
+// Each thread keeps only its most recent events, rounded up to a power of
+// two, or a default number if zero
+//
+int spooStartTrace(int eventsPerThread)
+{
+    unsigned long capacity = 1;
+
+    if (!_spooInitialized)
+        return SPOO_FALSE;
+
+    if (eventsPerThread <= 0)
+        eventsPerThread = DEFAULT_CAPACITY;
+
+    while (capacity < (unsigned long) eventsPerThread)
+        capacity <<= 1;
+
+    _SPOO_ATOMIC_STORE(&_spoo.traceEnabled, SPOO_FALSE);
+
+    _spoo.traceCapacity = capacity;
+    _SPOO_ATOMIC_ADD(&_spoo.traceGeneration, 1);
+
+    _SPOO_ATOMIC_STORE(&_spoo.traceEnabled, SPOO_TRUE);
+    return SPOO_TRUE;
+}
+
+// Stop recording trace events
+//
+void spooStopTrace(void)
+{
+    if (!_spooInitialized)
+        return;
+
+    _SPOO_ATOMIC_STORE(&_spoo.traceEnabled, SPOO_FALSE);
+}
+
+// Write the events of the current trace to a file in the Chrome trace event
+// format, which can be loaded into chrome://tracing or Perfetto
+//
+int spooWriteTrace(const char* filename)
+{
+    int tid = 0;
+    FILE* file;
+    long generation;
+    _SPOOtracebuffer* buffer;
+
+    if (!_spooInitialized)
+        return SPOO_FALSE;
+
+    file = fopen(filename, "w");
+    if (!file)
+        return SPOO_FALSE;
+
+    generation = _SPOO_ATOMIC_LOAD(&_spoo.traceGeneration);
+
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+          "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+          "\"args\":{\"name\":\"Spoo\"}}", file);
+
+    for (buffer = _SPOO_ATOMIC_LOAD(&_spoo.traceBuffers);  buffer;  buffer = buffer->next)
+    {
+        // Threads outside of Spoo have no ID, so all buffers get new ones
+        if (buffer->generation == generation)
+            writeTraceBuffer(file, buffer, ++tid);
+    }
+
+    fputs("\n]}\n", file);
+
+    if (fclose(file) != 0)
+        return SPOO_FALSE;
+
+    return SPOO_TRUE;
+}
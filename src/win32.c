@@ -30,6 +30,8 @@
 #include "internal.h"
 
 #include <mmsystem.h>
+#include <errno.h>
+#include <io.h>
 #include <stdlib.h>
 
 
@@ -41,6 +43,15 @@
 #define LEAVE_THREAD_CRITICAL_SECTION \
         LeaveCriticalSection(&_spoo.windows.criticalSection)
 
+#if defined(_SPOO_THREAD_LOCAL)
+
+// Thread-local values of the current thread, used instead of TLS indices
+// when the compiler supports thread-local variables
+//
+static _SPOO_THREAD_LOCAL _SPOOtlsvalue tlsValues[SPOO_MAX_TLS_KEYS];
+
+#endif /*_SPOO_THREAD_LOCAL*/
+
 
 //************************************************************************
 // This is an implementation of POSIX "compatible" condition variables for
@@ -83,9 +94,29 @@ static DWORD WINAPI runThread(LPVOID lpParam)
     if (!thread)
         return 0;
 
+    _spooPlatformSetTLS(_spoo.threadKey, thread);
+
+    _SPOO_TRACE("Thread", _SPOO_TRACE_BEGIN);
+
     // Call the user thread function
     thread->function(lpParam);
 
+    _SPOO_TRACE("Thread", _SPOO_TRACE_END);
+
+    // Clean up any thread-local values
+    _spooRunTLSDestructors();
+
+    // Hand over hazard pointer records and what they still have retired
+    _spooLeaveHazardDomains();
+
+    // Hand over flat combining records
+    _spooLeaveCombiners();
+
+    // Hand over the trace buffer
+    _spooLeaveTracing();
+
+    _spooPlatformSetTLS(_spoo.threadKey, NULL);
+
     // Remove thread from thread list
     ENTER_THREAD_CRITICAL_SECTION;
     _spooRemoveThread(thread);
@@ -95,6 +126,15 @@ static DWORD WINAPI runThread(LPVOID lpParam)
     return 0;
 }
 
+// Call the entry point of a new context
+//
+static VOID WINAPI startContext(LPVOID lpParam)
+{
+    _SPOOcontext* context = (_SPOOcontext*) lpParam;
+
+    context->entry(context->arg);
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 //////                   Spoo platform functions                    //////
@@ -141,22 +181,10 @@ int _spooPlatformInit(void)
 //
 int _spooPlatformTerminate(void)
 {
-    _SPOOthread* thread;
-
     // Only the main thread is allowed to do this
     if (GetCurrentThreadId() != _spoo.first.windows.ID)
         return SPOO_FALSE;
 
-    ENTER_THREAD_CRITICAL_SECTION;
-
-    // Kill all remaining threads created by Spoo
-    // NOTE: The user should wait for all threads to die BEFORE calling
-    // spooTerminate.  Any work we need to do here is really an error.
-    while (thread = _spoo.first.next)
-        _spooPlatformDestroyThread(thread->ID);
-
-    LEAVE_THREAD_CRITICAL_SECTION;
-
     DeleteCriticalSection(&_spoo.windows.criticalSection);
 
     return SPOO_TRUE;
@@ -197,6 +225,28 @@ void _spooPlatformSetTime(double time)
         _spoo.windows.baseTime32 = timeGetTime() - (int) rawTime;
 }
 
+// Return the raw value of the high-resolution timer
+//
+unsigned long long _spooPlatformGetTimerValue(void)
+{
+    __int64 counter;
+
+    if (_spoo.windows.hasPerformanceCounter)
+    {
+        QueryPerformanceCounter((LARGE_INTEGER*) &counter);
+        return (unsigned long long) counter;
+    }
+
+    return (unsigned long long) timeGetTime();
+}
+
+// Return the number of high-resolution timer ticks per second
+//
+unsigned long long _spooPlatformGetTimerFrequency(void)
+{
+    return (unsigned long long) (1.0 / _spoo.windows.timerRes + 0.5);
+}
+
 // Put the current thread to sleep for the specified amount of time
 //
 void _spooPlatformSleep(double time)
@@ -219,6 +269,7 @@ void _spooPlatformSleep(double time)
 //
 SPOOthread _spooPlatformCreateThread(SPOOthreadfun fun, void* arg)
 {
+    SPOOthread ID;
     _SPOOthread* thread;
     HANDLE hThread;
     DWORD dwThreadId;
@@ -236,6 +287,13 @@ SPOOthread _spooPlatformCreateThread(SPOOthreadfun fun, void* arg)
     thread->ID = _spoo.nextID++;
     thread->function = fun;
 
+    if (!_spooInitThreadCancel(thread))
+    {
+        free(thread);
+        LEAVE_THREAD_CRITICAL_SECTION;
+        return SPOO_INVALID_THREAD;
+    }
+
     hThread = CreateThread(NULL,         // Default security attributes
                            0,            // Default stack size (1 MB)
                            runThread,    // Internal thread function
@@ -246,6 +304,7 @@ SPOOthread _spooPlatformCreateThread(SPOOthreadfun fun, void* arg)
     // Did the thread creation fail?
     if (!hThread)
     {
+        _spooTerminateThreadCancel(thread);
         free(thread);
         LEAVE_THREAD_CRITICAL_SECTION;
         return SPOO_INVALID_THREAD;
@@ -257,16 +316,37 @@ SPOOthread _spooPlatformCreateThread(SPOOthreadfun fun, void* arg)
 
     _spooAppendThread(thread);
 
+    // The thread may finish and free its state as soon as we leave
+    ID = thread->ID;
+
     LEAVE_THREAD_CRITICAL_SECTION;
 
-    return thread->ID;
+    return ID;
+}
+
+// Configure the cache of thread stacks
+// Windows threads cannot be given caller-allocated stacks, so there is no
+// cache
+//
+int _spooPlatformSetThreadStackCache(size_t stackSize, int maxStacks, int flags)
+{
+    return SPOO_FALSE;
 }
 
-// Kill a running thread
-// NOTE: This is a VERY DANGEROUS operation that should NOT BE USED except
-// in EXTREME SITUATIONS!
+// Stop a running thread
+// TerminateThread leaves locks held and state half updated, so the thread
+// is asked to stop and waited for instead
 //
 void _spooPlatformDestroyThread(SPOOthread ID)
+{
+    // The thread may have stopped by itself, but it must still be joined
+    _spooPlatformRequestCancel(ID);
+    _spooPlatformWaitThread(ID, SPOO_WAIT);
+}
+
+// Request cancellation of a thread
+//
+int _spooPlatformRequestCancel(SPOOthread ID)
 {
     _SPOOthread* thread;
 
@@ -276,17 +356,45 @@ void _spooPlatformDestroyThread(SPOOthread ID)
     if (!thread)
     {
         LEAVE_THREAD_CRITICAL_SECTION;
-        return;
+        return SPOO_FALSE;
     }
 
-    // Simply murder the process
-    if (TerminateThread(thread->windows.handle, 0))
-    {
-        CloseHandle(thread->windows.handle);
-        _spooRemoveThread(thread);
-    }
+    _spooCancelThread(thread);
 
     LEAVE_THREAD_CRITICAL_SECTION;
+    return SPOO_TRUE;
+}
+
+// Stop all remaining threads created by Spoo
+// NOTE: The user should wait for all threads to die BEFORE calling
+// spooTerminate.  Any work we need to do here is really an error.
+//
+void _spooPlatformCancelAllThreads(void)
+{
+    _SPOOthread* thread;
+    SPOOthread ID;
+
+    // Request cancellation of all threads first so they stop in parallel
+    ENTER_THREAD_CRITICAL_SECTION;
+
+    for (thread = _spoo.first.next;  thread;  thread = thread->next)
+        _spooCancelThread(thread);
+
+    LEAVE_THREAD_CRITICAL_SECTION;
+
+    for (;;)
+    {
+        ENTER_THREAD_CRITICAL_SECTION;
+        thread = _spoo.first.next;
+        ID = thread ? thread->ID : SPOO_INVALID_THREAD;
+        LEAVE_THREAD_CRITICAL_SECTION;
+
+        if (!thread)
+            break;
+
+        // Threads started since we asked are asked too, then waited for
+        _spooPlatformDestroyThread(ID);
+    }
 }
 
 // Wait for a thread to die
@@ -294,6 +402,7 @@ void _spooPlatformDestroyThread(SPOOthread ID)
 int _spooPlatformWaitThread(SPOOthread ID, int waitmode)
 {
     DWORD result;
+    HANDLE handle;
     _SPOOthread* thread;
 
     ENTER_THREAD_CRITICAL_SECTION;
@@ -307,13 +416,17 @@ int _spooPlatformWaitThread(SPOOthread ID, int waitmode)
         return SPOO_TRUE;
     }
 
+    // The thread frees its state when it finishes, which may happen as soon
+    // as we leave the critical section
+    handle = thread->windows.handle;
+
     LEAVE_THREAD_CRITICAL_SECTION;
 
     // Wait for thread to die
     if (waitmode == SPOO_WAIT)
-        result = WaitForSingleObject(thread->windows.handle, INFINITE);
+        result = WaitForSingleObject(handle, INFINITE);
     else if (waitmode == SPOO_NOWAIT)
-        result = WaitForSingleObject(thread->windows.handle, 0);
+        result = WaitForSingleObject(handle, 0);
     else
         return SPOO_FALSE;
 
@@ -352,17 +465,42 @@ SPOOthread _spooPlatformGetThreadID(void)
     return threadID;
 }
 
+// The by-value storage types must be able to hold the platform objects
+typedef char _spooCheckMutexStorage[sizeof(CRITICAL_SECTION) <= SPOO_MUTEX_STORAGE_SIZE ? 1 : -1];
+typedef char _spooCheckCondStorage[sizeof(_SPOOcond) <= SPOO_COND_STORAGE_SIZE ? 1 : -1];
+
+// Return the size of the storage for a mutual exclusion object
+//
+size_t _spooPlatformGetMutexStorageSize(void)
+{
+    return sizeof(CRITICAL_SECTION);
+}
+
+// Initialize a mutual exclusion object in caller-provided storage
+//
+void _spooPlatformInitMutexStorage(void* storage)
+{
+    InitializeCriticalSection((CRITICAL_SECTION*) storage);
+}
+
+// Deinitialize a mutual exclusion object in caller-provided storage
+//
+void _spooPlatformDeinitMutexStorage(SPOOmutex mutex)
+{
+    DeleteCriticalSection((CRITICAL_SECTION*) mutex);
+}
+
 // Create a mutual exclusion object
 //
 SPOOmutex _spooPlatformCreateMutex(void)
 {
-    CRITICAL_SECTION* mutex;
+    void* mutex;
 
-    mutex = (CRITICAL_SECTION*) malloc(sizeof(CRITICAL_SECTION));
+    mutex = malloc(sizeof(CRITICAL_SECTION));
     if (!mutex)
         return NULL;
 
-    InitializeCriticalSection(mutex);
+    _spooPlatformInitMutexStorage(mutex);
 
     return (SPOOmutex) mutex;
 }
@@ -371,7 +509,7 @@ SPOOmutex _spooPlatformCreateMutex(void)
 //
 void _spooPlatformDestroyMutex(SPOOmutex mutex)
 {
-    DeleteCriticalSection((CRITICAL_SECTION*) mutex);
+    _spooPlatformDeinitMutexStorage(mutex);
     free(mutex);
 }
 
@@ -383,6 +521,13 @@ void _spooPlatformLockMutex(SPOOmutex mutex)
     EnterCriticalSection((CRITICAL_SECTION*) mutex);
 }
 
+// Request access to a mutex without waiting
+//
+int _spooPlatformTryLockMutex(SPOOmutex mutex)
+{
+    return TryEnterCriticalSection((CRITICAL_SECTION*) mutex) != 0;
+}
+
 // Release a mutex
 //
 void _spooPlatformUnlockMutex(SPOOmutex mutex)
@@ -391,28 +536,34 @@ void _spooPlatformUnlockMutex(SPOOmutex mutex)
     LeaveCriticalSection((CRITICAL_SECTION*) mutex);
 }
 
-// Create a new condition variable object
+// Initialize a condition variable object in caller-provided storage
 //
-SPOOcond _spooPlatformCreateCond(void)
+int _spooPlatformInitCondStorage(void* storage)
 {
-    _SPOOcond* cond;
+    _SPOOcond* cond = (_SPOOcond*) storage;
 
-    cond = (_SPOOcond *) malloc(sizeof(_SPOOcond));
-    if (!cond)
-        return NULL;
-
-    // Initialize condition variable
     cond->waiterCount = 0;
     cond->events[_SPOO_COND_SIGNAL] = CreateEvent(NULL, FALSE, FALSE, NULL);
     cond->events[_SPOO_COND_BROADCAST] = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    if (!cond->events[_SPOO_COND_SIGNAL] || !cond->events[_SPOO_COND_BROADCAST])
+    {
+        if (cond->events[_SPOO_COND_SIGNAL])
+            CloseHandle(cond->events[_SPOO_COND_SIGNAL]);
+        if (cond->events[_SPOO_COND_BROADCAST])
+            CloseHandle(cond->events[_SPOO_COND_BROADCAST]);
+
+        return FALSE;
+    }
+
     InitializeCriticalSection(&cond->waiterCountLock);
 
-    return (SPOOcond) cond;
+    return TRUE;
 }
 
-// Destroy a condition variable object
+// Deinitialize a condition variable object in caller-provided storage
 //
-void _spooPlatformDestroyCond(SPOOcond handle)
+void _spooPlatformDeinitCondStorage(SPOOcond handle)
 {
     _SPOOcond* cond = (_SPOOcond*) handle;
 
@@ -422,6 +573,32 @@ void _spooPlatformDestroyCond(SPOOcond handle)
 
     // Delete critical section
     DeleteCriticalSection(&cond->waiterCountLock);
+}
+
+// Create a new condition variable object
+//
+SPOOcond _spooPlatformCreateCond(void)
+{
+    void* cond;
+
+    cond = malloc(sizeof(_SPOOcond));
+    if (!cond)
+        return NULL;
+
+    if (!_spooPlatformInitCondStorage(cond))
+    {
+        free(cond);
+        return NULL;
+    }
+
+    return (SPOOcond) cond;
+}
+
+// Destroy a condition variable object
+//
+void _spooPlatformDestroyCond(SPOOcond cond)
+{
+    _spooPlatformDeinitCondStorage(cond);
 
     // Free memory for condition variable
     free(cond);
@@ -429,7 +606,15 @@ void _spooPlatformDestroyCond(SPOOcond handle)
 
 // Wait for a condition to be raised
 //
-void _spooPlatformWaitCond(SPOOcond handle, SPOOmutex mutex, double timeout)
+void _spooPlatformWaitCond(SPOOcond cond, SPOOmutex mutex, double timeout)
+{
+    _spooPlatformWaitCondCancellable(cond, mutex, timeout, NULL);
+}
+
+// Wait for a condition to be raised, unless the cancellation flag is set
+//
+void _spooPlatformWaitCondCancellable(SPOOcond handle, SPOOmutex mutex,
+                                      double timeout, volatile long* cancelled)
 {
     _SPOOcond* cond = (_SPOOcond*) handle;
     int result, lastWaiter;
@@ -438,6 +623,16 @@ void _spooPlatformWaitCond(SPOOcond handle, SPOOmutex mutex, double timeout)
     // Avoid race conditions
     EnterCriticalSection(&cond->waiterCountLock);
     cond->waiterCount++;
+
+    // The flag is set before the condition is raised, so if it is not set
+    // yet the broadcast will see us counted and set its event
+    if (cancelled && *cancelled)
+    {
+        cond->waiterCount--;
+        LeaveCriticalSection(&cond->waiterCountLock);
+        return;
+    }
+
     LeaveCriticalSection(&cond->waiterCountLock);
 
     // It's ok to release the mutex here since Win32 manual-reset events
@@ -521,3 +716,207 @@ int _spooPlatformGetCPUCoreCount(void)
     return (int) si.dwNumberOfProcessors;
 }
 
+// Return the CPU the calling thread is running on, or -1 if unknown
+//
+int _spooPlatformGetCurrentCPU(void)
+{
+    return (int) GetCurrentProcessorNumber();
+}
+
+
+// Create a thread-local storage key
+//
+SPOOtlskey _spooPlatformCreateTLSKey(SPOOtlsfun destructor)
+{
+    SPOOtlskey key;
+
+    ENTER_THREAD_CRITICAL_SECTION;
+
+    for (key = 0;  key < SPOO_MAX_TLS_KEYS;  key++)
+    {
+        if (!_spoo.tlsKeys[key].used)
+            break;
+    }
+
+    if (key == SPOO_MAX_TLS_KEYS)
+    {
+        LEAVE_THREAD_CRITICAL_SECTION;
+        return SPOO_INVALID_TLS_KEY;
+    }
+
+#if !defined(_SPOO_THREAD_LOCAL)
+    _spoo.tlsKeys[key].windows.index = TlsAlloc();
+    if (_spoo.tlsKeys[key].windows.index == TLS_OUT_OF_INDEXES)
+    {
+        LEAVE_THREAD_CRITICAL_SECTION;
+        return SPOO_INVALID_TLS_KEY;
+    }
+#endif /*_SPOO_THREAD_LOCAL*/
+
+    _spoo.tlsKeys[key].used = SPOO_TRUE;
+    _spoo.tlsKeys[key].generation++;
+    _spoo.tlsKeys[key].destructor = destructor;
+
+    LEAVE_THREAD_CRITICAL_SECTION;
+
+    return key;
+}
+
+// Destroy a thread-local storage key
+//
+void _spooPlatformDestroyTLSKey(SPOOtlskey key)
+{
+    ENTER_THREAD_CRITICAL_SECTION;
+
+    if (_spoo.tlsKeys[key].used)
+    {
+#if !defined(_SPOO_THREAD_LOCAL)
+        TlsFree(_spoo.tlsKeys[key].windows.index);
+#endif /*_SPOO_THREAD_LOCAL*/
+
+        // Invalidate any values left behind in other threads
+        _spoo.tlsKeys[key].used = SPOO_FALSE;
+        _spoo.tlsKeys[key].generation++;
+        _spoo.tlsKeys[key].destructor = NULL;
+    }
+
+    LEAVE_THREAD_CRITICAL_SECTION;
+}
+
+// Set the value of a thread-local storage key for the current thread
+//
+void _spooPlatformSetTLS(SPOOtlskey key, void* value)
+{
+#if defined(_SPOO_THREAD_LOCAL)
+    tlsValues[key].value = value;
+    tlsValues[key].generation = _spoo.tlsKeys[key].generation;
+#else
+    TlsSetValue(_spoo.tlsKeys[key].windows.index, value);
+#endif /*_SPOO_THREAD_LOCAL*/
+}
+
+// Return the value of a thread-local storage key for the current thread
+//
+void* _spooPlatformGetTLS(SPOOtlskey key)
+{
+#if defined(_SPOO_THREAD_LOCAL)
+    if (tlsValues[key].generation != _spoo.tlsKeys[key].generation)
+        return NULL;
+
+    return tlsValues[key].value;
+#else
+    return TlsGetValue(_spoo.tlsKeys[key].windows.index);
+#endif /*_SPOO_THREAD_LOCAL*/
+}
+
+// Create an execution context that runs its entry function on a new stack
+//
+int _spooPlatformCreateContext(_SPOOcontext* context, size_t stackSize)
+{
+    context->windows.fiber = CreateFiberEx(stackSize, stackSize,
+                                           FIBER_FLAG_FLOAT_SWITCH,
+                                           startContext,
+                                           context);
+    if (!context->windows.fiber)
+        return SPOO_FALSE;
+
+    context->windows.converted = FALSE;
+    return SPOO_TRUE;
+}
+
+// Destroy an execution context and free its stack
+//
+void _spooPlatformDestroyContext(_SPOOcontext* context)
+{
+    DeleteFiber(context->windows.fiber);
+}
+
+// Make the current thread able to switch to other contexts
+//
+int _spooPlatformInitThreadContext(_SPOOcontext* context)
+{
+    context->windows.fiber = ConvertThreadToFiberEx(NULL, FIBER_FLAG_FLOAT_SWITCH);
+    if (!context->windows.fiber)
+        return SPOO_FALSE;
+
+    context->windows.converted = TRUE;
+    return SPOO_TRUE;
+}
+
+// Make the current thread a plain thread again
+//
+void _spooPlatformTerminateThreadContext(_SPOOcontext* context)
+{
+    if (context->windows.converted)
+        ConvertFiberToThread();
+}
+
+// Save the current context and switch to another
+//
+void _spooPlatformSwitchContext(_SPOOcontext* from, _SPOOcontext* to)
+{
+    SwitchToFiber(to->windows.fiber);
+}
+
+
+// Read from a file at the specified offset
+//
+long _spooPlatformReadFile(int fd, void* buffer, size_t size, long long offset)
+{
+    DWORD count;
+    OVERLAPPED overlapped;
+    HANDLE file = (HANDLE) _get_osfhandle(fd);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return -EBADF;
+
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.Offset = (DWORD) offset;
+    overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+    if (!ReadFile(file, buffer, (DWORD) size, &count, &overlapped))
+    {
+        if (GetLastError() == ERROR_HANDLE_EOF)
+            return 0;
+
+        return -EIO;
+    }
+
+    return (long) count;
+}
+
+// Write to a file at the specified offset
+//
+long _spooPlatformWriteFile(int fd, const void* buffer, size_t size, long long offset)
+{
+    DWORD count;
+    OVERLAPPED overlapped;
+    HANDLE file = (HANDLE) _get_osfhandle(fd);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return -EBADF;
+
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.Offset = (DWORD) offset;
+    overlapped.OffsetHigh = (DWORD) (offset >> 32);
+
+    if (!WriteFile(file, buffer, (DWORD) size, &count, &overlapped))
+        return -EIO;
+
+    return (long) count;
+}
+
+// Flush the data of a file to its storage device
+//
+long _spooPlatformSyncFile(int fd)
+{
+    HANDLE file = (HANDLE) _get_osfhandle(fd);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return -EBADF;
+
+    if (!FlushFileBuffers(file))
+        return -EIO;
+
+    return 0;
+}
@@ -44,6 +44,8 @@
 
 #define _SPOO_PLATFORM_THREAD_STATE  _SPOOthreadWINDOWS windows
 #define _SPOO_PLATFORM_LIBRARY_STATE _SPOOlibraryWINDOWS windows
+#define _SPOO_PLATFORM_TLS_KEY_STATE _SPOOtlskeyWINDOWS windows
+#define _SPOO_PLATFORM_CONTEXT_STATE _SPOOcontextWINDOWS windows
 
 //------------------------------------------------------------------------
 // Platform-specific Spoo thread state
@@ -57,6 +59,29 @@ typedef struct
 } _SPOOthreadWINDOWS;
 
 
+//------------------------------------------------------------------------
+// Platform-specific Spoo thread-local storage key state
+//------------------------------------------------------------------------
+
+typedef struct
+{
+    DWORD         index;
+
+} _SPOOtlskeyWINDOWS;
+
+
+//------------------------------------------------------------------------
+// Platform-specific Spoo execution context state
+//------------------------------------------------------------------------
+
+typedef struct
+{
+    LPVOID        fiber;
+    BOOL          converted;
+
+} _SPOOcontextWINDOWS;
+
+
 //------------------------------------------------------------------------
 // Platform-specific Spoo library state
 //------------------------------------------------------------------------
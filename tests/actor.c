@@ -0,0 +1,240 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It passes messages around a ring of 100k actors and has all actors send
+// to a single one, measuring message throughput
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ACTOR_COUNT 100000
+#define TOKEN_COUNT 10000
+#define HOPS 200
+
+typedef struct Token
+{
+    SPOOmessage message;
+    int hops;
+    int sender;
+} Token;
+
+typedef struct Entity
+{
+    int index;
+    long received;
+    int lastSender;
+    int ordered;
+} Entity;
+
+static SPOOactor* actors;
+static Entity* entities;
+static Token* tokens;
+static SPOOmutex mutex;
+static SPOOcond cond;
+static int finished;
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static void finish_token(void)
+{
+    spooLockMutex(mutex);
+    finished++;
+    spooSignalCond(cond);
+    spooUnlockMutex(mutex);
+}
+
+static void wait_for_tokens(int count)
+{
+    spooLockMutex(mutex);
+    while (finished < count)
+        spooWaitCond(cond, mutex, SPOO_INFINITY);
+    spooUnlockMutex(mutex);
+}
+
+// Forward each token to the next actor on the ring until its hops run out
+//
+static void ring_function(SPOOactor actor, SPOOmessage* message, void* arg)
+{
+    Entity* entity = (Entity*) arg;
+    Token* token = (Token*) message;
+
+    entity->received++;
+
+    if (--token->hops == 0)
+        finish_token();
+    else
+        spooSendActor(actors[(entity->index + 1) % ACTOR_COUNT], message);
+}
+
+// Count messages, checking that each sender's messages arrive in order
+//
+static void sink_function(SPOOactor actor, SPOOmessage* message, void* arg)
+{
+    Entity* entity = (Entity*) arg;
+    Token* token = (Token*) message;
+
+    entity->received++;
+
+    if (token->hops <= entities[token->sender].lastSender)
+        entities[token->sender].ordered = 0;
+
+    entities[token->sender].lastSender = token->hops;
+
+    if (token->hops == HOPS)
+        finish_token();
+}
+
+static void sender_function(SPOOactor actor, SPOOmessage* message, void* arg)
+{
+    int i;
+    Entity* entity = (Entity*) arg;
+    Token* token = (Token*) message;
+
+    // Send a numbered series of messages from this actor to the sink
+    for (i = 1;  i <= HOPS;  i++)
+    {
+        token[i - 1].sender = entity->index;
+        token[i - 1].hops = i;
+        spooSendActor(actors[0], &token[i - 1].message);
+    }
+}
+
+int main(void)
+{
+    int i;
+    long total = 0;
+    double time;
+    SPOOpool pool;
+    SPOOactor sink;
+    Token* series;
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    mutex = spooCreateMutex();
+    cond = spooCreateCond();
+    pool = spooCreatePool(0);
+
+    actors = (SPOOactor*) calloc(ACTOR_COUNT, sizeof(SPOOactor));
+    entities = (Entity*) calloc(ACTOR_COUNT, sizeof(Entity));
+    tokens = (Token*) calloc(TOKEN_COUNT, sizeof(Token));
+
+    time = spooGetTime();
+
+    for (i = 0;  i < ACTOR_COUNT;  i++)
+    {
+        entities[i].index = i;
+        actors[i] = spooCreateActor(pool, ring_function, entities + i);
+        if (!actors[i])
+            fail("Failed to create actor");
+    }
+
+    printf("Created %i actors in %.2f ms\n", ACTOR_COUNT, (spooGetTime() - time) * 1e3);
+
+    // Tokens hop around the ring, spread out over its actors
+    time = spooGetTime();
+
+    for (i = 0;  i < TOKEN_COUNT;  i++)
+    {
+        tokens[i].hops = HOPS;
+        spooSendActor(actors[(long) i * ACTOR_COUNT / TOKEN_COUNT], &tokens[i].message);
+    }
+
+    wait_for_tokens(TOKEN_COUNT);
+    time = spooGetTime() - time;
+
+    for (i = 0;  i < ACTOR_COUNT;  i++)
+        total += entities[i].received;
+
+    if (total != (long) TOKEN_COUNT * HOPS)
+        fail("Ring lost messages");
+
+    printf("Ring on %i threads: %.0f messages/s\n",
+           spooGetPoolThreadCount(pool), total / time);
+
+    for (i = 0;  i < ACTOR_COUNT;  i++)
+        spooDestroyActor(actors[i]);
+
+    // Many senders to one sink actor, whose mailbox is drained in batches
+    finished = 0;
+    entities[0].received = 0;
+
+    sink = spooCreateActor(pool, sink_function, entities);
+    actors[0] = sink;
+
+    series = (Token*) calloc((size_t) TOKEN_COUNT * HOPS, sizeof(Token));
+
+    for (i = 1;  i <= TOKEN_COUNT;  i++)
+    {
+        entities[i].lastSender = 0;
+        entities[i].ordered = 1;
+        actors[i] = spooCreateActor(pool, sender_function, entities + i);
+    }
+
+    time = spooGetTime();
+
+    for (i = 1;  i <= TOKEN_COUNT;  i++)
+        spooSendActor(actors[i], &series[(i - 1) * HOPS].message);
+
+    wait_for_tokens(TOKEN_COUNT);
+    time = spooGetTime() - time;
+
+    if (entities[0].received != (long) TOKEN_COUNT * HOPS)
+        fail("Sink lost messages");
+
+    for (i = 1;  i <= TOKEN_COUNT;  i++)
+    {
+        if (!entities[i].ordered)
+            fail("Sink received messages out of order");
+
+        spooDestroyActor(actors[i]);
+    }
+
+    printf("Fan-in on %i threads: %.0f messages/s\n",
+           spooGetPoolThreadCount(pool), (double) TOKEN_COUNT * HOPS / time);
+
+    spooDestroyActor(sink);
+    spooDestroyPool(pool);
+
+    free(series);
+    free(tokens);
+    free(entities);
+    free(actors);
+
+    spooDestroyCond(cond);
+    spooDestroyMutex(mutex);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,439 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is the Spoo benchmark suite
+// It measures the cost of every primitive across a range of thread counts
+// and prints the results as CSV or JSON for tracking regressions
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_THREADS 256
+
+typedef struct
+{
+    const char* name;
+    int threads;
+    int iterations;
+    double value;
+    const char* unit;
+} Result;
+
+static Result results[1024];
+static int resultCount = 0;
+
+static SPOOmutex mutex;
+static SPOOcond cond;
+static SPOOcond ack;
+
+static volatile int iterations;
+static volatile int generation;
+static volatile int awake;
+static volatile int stop;
+static volatile double signalTime;
+static volatile double latency;
+static double wakeTimes[MAX_THREADS];
+
+static void usage(void)
+{
+    printf("Usage: spoo_bench [-h] [-f csv|json] [-t MAXTHREADS]\n");
+}
+
+static void add_result(const char* name, int threads, int count,
+                       double value, const char* unit)
+{
+    if (resultCount == sizeof(results) / sizeof(results[0]))
+        return;
+
+    results[resultCount].name = name;
+    results[resultCount].threads = threads;
+    results[resultCount].iterations = count;
+    results[resultCount].value = value;
+    results[resultCount].unit = unit;
+    resultCount++;
+}
+
+static void empty_function(void* arg)
+{
+}
+
+static void lock_function(void* arg)
+{
+    int i;
+
+    for (i = 0;  i < iterations;  i++)
+    {
+        spooLockMutex(mutex);
+        generation++;
+        spooUnlockMutex(mutex);
+    }
+}
+
+static void wake_function(void* arg)
+{
+    spooLockMutex(mutex);
+
+    for (;;)
+    {
+        while (awake && !stop)
+            spooWaitCond(cond, mutex, SPOO_INFINITY);
+
+        if (stop)
+            break;
+
+        latency += spooGetTime() - signalTime;
+        awake = 1;
+        spooSignalCond(ack);
+    }
+
+    spooUnlockMutex(mutex);
+}
+
+static void fan_function(void* arg)
+{
+    int index = (int) (size_t) arg;
+    int seen = 0;
+
+    spooLockMutex(mutex);
+
+    for (;;)
+    {
+        while (generation == seen && !stop)
+            spooWaitCond(cond, mutex, SPOO_INFINITY);
+
+        if (stop)
+            break;
+
+        seen = generation;
+        wakeTimes[index] = spooGetTime();
+
+        awake++;
+        spooSignalCond(ack);
+    }
+
+    spooUnlockMutex(mutex);
+}
+
+static void bench_time(void)
+{
+    int i, count = 1000000;
+    double time, sum = 0.0;
+
+    time = spooGetTime();
+
+    for (i = 0;  i < count;  i++)
+        sum += spooGetTime();
+
+    time = spooGetTime() - time;
+    add_result("get_time", 1, count, time * 1e9 / count, "ns");
+
+    // Keep the compiler from dropping the loop
+    if (sum < 0.0)
+        printf("%f\n", sum);
+}
+
+static void bench_sleep(void)
+{
+    int i, j, count = 20;
+    double time, overshoot;
+    const double durations[] = { 0.0001, 0.001, 0.01 };
+    const char* names[] = { "sleep_overshoot_100us",
+                            "sleep_overshoot_1ms",
+                            "sleep_overshoot_10ms" };
+
+    for (i = 0;  i < 3;  i++)
+    {
+        overshoot = 0.0;
+
+        for (j = 0;  j < count;  j++)
+        {
+            time = spooGetTime();
+            spooSleep(durations[i]);
+            overshoot += spooGetTime() - time - durations[i];
+        }
+
+        add_result(names[i], 1, count, overshoot * 1e6 / count, "us");
+    }
+}
+
+static void bench_create(void)
+{
+    int i, count = 1000;
+    double time;
+
+    time = spooGetTime();
+
+    for (i = 0;  i < count;  i++)
+        spooWaitThread(spooCreateThread(empty_function, NULL), SPOO_WAIT);
+
+    time = spooGetTime() - time;
+    add_result("thread_create_join", 1, count, time * 1e6 / count, "us");
+}
+
+static void bench_uncontended(void)
+{
+    int i, count = 10000000;
+    double time;
+
+    time = spooGetTime();
+
+    for (i = 0;  i < count;  i++)
+    {
+        spooLockMutex(mutex);
+        spooUnlockMutex(mutex);
+    }
+
+    time = spooGetTime() - time;
+    add_result("mutex_uncontended", 1, count, time * 1e9 / count, "ns");
+}
+
+static void bench_contended(int threadCount)
+{
+    int i;
+    double time;
+    SPOOthread threads[MAX_THREADS];
+
+    iterations = 200000 / threadCount;
+
+    time = spooGetTime();
+
+    for (i = 0;  i < threadCount;  i++)
+        threads[i] = spooCreateThread(lock_function, NULL);
+
+    for (i = 0;  i < threadCount;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    time = spooGetTime() - time;
+    add_result("mutex_contended", threadCount, iterations * threadCount,
+               time * 1e9 / (iterations * threadCount), "ns");
+}
+
+static void bench_signal(void)
+{
+    int i, count = 2000;
+    SPOOthread thread;
+
+    stop = 0;
+    awake = 1;
+    latency = 0.0;
+
+    spooLockMutex(mutex);
+
+    thread = spooCreateThread(wake_function, NULL);
+
+    for (i = 0;  i < count;  i++)
+    {
+        // Give the waiter time to block in spooWaitCond
+        spooUnlockMutex(mutex);
+        spooSleep(0.0);
+        spooLockMutex(mutex);
+
+        awake = 0;
+        signalTime = spooGetTime();
+        spooSignalCond(cond);
+
+        while (!awake)
+            spooWaitCond(ack, mutex, SPOO_INFINITY);
+    }
+
+    stop = 1;
+    spooBroadcastCond(cond);
+    spooUnlockMutex(mutex);
+
+    spooWaitThread(thread, SPOO_WAIT);
+
+    add_result("cond_signal_wake", 2, count, latency * 1e6 / count, "us");
+}
+
+static void bench_broadcast(int threadCount)
+{
+    int i, j, count = 200;
+    double time, total = 0.0, latest;
+    SPOOthread threads[MAX_THREADS];
+
+    stop = 0;
+    generation = 0;
+
+    for (i = 0;  i < threadCount;  i++)
+        threads[i] = spooCreateThread(fan_function, (void*) (size_t) i);
+
+    for (i = 0;  i < count;  i++)
+    {
+        spooSleep(0.0);
+
+        spooLockMutex(mutex);
+
+        awake = 0;
+        generation++;
+        time = spooGetTime();
+        spooBroadcastCond(cond);
+
+        while (awake < threadCount)
+            spooWaitCond(ack, mutex, SPOO_INFINITY);
+
+        spooUnlockMutex(mutex);
+
+        latest = time;
+        for (j = 0;  j < threadCount;  j++)
+        {
+            if (wakeTimes[j] > latest)
+                latest = wakeTimes[j];
+        }
+
+        total += latest - time;
+    }
+
+    spooLockMutex(mutex);
+    stop = 1;
+    spooBroadcastCond(cond);
+    spooUnlockMutex(mutex);
+
+    for (i = 0;  i < threadCount;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    add_result("cond_broadcast_fanout", threadCount, count,
+               total * 1e6 / count, "us");
+}
+
+static void print_csv(void)
+{
+    int i;
+
+    printf("benchmark,threads,iterations,value,unit\n");
+
+    for (i = 0;  i < resultCount;  i++)
+    {
+        printf("%s,%i,%i,%.4f,%s\n",
+               results[i].name,
+               results[i].threads,
+               results[i].iterations,
+               results[i].value,
+               results[i].unit);
+    }
+}
+
+static void print_json(void)
+{
+    int i;
+
+    printf("{\n  \"version\": \"%i.%i.%i\",\n  \"cores\": %i,\n  \"results\": [\n",
+           SPOO_VERSION_MAJOR, SPOO_VERSION_MINOR, SPOO_VERSION_REVISION,
+           spooGetCPUCoreCount());
+
+    for (i = 0;  i < resultCount;  i++)
+    {
+        printf("    {\"benchmark\": \"%s\", \"threads\": %i, \"iterations\": %i, "
+               "\"value\": %.4f, \"unit\": \"%s\"}%s\n",
+               results[i].name,
+               results[i].threads,
+               results[i].iterations,
+               results[i].value,
+               results[i].unit,
+               i + 1 < resultCount ? "," : "");
+    }
+
+    printf("  ]\n}\n");
+}
+
+int main(int argc, char** argv)
+{
+    int i, threadCount, maxThreads = 0, json = 0;
+
+    for (i = 1;  i < argc;  i++)
+    {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "json") == 0)
+                json = 1;
+            else if (strcmp(argv[i], "csv") == 0)
+                json = 0;
+            else
+            {
+                usage();
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            maxThreads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-h") == 0)
+        {
+            usage();
+            exit(EXIT_SUCCESS);
+        }
+        else
+        {
+            usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (maxThreads <= 0)
+        maxThreads = spooGetCPUCoreCount() * 2;
+    if (maxThreads < 2)
+        maxThreads = 2;
+    if (maxThreads > MAX_THREADS)
+        maxThreads = MAX_THREADS;
+
+    mutex = spooCreateMutex();
+    cond = spooCreateCond();
+    ack = spooCreateCond();
+
+    bench_time();
+    bench_sleep();
+    bench_create();
+    bench_uncontended();
+
+    for (threadCount = 1;  threadCount <= maxThreads;  threadCount *= 2)
+        bench_contended(threadCount);
+
+    bench_signal();
+
+    for (threadCount = 1;  threadCount <= maxThreads;  threadCount *= 2)
+        bench_broadcast(threadCount);
+
+    spooDestroyCond(ack);
+    spooDestroyCond(cond);
+    spooDestroyMutex(mutex);
+
+    if (json)
+        print_json();
+    else
+        print_csv();
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
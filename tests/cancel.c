@@ -0,0 +1,218 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It starts thousands of threads that sleep, wait on a condition or poll
+// for cancellation, then measures how long cancelling them all takes, both
+// explicitly and by leaving them to spooTerminate.  It also cancels waiters
+// while holding the mutex they wait with, and leaves a pool, the fiber
+// scheduler and a reactor running for spooTerminate.
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define THREAD_COUNT 2000
+#define POLLER_COUNT 4
+#define CHECKS 10000000
+#define HELD_MUTEX_ROUNDS 200
+
+static SPOOmutex mutex;
+static SPOOcond cond;
+static SPOOthread threads[THREAD_COUNT];
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static void sleeper_function(void* arg)
+{
+    while (!spooIsCancelRequested())
+        spooSleep(SPOO_INFINITY);
+}
+
+static void waiter_function(void* arg)
+{
+    spooLockMutex(mutex);
+
+    // The condition is never signaled, so only cancellation gets us out
+    while (!spooIsCancelRequested())
+        spooWaitCond(cond, mutex, SPOO_INFINITY);
+
+    spooUnlockMutex(mutex);
+}
+
+static void poller_function(void* arg)
+{
+    volatile unsigned long work = 0;
+
+    while (!spooIsCancelRequested())
+    {
+        work++;
+        spooSleep(0.0);
+    }
+}
+
+static void start_threads(void)
+{
+    int i;
+
+    for (i = 0;  i < THREAD_COUNT;  i++)
+    {
+        if (i < POLLER_COUNT)
+            threads[i] = spooCreateThread(poller_function, NULL);
+        else if (i % 2)
+            threads[i] = spooCreateThread(sleeper_function, NULL);
+        else
+            threads[i] = spooCreateThread(waiter_function, NULL);
+
+        if (threads[i] == SPOO_INVALID_THREAD)
+            fail("Failed to create thread");
+    }
+
+    // Give the threads time to start blocking
+    spooSleep(0.5);
+}
+
+static void cancel_with_mutex_held(void)
+{
+    int i;
+    SPOOthread thread;
+
+    for (i = 0;  i < HELD_MUTEX_ROUNDS;  i++)
+    {
+        thread = spooCreateThread(waiter_function, NULL);
+        if (thread == SPOO_INVALID_THREAD)
+            fail("Failed to create thread");
+
+        // Catch the waiter both before and after it starts waiting
+        if (i % 2)
+            spooSleep(0.001);
+
+        spooLockMutex(mutex);
+
+        if (!spooRequestCancel(thread))
+            fail("Failed to request cancellation of a waiting thread");
+
+        spooUnlockMutex(mutex);
+
+        spooWaitThread(thread, SPOO_WAIT);
+    }
+}
+
+int main(void)
+{
+    int i;
+    double time;
+    unsigned long long start;
+    SPOOpool pool;
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    mutex = spooCreateMutex();
+    cond = spooCreateCond();
+
+    if (spooIsCancelRequested())
+        fail("Cancellation requested before it was requested");
+
+    time = spooGetTime();
+    for (i = 0;  i < CHECKS;  i++)
+        spooIsCancelRequested();
+    time = spooGetTime() - time;
+
+    printf("Cancellation check: %.2f ns\n", time * 1e9 / CHECKS);
+
+    start_threads();
+
+    time = spooGetTime();
+
+    for (i = 0;  i < THREAD_COUNT;  i++)
+    {
+        if (!spooRequestCancel(threads[i]))
+            fail("Failed to request cancellation of a running thread");
+    }
+
+    for (i = 0;  i < THREAD_COUNT;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    time = spooGetTime() - time;
+
+    printf("Cancelled %i threads in %.2f ms\n", THREAD_COUNT, time * 1e3);
+
+    if (spooRequestCancel(threads[0]))
+        fail("Requested cancellation of a finished thread");
+
+    time = spooGetTime();
+    cancel_with_mutex_held();
+    time = spooGetTime() - time;
+
+    printf("Cancelled %i waiters holding their mutex in %.2f ms\n",
+           HELD_MUTEX_ROUNDS, time * 1e3);
+
+    // Leave a second set running for spooTerminate to stop
+    start_threads();
+
+    start = spooGetTimerValue();
+    spooTerminate();
+
+    // The raw timer does not restart with the library, so it can measure
+    // across termination
+    if (!spooInit())
+        fail("Failed to initialize Spoo again");
+
+    time = (double) (spooGetTimerValue() - start) / (double) spooGetTimerFrequency();
+    printf("Terminated with %i threads running in %.2f ms\n",
+           THREAD_COUNT, time * 1e3);
+
+    // Library threads are left running too, and must stop rather than spin
+    pool = spooCreatePool(2);
+    if (!pool)
+        fail("Failed to create pool");
+
+    if (!spooStartFibers(2, 0))
+        fail("Failed to start fibers");
+
+    // Reactors are not available on all platforms
+    spooCreateReactor(pool, 2);
+
+    start = spooGetTimerValue();
+    spooTerminate();
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo again");
+
+    time = (double) (spooGetTimerValue() - start) / (double) spooGetTimerFrequency();
+    printf("Terminated with a pool, fibers and a reactor running in %.2f ms\n",
+           time * 1e3);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,274 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It measures channel ping-pong latency and fan-in throughput, directly and
+// through spooSelect, and checks timeouts and close semantics
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ROUND_TRIPS 100000
+#define PRODUCER_COUNT 4
+#define MESSAGES 250000
+#define CAPACITY 1024
+
+static SPOOchannel pings;
+static SPOOchannel pongs;
+static SPOOchannel shared;
+static SPOOchannel producerChannels[PRODUCER_COUNT];
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static void pong_function(void* arg)
+{
+    int i, value;
+
+    for (i = 0;  i < ROUND_TRIPS;  i++)
+    {
+        if (spooRecvChannel(pings, &value) != SPOO_CHANNEL_OK)
+            fail("Failed to receive ping");
+
+        value++;
+
+        if (spooSendChannel(pongs, &value) != SPOO_CHANNEL_OK)
+            fail("Failed to send pong");
+    }
+}
+
+static void run_ping_pong(const char* name, int capacity)
+{
+    int i, value = 0;
+    double time;
+    SPOOthread thread;
+
+    pings = spooCreateChannel(sizeof(int), capacity);
+    pongs = spooCreateChannel(sizeof(int), capacity);
+
+    time = spooGetTime();
+    thread = spooCreateThread(pong_function, NULL);
+
+    for (i = 0;  i < ROUND_TRIPS;  i++)
+    {
+        spooSendChannel(pings, &value);
+        spooRecvChannel(pongs, &value);
+    }
+
+    spooWaitThread(thread, SPOO_WAIT);
+    time = spooGetTime() - time;
+
+    if (value != ROUND_TRIPS)
+        fail("Ping-pong lost messages");
+
+    printf("%s ping-pong: %.2f ns per round trip\n", name, time * 1e9 / ROUND_TRIPS);
+
+    spooDestroyChannel(pongs);
+    spooDestroyChannel(pings);
+}
+
+static void producer_function(void* arg)
+{
+    int i;
+    SPOOchannel channel = (SPOOchannel) arg;
+
+    for (i = 1;  i <= MESSAGES;  i++)
+    {
+        if (spooSendChannel(channel, &i) != SPOO_CHANNEL_OK)
+            fail("Failed to send message");
+    }
+}
+
+static void close_function(void* arg)
+{
+    producer_function(arg);
+    spooCloseChannel((SPOOchannel) arg);
+}
+
+static void check_sum(long long sum)
+{
+    const long long expected = (long long) PRODUCER_COUNT * MESSAGES * (MESSAGES + 1) / 2;
+
+    if (sum != expected)
+    {
+        fprintf(stderr, "Received sum %lli, expected %lli\n", sum, expected);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void run_fan_in(const char* name, int capacity)
+{
+    int i, value;
+    long long sum = 0;
+    double time;
+    SPOOthread threads[PRODUCER_COUNT];
+
+    shared = spooCreateChannel(sizeof(int), capacity);
+
+    time = spooGetTime();
+
+    for (i = 0;  i < PRODUCER_COUNT;  i++)
+        threads[i] = spooCreateThread(producer_function, shared);
+
+    for (i = 0;  i < PRODUCER_COUNT * MESSAGES;  i++)
+    {
+        spooRecvChannel(shared, &value);
+        sum += value;
+    }
+
+    for (i = 0;  i < PRODUCER_COUNT;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    time = spooGetTime() - time;
+    check_sum(sum);
+
+    printf("%s fan-in: %.2f ns per message\n",
+           name, time * 1e9 / (PRODUCER_COUNT * MESSAGES));
+
+    spooDestroyChannel(shared);
+}
+
+static void run_select_fan_in(const char* name, int capacity)
+{
+    int i, index, value, open = PRODUCER_COUNT;
+    long long sum = 0;
+    double time;
+    SPOOthread threads[PRODUCER_COUNT];
+    SPOOselectcase cases[PRODUCER_COUNT];
+
+    for (i = 0;  i < PRODUCER_COUNT;  i++)
+    {
+        producerChannels[i] = spooCreateChannel(sizeof(int), capacity);
+        cases[i].channel = producerChannels[i];
+        cases[i].operation = SPOO_SELECT_RECV;
+        cases[i].value = &value;
+    }
+
+    time = spooGetTime();
+
+    for (i = 0;  i < PRODUCER_COUNT;  i++)
+        threads[i] = spooCreateThread(close_function, producerChannels[i]);
+
+    // Closed channels are dropped from the select
+    while (open)
+    {
+        index = spooSelect(cases, open, SPOO_INFINITY);
+        if (index == -1)
+            fail("Select failed");
+
+        if (cases[index].result == SPOO_CHANNEL_CLOSED)
+            cases[index] = cases[--open];
+        else
+            sum += value;
+    }
+
+    for (i = 0;  i < PRODUCER_COUNT;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    time = spooGetTime() - time;
+    check_sum(sum);
+
+    printf("%s select fan-in: %.2f ns per message\n",
+           name, time * 1e9 / (PRODUCER_COUNT * MESSAGES));
+
+    for (i = 0;  i < PRODUCER_COUNT;  i++)
+        spooDestroyChannel(producerChannels[i]);
+}
+
+static void check_semantics(void)
+{
+    int value = 1;
+    double time;
+    SPOOchannel buffered = spooCreateChannel(sizeof(int), 2);
+    SPOOchannel unbuffered = spooCreateChannel(sizeof(int), 0);
+
+    if (spooTrySendChannel(unbuffered, &value) != SPOO_CHANNEL_TIMEOUT ||
+        spooTryRecvChannel(buffered, &value) != SPOO_CHANNEL_TIMEOUT)
+    {
+        fail("Try operations did not fail");
+    }
+
+    time = spooGetTime();
+    if (spooTimedRecvChannel(unbuffered, &value, 0.05) != SPOO_CHANNEL_TIMEOUT)
+        fail("Timed receive did not time out");
+    time = spooGetTime() - time;
+    if (time < 0.04)
+        fail("Timed receive returned early");
+
+    spooSendChannel(buffered, &value);
+    value = 2;
+    spooSendChannel(buffered, &value);
+
+    if (spooTimedSendChannel(buffered, &value, 0.01) != SPOO_CHANNEL_TIMEOUT)
+        fail("Send on a full channel did not time out");
+
+    spooCloseChannel(buffered);
+    spooCloseChannel(unbuffered);
+
+    if (spooSendChannel(buffered, &value) != SPOO_CHANNEL_CLOSED ||
+        spooSendChannel(unbuffered, &value) != SPOO_CHANNEL_CLOSED)
+    {
+        fail("Send on a closed channel succeeded");
+    }
+
+    // Buffered elements are delivered before the close
+    if (spooRecvChannel(buffered, &value) != SPOO_CHANNEL_OK || value != 1 ||
+        spooRecvChannel(buffered, &value) != SPOO_CHANNEL_OK || value != 2 ||
+        spooRecvChannel(buffered, &value) != SPOO_CHANNEL_CLOSED ||
+        spooRecvChannel(unbuffered, &value) != SPOO_CHANNEL_CLOSED)
+    {
+        fail("Receive on a closed channel is wrong");
+    }
+
+    spooDestroyChannel(unbuffered);
+    spooDestroyChannel(buffered);
+}
+
+int main(void)
+{
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    check_semantics();
+
+    run_ping_pong("Unbuffered", 0);
+    run_ping_pong("Buffered", 1);
+
+    run_fan_in("Unbuffered", 0);
+    run_fan_in("Buffered", CAPACITY);
+
+    run_select_fan_in("Unbuffered", 0);
+    run_select_fan_in("Buffered", CAPACITY);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,275 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It updates a shared priority queue from several threads, both through a
+// flat combiner and by locking its mutex for each operation
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define OPERATIONS 200000
+#define CAPACITY 1000000
+#define MAX_THREADS 64
+
+enum { PUSH, POP };
+
+typedef struct
+{
+    int operation;
+    long value;
+} Request;
+
+typedef struct
+{
+    long values[CAPACITY];
+    int count;
+} Heap;
+
+typedef struct
+{
+    int index;
+    SPOOmutex mutex;
+    SPOOcombiner combiner;
+    long long pushed;
+    long long popped;
+} Worker;
+
+static Heap heap;
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static void push(long value)
+{
+    int parent, index = heap.count++;
+
+    while (index > 0)
+    {
+        parent = (index - 1) / 2;
+        if (heap.values[parent] <= value)
+            break;
+
+        heap.values[index] = heap.values[parent];
+        index = parent;
+    }
+
+    heap.values[index] = value;
+}
+
+static long pop(void)
+{
+    int child, index = 0;
+    long top, last;
+
+    if (!heap.count)
+        return -1;
+
+    top = heap.values[0];
+    last = heap.values[--heap.count];
+
+    while ((child = index * 2 + 1) < heap.count)
+    {
+        if (child + 1 < heap.count && heap.values[child + 1] < heap.values[child])
+            child++;
+        if (last <= heap.values[child])
+            break;
+
+        heap.values[index] = heap.values[child];
+        index = child;
+    }
+
+    heap.values[index] = last;
+    return top;
+}
+
+static void apply(void* request, void* arg)
+{
+    Request* r = (Request*) request;
+
+    if (r->operation == PUSH)
+        push(r->value);
+    else
+        r->value = pop();
+}
+
+static long next_value(Worker* worker, int i)
+{
+    return ((long) i * 7919 + worker->index * 104729) % 1000003;
+}
+
+static void combined_function(void* arg)
+{
+    int i;
+    Request request;
+    Worker* worker = (Worker*) arg;
+
+    for (i = 0;  i < OPERATIONS;  i++)
+    {
+        request.operation = (i & 1) ? POP : PUSH;
+        request.value = next_value(worker, i);
+        spooApplyCombiner(worker->combiner, &request);
+
+        if (request.operation == PUSH)
+            worker->pushed += request.value;
+        else if (request.value >= 0)
+            worker->popped += request.value;
+    }
+}
+
+static void locked_function(void* arg)
+{
+    int i;
+    long value;
+    Worker* worker = (Worker*) arg;
+
+    for (i = 0;  i < OPERATIONS;  i++)
+    {
+        value = next_value(worker, i);
+
+        spooLockMutex(worker->mutex);
+        if (i & 1)
+            value = pop();
+        else
+            push(value);
+        spooUnlockMutex(worker->mutex);
+
+        if (!(i & 1))
+            worker->pushed += value;
+        else if (value >= 0)
+            worker->popped += value;
+    }
+}
+
+static double run(SPOOthreadfun function, Worker* workers, int threadCount)
+{
+    int i;
+    long top, value = -1;
+    long long pushed = 0, popped = 0;
+    double time;
+    SPOOthread threads[MAX_THREADS];
+
+    heap.count = 0;
+
+    time = spooGetTime();
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        workers[i].pushed = 0;
+        workers[i].popped = 0;
+
+        threads[i] = spooCreateThread(function, workers + i);
+        if (!threads[i])
+            fail("Failed to create thread");
+    }
+
+    for (i = 0;  i < threadCount;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    time = spooGetTime() - time;
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        pushed += workers[i].pushed;
+        popped += workers[i].popped;
+    }
+
+    // Whatever was pushed but not popped must still be in the heap, in order
+    while (heap.count)
+    {
+        top = pop();
+        if (top < value)
+            fail("Priority queue order is broken");
+
+        value = top;
+        popped += top;
+    }
+
+    if (pushed != popped)
+        fail("Priority queue lost or duplicated values");
+
+    return time * 1e9 / ((double) threadCount * OPERATIONS);
+}
+
+int main(void)
+{
+    int i, threadCount, maxThreads;
+    double combined, locked;
+    SPOOmutex mutex;
+    SPOOcombiner combiner;
+    Worker workers[MAX_THREADS];
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    mutex = spooCreateMutex();
+    if (!mutex)
+        fail("Failed to create mutex");
+
+    combiner = spooCreateCombiner(mutex, apply, NULL);
+    if (!combiner)
+        fail("Failed to create combiner");
+
+    for (i = 0;  i < MAX_THREADS;  i++)
+    {
+        workers[i].index = i;
+        workers[i].mutex = mutex;
+        workers[i].combiner = combiner;
+    }
+
+    maxThreads = spooGetCPUCoreCount() * 2;
+    if (maxThreads < 8)
+        maxThreads = 8;
+    if (maxThreads > MAX_THREADS)
+        maxThreads = MAX_THREADS;
+
+    for (threadCount = 1;  ;  threadCount *= 2)
+    {
+        if (threadCount > maxThreads)
+            threadCount = maxThreads;
+
+        combined = run(combined_function, workers, threadCount);
+        locked = run(locked_function, workers, threadCount);
+
+        printf("%2i threads: combined %.1f ns, locked %.1f ns per operation\n",
+               threadCount, combined, locked);
+
+        if (threadCount == maxThreads)
+            break;
+    }
+
+    spooDestroyCombiner(combiner);
+    spooDestroyMutex(mutex);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,281 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It compares condition variable signal-to-wake latency and broadcast
+// scalability of Spoo conditions to plain POSIX conditions, if available
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !defined(_WIN32)
+ #include <pthread.h>
+ #define HAVE_PTHREADS 1
+#endif
+
+#define MAX_THREADS 64
+#define SIGNAL_ITERATIONS 5000
+#define BROADCAST_ITERATIONS 500
+
+typedef struct
+{
+    const char* name;
+    void (*lock)(void);
+    void (*unlock)(void);
+    void (*wait)(void);
+    void (*signal)(void);
+    void (*broadcast)(void);
+} Primitives;
+
+static const Primitives* prims;
+
+static volatile int generation;
+static volatile int awake;
+static volatile int stop;
+static volatile double signalTime;
+static double latency;
+
+static SPOOmutex spooMutex;
+static SPOOcond spooCond;
+
+static void spoo_lock(void) { spooLockMutex(spooMutex); }
+static void spoo_unlock(void) { spooUnlockMutex(spooMutex); }
+static void spoo_wait(void) { spooWaitCond(spooCond, spooMutex, SPOO_INFINITY); }
+static void spoo_signal(void) { spooSignalCond(spooCond); }
+static void spoo_broadcast(void) { spooBroadcastCond(spooCond); }
+
+static const Primitives spooPrimitives =
+{
+    "spoo",
+    spoo_lock, spoo_unlock, spoo_wait, spoo_signal, spoo_broadcast
+};
+
+#if defined(HAVE_PTHREADS)
+
+static pthread_mutex_t posixMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t posixCond = PTHREAD_COND_INITIALIZER;
+
+static void posix_lock(void) { pthread_mutex_lock(&posixMutex); }
+static void posix_unlock(void) { pthread_mutex_unlock(&posixMutex); }
+static void posix_wait(void) { pthread_cond_wait(&posixCond, &posixMutex); }
+static void posix_signal(void) { pthread_cond_signal(&posixCond); }
+static void posix_broadcast(void) { pthread_cond_broadcast(&posixCond); }
+
+static const Primitives posixPrimitives =
+{
+    "pthread",
+    posix_lock, posix_unlock, posix_wait, posix_signal, posix_broadcast
+};
+
+#endif /*HAVE_PTHREADS*/
+
+// Wait for each new generation, measuring the time from the signal
+//
+static void signal_function(void* arg)
+{
+    int seen = 0;
+
+    prims->lock();
+
+    for (;;)
+    {
+        while (generation == seen && !stop)
+            prims->wait();
+
+        if (stop)
+            break;
+
+        seen = generation;
+        latency += spooGetTime() - signalTime;
+        awake++;
+    }
+
+    prims->unlock();
+}
+
+// Wait for each new generation and count ourselves as awake
+//
+static void broadcast_function(void* arg)
+{
+    int seen = 0;
+
+    prims->lock();
+
+    for (;;)
+    {
+        while (generation == seen && !stop)
+            prims->wait();
+
+        if (stop)
+            break;
+
+        seen = generation;
+        awake++;
+    }
+
+    prims->unlock();
+}
+
+static void start_threads(SPOOthread* threads, int count, SPOOthreadfun fun)
+{
+    int i;
+
+    stop = 0;
+    awake = 0;
+    generation = 0;
+
+    for (i = 0;  i < count;  i++)
+        threads[i] = spooCreateThread(fun, NULL);
+}
+
+static void stop_threads(SPOOthread* threads, int count)
+{
+    int i;
+
+    prims->lock();
+    stop = 1;
+    prims->broadcast();
+    prims->unlock();
+
+    for (i = 0;  i < count;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+}
+
+// Measure the time from signalling a waiting thread until it runs
+//
+static double bench_signal(void)
+{
+    int i;
+    SPOOthread thread;
+
+    latency = 0.0;
+    start_threads(&thread, 1, signal_function);
+
+    for (i = 0;  i < SIGNAL_ITERATIONS;  i++)
+    {
+        // Let the waiter get back to waiting
+        while (awake != i)
+            spooSleep(0.0);
+
+        prims->lock();
+        generation++;
+        signalTime = spooGetTime();
+        prims->signal();
+        prims->unlock();
+    }
+
+    while (awake != SIGNAL_ITERATIONS)
+        spooSleep(0.0);
+
+    stop_threads(&thread, 1);
+
+    return latency * 1e6 / SIGNAL_ITERATIONS;
+}
+
+// Measure the time from broadcasting to all waiters having run
+//
+static double bench_broadcast(int count)
+{
+    int i;
+    double time, total = 0.0;
+    SPOOthread threads[MAX_THREADS];
+
+    start_threads(threads, count, broadcast_function);
+
+    for (i = 0;  i < BROADCAST_ITERATIONS;  i++)
+    {
+        while (awake != i * count)
+            spooSleep(0.0);
+
+        prims->lock();
+        generation++;
+        time = spooGetTime();
+        prims->broadcast();
+        prims->unlock();
+
+        while (awake != (i + 1) * count)
+            spooSleep(0.0);
+
+        total += spooGetTime() - time;
+    }
+
+    stop_threads(threads, count);
+
+    return total * 1e6 / BROADCAST_ITERATIONS;
+}
+
+static void run(const Primitives* primitives, int maxThreads)
+{
+    int count;
+
+    prims = primitives;
+
+    printf("%-8s %-20s %8s %10.2f us\n",
+           prims->name, "signal-to-wake", "1", bench_signal());
+
+    for (count = 1;  count <= maxThreads;  count *= 2)
+    {
+        printf("%-8s %-20s %8i %10.2f us\n",
+               prims->name, "broadcast-to-all", count, bench_broadcast(count));
+    }
+}
+
+int main(void)
+{
+    int maxThreads;
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    maxThreads = spooGetCPUCoreCount() * 4;
+    if (maxThreads < 8)
+        maxThreads = 8;
+    if (maxThreads > MAX_THREADS)
+        maxThreads = MAX_THREADS;
+
+    spooMutex = spooCreateMutex();
+    spooCond = spooCreateCond();
+
+    printf("%-8s %-20s %8s %13s\n", "impl", "benchmark", "threads", "time");
+
+    run(&spooPrimitives, maxThreads);
+
+#if defined(HAVE_PTHREADS)
+    run(&posixPrimitives, maxThreads);
+#endif
+
+    spooDestroyCond(spooCond);
+    spooDestroyMutex(spooMutex);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
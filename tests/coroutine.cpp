@@ -0,0 +1,252 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It runs coroutines on a worker pool, checks that they can share a mutex,
+// wait on a condition and sleep, and compares the cost of hopping between
+// workers and awaiting subtasks to that of creating a thread per task
+//========================================================================
+
+#include <spoo/spoo.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <new>
+#include <optional>
+
+#define WORKER_COUNT 4
+#define COROUTINE_COUNT 1000
+#define INCREMENTS 100
+#define ITERATIONS 100000
+#define THREAD_COUNT 1000
+
+static std::atomic<long> allocations(0);
+
+void* operator new(std::size_t size)
+{
+    allocations++;
+
+    void* p = malloc(size);
+    if (!p)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    free(p);
+}
+
+static SPOOpool pool;
+static std::optional<spoo::async_mutex> mutex;
+static std::optional<spoo::async_cond> cond;
+static long counter = 0;
+static int finished = 0;
+
+static spoo::task<> increment(void)
+{
+    int i;
+
+    co_await spoo::schedule(pool);
+
+    for (i = 0;  i < INCREMENTS;  i++)
+    {
+        auto guard = co_await mutex->scoped_lock(pool);
+        counter++;
+    }
+
+    co_await mutex->lock(pool);
+    finished++;
+    cond->signal();
+    mutex->unlock();
+}
+
+static spoo::task<> wait_for_all(void)
+{
+    co_await mutex->lock(pool);
+
+    while (finished < COROUTINE_COUNT)
+        co_await cond->wait(*mutex, pool);
+
+    mutex->unlock();
+}
+
+static spoo::task<double> sleep_on_pool(double seconds)
+{
+    double start = spooGetTime();
+    co_await spoo::sleep_for(seconds, pool);
+    co_return spooGetTime() - start;
+}
+
+static spoo::task<int> add_one(int value)
+{
+    co_return value + 1;
+}
+
+static spoo::task<long> await_subtasks(void)
+{
+    int i;
+    long sum = 0;
+
+    for (i = 0;  i < ITERATIONS;  i++)
+        sum += co_await add_one(i);
+
+    co_return sum;
+}
+
+static spoo::task<> hop_workers(void)
+{
+    int i;
+
+    for (i = 0;  i < ITERATIONS;  i++)
+        co_await spoo::schedule(pool);
+}
+
+static void thread_function(void* arg)
+{
+    (*(long*) arg)++;
+}
+
+int main(void)
+{
+    int i;
+    long sum, steady, misses, value = 0;
+    double time, slept;
+    SPOOthread threads[WORKER_COUNT];
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pool = spooCreatePool(WORKER_COUNT);
+    if (!pool)
+    {
+        fprintf(stderr, "Failed to create pool\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mutex.emplace();
+    cond.emplace();
+
+    // Many coroutines contending for a mutex and waking a waiter
+    time = spooGetTime();
+
+    for (i = 0;  i < COROUTINE_COUNT;  i++)
+        spoo::spawn(increment(), pool);
+
+    spoo::sync_wait(wait_for_all());
+
+    printf("%i coroutines on %i workers: %.2f ms\n",
+           COROUTINE_COUNT, WORKER_COUNT, (spooGetTime() - time) * 1e3);
+
+    slept = spoo::sync_wait(sleep_on_pool(0.05));
+    printf("Slept for %.2f ms on the pool\n", slept * 1e3);
+
+    // Awaiting subtasks, warming the frame allocator up first
+    spoo::sync_wait(await_subtasks());
+
+    // Frames come from the frame allocator, which falls back to malloc,
+    // while anything else on the await path would use operator new
+    steady = allocations;
+    misses = (long) spoo::detail::frame_allocator::misses();
+    time = spooGetTime();
+    sum = spoo::sync_wait(await_subtasks());
+    time = spooGetTime() - time;
+    steady = allocations - steady;
+    misses = (long) spoo::detail::frame_allocator::misses() - misses;
+
+    printf("Awaited subtask: %.2f ns, %li allocations, %li frame misses\n",
+           time * 1e9 / ITERATIONS, steady, misses);
+
+    // Hopping between pool workers
+    spoo::sync_wait(hop_workers());
+
+    time = spooGetTime();
+    spoo::sync_wait(hop_workers());
+    time = spooGetTime() - time;
+
+    printf("Pool hop: %.2f ns\n", time * 1e9 / ITERATIONS);
+
+    // Creating a thread per task, as the pool replaces
+    time = spooGetTime();
+
+    for (i = 0;  i < THREAD_COUNT;  i += WORKER_COUNT)
+    {
+        int j;
+
+        for (j = 0;  j < WORKER_COUNT;  j++)
+            threads[j] = spooCreateThread(thread_function, &value);
+        for (j = 0;  j < WORKER_COUNT;  j++)
+            spooWaitThread(threads[j], SPOO_WAIT);
+    }
+
+    time = spooGetTime() - time;
+    printf("Thread per task: %.2f ns\n", time * 1e9 / THREAD_COUNT);
+
+    spooDestroyPool(pool);
+
+    cond.reset();
+    mutex.reset();
+
+    spooTerminate();
+
+    if (counter != (long) COROUTINE_COUNT * INCREMENTS)
+    {
+        fprintf(stderr, "Counter is %li, expected %li\n",
+                counter, (long) COROUTINE_COUNT * INCREMENTS);
+        exit(EXIT_FAILURE);
+    }
+
+    if (sum != (long) ITERATIONS * (ITERATIONS + 1) / 2)
+    {
+        fprintf(stderr, "Subtask sum is %li\n", sum);
+        exit(EXIT_FAILURE);
+    }
+
+    if (steady != 0 || misses != 0)
+    {
+        fprintf(stderr, "Awaiting subtasks allocated memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (slept < 0.05)
+    {
+        fprintf(stderr, "Woke up early after %.2f ms\n", slept * 1e3);
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
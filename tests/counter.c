@@ -0,0 +1,191 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It checks sharded sum and max counters from several threads and compares
+// their updates to a single atomic counter shared by all threads
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_MSC_VER)
+ #include <windows.h>
+ #define ATOMIC_INCREMENT(p) InterlockedIncrement(p)
+#else
+ #define ATOMIC_INCREMENT(p) __sync_add_and_fetch((p), 1)
+#endif
+
+#define OPERATIONS 2000000
+#define MAX_THREADS 64
+
+typedef struct
+{
+    int index;
+    SPOOcounter counter;
+    SPOOcounter gauge;
+    SPOOcounter max;
+} Worker;
+
+static volatile long shared = 0;
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static void counter_function(void* arg)
+{
+    int i;
+    Worker* worker = (Worker*) arg;
+
+    for (i = 0;  i < OPERATIONS;  i++)
+        spooAddCounter(worker->counter, 1);
+}
+
+static void atomic_function(void* arg)
+{
+    int i;
+
+    for (i = 0;  i < OPERATIONS;  i++)
+        ATOMIC_INCREMENT(&shared);
+}
+
+static void gauge_function(void* arg)
+{
+    int i;
+    Worker* worker = (Worker*) arg;
+
+    for (i = 0;  i < OPERATIONS / 10;  i++)
+    {
+        spooAddCounter(worker->gauge, 3);
+        spooAddCounter(worker->max, (long long) worker->index * OPERATIONS + i);
+        spooAddCounter(worker->gauge, -3);
+    }
+}
+
+static double run(SPOOthreadfun function, Worker* workers, int threadCount)
+{
+    int i;
+    double time;
+    SPOOthread threads[MAX_THREADS];
+
+    time = spooGetTime();
+
+    for (i = 0;  i < threadCount;  i++)
+        threads[i] = spooCreateThread(function, workers + i);
+
+    for (i = 0;  i < threadCount;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    time = spooGetTime() - time;
+    return time * 1e9 / ((double) threadCount * OPERATIONS);
+}
+
+int main(void)
+{
+    int i, threadCount, maxThreads;
+    double sharded, atomic;
+    Worker workers[MAX_THREADS];
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    maxThreads = spooGetCPUCoreCount();
+    if (maxThreads < 4)
+        maxThreads = 4;
+    if (maxThreads > MAX_THREADS)
+        maxThreads = MAX_THREADS;
+
+    for (threadCount = 1;  ;  threadCount *= 2)
+    {
+        if (threadCount > maxThreads)
+            threadCount = maxThreads;
+
+        for (i = 0;  i < threadCount;  i++)
+        {
+            workers[i].index = i;
+            workers[i].counter = spooCreateCounter(SPOO_COUNTER_SUM);
+            workers[i].gauge = spooCreateCounter(SPOO_COUNTER_SUM);
+            workers[i].max = spooCreateCounter(SPOO_COUNTER_MAX);
+            if (!workers[i].counter || !workers[i].gauge || !workers[i].max)
+                fail("Failed to create counter");
+        }
+
+        // All workers share the counters of the first one
+        for (i = 1;  i < threadCount;  i++)
+        {
+            spooDestroyCounter(workers[i].counter);
+            spooDestroyCounter(workers[i].gauge);
+            spooDestroyCounter(workers[i].max);
+            workers[i].counter = workers[0].counter;
+            workers[i].gauge = workers[0].gauge;
+            workers[i].max = workers[0].max;
+        }
+
+        shared = 0;
+
+        sharded = run(counter_function, workers, threadCount);
+        atomic = run(atomic_function, workers, threadCount);
+        run(gauge_function, workers, threadCount);
+
+        if (spooGetCounter(workers[0].counter) != (long long) threadCount * OPERATIONS)
+            fail("Sharded counter lost updates");
+        if (shared != (long) threadCount * OPERATIONS)
+            fail("Atomic counter lost updates");
+        if (spooGetCounter(workers[0].gauge) != 0)
+            fail("Gauge did not return to zero");
+        if (spooGetCounter(workers[0].max) !=
+            (long long) (threadCount - 1) * OPERATIONS + OPERATIONS / 10 - 1)
+        {
+            fail("Max counter missed the largest value");
+        }
+
+        spooSetCounter(workers[0].gauge, 42);
+        spooSetCounter(workers[0].max, -1);
+        if (spooGetCounter(workers[0].gauge) != 42 ||
+            spooGetCounter(workers[0].max) != -1)
+        {
+            fail("Setting counters failed");
+        }
+
+        printf("%2i threads: sharded %.2f ns, atomic %.2f ns per increment\n",
+               threadCount, sharded, atomic);
+
+        spooDestroyCounter(workers[0].counter);
+        spooDestroyCounter(workers[0].gauge);
+        spooDestroyCounter(workers[0].max);
+
+        if (threadCount == maxThreads)
+            break;
+    }
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,207 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It compares fiber context switches to kernel thread switches, and checks
+// that fiber mutexes, conditions and sleeps work across worker threads
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SWITCHES 200000
+#define FIBER_COUNT 1000
+#define WORKER_COUNT 4
+#define INCREMENTS 1000
+
+static SPOOmutex mutex;
+static SPOOcond cond;
+static SPOOfibermutex fiber_mutex;
+static SPOOfibercond fiber_cond;
+static volatile int turn = 0;
+static volatile long counter = 0;
+
+static void yield_function(void* arg)
+{
+    int i;
+
+    for (i = 0;  i < SWITCHES / 2;  i++)
+        spooYieldFiber();
+}
+
+static void thread_function(void* arg)
+{
+    int i, self = (int) (size_t) arg;
+
+    spooLockMutex(mutex);
+
+    for (i = 0;  i < SWITCHES / 2;  i++)
+    {
+        while (turn != self)
+            spooWaitCond(cond, mutex, SPOO_INFINITY);
+
+        turn = !self;
+        spooSignalCond(cond);
+    }
+
+    spooUnlockMutex(mutex);
+}
+
+static void fiber_function(void* arg)
+{
+    int i, self = (int) (size_t) arg;
+
+    spooLockFiberMutex(fiber_mutex);
+
+    for (i = 0;  i < SWITCHES / 2;  i++)
+    {
+        while (turn != self)
+            spooWaitFiberCond(fiber_cond, fiber_mutex, SPOO_INFINITY);
+
+        turn = !self;
+        spooSignalFiberCond(fiber_cond);
+    }
+
+    spooUnlockFiberMutex(fiber_mutex);
+}
+
+static void counter_function(void* arg)
+{
+    int i;
+
+    spooSleepFiber(0.01);
+
+    for (i = 0;  i < INCREMENTS;  i++)
+    {
+        spooLockFiberMutex(fiber_mutex);
+        counter++;
+        if (i % 100 == 0)
+            spooYieldFiber();
+        spooUnlockFiberMutex(fiber_mutex);
+    }
+}
+
+static double run_fibers(SPOOthreadfun function)
+{
+    double time;
+    SPOOfiber fibers[2];
+
+    turn = 0;
+    time = spooGetTime();
+
+    fibers[0] = spooCreateFiber(function, (void*) 0);
+    fibers[1] = spooCreateFiber(function, (void*) 1);
+    spooWaitFiber(fibers[0]);
+    spooWaitFiber(fibers[1]);
+
+    return spooGetTime() - time;
+}
+
+int main(void)
+{
+    int i;
+    double time;
+    SPOOthread threads[2];
+    SPOOfiber* fibers;
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mutex = spooCreateMutex();
+    cond = spooCreateCond();
+    fiber_mutex = spooCreateFiberMutex();
+    fiber_cond = spooCreateFiberCond();
+
+    // Kernel thread switches, handing a token back and forth
+    turn = 0;
+    time = spooGetTime();
+    threads[0] = spooCreateThread(thread_function, (void*) 0);
+    threads[1] = spooCreateThread(thread_function, (void*) 1);
+    spooWaitThread(threads[0], SPOO_WAIT);
+    spooWaitThread(threads[1], SPOO_WAIT);
+    time = spooGetTime() - time;
+    printf("Thread condition switch: %.2f ns\n", time * 1e9 / SWITCHES);
+
+    // Fiber switches on a single worker thread
+    if (!spooStartFibers(1, 0))
+    {
+        fprintf(stderr, "Failed to start fibers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    time = run_fibers(yield_function);
+    printf("Fiber yield switch: %.2f ns\n", time * 1e9 / SWITCHES);
+
+    time = run_fibers(fiber_function);
+    printf("Fiber condition switch: %.2f ns\n", time * 1e9 / SWITCHES);
+
+    spooStopFibers();
+
+    // Many sleeping fibers contending for a mutex across workers
+    if (!spooStartFibers(WORKER_COUNT, 16 * 1024))
+    {
+        fprintf(stderr, "Failed to start fibers\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fibers = (SPOOfiber*) calloc(FIBER_COUNT, sizeof(SPOOfiber));
+
+    time = spooGetTime();
+
+    for (i = 0;  i < FIBER_COUNT;  i++)
+        fibers[i] = spooCreateFiber(counter_function, NULL);
+
+    for (i = 0;  i < FIBER_COUNT;  i++)
+        spooWaitFiber(fibers[i]);
+
+    time = spooGetTime() - time;
+    printf("%i fibers on %i workers: %.2f ms\n",
+           FIBER_COUNT, WORKER_COUNT, time * 1e3);
+
+    spooStopFibers();
+    free(fibers);
+
+    spooDestroyFiberCond(fiber_cond);
+    spooDestroyFiberMutex(fiber_mutex);
+    spooDestroyCond(cond);
+    spooDestroyMutex(mutex);
+
+    spooTerminate();
+
+    if (counter != (long) FIBER_COUNT * INCREMENTS)
+    {
+        fprintf(stderr, "Counter is %li, expected %li\n",
+                counter, (long) FIBER_COUNT * INCREMENTS);
+        exit(EXIT_FAILURE);
+    }
+
+    exit(EXIT_SUCCESS);
+}
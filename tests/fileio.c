@@ -0,0 +1,278 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It writes a large local file with asynchronous file I/O, then measures
+// reading it back at various queue depths with each available backend
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+ #include <io.h>
+ #define open _open
+ #define close _close
+ #define unlink _unlink
+ #define OPEN_FLAGS (_O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY)
+#else
+ #include <unistd.h>
+ #define OPEN_FLAGS (O_RDWR | O_CREAT | O_TRUNC)
+#endif
+
+#define BLOCK_SIZE (64 * 1024)
+#define BLOCK_COUNT 1024
+#define MAX_DEPTH 64
+
+typedef struct
+{
+    SPOOfilerequest request;
+    char buffer[BLOCK_SIZE];
+} Block;
+
+static Block blocks[MAX_DEPTH];
+static SPOOfileio io;
+static SPOOmutex mutex;
+static SPOOcond cond;
+static int fd;
+static int next_block;
+static int completed;
+static int errors;
+
+static void check_block(SPOOfilerequest* request)
+{
+    Block* block = (Block*) request->arg;
+    int index = (int) (request->offset / BLOCK_SIZE);
+
+    if (request->result != BLOCK_SIZE || block->buffer[0] != (char) index)
+        errors++;
+}
+
+static void count_block(void)
+{
+    spooLockMutex(mutex);
+    completed++;
+    spooSignalCond(cond);
+    spooUnlockMutex(mutex);
+}
+
+static void finish_block(SPOOfilerequest* request)
+{
+    check_block(request);
+    count_block();
+}
+
+static void finish_sync(SPOOfilerequest* request)
+{
+    count_block();
+}
+
+static void read_next(SPOOfilerequest* request);
+
+static int start_read(Block* block)
+{
+    int index;
+
+    spooLockMutex(mutex);
+    index = next_block++;
+    spooUnlockMutex(mutex);
+
+    if (index >= BLOCK_COUNT)
+        return 0;
+
+    block->request.fd = fd;
+    block->request.buffer = block->buffer;
+    block->request.size = BLOCK_SIZE;
+    block->request.offset = (long long) index * BLOCK_SIZE;
+    block->request.fun = read_next;
+    block->request.arg = block;
+
+    spooReadFile(io, &block->request);
+    return 1;
+}
+
+static void read_next(SPOOfilerequest* request)
+{
+    check_block(request);
+
+    if (start_read((Block*) request->arg))
+        spooSubmitFileIO(io);
+
+    // Only count the block once its request can no longer be reused
+    count_block();
+}
+
+static void wait_for_blocks(void)
+{
+    spooLockMutex(mutex);
+    while (completed < BLOCK_COUNT)
+        spooWaitCond(cond, mutex, SPOO_INFINITY);
+    spooUnlockMutex(mutex);
+}
+
+static void write_file(void)
+{
+    int i, j;
+    SPOOfilerequest sync;
+
+    // Write the file one batch of blocks at a time
+    completed = 0;
+
+    for (i = 0;  i < BLOCK_COUNT;  i += MAX_DEPTH)
+    {
+        for (j = 0;  j < MAX_DEPTH;  j++)
+        {
+            memset(blocks[j].buffer, (char) (i + j), BLOCK_SIZE);
+
+            blocks[j].request.fd = fd;
+            blocks[j].request.buffer = blocks[j].buffer;
+            blocks[j].request.size = BLOCK_SIZE;
+            blocks[j].request.offset = (long long) (i + j) * BLOCK_SIZE;
+            blocks[j].request.fun = finish_block;
+            blocks[j].request.arg = blocks + j;
+
+            spooWriteFile(io, &blocks[j].request);
+        }
+
+        spooSubmitFileIO(io);
+
+        spooLockMutex(mutex);
+        while (completed < i + MAX_DEPTH)
+            spooWaitCond(cond, mutex, SPOO_INFINITY);
+        spooUnlockMutex(mutex);
+    }
+
+    memset(&sync, 0, sizeof(sync));
+    sync.fd = fd;
+    sync.fun = finish_sync;
+
+    completed = 0;
+
+    spooSyncFile(io, &sync);
+    spooSubmitFileIO(io);
+
+    spooLockMutex(mutex);
+    while (completed < 1)
+        spooWaitCond(cond, mutex, SPOO_INFINITY);
+    spooUnlockMutex(mutex);
+
+    if (sync.result != 0)
+        errors++;
+}
+
+static double read_file(int depth)
+{
+    int i;
+    double time = spooGetTime();
+
+    next_block = 0;
+    completed = 0;
+
+    for (i = 0;  i < depth;  i++)
+        start_read(blocks + i);
+
+    // The first requests go to the kernel as a single batch
+    spooSubmitFileIO(io);
+
+    wait_for_blocks();
+
+    return spooGetTime() - time;
+}
+
+int main(int argc, char** argv)
+{
+    int flags, depth;
+    double time;
+    const char* filename = "spoo_fileio.tmp";
+
+    if (argc > 1)
+        filename = argv[1];
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mutex = spooCreateMutex();
+    cond = spooCreateCond();
+
+    fd = open(filename, OPEN_FLAGS, 0600);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Failed to create %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    for (flags = 0;  flags <= SPOO_FILE_IO_THREADS;  flags += SPOO_FILE_IO_THREADS)
+    {
+        io = spooCreateFileIO(NULL, MAX_DEPTH, flags);
+        if (!io)
+        {
+            fprintf(stderr, "Failed to create file I/O service\n");
+            exit(EXIT_FAILURE);
+        }
+
+        // Only test io_uring where it is actually available
+        if (flags == 0 && !spooIsFileIOAsync(io))
+        {
+            spooDestroyFileIO(io);
+            continue;
+        }
+
+        printf("%s:\n", spooIsFileIOAsync(io) ? "io_uring" : "Blocking I/O threads");
+
+        write_file();
+
+        for (depth = 1;  depth <= MAX_DEPTH;  depth *= 4)
+        {
+            time = read_file(depth);
+            printf("  Queue depth %2i: %.1f MB/s\n",
+                   depth, (double) BLOCK_COUNT * BLOCK_SIZE / time / 1e6);
+        }
+
+        spooDestroyFileIO(io);
+
+        if (errors)
+        {
+            fprintf(stderr, "%i blocks failed\n", errors);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    close(fd);
+    unlink(filename);
+
+    spooDestroyCond(cond);
+    spooDestroyMutex(mutex);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,291 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It runs wide, deep and layered task graphs many times, checking that every
+// task runs after its predecessors, and compares them to one thread per task
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WIDTH 10000
+#define DEPTH 10000
+#define LAYERS 64
+#define LAYER_WIDTH 64
+#define RUNS 50
+#define WORKER_COUNT 4
+
+typedef struct Node
+{
+    volatile int runs;
+    struct Node* predecessors[2];
+    int predecessorCount;
+} Node;
+
+static Node* nodes;
+static volatile int failed = 0;
+
+static void node_function(void* arg)
+{
+    int i;
+    Node* node = (Node*) arg;
+    const int runs = node->runs + 1;
+
+    for (i = 0;  i < node->predecessorCount;  i++)
+    {
+        if (node->predecessors[i]->runs != runs)
+            failed = 1;
+    }
+
+    node->runs = runs;
+}
+
+static SPOOgraphnode add_node(SPOOgraph graph, int index)
+{
+    SPOOgraphnode node = spooAddGraphNode(graph, node_function, nodes + index);
+    if (!node)
+    {
+        fprintf(stderr, "Failed to add graph node\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return node;
+}
+
+static void add_edge(SPOOgraphnode* handles, int before, int after)
+{
+    Node* node = nodes + after;
+
+    if (!spooAddGraphEdge(handles[before], handles[after]))
+    {
+        fprintf(stderr, "Failed to add graph edge\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Only the first two predecessors are checked
+    if (node->predecessorCount < 2)
+        node->predecessors[node->predecessorCount++] = nodes + before;
+}
+
+// One root, a wide middle and one sink
+//
+static SPOOgraph build_wide(SPOOpool pool, SPOOgraphnode* handles)
+{
+    int i;
+    SPOOgraph graph = spooCreateGraph(pool);
+
+    for (i = 0;  i < WIDTH + 2;  i++)
+        handles[i] = add_node(graph, i);
+
+    for (i = 1;  i <= WIDTH;  i++)
+    {
+        add_edge(handles, 0, i);
+        add_edge(handles, i, WIDTH + 1);
+    }
+
+    return graph;
+}
+
+// A single long chain
+//
+static SPOOgraph build_deep(SPOOpool pool, SPOOgraphnode* handles)
+{
+    int i;
+    SPOOgraph graph = spooCreateGraph(pool);
+
+    for (i = 0;  i < DEPTH;  i++)
+        handles[i] = add_node(graph, i);
+
+    for (i = 1;  i < DEPTH;  i++)
+        add_edge(handles, i - 1, i);
+
+    return graph;
+}
+
+// Layers where each task depends on two tasks of the previous layer
+//
+static SPOOgraph build_layered(SPOOpool pool, SPOOgraphnode* handles)
+{
+    int i, j;
+    SPOOgraph graph = spooCreateGraph(pool);
+
+    for (i = 0;  i < LAYERS * LAYER_WIDTH;  i++)
+        handles[i] = add_node(graph, i);
+
+    for (i = 1;  i < LAYERS;  i++)
+    {
+        for (j = 0;  j < LAYER_WIDTH;  j++)
+        {
+            const int node = i * LAYER_WIDTH + j;
+            const int above = node - LAYER_WIDTH;
+
+            add_edge(handles, above, node);
+            add_edge(handles, above - j + (j + 1) % LAYER_WIDTH, node);
+        }
+    }
+
+    return graph;
+}
+
+static void reset_nodes(int count)
+{
+    int i;
+
+    for (i = 0;  i < count;  i++)
+    {
+        nodes[i].runs = 0;
+        nodes[i].predecessorCount = 0;
+    }
+}
+
+static void check_nodes(const char* name, int count, int runs)
+{
+    int i;
+
+    for (i = 0;  i < count;  i++)
+    {
+        if (nodes[i].runs != runs)
+            failed = 1;
+    }
+
+    if (failed)
+    {
+        fprintf(stderr, "%s graph ran out of order\n", name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void benchmark(const char* name, SPOOpool pool, int count,
+                      SPOOgraph (*build)(SPOOpool, SPOOgraphnode*))
+{
+    int i;
+    double time;
+    SPOOgraph graph;
+    SPOOgraphnode* handles;
+
+    handles = (SPOOgraphnode*) calloc(count, sizeof(SPOOgraphnode));
+    reset_nodes(count);
+
+    time = spooGetTime();
+    graph = build(pool, handles);
+    time = spooGetTime() - time;
+    printf("%s graph: %i tasks built in %.2f ms\n", name, count, time * 1e3);
+
+    time = spooGetTime();
+
+    for (i = 0;  i < RUNS;  i++)
+    {
+        if (!spooRunGraph(graph))
+        {
+            fprintf(stderr, "Failed to run %s graph\n", name);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    time = spooGetTime() - time;
+    printf("%s graph: %.2f ns per task\n", name, time * 1e9 / (count * RUNS));
+
+    check_nodes(name, count, RUNS);
+
+    spooDestroyGraph(graph);
+    free(handles);
+}
+
+// The layered graph with one thread per task, waiting for each layer
+//
+static void benchmark_threads(void)
+{
+    int i, j;
+    double time;
+    SPOOthread threads[LAYER_WIDTH];
+
+    reset_nodes(LAYERS * LAYER_WIDTH);
+
+    time = spooGetTime();
+
+    for (i = 0;  i < LAYERS;  i++)
+    {
+        for (j = 0;  j < LAYER_WIDTH;  j++)
+            threads[j] = spooCreateThread(node_function, nodes + i * LAYER_WIDTH + j);
+
+        for (j = 0;  j < LAYER_WIDTH;  j++)
+            spooWaitThread(threads[j], SPOO_WAIT);
+    }
+
+    time = spooGetTime() - time;
+    printf("Layered threads: %.2f ns per task\n",
+           time * 1e9 / (LAYERS * LAYER_WIDTH));
+}
+
+int main(void)
+{
+    SPOOpool pool;
+    SPOOgraph graph;
+    SPOOgraphnode cycle[2];
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pool = spooCreatePool(WORKER_COUNT);
+    if (!pool)
+    {
+        fprintf(stderr, "Failed to create pool\n");
+        exit(EXIT_FAILURE);
+    }
+
+    nodes = (Node*) calloc(DEPTH + WIDTH + LAYERS * LAYER_WIDTH, sizeof(Node));
+
+    benchmark("Wide", pool, WIDTH + 2, build_wide);
+    benchmark("Deep", pool, DEPTH, build_deep);
+    benchmark("Layered", pool, LAYERS * LAYER_WIDTH, build_layered);
+    benchmark_threads();
+
+    // Cycles must be rejected instead of hanging
+    graph = spooCreateGraph(pool);
+    cycle[0] = spooAddGraphNode(graph, node_function, nodes);
+    cycle[1] = spooAddGraphNode(graph, node_function, nodes + 1);
+    spooAddGraphEdge(cycle[0], cycle[1]);
+    spooAddGraphEdge(cycle[1], cycle[0]);
+
+    if (spooRunGraph(graph))
+    {
+        fprintf(stderr, "Cyclic graph was run\n");
+        exit(EXIT_FAILURE);
+    }
+
+    spooDestroyGraph(graph);
+    spooDestroyPool(pool);
+    free(nodes);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
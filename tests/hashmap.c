@@ -0,0 +1,300 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It checks a concurrent hash map from one and several threads while the
+// map grows, then measures read/write mixes against the same map behind a
+// single mutex
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KEY_COUNT 100000
+#define WRITER_COUNT 4
+#define WRITER_KEYS 50000
+#define BENCH_KEYS 65536
+#define BENCH_OPS 1000000
+#define MAX_THREADS 64
+
+typedef struct
+{
+    SPOOhashmap map;
+    SPOOmutex lock;
+    unsigned long seed;
+    int first;
+    int writePercent;
+} Worker;
+
+static volatile int writersDone = 0;
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static unsigned long next_random(unsigned long* seed)
+{
+    *seed = *seed * 1103515245 + 12345;
+    return (*seed >> 16) & 0x7fff;
+}
+
+static size_t hash_int(const void* key, void* arg)
+{
+    size_t x = *(const int*) key;
+    x ^= x >> 16;
+    x *= 0x45d9f3b;
+    x ^= x >> 16;
+    return x;
+}
+
+static int equal_int(const void* a, const void* b, void* arg)
+{
+    return *(const int*) a == *(const int*) b;
+}
+
+static void single_thread_test(void)
+{
+    int i, value;
+    SPOOhashmap map = spooCreateHashMap(sizeof(int), sizeof(int), NULL, NULL, NULL);
+    if (!map)
+        fail("Failed to create hash map");
+
+    for (i = 0;  i < KEY_COUNT;  i++)
+    {
+        value = i * 3;
+        if (!spooInsertHashMap(map, &i, &value))
+            fail("Failed to insert key");
+    }
+
+    for (i = 0;  i < KEY_COUNT;  i += 2)
+    {
+        value = -i;
+        spooInsertHashMap(map, &i, &value);
+    }
+
+    for (i = 1;  i < KEY_COUNT;  i += 2)
+    {
+        if (!spooRemoveHashMap(map, &i))
+            fail("Failed to remove key");
+        if (spooRemoveHashMap(map, &i))
+            fail("Removed key twice");
+    }
+
+    if (spooGetHashMapCount(map) != KEY_COUNT / 2)
+        fail("Wrong key count after removal");
+
+    for (i = 0;  i < KEY_COUNT;  i++)
+    {
+        if (spooLookupHashMap(map, &i, &value) != !(i & 1))
+            fail("Wrong key found");
+        if (!(i & 1) && value != -i)
+            fail("Wrong value found");
+    }
+
+    spooDestroyHashMap(map);
+}
+
+static void writer_function(void* arg)
+{
+    int i, key, value;
+    Worker* worker = (Worker*) arg;
+
+    for (i = 0;  i < WRITER_KEYS;  i++)
+    {
+        key = worker->first + i;
+        value = key * 3;
+        if (!spooInsertHashMap(worker->map, &key, &value))
+            fail("Failed to insert key");
+    }
+
+    // Remove every other key again so nodes get reused
+    for (i = 0;  i < WRITER_KEYS;  i += 2)
+    {
+        key = worker->first + i;
+        if (!spooRemoveHashMap(worker->map, &key))
+            fail("Failed to remove key");
+    }
+}
+
+static void reader_function(void* arg)
+{
+    int key, value;
+    Worker* worker = (Worker*) arg;
+
+    // The keys below zero stay in the map while the writers grow it
+    while (!writersDone)
+    {
+        key = -1 - (int) (next_random(&worker->seed) % 1000);
+        if (!spooLookupHashMap(worker->map, &key, &value) || value != key * 3)
+            fail("Lost a key while the map was growing");
+    }
+}
+
+static void concurrent_test(void)
+{
+    int i, key, value;
+    Worker writers[WRITER_COUNT], reader;
+    SPOOthread threads[WRITER_COUNT], readerThread;
+    SPOOhashmap map = spooCreateHashMap(sizeof(int), sizeof(int), hash_int, equal_int, NULL);
+    if (!map)
+        fail("Failed to create hash map");
+
+    for (key = -1;  key >= -1000;  key--)
+    {
+        value = key * 3;
+        spooInsertHashMap(map, &key, &value);
+    }
+
+    reader.map = map;
+    reader.seed = 1;
+    readerThread = spooCreateThread(reader_function, &reader);
+
+    for (i = 0;  i < WRITER_COUNT;  i++)
+    {
+        writers[i].map = map;
+        writers[i].first = i * WRITER_KEYS;
+        threads[i] = spooCreateThread(writer_function, writers + i);
+    }
+
+    for (i = 0;  i < WRITER_COUNT;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    writersDone = 1;
+    spooWaitThread(readerThread, SPOO_WAIT);
+
+    if (spooGetHashMapCount(map) != 1000 + WRITER_COUNT * WRITER_KEYS / 2)
+        fail("Wrong key count after concurrent writes");
+
+    for (key = 0;  key < WRITER_COUNT * WRITER_KEYS;  key++)
+    {
+        if (spooLookupHashMap(map, &key, &value) != (key & 1))
+            fail("Wrong key found after concurrent writes");
+        if ((key & 1) && value != key * 3)
+            fail("Wrong value found after concurrent writes");
+    }
+
+    spooDestroyHashMap(map);
+}
+
+static void bench_function(void* arg)
+{
+    int i, key, value;
+    Worker* worker = (Worker*) arg;
+
+    for (i = 0;  i < BENCH_OPS;  i++)
+    {
+        key = (int) ((next_random(&worker->seed) << 15 |
+                      next_random(&worker->seed)) % BENCH_KEYS);
+
+        if (worker->lock)
+            spooLockMutex(worker->lock);
+
+        if ((int) (next_random(&worker->seed) % 100) >= worker->writePercent)
+            spooLookupHashMap(worker->map, &key, &value);
+        else if (key & 1)
+            spooInsertHashMap(worker->map, &key, &key);
+        else
+            spooRemoveHashMap(worker->map, &key);
+
+        if (worker->lock)
+            spooUnlockMutex(worker->lock);
+    }
+}
+
+static void bench(int threadCount, int writePercent, int locked)
+{
+    int i;
+    double time;
+    Worker workers[MAX_THREADS];
+    SPOOthread threads[MAX_THREADS];
+    SPOOhashmap map = spooCreateHashMap(sizeof(int), sizeof(int), hash_int, equal_int, NULL);
+    SPOOmutex lock = locked ? spooCreateMutex() : NULL;
+
+    for (i = 0;  i < BENCH_KEYS;  i += 2)
+        spooInsertHashMap(map, &i, &i);
+
+    time = spooGetTime();
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        workers[i].map = map;
+        workers[i].lock = lock;
+        workers[i].seed = i + 1;
+        workers[i].writePercent = writePercent;
+        threads[i] = spooCreateThread(bench_function, workers + i);
+    }
+
+    for (i = 0;  i < threadCount;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    time = spooGetTime() - time;
+
+    printf("%s %2i%% writes, %2i threads: %.2f ns per operation\n",
+           locked ? "Locked map" : "Hash map  ",
+           writePercent, threadCount,
+           time * 1e9 / ((double) BENCH_OPS * threadCount));
+
+    spooDestroyMutex(lock);
+    spooDestroyHashMap(map);
+}
+
+int main(void)
+{
+    int i, threadCount, coreCount;
+    const int mixes[] = { 10, 50 };
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    single_thread_test();
+    concurrent_test();
+
+    coreCount = spooGetCPUCoreCount();
+    if (coreCount > MAX_THREADS)
+        coreCount = MAX_THREADS;
+
+    for (i = 0;  i < 2;  i++)
+    {
+        for (threadCount = 1;  ;  threadCount *= 2)
+        {
+            if (threadCount > coreCount)
+                threadCount = coreCount;
+
+            bench(threadCount, mixes[i], SPOO_FALSE);
+            bench(threadCount, mixes[i], SPOO_TRUE);
+
+            if (threadCount == coreCount)
+                break;
+        }
+    }
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,303 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It runs a lock-free stack that frees popped nodes through hazard pointers,
+// checks that every node is popped and reclaimed exactly once, and compares
+// it to a stack protected by a mutex
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(_MSC_VER)
+ #include <windows.h>
+ #define CAS_POINTER(p, e, d) (InterlockedCompareExchangePointer((PVOID volatile*) (p), (d), (e)) == (e))
+ #define CAS_LONG(p, e, d) (InterlockedCompareExchange((p), (d), (e)) == (e))
+#else
+ #define CAS_POINTER(p, e, d) __sync_bool_compare_and_swap((p), (e), (d))
+ #define CAS_LONG(p, e, d) __sync_bool_compare_and_swap((p), (e), (d))
+#endif
+
+#define OPERATIONS 200000
+#define MAX_THREADS 16
+#define EXIT_ROUNDS 200
+
+typedef struct Node
+{
+    struct Node* next;
+    long value;
+} Node;
+
+typedef struct
+{
+    Node* volatile top;
+    SPOOmutex lock;
+    SPOOhazarddomain domain;
+} Stack;
+
+typedef struct
+{
+    Stack* stack;
+    long first;
+    long sum;
+} Worker;
+
+static volatile long reclaimed = 0;
+static volatile long finished = 0;
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static void reclaim_node(void* pointer, void* arg)
+{
+    long count;
+
+    do
+        count = reclaimed;
+    while (!CAS_LONG(&reclaimed, count, count + 1));
+
+    free(pointer);
+}
+
+static void push(Stack* stack, long value)
+{
+    Node* top;
+    Node* node = (Node*) malloc(sizeof(Node));
+    if (!node)
+        fail("Failed to allocate node");
+
+    node->value = value;
+
+    if (stack->lock)
+    {
+        spooLockMutex(stack->lock);
+        node->next = stack->top;
+        stack->top = node;
+        spooUnlockMutex(stack->lock);
+        return;
+    }
+
+    do
+    {
+        top = stack->top;
+        node->next = top;
+    }
+    while (!CAS_POINTER(&stack->top, top, node));
+}
+
+static int pop(Stack* stack, long* value)
+{
+    Node* top;
+
+    if (stack->lock)
+    {
+        spooLockMutex(stack->lock);
+        top = stack->top;
+        if (top)
+            stack->top = top->next;
+        spooUnlockMutex(stack->lock);
+
+        if (!top)
+            return SPOO_FALSE;
+
+        *value = top->value;
+        free(top);
+        return SPOO_TRUE;
+    }
+
+    for (;;)
+    {
+        // The hazard pointer keeps the node from being freed, and so from
+        // being reused while its next pointer is read
+        top = (Node*) spooProtectHazard(stack->domain, 0, (void* volatile*) &stack->top);
+        if (!top)
+            return SPOO_FALSE;
+
+        if (CAS_POINTER(&stack->top, top, top->next))
+            break;
+    }
+
+    spooClearHazard(stack->domain, 0);
+
+    *value = top->value;
+    spooRetireHazard(stack->domain, top);
+    return SPOO_TRUE;
+}
+
+static void worker_function(void* arg)
+{
+    long i, value;
+    Worker* worker = (Worker*) arg;
+
+    for (i = 0;  i < OPERATIONS;  i++)
+    {
+        push(worker->stack, worker->first + i);
+
+        if (pop(worker->stack, &value))
+            worker->sum += value;
+    }
+}
+
+static void exiting_function(void* arg)
+{
+    long count, value;
+    Stack* stack = (Stack*) arg;
+
+    push(stack, 1);
+    pop(stack, &value);
+
+    do
+        count = finished;
+    while (!CAS_LONG(&finished, count, count + 1));
+}
+
+// Destroy domains while the threads that used them are still exiting, which
+// must neither lose nor reclaim twice what those threads retired
+//
+static void destroy_while_exiting(int threadCount)
+{
+    int i, round;
+    Stack stack;
+    SPOOthread threads[MAX_THREADS];
+
+    for (round = 0;  round < EXIT_ROUNDS;  round++)
+    {
+        reclaimed = 0;
+        finished = 0;
+
+        stack.top = NULL;
+        stack.lock = NULL;
+        stack.domain = spooCreateHazardDomain(reclaim_node, NULL);
+        if (!stack.domain)
+            fail("Failed to create hazard domain");
+
+        for (i = 0;  i < threadCount;  i++)
+            threads[i] = spooCreateThread(exiting_function, &stack);
+
+        while (finished < threadCount)
+            spooSleep(0.0);
+
+        spooDestroyHazardDomain(stack.domain);
+
+        for (i = 0;  i < threadCount;  i++)
+            spooWaitThread(threads[i], SPOO_WAIT);
+
+        if (reclaimed != threadCount)
+            fail("Destroying a domain of exiting threads lost nodes");
+    }
+}
+
+static double run(Stack* stack, int threadCount)
+{
+    int i;
+    long value, sum = 0, expected = 0;
+    double time;
+    Worker workers[MAX_THREADS];
+    SPOOthread threads[MAX_THREADS];
+
+    time = spooGetTime();
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        workers[i].stack = stack;
+        workers[i].first = (long) i * OPERATIONS;
+        workers[i].sum = 0;
+        threads[i] = spooCreateThread(worker_function, workers + i);
+    }
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        spooWaitThread(threads[i], SPOO_WAIT);
+        sum += workers[i].sum;
+    }
+
+    time = spooGetTime() - time;
+
+    while (pop(stack, &value))
+        sum += value;
+
+    for (i = 0;  i < threadCount * OPERATIONS;  i++)
+        expected += i;
+
+    if (sum != expected)
+        fail("Popped values do not match pushed values");
+
+    return time * 1e9 / ((double) threadCount * OPERATIONS * 2);
+}
+
+int main(void)
+{
+    int threadCount, maxThreads;
+    double lockFree, locked;
+    Stack stack;
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    maxThreads = spooGetCPUCoreCount() * 2;
+    if (maxThreads < 4)
+        maxThreads = 4;
+    if (maxThreads > MAX_THREADS)
+        maxThreads = MAX_THREADS;
+
+    for (threadCount = 1;  threadCount <= maxThreads;  threadCount *= 2)
+    {
+        reclaimed = 0;
+
+        stack.top = NULL;
+        stack.lock = NULL;
+        stack.domain = spooCreateHazardDomain(reclaim_node, NULL);
+        if (!stack.domain)
+            fail("Failed to create hazard domain");
+
+        lockFree = run(&stack, threadCount);
+
+        // The threads have left, so their records hold whatever was still
+        // retired and destroying the domain reclaims it
+        spooDestroyHazardDomain(stack.domain);
+
+        if (reclaimed != (long) threadCount * OPERATIONS)
+            fail("Not every popped node was reclaimed");
+
+        stack.lock = spooCreateMutex();
+        locked = run(&stack, threadCount);
+        spooDestroyMutex(stack.lock);
+
+        printf("%2i threads: lock-free %.2f ns, mutex %.2f ns per operation\n",
+               threadCount, lockFree, locked);
+    }
+
+    destroy_while_exiting(maxThreads);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,264 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It checks histogram percentiles against known distributions, records
+// timer differences from several threads, and compares the cost of that to
+// appending raw times to a shared array behind a mutex
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define VALUE_COUNT 100000
+#define RECORDS 1000000
+#define MERGES 1000
+#define MAX_THREADS 64
+
+typedef struct
+{
+    SPOOhistogram histogram;
+    SPOOmutex lock;
+    double* samples;
+    long* sampleCount;
+    long sampleCapacity;
+} Worker;
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static void check_percentile(SPOOhistogram histogram, double percentile,
+                             unsigned long long expected)
+{
+    const unsigned long long value = spooGetHistogramPercentile(histogram, percentile);
+
+    // Buckets are at most 1/64 of their values wide and report their top
+    if (value < expected || value > expected + expected / 64)
+    {
+        fprintf(stderr, "Percentile %.1f is %llu, expected %llu\n",
+                percentile, value, expected);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void accuracy_test(void)
+{
+    unsigned long long i;
+    SPOOhistogram histogram = spooCreateHistogram();
+    SPOOhistogram merged = spooCreateHistogram();
+    if (!histogram || !merged)
+        fail("Failed to create histogram");
+
+    if (spooGetHistogramPercentile(histogram, 50.0) != 0)
+        fail("Empty histogram has a percentile");
+
+    // Small values have a bucket each
+    for (i = 0;  i < 64;  i++)
+        spooRecordHistogram(histogram, i);
+
+    if (spooGetHistogramPercentile(histogram, 50.0) != 31 ||
+        spooGetHistogramPercentile(histogram, 100.0) != 63)
+    {
+        fail("Small values are not exact");
+    }
+
+    spooResetHistogram(histogram);
+    if (spooGetHistogramCount(histogram) != 0)
+        fail("Reset histogram is not empty");
+
+    for (i = 1;  i <= VALUE_COUNT;  i++)
+        spooRecordHistogram(histogram, i * 1000);
+
+    check_percentile(histogram, 0.0, 1000);
+    check_percentile(histogram, 50.0, VALUE_COUNT / 2 * 1000);
+    check_percentile(histogram, 99.0, VALUE_COUNT / 100 * 99 * 1000);
+    check_percentile(histogram, 99.9, VALUE_COUNT / 1000 * 999 * 1000);
+    check_percentile(histogram, 100.0, VALUE_COUNT * 1000);
+
+    // Huge values are clamped instead of lost
+    spooRecordHistogram(histogram, ~0ull);
+    if (spooGetHistogramCount(histogram) != VALUE_COUNT + 1)
+        fail("Huge value was not recorded");
+
+    spooMergeHistogram(merged, histogram);
+    spooMergeHistogram(merged, histogram);
+    if (spooGetHistogramCount(merged) != 2 * (VALUE_COUNT + 1))
+        fail("Merged histogram has the wrong count");
+
+    check_percentile(merged, 50.0, VALUE_COUNT / 2 * 1000);
+
+    spooDestroyHistogram(merged);
+    spooDestroyHistogram(histogram);
+}
+
+static void histogram_function(void* arg)
+{
+    int i;
+    unsigned long long start;
+    Worker* worker = (Worker*) arg;
+
+    for (i = 0;  i < RECORDS;  i++)
+    {
+        start = spooGetTimerValue();
+        spooRecordHistogram(worker->histogram, spooGetTimerValue() - start);
+    }
+}
+
+static void array_function(void* arg)
+{
+    int i;
+    double start, time;
+    Worker* worker = (Worker*) arg;
+
+    for (i = 0;  i < RECORDS;  i++)
+    {
+        start = spooGetTime();
+        time = spooGetTime() - start;
+
+        spooLockMutex(worker->lock);
+
+        if (*worker->sampleCount < worker->sampleCapacity)
+            worker->samples[(*worker->sampleCount)++] = time;
+
+        spooUnlockMutex(worker->lock);
+    }
+}
+
+static double run(SPOOthreadfun function, Worker* workers, int threadCount)
+{
+    int i;
+    double time;
+    SPOOthread threads[MAX_THREADS];
+
+    time = spooGetTime();
+
+    for (i = 0;  i < threadCount;  i++)
+        threads[i] = spooCreateThread(function, workers + i);
+
+    for (i = 0;  i < threadCount;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    time = spooGetTime() - time;
+    return time * 1e9 / ((double) threadCount * RECORDS);
+}
+
+int main(void)
+{
+    int i, threadCount, maxThreads;
+    long sampleCount;
+    double histogramTime, arrayTime, time;
+    Worker workers[MAX_THREADS];
+    SPOOhistogram histogram, merged;
+    SPOOmutex lock;
+    double* samples;
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    if (spooGetTimerFrequency() == 0)
+        fail("Timer has no frequency");
+
+    accuracy_test();
+
+    maxThreads = spooGetCPUCoreCount();
+    if (maxThreads < 4)
+        maxThreads = 4;
+    if (maxThreads > MAX_THREADS)
+        maxThreads = MAX_THREADS;
+
+    samples = (double*) malloc(sizeof(double) * RECORDS * maxThreads);
+    lock = spooCreateMutex();
+    if (!samples || !lock)
+        fail("Failed to allocate sample array");
+
+    for (threadCount = 1;  ;  threadCount *= 2)
+    {
+        if (threadCount > maxThreads)
+            threadCount = maxThreads;
+
+        histogram = spooCreateHistogram();
+        sampleCount = 0;
+
+        for (i = 0;  i < threadCount;  i++)
+        {
+            workers[i].histogram = histogram;
+            workers[i].lock = lock;
+            workers[i].samples = samples;
+            workers[i].sampleCount = &sampleCount;
+            workers[i].sampleCapacity = (long) RECORDS * maxThreads;
+        }
+
+        histogramTime = run(histogram_function, workers, threadCount);
+        arrayTime = run(array_function, workers, threadCount);
+
+        if (spooGetHistogramCount(histogram) != (unsigned long long) threadCount * RECORDS)
+            fail("Histogram lost records");
+        if (sampleCount != (long) threadCount * RECORDS)
+            fail("Sample array lost records");
+
+        printf("%2i threads: histogram %.2f ns, locked array %.2f ns per record, "
+               "median %llu ticks\n",
+               threadCount, histogramTime, arrayTime,
+               spooGetHistogramPercentile(histogram, 50.0));
+
+        if (threadCount == maxThreads)
+        {
+            merged = spooCreateHistogram();
+
+            time = spooGetTime();
+            for (i = 0;  i < MERGES;  i++)
+                spooMergeHistogram(merged, histogram);
+            time = spooGetTime() - time;
+
+            printf("Merge: %.2f us, ", time * 1e6 / MERGES);
+
+            time = spooGetTime();
+            for (i = 0;  i < MERGES;  i++)
+                spooGetHistogramPercentile(merged, 99.0);
+            time = spooGetTime() - time;
+
+            printf("99th percentile query: %.2f us\n", time * 1e6 / MERGES);
+
+            spooDestroyHistogram(merged);
+        }
+
+        spooDestroyHistogram(histogram);
+
+        if (threadCount == maxThreads)
+            break;
+    }
+
+    spooDestroyMutex(lock);
+    free(samples);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,101 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It contends for one mutex from several threads and prints the mutex
+// contention statistics (requires building with SPOO_MUTEX_PROFILING)
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define THREAD_COUNT 4
+#define ITERATIONS 100000
+
+static SPOOmutex hot;
+static SPOOmutex cold;
+static volatile long counter = 0;
+
+static void thread_function(void* arg)
+{
+    int i, j;
+
+    for (i = 0;  i < ITERATIONS;  i++)
+    {
+        spooLockMutex(hot);
+
+        for (j = 0;  j < 10;  j++)
+            counter++;
+
+        spooUnlockMutex(hot);
+    }
+
+    spooLockMutex(cold);
+    counter++;
+    spooUnlockMutex(cold);
+}
+
+int main(void)
+{
+    int i, count;
+    SPOOthread threads[THREAD_COUNT];
+    SPOOmutexstats stats;
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    hot = spooCreateMutex();
+    spooSetMutexName(hot, "hot");
+
+    cold = spooCreateMutex();
+    spooSetMutexName(cold, "cold");
+
+    for (i = 0;  i < THREAD_COUNT;  i++)
+        threads[i] = spooCreateThread(thread_function, NULL);
+
+    for (i = 0;  i < THREAD_COUNT;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    count = spooGetMutexStats(&stats, 1);
+    if (count == 0)
+        printf("Mutex profiling is not available\n");
+    else
+    {
+        printf("Most contended mutex is %s\n", stats.name);
+        spooDumpMutexStats(NULL);
+    }
+
+    spooDestroyMutex(hot);
+    spooDestroyMutex(cold);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
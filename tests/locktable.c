@@ -0,0 +1,257 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It moves money between many accounts from several threads, protecting
+// the accounts with a striped lock table and with one mutex each, and
+// compares the memory used and the time taken
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ACCOUNTS (1 << 20)
+#define TRANSFERS 500000
+#define BALANCE 100
+#define MAX_THREADS 64
+
+typedef struct
+{
+    int index;
+    SPOOlocktable table;
+} Worker;
+
+static long balances[ACCOUNTS];
+static SPOOmutex mutexes[ACCOUNTS];
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+// Return the resident memory of the process in bytes, where known
+static long get_resident_memory(void)
+{
+#if defined(__linux__)
+    long size, resident = 0;
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+
+    if (fscanf(file, "%li %li", &size, &resident) != 2)
+        resident = 0;
+
+    fclose(file);
+    return resident * 4096;
+#else
+    return 0;
+#endif
+}
+
+static unsigned int next_random(unsigned int* state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+static void transfer(int from, int to)
+{
+    if (balances[from] > 0)
+    {
+        balances[from]--;
+        balances[to]++;
+    }
+}
+
+static void table_function(void* arg)
+{
+    int i;
+    size_t keys[2];
+    Worker* worker = (Worker*) arg;
+    unsigned int state = worker->index + 1;
+
+    for (i = 0;  i < TRANSFERS;  i++)
+    {
+        keys[0] = next_random(&state) % ACCOUNTS;
+        keys[1] = next_random(&state) % ACCOUNTS;
+
+        if (!spooLockTableKeys(worker->table, keys, 2))
+            fail("Failed to lock keys");
+
+        transfer((int) keys[0], (int) keys[1]);
+        spooUnlockTableKeys(worker->table, keys, 2);
+    }
+}
+
+static void mutex_function(void* arg)
+{
+    int i, from, to;
+    Worker* worker = (Worker*) arg;
+    unsigned int state = worker->index + 1;
+
+    for (i = 0;  i < TRANSFERS;  i++)
+    {
+        from = next_random(&state) % ACCOUNTS;
+        to = next_random(&state) % ACCOUNTS;
+
+        // Lock in index order to avoid deadlock
+        spooLockMutex(mutexes[from < to ? from : to]);
+        if (from != to)
+            spooLockMutex(mutexes[from < to ? to : from]);
+
+        transfer(from, to);
+
+        if (from != to)
+            spooUnlockMutex(mutexes[to]);
+        spooUnlockMutex(mutexes[from]);
+    }
+}
+
+static void check_duplicates(SPOOlocktable table)
+{
+    size_t keys[3] = { 7, 42, 7 };
+
+    // Keys repeated in a set must not lock their stripe twice
+    if (!spooLockTableKeys(table, keys, 3))
+        fail("Failed to lock keys");
+    spooUnlockTableKeys(table, keys, 3);
+
+    spooLockTableKey(table, 7);
+    spooUnlockTableKey(table, 7);
+}
+
+static double run(SPOOthreadfun function, Worker* workers, int threadCount)
+{
+    int i;
+    long long total = 0;
+    double time;
+    SPOOthread threads[MAX_THREADS];
+
+    for (i = 0;  i < ACCOUNTS;  i++)
+        balances[i] = BALANCE;
+
+    time = spooGetTime();
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        threads[i] = spooCreateThread(function, workers + i);
+        if (!threads[i])
+            fail("Failed to create thread");
+    }
+
+    for (i = 0;  i < threadCount;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    time = spooGetTime() - time;
+
+    for (i = 0;  i < ACCOUNTS;  i++)
+    {
+        if (balances[i] < 0)
+            fail("Account balance went negative");
+
+        total += balances[i];
+    }
+
+    if (total != (long long) ACCOUNTS * BALANCE)
+        fail("Money was created or destroyed");
+
+    return time * 1e9 / ((double) threadCount * TRANSFERS);
+}
+
+int main(void)
+{
+    int i, threadCount, maxThreads;
+    long before, tableMemory, mutexMemory;
+    double striped, separate;
+    SPOOlocktable table;
+    Worker workers[MAX_THREADS];
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    table = spooCreateLockTable(0);
+    if (!table)
+        fail("Failed to create lock table");
+
+    check_duplicates(table);
+
+    tableMemory = (long) spooGetLockTableMemory(table);
+
+    before = get_resident_memory();
+
+    for (i = 0;  i < ACCOUNTS;  i++)
+    {
+        mutexes[i] = spooCreateMutex();
+        if (!mutexes[i])
+            fail("Failed to create mutex");
+    }
+
+    mutexMemory = get_resident_memory() - before;
+
+    printf("%i accounts: lock table %li bytes, one mutex each ", ACCOUNTS, tableMemory);
+    if (mutexMemory > 0)
+        printf("%li bytes\n", mutexMemory);
+    else
+        printf("%i allocations\n", ACCOUNTS);
+
+    for (i = 0;  i < MAX_THREADS;  i++)
+    {
+        workers[i].index = i;
+        workers[i].table = table;
+    }
+
+    maxThreads = spooGetCPUCoreCount();
+    if (maxThreads < 4)
+        maxThreads = 4;
+    if (maxThreads > MAX_THREADS)
+        maxThreads = MAX_THREADS;
+
+    for (threadCount = 1;  ;  threadCount *= 2)
+    {
+        if (threadCount > maxThreads)
+            threadCount = maxThreads;
+
+        striped = run(table_function, workers, threadCount);
+        separate = run(mutex_function, workers, threadCount);
+
+        printf("%2i threads: lock table %.1f ns, one mutex each %.1f ns per transfer\n",
+               threadCount, striped, separate);
+
+        if (threadCount == maxThreads)
+            break;
+    }
+
+    for (i = 0;  i < ACCOUNTS;  i++)
+        spooDestroyMutex(mutexes[i]);
+
+    spooDestroyLockTable(table);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
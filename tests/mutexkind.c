@@ -0,0 +1,217 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It compares the throughput and per-thread fairness of ticket and MCS lock
+// mutexes to that of the default mutex, with many threads contending
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DURATION 0.5
+#define MAX_THREADS 64
+
+typedef struct
+{
+    SPOOmutex mutex;
+    SPOOcond cond;
+    long acquisitions;
+} Worker;
+
+static const int kinds[] = { SPOO_MUTEX_DEFAULT, SPOO_MUTEX_TICKET, SPOO_MUTEX_MCS };
+static const char* kindNames[] = { "default", "ticket", "MCS" };
+
+static volatile int running;
+static volatile int signaled;
+static long shared;
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static void lock_function(void* arg)
+{
+    Worker* worker = (Worker*) arg;
+
+    while (running)
+    {
+        spooLockMutex(worker->mutex);
+        shared++;
+        worker->acquisitions++;
+        spooUnlockMutex(worker->mutex);
+    }
+}
+
+static void wait_function(void* arg)
+{
+    Worker* worker = (Worker*) arg;
+
+    spooLockMutex(worker->mutex);
+
+    while (!signaled)
+        spooWaitCond(worker->cond, worker->mutex, 1.0);
+
+    worker->acquisitions++;
+    spooUnlockMutex(worker->mutex);
+}
+
+static void check_cond(int kind)
+{
+    Worker worker;
+    SPOOthread thread;
+
+    worker.mutex = spooCreateMutexKind(kind);
+    worker.cond = spooCreateCond();
+    worker.acquisitions = 0;
+    if (!worker.mutex || !worker.cond)
+        fail("Failed to create mutex or condition");
+
+    // A timed out wait must return with the mutex locked
+    spooLockMutex(worker.mutex);
+    spooWaitCond(worker.cond, worker.mutex, 0.01);
+    spooUnlockMutex(worker.mutex);
+
+    signaled = 0;
+
+    thread = spooCreateThread(wait_function, &worker);
+    if (!thread)
+        fail("Failed to create thread");
+
+    spooSleep(0.05);
+
+    spooLockMutex(worker.mutex);
+    signaled = 1;
+    spooSignalCond(worker.cond);
+    spooUnlockMutex(worker.mutex);
+
+    spooWaitThread(thread, SPOO_WAIT);
+
+    if (worker.acquisitions != 1)
+        fail("Condition wait did not complete");
+
+    spooDestroyCond(worker.cond);
+    spooDestroyMutex(worker.mutex);
+}
+
+static void run(int kind, int threadCount)
+{
+    int i;
+    long least, most, total = 0;
+    double time;
+    SPOOmutex mutex;
+    SPOOthread threads[MAX_THREADS];
+    Worker workers[MAX_THREADS];
+
+    mutex = spooCreateMutexKind(kind);
+    if (!mutex)
+        fail("Failed to create mutex");
+
+    shared = 0;
+    running = 1;
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        workers[i].mutex = mutex;
+        workers[i].acquisitions = 0;
+    }
+
+    time = spooGetTime();
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        threads[i] = spooCreateThread(lock_function, workers + i);
+        if (!threads[i])
+            fail("Failed to create thread");
+    }
+
+    spooSleep(DURATION);
+    running = 0;
+
+    for (i = 0;  i < threadCount;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    time = spooGetTime() - time;
+
+    least = most = workers[0].acquisitions;
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        if (workers[i].acquisitions < least)
+            least = workers[i].acquisitions;
+        if (workers[i].acquisitions > most)
+            most = workers[i].acquisitions;
+
+        total += workers[i].acquisitions;
+    }
+
+    if (total != shared)
+        fail("Mutex did not provide mutual exclusion");
+
+    // The fairness is the ratio of the least to the most acquisitions made
+    // by any one thread, where 1.0 means all threads got equal turns
+    printf("%2i threads %-8s %8.2f Mlocks/s, fairness %.3f\n",
+           threadCount, kindNames[kind], total / time / 1e6,
+           most ? (double) least / most : 0.0);
+
+    spooDestroyMutex(mutex);
+}
+
+int main(void)
+{
+    int i, threadCount, maxThreads;
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    for (i = 0;  i < 3;  i++)
+        check_cond(kinds[i]);
+
+    maxThreads = spooGetCPUCoreCount() * 4;
+    if (maxThreads < 16)
+        maxThreads = 16;
+    if (maxThreads > MAX_THREADS)
+        maxThreads = MAX_THREADS;
+
+    for (threadCount = 1;  ;  threadCount *= 4)
+    {
+        if (threadCount > maxThreads)
+            threadCount = maxThreads;
+
+        for (i = 0;  i < 3;  i++)
+            run(kinds[i], threadCount);
+
+        if (threadCount == maxThreads)
+            break;
+    }
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,259 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It compares parallel sums, histograms and prefix sums to single-threaded
+// loops and checks that the results do not depend on the thread count
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COUNT (16 * 1024 * 1024)
+#define RUNS 10
+#define BINS 256
+
+static double* values;
+static unsigned char* bytes;
+static long long* integers;
+static long long* sums;
+
+static void sum_range(void* partial, size_t first, size_t count, void* arg)
+{
+    size_t i;
+    double sum = *(double*) partial;
+
+    for (i = first;  i < first + count;  i++)
+        sum += values[i];
+
+    *(double*) partial = sum;
+}
+
+static void add_double(void* result, const void* value, void* arg)
+{
+    *(double*) result += *(const double*) value;
+}
+
+static void count_range(void* partial, size_t first, size_t count, void* arg)
+{
+    size_t i;
+    long* bins = (long*) partial;
+
+    for (i = first;  i < first + count;  i++)
+        bins[bytes[i]]++;
+}
+
+static void add_bins(void* result, const void* value, void* arg)
+{
+    int i;
+
+    for (i = 0;  i < BINS;  i++)
+        ((long*) result)[i] += ((const long*) value)[i];
+}
+
+static void add_integer(void* result, const void* value, void* arg)
+{
+    *(long long*) result += *(const long long*) value;
+}
+
+static double parallel_sum(SPOOpool pool)
+{
+    double sum = 0.0;
+
+    if (!spooParallelReduce(pool, COUNT, &sum, sizeof(sum),
+                            sum_range, add_double, NULL))
+    {
+        fprintf(stderr, "Failed to reduce\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return sum;
+}
+
+static void parallel_scan(SPOOpool pool, const void* input, void* output, int flags)
+{
+    const long long zero = 0;
+
+    if (!spooParallelScan(pool, input, output, COUNT, sizeof(long long),
+                          &zero, add_integer, NULL, flags))
+    {
+        fprintf(stderr, "Failed to scan\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void check_scan(const char* name, int exclusive)
+{
+    size_t i;
+    long long sum = 0;
+
+    for (i = 0;  i < COUNT;  i++)
+    {
+        if (!exclusive)
+            sum += integers[i];
+
+        if (sums[i] != sum)
+        {
+            fprintf(stderr, "%s scan is wrong at %lu\n", name, (unsigned long) i);
+            exit(EXIT_FAILURE);
+        }
+
+        if (exclusive)
+            sum += integers[i];
+    }
+}
+
+int main(void)
+{
+    int i;
+    size_t j;
+    double time, sum, serial;
+    long bins[BINS], serialBins[BINS];
+    SPOOpool pool, single;
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pool = spooCreatePool(0);
+    single = spooCreatePool(1);
+    if (!pool || !single)
+    {
+        fprintf(stderr, "Failed to create pools\n");
+        exit(EXIT_FAILURE);
+    }
+
+    values = (double*) malloc(COUNT * sizeof(double));
+    bytes = (unsigned char*) malloc(COUNT);
+    integers = (long long*) malloc(COUNT * sizeof(long long));
+    sums = (long long*) malloc(COUNT * sizeof(long long));
+
+    srand(1);
+
+    for (j = 0;  j < COUNT;  j++)
+    {
+        values[j] = rand() / (double) RAND_MAX;
+        bytes[j] = (unsigned char) rand();
+        integers[j] = rand() % 1000;
+    }
+
+    printf("%i elements on %i threads\n", COUNT, spooGetPoolThreadCount(pool));
+
+    // Floating point sums must not depend on the thread count
+    time = spooGetTime();
+    for (i = 0;  i < RUNS;  i++)
+    {
+        serial = 0.0;
+        sum_range(&serial, 0, COUNT, NULL);
+    }
+    printf("Serial sum: %.2f ms\n", (spooGetTime() - time) * 1e3 / RUNS);
+
+    time = spooGetTime();
+    for (i = 0;  i < RUNS;  i++)
+        sum = parallel_sum(pool);
+    printf("Parallel sum: %.2f ms\n", (spooGetTime() - time) * 1e3 / RUNS);
+
+    if (sum != parallel_sum(single) || sum != parallel_sum(pool))
+    {
+        fprintf(stderr, "Parallel sum depends on the thread count\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (sum < serial * 0.999999 || sum > serial * 1.000001)
+    {
+        fprintf(stderr, "Parallel sum is %f, expected %f\n", sum, serial);
+        exit(EXIT_FAILURE);
+    }
+
+    // Histograms
+    time = spooGetTime();
+    for (i = 0;  i < RUNS;  i++)
+    {
+        memset(serialBins, 0, sizeof(serialBins));
+        count_range(serialBins, 0, COUNT, NULL);
+    }
+    printf("Serial histogram: %.2f ms\n", (spooGetTime() - time) * 1e3 / RUNS);
+
+    time = spooGetTime();
+    for (i = 0;  i < RUNS;  i++)
+    {
+        memset(bins, 0, sizeof(bins));
+        spooParallelReduce(pool, COUNT, bins, sizeof(bins),
+                           count_range, add_bins, NULL);
+    }
+    printf("Parallel histogram: %.2f ms\n", (spooGetTime() - time) * 1e3 / RUNS);
+
+    if (memcmp(bins, serialBins, sizeof(bins)) != 0)
+    {
+        fprintf(stderr, "Parallel histogram is wrong\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Prefix sums
+    time = spooGetTime();
+    for (i = 0;  i < RUNS;  i++)
+    {
+        long long total = 0;
+
+        for (j = 0;  j < COUNT;  j++)
+        {
+            total += integers[j];
+            sums[j] = total;
+        }
+    }
+    printf("Serial inclusive scan: %.2f ms\n", (spooGetTime() - time) * 1e3 / RUNS);
+
+    time = spooGetTime();
+    for (i = 0;  i < RUNS;  i++)
+        parallel_scan(pool, integers, sums, SPOO_SCAN_INCLUSIVE);
+    printf("Parallel inclusive scan: %.2f ms\n", (spooGetTime() - time) * 1e3 / RUNS);
+
+    check_scan("Inclusive", 0);
+
+    parallel_scan(pool, integers, sums, SPOO_SCAN_EXCLUSIVE);
+    check_scan("Exclusive", 1);
+
+    // In place, on a copy of the input
+    memcpy(sums, integers, COUNT * sizeof(long long));
+    parallel_scan(pool, sums, sums, SPOO_SCAN_EXCLUSIVE);
+    check_scan("In-place exclusive", 1);
+
+    free(sums);
+    free(integers);
+    free(bytes);
+    free(values);
+
+    spooDestroyPool(single);
+    spooDestroyPool(pool);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
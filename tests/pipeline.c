@@ -0,0 +1,211 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It runs a synthetic read, compute, filter and write pipeline with
+// different token counts, checking ordering and the bound on items in flight
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ITEM_COUNT 20000
+#define WORK 2000
+#define DROP_INTERVAL 10
+
+typedef struct Item
+{
+    int index;
+    unsigned long long value;
+} Item;
+
+static SPOOmutex mutex;
+static int nextIndex;
+static int lastIndex;
+static int inFlight;
+static int maxInFlight;
+static unsigned long long total;
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static void* read_item(void* unused, void* arg)
+{
+    Item* item;
+
+    if (nextIndex == ITEM_COUNT)
+        return NULL;
+
+    item = (Item*) malloc(sizeof(Item));
+    item->index = nextIndex++;
+
+    spooLockMutex(mutex);
+    inFlight++;
+    if (inFlight > maxInFlight)
+        maxInFlight = inFlight;
+    spooUnlockMutex(mutex);
+
+    return item;
+}
+
+static void* compute_item(void* data, void* arg)
+{
+    int i;
+    Item* item = (Item*) data;
+    unsigned long long value = item->index;
+
+    for (i = 0;  i < WORK;  i++)
+        value = value * 6364136223846793005ull + 1442695040888963407ull;
+
+    item->value = value;
+    return item;
+}
+
+static void retire_item(Item* item)
+{
+    spooLockMutex(mutex);
+    inFlight--;
+    spooUnlockMutex(mutex);
+
+    free(item);
+}
+
+static void* filter_item(void* data, void* arg)
+{
+    Item* item = (Item*) data;
+
+    if (item->index % DROP_INTERVAL == 0)
+    {
+        retire_item(item);
+        return NULL;
+    }
+
+    return item;
+}
+
+static void* write_item(void* data, void* arg)
+{
+    Item* item = (Item*) data;
+
+    if (item->index <= lastIndex)
+        fail("Serial in-order stage ran out of order");
+
+    lastIndex = item->index;
+    total += item->value;
+
+    retire_item(item);
+    return NULL;
+}
+
+static void run_serial(void)
+{
+    double time;
+    Item* item;
+
+    nextIndex = 0;
+    lastIndex = -1;
+    total = 0;
+
+    time = spooGetTime();
+
+    while ((item = (Item*) read_item(NULL, NULL)))
+    {
+        if (filter_item(compute_item(item, NULL), NULL))
+            write_item(item, NULL);
+    }
+
+    time = spooGetTime() - time;
+    printf("Serial loop: %.0f items/s\n", ITEM_COUNT / time);
+}
+
+static void run_pipeline(SPOOpipeline pipeline, int tokenCount,
+                         unsigned long long expected)
+{
+    double time;
+
+    nextIndex = 0;
+    lastIndex = -1;
+    total = 0;
+    maxInFlight = 0;
+
+    time = spooGetTime();
+
+    if (!spooRunPipeline(pipeline, tokenCount))
+        fail("Failed to run pipeline");
+
+    time = spooGetTime() - time;
+    printf("Pipeline with %i tokens: %.0f items/s, at most %i in flight\n",
+           tokenCount, ITEM_COUNT / time, maxInFlight);
+
+    if (maxInFlight > tokenCount)
+        fail("Too many items in flight");
+
+    if (inFlight != 0 || total != expected)
+        fail("Pipeline lost items");
+}
+
+int main(void)
+{
+    int tokenCount;
+    unsigned long long expected;
+    SPOOpool pool;
+    SPOOpipeline pipeline;
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    mutex = spooCreateMutex();
+    pool = spooCreatePool(0);
+    pipeline = spooCreatePipeline(pool);
+
+    if (!spooAddPipelineStage(pipeline, SPOO_STAGE_SERIAL_IN_ORDER, read_item, NULL) ||
+        !spooAddPipelineStage(pipeline, SPOO_STAGE_PARALLEL, compute_item, NULL) ||
+        !spooAddPipelineStage(pipeline, SPOO_STAGE_SERIAL_OUT_OF_ORDER, filter_item, NULL) ||
+        !spooAddPipelineStage(pipeline, SPOO_STAGE_SERIAL_IN_ORDER, write_item, NULL))
+    {
+        fail("Failed to create pipeline");
+    }
+
+    printf("%i items on %i threads\n", ITEM_COUNT, spooGetPoolThreadCount(pool));
+
+    run_serial();
+    expected = total;
+
+    for (tokenCount = 1;  tokenCount <= 64;  tokenCount *= 4)
+        run_pipeline(pipeline, tokenCount, expected);
+
+    spooDestroyPipeline(pipeline);
+    spooDestroyPool(pool);
+    spooDestroyMutex(mutex);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,211 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It measures the throughput of pipes whose read ends are watched by the
+// I/O reactor and drained by pool workers, without needing a network
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if defined(__linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PIPE_COUNT 64
+#define BLOCK_SIZE 4096
+#define BLOCKS_PER_PIPE 1024
+#define WRITER_COUNT 4
+
+typedef struct
+{
+    int fds[2];
+    long received;
+    SPOOwatch watch;
+} Pipe;
+
+static Pipe pipes[PIPE_COUNT];
+static SPOOmutex mutex;
+static SPOOcond cond;
+static long total = 0;
+static long callbacks = 0;
+
+static void read_pipe(int fd, int events, void* arg)
+{
+    Pipe* entry = (Pipe*) arg;
+    char buffer[BLOCK_SIZE * 4];
+    ssize_t size;
+    long received = 0;
+
+    // Watches are edge-triggered, so drain everything available
+    for (;;)
+    {
+        size = read(fd, buffer, sizeof(buffer));
+        if (size > 0)
+        {
+            received += size;
+            continue;
+        }
+
+        if (size < 0 && errno == EINTR)
+            continue;
+
+        break;
+    }
+
+    entry->received += received;
+
+    spooLockMutex(mutex);
+    total += received;
+    callbacks++;
+    spooSignalCond(cond);
+    spooUnlockMutex(mutex);
+}
+
+static void write_pipes(void* arg)
+{
+    int i, j;
+    char buffer[BLOCK_SIZE] = { 0 };
+    int first = (int) (size_t) arg;
+
+    for (i = 0;  i < BLOCKS_PER_PIPE;  i++)
+    {
+        for (j = first;  j < PIPE_COUNT;  j += WRITER_COUNT)
+        {
+            if (write(pipes[j].fds[1], buffer, sizeof(buffer)) != sizeof(buffer))
+            {
+                fprintf(stderr, "Failed to write to pipe\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    int i;
+    double time;
+    long expected = (long) PIPE_COUNT * BLOCKS_PER_PIPE * BLOCK_SIZE;
+    SPOOpool pool;
+    SPOOreactor reactor;
+    SPOOthread writers[WRITER_COUNT];
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mutex = spooCreateMutex();
+    cond = spooCreateCond();
+
+    pool = spooCreatePool(4);
+    reactor = spooCreateReactor(pool, 0);
+    if (!reactor)
+    {
+        fprintf(stderr, "Failed to create reactor\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0;  i < PIPE_COUNT;  i++)
+    {
+        if (pipe(pipes[i].fds) != 0)
+        {
+            fprintf(stderr, "Failed to create pipe\n");
+            exit(EXIT_FAILURE);
+        }
+
+        fcntl(pipes[i].fds[0], F_SETFL, O_NONBLOCK);
+
+        pipes[i].watch = spooAddWatch(reactor, pipes[i].fds[0], SPOO_IO_READ,
+                                      read_pipe, pipes + i);
+        if (!pipes[i].watch)
+        {
+            fprintf(stderr, "Failed to watch pipe\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    time = spooGetTime();
+
+    for (i = 0;  i < WRITER_COUNT;  i++)
+        writers[i] = spooCreateThread(write_pipes, (void*) (size_t) i);
+
+    spooLockMutex(mutex);
+    while (total < expected)
+        spooWaitCond(cond, mutex, SPOO_INFINITY);
+    spooUnlockMutex(mutex);
+
+    time = spooGetTime() - time;
+
+    for (i = 0;  i < WRITER_COUNT;  i++)
+        spooWaitThread(writers[i], SPOO_WAIT);
+
+    printf("%i pipes: %.1f MB/s, %.1f KB per callback\n",
+           PIPE_COUNT, expected / time / 1e6,
+           expected / (double) callbacks / 1e3);
+
+    for (i = 0;  i < PIPE_COUNT;  i++)
+    {
+        spooRemoveWatch(pipes[i].watch);
+        close(pipes[i].fds[0]);
+        close(pipes[i].fds[1]);
+    }
+
+    spooDestroyReactor(reactor);
+    spooDestroyPool(pool);
+
+    spooDestroyCond(cond);
+    spooDestroyMutex(mutex);
+
+    spooTerminate();
+
+    for (i = 0;  i < PIPE_COUNT;  i++)
+    {
+        if (pipes[i].received != (long) BLOCKS_PER_PIPE * BLOCK_SIZE)
+        {
+            fprintf(stderr, "Pipe %i received %li bytes\n", i, pipes[i].received);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    exit(EXIT_SUCCESS);
+}
+
+#else /*__linux__*/
+
+int main(void)
+{
+    printf("The I/O reactor is not available on this platform\n");
+    exit(EXIT_SUCCESS);
+}
+
+#endif /*__linux__*/
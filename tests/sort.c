@@ -0,0 +1,178 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It compares parallel comparison and radix sorts to qsort across array
+// sizes and thread counts, and checks that the results are sorted
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_COUNT (4 * 1024 * 1024)
+
+typedef struct Record
+{
+    unsigned long long key;
+    unsigned long long index;
+} Record;
+
+static Record* input;
+static Record* records;
+
+static int compare_records(const void* a, const void* b)
+{
+    const Record* ra = (const Record*) a;
+    const Record* rb = (const Record*) b;
+
+    if (ra->key < rb->key)
+        return -1;
+    if (ra->key > rb->key)
+        return 1;
+
+    return 0;
+}
+
+static unsigned long long get_key(const void* element, void* arg)
+{
+    return ((const Record*) element)->key;
+}
+
+static void fill(size_t count)
+{
+    size_t i;
+
+    srand(1);
+
+    for (i = 0;  i < count;  i++)
+    {
+        // Keys with few distinct upper bits and plenty of duplicates
+        input[i].key = ((unsigned long long) rand() << 8) ^ (rand() & 0xff);
+        input[i].key %= count / 2 + 1;
+        input[i].index = i;
+    }
+}
+
+static void check(const char* name, size_t count, int stable)
+{
+    size_t i;
+    unsigned long long sum = 0;
+
+    for (i = 0;  i < count;  i++)
+    {
+        sum += records[i].index;
+
+        if (i == 0)
+            continue;
+
+        if (records[i - 1].key > records[i].key ||
+            (stable && records[i - 1].key == records[i].key &&
+                       records[i - 1].index > records[i].index))
+        {
+            fprintf(stderr, "%s sort is wrong at %lu\n", name, (unsigned long) i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (sum != (unsigned long long) count * (count - 1) / 2)
+    {
+        fprintf(stderr, "%s sort lost elements\n", name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int main(void)
+{
+    int i;
+    size_t count;
+    double time;
+    const int threadCounts[] = { 1, 2, 4 };
+    const size_t counts[] = { 64 * 1024, 1024 * 1024, MAX_COUNT };
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    input = (Record*) malloc(MAX_COUNT * sizeof(Record));
+    records = (Record*) malloc(MAX_COUNT * sizeof(Record));
+
+    for (count = 0;  count < sizeof(counts) / sizeof(counts[0]);  count++)
+    {
+        const size_t size = counts[count];
+
+        fill(size);
+
+        memcpy(records, input, size * sizeof(Record));
+        time = spooGetTime();
+        qsort(records, size, sizeof(Record), compare_records);
+        printf("%lu records, qsort: %.2f ms\n",
+               (unsigned long) size, (spooGetTime() - time) * 1e3);
+        check("qsort", size, 0);
+
+        for (i = 0;  i < (int) (sizeof(threadCounts) / sizeof(threadCounts[0]));  i++)
+        {
+            SPOOpool pool = spooCreatePool(threadCounts[i]);
+
+            memcpy(records, input, size * sizeof(Record));
+            time = spooGetTime();
+            spooParallelSort(pool, records, size, sizeof(Record), compare_records);
+            printf("%lu records, %i threads, merge: %.2f ms\n",
+                   (unsigned long) size, threadCounts[i],
+                   (spooGetTime() - time) * 1e3);
+            check("Parallel", size, 0);
+
+            memcpy(records, input, size * sizeof(Record));
+            time = spooGetTime();
+            spooParallelRadixSort(pool, records, size, sizeof(Record), get_key, NULL);
+            printf("%lu records, %i threads, radix: %.2f ms\n",
+                   (unsigned long) size, threadCounts[i],
+                   (spooGetTime() - time) * 1e3);
+            check("Radix", size, 1);
+
+            spooDestroyPool(pool);
+        }
+    }
+
+    // Arrays smaller than a block and odd element sizes
+    for (count = 0;  count < 3000;  count += 37)
+    {
+        fill(count);
+        memcpy(records, input, count * sizeof(Record));
+        spooParallelSort(NULL, records, count, sizeof(Record), compare_records);
+        check("Small", count, 0);
+    }
+
+    free(records);
+    free(input);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
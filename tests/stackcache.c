@@ -0,0 +1,173 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It creates and waits for many short-lived threads that each use some of
+// their stack, with and without the thread stack cache
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define THREADS 2000
+#define BATCH 8
+#define STACK_SIZE (1024 * 1024)
+#define STACK_USE (256 * 1024)
+
+static volatile long finished;
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static void thread_function(void* arg)
+{
+    volatile char buffer[STACK_USE];
+
+    memset((char*) buffer, 1, sizeof(buffer));
+
+    spooLockMutex((SPOOmutex) arg);
+    finished += buffer[STACK_USE - 1];
+    spooUnlockMutex((SPOOmutex) arg);
+}
+
+static void idle_function(void* arg)
+{
+    volatile char buffer[STACK_USE];
+
+    memset((char*) buffer, 1, sizeof(buffer));
+}
+
+static double run(SPOOmutex mutex)
+{
+    int i, j;
+    double time;
+    SPOOthread threads[BATCH];
+
+    finished = 0;
+
+    time = spooGetTime();
+
+    for (i = 0;  i < THREADS;  i += BATCH)
+    {
+        for (j = 0;  j < BATCH;  j++)
+        {
+            threads[j] = spooCreateThread(thread_function, mutex);
+            if (threads[j] == SPOO_INVALID_THREAD)
+                fail("Failed to create thread");
+        }
+
+        for (j = 0;  j < BATCH;  j++)
+            spooWaitThread(threads[j], SPOO_WAIT);
+    }
+
+    time = spooGetTime() - time;
+
+    if (finished != THREADS)
+        fail("Not all threads ran");
+
+    return time * 1e6 / THREADS;
+}
+
+static void check_unwaited(SPOOmutex mutex)
+{
+    int i;
+    SPOOthread threads[BATCH];
+
+    finished = 0;
+
+    // Threads that exit before they are waited for keep their stacks until
+    // they are joined, either by a wait or when the cache needs a stack
+    for (i = 0;  i < BATCH;  i++)
+    {
+        threads[i] = spooCreateThread(thread_function, mutex);
+        if (threads[i] == SPOO_INVALID_THREAD)
+            fail("Failed to create thread");
+    }
+
+    while (finished != BATCH)
+        spooSleep(0.001);
+
+    spooSleep(0.01);
+
+    for (i = 0;  i < BATCH / 2;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    run(mutex);
+
+    for (i = BATCH / 2;  i < BATCH;  i++)
+    {
+        if (!spooWaitThread(threads[i], SPOO_WAIT))
+            fail("Waiting for an exited thread failed");
+    }
+}
+
+int main(void)
+{
+    SPOOmutex mutex;
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    mutex = spooCreateMutex();
+    if (!mutex)
+        fail("Failed to create mutex");
+
+    printf("Default stacks:         %.1f us per thread\n", run(mutex));
+
+    if (!spooSetThreadStackCache(STACK_SIZE, BATCH, 0))
+    {
+        printf("Thread stack cache is not available\n");
+        spooTerminate();
+        exit(EXIT_SUCCESS);
+    }
+
+    check_unwaited(mutex);
+
+    printf("Cached stacks:          %.1f us per thread\n", run(mutex));
+
+    spooSetThreadStackCache(STACK_SIZE, BATCH, SPOO_STACK_PREFAULT);
+    printf("Prefaulted stacks:      %.1f us per thread\n", run(mutex));
+
+    spooSetThreadStackCache(STACK_SIZE, BATCH, SPOO_STACK_PREFAULT | SPOO_STACK_HUGE_PAGES);
+    printf("Huge page stacks:       %.1f us per thread\n", run(mutex));
+
+    // Leave a thread with a cached stack for the library to join
+    spooCreateThread(idle_function, NULL);
+
+    spooSetThreadStackCache(0, 0, 0);
+    printf("Default stacks again:   %.1f us per thread\n", run(mutex));
+
+    spooDestroyMutex(mutex);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
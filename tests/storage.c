@@ -0,0 +1,275 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It checks by-value mutexes and condition variables, including statically
+// initialized ones used before spooInit, and compares locking objects with
+// an embedded mutex to locking objects with a separately allocated one
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define OBJECTS (1 << 18)
+#define OPERATIONS 2000000
+#define MAX_THREADS 64
+
+typedef struct
+{
+    SPOOmutex mutex;
+    long value;
+} PointerObject;
+
+typedef struct
+{
+    SPOOmutexstorage mutex;
+    long value;
+} EmbeddedObject;
+
+typedef struct
+{
+    int index;
+    PointerObject* pointerObjects;
+    EmbeddedObject* embeddedObjects;
+} Worker;
+
+static SPOOmutexstorage staticMutex = SPOO_MUTEX_STORAGE_INITIALIZER;
+static SPOOcondstorage staticCond = SPOO_COND_STORAGE_INITIALIZER;
+static volatile int signaled = 0;
+
+static void fail(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(EXIT_FAILURE);
+}
+
+static unsigned int next_random(unsigned int* state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state >> 8;
+}
+
+static void wait_function(void* arg)
+{
+    spooLockMutexStorage(&staticMutex);
+
+    while (!signaled)
+        spooWaitCondStorage(&staticCond, &staticMutex, 1.0);
+
+    signaled = 2;
+    spooUnlockMutexStorage(&staticMutex);
+}
+
+static void check_cond(void)
+{
+    SPOOthread thread;
+
+    thread = spooCreateThread(wait_function, NULL);
+    if (!thread)
+        fail("Failed to create thread");
+
+    spooSleep(0.05);
+
+    spooLockMutexStorage(&staticMutex);
+    signaled = 1;
+    spooSignalCondStorage(&staticCond);
+    spooUnlockMutexStorage(&staticMutex);
+
+    spooWaitThread(thread, SPOO_WAIT);
+
+    if (signaled != 2)
+        fail("Condition wait did not complete");
+}
+
+static void pointer_function(void* arg)
+{
+    int i;
+    PointerObject* object;
+    Worker* worker = (Worker*) arg;
+    unsigned int state = worker->index + 1;
+
+    for (i = 0;  i < OPERATIONS;  i++)
+    {
+        object = worker->pointerObjects + next_random(&state) % OBJECTS;
+
+        spooLockMutex(object->mutex);
+        object->value++;
+        spooUnlockMutex(object->mutex);
+    }
+}
+
+static void embedded_function(void* arg)
+{
+    int i;
+    EmbeddedObject* object;
+    Worker* worker = (Worker*) arg;
+    unsigned int state = worker->index + 1;
+
+    for (i = 0;  i < OPERATIONS;  i++)
+    {
+        object = worker->embeddedObjects + next_random(&state) % OBJECTS;
+
+        spooLockMutexStorage(&object->mutex);
+        object->value++;
+        spooUnlockMutexStorage(&object->mutex);
+    }
+}
+
+static double run(SPOOthreadfun function, Worker* workers, int threadCount)
+{
+    int i;
+    double time;
+    SPOOthread threads[MAX_THREADS];
+
+    time = spooGetTime();
+
+    for (i = 0;  i < threadCount;  i++)
+    {
+        threads[i] = spooCreateThread(function, workers + i);
+        if (!threads[i])
+            fail("Failed to create thread");
+    }
+
+    for (i = 0;  i < threadCount;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    time = spooGetTime() - time;
+    return time * 1e9 / ((double) threadCount * OPERATIONS);
+}
+
+int main(void)
+{
+    int i, j, temp, threadCount, maxThreads;
+    unsigned int state = 1;
+    long long pointerTotal = 0, embeddedTotal = 0;
+    double pointer, embedded, time;
+    int* order;
+    PointerObject* pointerObjects;
+    EmbeddedObject* embeddedObjects;
+    Worker workers[MAX_THREADS];
+
+    // Statically initialized storage works before the library is
+    spooLockMutexStorage(&staticMutex);
+    spooSignalCondStorage(&staticCond);
+    spooUnlockMutexStorage(&staticMutex);
+
+    if (!spooInit())
+        fail("Failed to initialize Spoo");
+
+    check_cond();
+
+    pointerObjects = (PointerObject*) calloc(OBJECTS, sizeof(PointerObject));
+    embeddedObjects = (EmbeddedObject*) calloc(OBJECTS, sizeof(EmbeddedObject));
+    order = (int*) malloc(OBJECTS * sizeof(int));
+    if (!pointerObjects || !embeddedObjects || !order)
+        fail("Out of memory");
+
+    // Create the separate mutexes in random order, as they would be by a
+    // long-running program, so they are not laid out like their objects
+    for (i = 0;  i < OBJECTS;  i++)
+        order[i] = i;
+
+    for (i = OBJECTS - 1;  i > 0;  i--)
+    {
+        j = next_random(&state) % (i + 1);
+        temp = order[i];
+        order[i] = order[j];
+        order[j] = temp;
+    }
+
+    time = spooGetTime();
+
+    for (i = 0;  i < OBJECTS;  i++)
+    {
+        pointerObjects[order[i]].mutex = spooCreateMutex();
+        if (!pointerObjects[order[i]].mutex)
+            fail("Failed to create mutex");
+    }
+
+    pointer = (spooGetTime() - time) * 1e9 / OBJECTS;
+
+    time = spooGetTime();
+
+    for (i = 0;  i < OBJECTS;  i++)
+        spooInitMutexStorage(&embeddedObjects[i].mutex);
+
+    embedded = (spooGetTime() - time) * 1e9 / OBJECTS;
+
+    printf("Creation: separate %.1f ns, embedded %.1f ns per mutex\n",
+           pointer, embedded);
+
+    for (i = 0;  i < MAX_THREADS;  i++)
+    {
+        workers[i].index = i;
+        workers[i].pointerObjects = pointerObjects;
+        workers[i].embeddedObjects = embeddedObjects;
+    }
+
+    maxThreads = spooGetCPUCoreCount();
+    if (maxThreads < 4)
+        maxThreads = 4;
+    if (maxThreads > MAX_THREADS)
+        maxThreads = MAX_THREADS;
+
+    for (threadCount = 1;  ;  threadCount *= 2)
+    {
+        if (threadCount > maxThreads)
+            threadCount = maxThreads;
+
+        pointer = run(pointer_function, workers, threadCount);
+        embedded = run(embedded_function, workers, threadCount);
+
+        printf("%2i threads: separate %.1f ns, embedded %.1f ns per locked update\n",
+               threadCount, pointer, embedded);
+
+        if (threadCount == maxThreads)
+            break;
+    }
+
+    for (i = 0;  i < OBJECTS;  i++)
+    {
+        pointerTotal += pointerObjects[i].value;
+        embeddedTotal += embeddedObjects[i].value;
+
+        spooDestroyMutex(pointerObjects[i].mutex);
+        spooDeinitMutexStorage(&embeddedObjects[i].mutex);
+    }
+
+    if (pointerTotal != embeddedTotal)
+        fail("Locked updates were lost");
+
+    free(pointerObjects);
+    free(embeddedObjects);
+    free(order);
+
+    spooDeinitCondStorage(&staticCond);
+    spooDeinitMutexStorage(&staticMutex);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}
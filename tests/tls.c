@@ -0,0 +1,151 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It compares thread-local storage to per-thread state in an array indexed
+// by thread ID, and checks that the TLS destructors are called
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define THREAD_COUNT 4
+#define ITERATIONS 1000000
+
+typedef struct
+{
+    volatile long count;
+} State;
+
+static State states[THREAD_COUNT + 1];
+static SPOOtlskey key;
+static SPOOmutex mutex;
+static int destroyed = 0;
+
+static void destroy_state(void* value)
+{
+    spooLockMutex(mutex);
+    destroyed++;
+    spooUnlockMutex(mutex);
+
+    free(value);
+}
+
+static void array_function(void* arg)
+{
+    int i;
+
+    for (i = 0;  i < ITERATIONS;  i++)
+        states[spooGetThreadID() % (THREAD_COUNT + 1)].count++;
+}
+
+static void tls_function(void* arg)
+{
+    int i;
+
+    spooSetTLS(key, calloc(1, sizeof(State)));
+
+    for (i = 0;  i < ITERATIONS;  i++)
+        ((State*) spooGetTLS(key))->count++;
+}
+
+static double run(SPOOthreadfun function)
+{
+    int i;
+    double time;
+    SPOOthread threads[THREAD_COUNT];
+
+    time = spooGetTime();
+
+    for (i = 0;  i < THREAD_COUNT;  i++)
+        threads[i] = spooCreateThread(function, NULL);
+
+    for (i = 0;  i < THREAD_COUNT;  i++)
+        spooWaitThread(threads[i], SPOO_WAIT);
+
+    return spooGetTime() - time;
+}
+
+int main(void)
+{
+    double time;
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mutex = spooCreateMutex();
+
+    key = spooCreateTLSKey(destroy_state);
+    if (key == SPOO_INVALID_TLS_KEY)
+    {
+        fprintf(stderr, "Failed to create TLS key\n");
+        exit(EXIT_FAILURE);
+    }
+
+    time = run(array_function);
+    printf("Array indexed by thread ID: %.2f ns per access\n",
+           time * 1e9 / (THREAD_COUNT * (double) ITERATIONS));
+
+    time = run(tls_function);
+    printf("Thread-local storage: %.2f ns per access\n",
+           time * 1e9 / (THREAD_COUNT * (double) ITERATIONS));
+
+    printf("%i of %i TLS destructors called\n", destroyed, THREAD_COUNT);
+
+    // A value left by this thread must not show through a key created after
+    // the library has been initialized again
+    spooSetTLS(key, &key);
+    spooDestroyTLSKey(key);
+    spooDestroyMutex(mutex);
+
+    spooTerminate();
+
+    if (destroyed != THREAD_COUNT)
+        exit(EXIT_FAILURE);
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo again\n");
+        exit(EXIT_FAILURE);
+    }
+
+    key = spooCreateTLSKey(NULL);
+    if (spooGetTLS(key))
+    {
+        fprintf(stderr, "New TLS key returned a stale value\n");
+        exit(EXIT_FAILURE);
+    }
+
+    spooDestroyTLSKey(key);
+    spooTerminate();
+
+    exit(EXIT_SUCCESS);
+}
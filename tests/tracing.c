@@ -0,0 +1,212 @@
+//========================================================================
+// This software is based on parts of the GLFW 2.7 library
+//
+// Copyright (c) 2002-2006 Marcus Geelnard
+// Copyright (c) 2006-2011 Camilla Berglund <elmindreda@elmindreda.org>
+//
+// This software is provided 'as-is', without any express or implied
+// warranty. In no event will the authors be held liable for any damages
+// arising from the use of this software.
+//
+// Permission is granted to anyone to use this software for any purpose,
+// including commercial applications, and to alter it and redistribute it
+// freely, subject to the following restrictions:
+//
+// 1. The origin of this software must not be misrepresented; you must not
+//    claim that you wrote the original software. If you use this software
+//    in a product, an acknowledgment in the product documentation would
+//    be appreciated but is not required.
+//
+// 2. Altered source versions must be plainly marked as such, and must not
+//    be misrepresented as being the original software.
+//
+// 3. This notice may not be removed or altered from any source
+//    distribution.
+//
+//========================================================================
+// This is a small test application for Spoo
+// It measures the overhead of tracing, writes a Chrome trace file and
+// checks that threads exiting hand their trace buffers on.  The trace file
+// is only kept if its name is specified.
+//========================================================================
+
+#include <spoo/spoo.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOCK_ITERATIONS 1000000
+#define YIELD_ITERATIONS 100000
+#define PING_ITERATIONS 10000
+#define THREAD_COUNT 100
+
+static SPOOmutex mutex;
+static SPOOcond cond;
+static volatile int turn;
+
+static void pong_function(void* arg)
+{
+    int i;
+
+    spooLockMutex(mutex);
+
+    for (i = 0;  i < PING_ITERATIONS;  i++)
+    {
+        while (turn != 1)
+            spooWaitCond(cond, mutex, SPOO_INFINITY);
+
+        turn = 0;
+        spooSignalCond(cond);
+    }
+
+    spooUnlockMutex(mutex);
+}
+
+static void idle_function(void* arg)
+{
+}
+
+static double lock_unlock(void)
+{
+    int i;
+    double time = spooGetTime();
+
+    for (i = 0;  i < LOCK_ITERATIONS;  i++)
+    {
+        spooLockMutex(mutex);
+        spooUnlockMutex(mutex);
+    }
+
+    return (spooGetTime() - time) * 1e9 / LOCK_ITERATIONS;
+}
+
+static double yield(void)
+{
+    int i;
+    double time = spooGetTime();
+
+    for (i = 0;  i < YIELD_ITERATIONS;  i++)
+        spooSleep(0.0);
+
+    return (spooGetTime() - time) * 1e9 / YIELD_ITERATIONS;
+}
+
+static double ping_pong(void)
+{
+    int i;
+    SPOOthread thread;
+    double time = spooGetTime();
+
+    turn = 0;
+    thread = spooCreateThread(pong_function, NULL);
+
+    spooLockMutex(mutex);
+
+    for (i = 0;  i < PING_ITERATIONS;  i++)
+    {
+        turn = 1;
+        spooSignalCond(cond);
+
+        while (turn != 0)
+            spooWaitCond(cond, mutex, SPOO_INFINITY);
+    }
+
+    spooUnlockMutex(mutex);
+    spooWaitThread(thread, SPOO_WAIT);
+
+    return (spooGetTime() - time) * 1e9 / PING_ITERATIONS;
+}
+
+static void run_threads(void)
+{
+    int i;
+
+    for (i = 0;  i < THREAD_COUNT;  i++)
+        spooWaitThread(spooCreateThread(idle_function, NULL), SPOO_WAIT);
+}
+
+static int count_trace_threads(const char* filename)
+{
+    int count = 0;
+    char line[1024];
+    FILE* file;
+
+    file = fopen(filename, "r");
+    if (!file)
+        return -1;
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (strstr(line, "\"thread_name\""))
+            count++;
+    }
+
+    fclose(file);
+    return count;
+}
+
+int main(int argc, char** argv)
+{
+    int threads;
+    const char* filename = "spoo-trace.json";
+    double disabled[3], enabled[3];
+
+    if (argc > 1)
+        filename = argv[1];
+
+    if (!spooInit())
+    {
+        fprintf(stderr, "Failed to initialize Spoo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    mutex = spooCreateMutex();
+    cond = spooCreateCond();
+
+    disabled[0] = lock_unlock();
+    disabled[1] = yield();
+    disabled[2] = ping_pong();
+
+    spooStartTrace(0);
+
+    enabled[0] = lock_unlock();
+    enabled[1] = yield();
+    enabled[2] = ping_pong();
+
+    // Threads that have exited leave their buffers to the next ones
+    run_threads();
+
+    spooStopTrace();
+
+    printf("%-24s %12s %12s\n", "operation", "disabled", "enabled");
+    printf("%-24s %9.1f ns %9.1f ns\n", "lock/unlock", disabled[0], enabled[0]);
+    printf("%-24s %9.1f ns %9.1f ns\n", "spooSleep(0)", disabled[1], enabled[1]);
+    printf("%-24s %9.1f ns %9.1f ns\n", "cond ping-pong", disabled[2], enabled[2]);
+
+    if (!spooWriteTrace(filename))
+    {
+        fprintf(stderr, "Failed to write trace to %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    // One buffer for this thread and one shared by all the others
+    threads = count_trace_threads(filename);
+
+    if (argc > 1)
+        printf("Trace written to %s\n", filename);
+    else
+        remove(filename);
+
+    if (threads != 2)
+    {
+        fprintf(stderr, "Trace has %i thread buffers, expected 2\n", threads);
+        exit(EXIT_FAILURE);
+    }
+
+    spooDestroyCond(cond);
+    spooDestroyMutex(mutex);
+
+    spooTerminate();
+    exit(EXIT_SUCCESS);
+}